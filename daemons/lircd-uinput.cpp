@@ -22,13 +22,12 @@
 
 #include <string>
 #include <set>
-#include <unordered_map>
+#include <vector>
 
 #include <linux/input.h>
 #include "lirc/input_map.h"
 
 #include "lirc_private.h"
-#include "line_buffer.h"
 
 
 static const logchannel_t logchannel = LOG_APP;
@@ -73,6 +72,14 @@ static const struct option cli_options[] = {
 /** Used in parse_options(), matches cli_options above. */
 static const char* const optstring = "ad:D::hO:r:R:u:L:v";
 
+/** Size of input buffer, one read() is processed at a time. */
+static const int INPUT_SIZE = 4 * PACKET_SIZE;
+
+/** Max number of events sent in a single write(). */
+static const int MAX_EVENTS = 64;
+
+static const char* const WHITE_SPACE = " \t";
+
 /** Max for --repeat period and delay parts (ms). */
 static const int MAX_INTERVAL = 20000;
 
@@ -106,48 +113,97 @@ struct options {
 };
 
 
-/** Cached code lookups for button names. */
-class CodeCache {
+/**
+ * Interned button names. Each distinct name gets a small integer id
+ * when first seen, together with the results of the keycode and
+ * --disable lookups; later lines are resolved without allocating.
+ */
+class ButtonTable {
 
-	private:
-		struct Entry {
+	public:
+		struct Button {
+			char* name;
+			unsigned int hash;
 			linux_input_code code;
 			bool is_release;  /**< Button is a release event. */
+			bool disabled;    /**< Listed in --disable file. */
+			int release_id;   /**< Id of name + suffix, or -1. */
 		};
 
-		typedef std::unordered_map<std::string, struct Entry> code_map;
-		code_map cache;
+	private:
+		std::vector<Button> buttons;
+		std::vector<int> slots;   /**< Open addressing, -1 if free. */
 
-	public:
-		void add(const char* button, linux_input_code c, bool release)
+		static unsigned int hash(const char* s, size_t len)
 		{
-			Entry* entry = new Entry();
-			entry->code = c;
-			entry->is_release = release;
-			cache[button] = *entry;
+			unsigned int h = 2166136261u;
+
+			while (len-- > 0)
+				h = (h ^ static_cast<unsigned char>(*s++))
+				    * 16777619u;
+			return h;
 		};
 
-		bool lookup(const std::string button_name,
-			    linux_input_code* code,
-			    bool* is_release)
+		void grow()
 		{
-			auto it = cache.find(button_name);
-			if (it == cache.end())
-				return false;
-			*code = it->second.code;
-			*is_release = it->second.is_release;
-			return true;
+			size_t i;
+			size_t mask;
+
+			slots.assign(slots.empty() ? 64 : 2 * slots.size(), -1);
+			mask = slots.size() - 1;
+			for (size_t id = 0; id < buttons.size(); id++) {
+				i = buttons[id].hash & mask;
+				while (slots[i] != -1)
+					i = (i + 1) & mask;
+				slots[i] = static_cast<int>(id);
+			}
 		};
 
-		CodeCache() { cache = code_map(); }
+	public:
+		/** Return id for button name of length len, adding it if new. */
+		int intern(const char* name, size_t len,
+			   const struct options* opts);
+
+		const Button& operator[](int id) const { return buttons[id]; };
+
+		/**
+		 * Return id of the release event name for button id, -1 if
+		 * the name is too long.
+		 */
+		int release_id(int id, const struct options* opts)
+		{
+			char name[PACKET_SIZE + 64];
+			int release;
+			int len;
+
+			if (buttons[id].release_id == -1) {
+				len = snprintf(name, sizeof(name), "%s%s",
+					       buttons[id].name,
+					       opts->release_suffix);
+				if (len < 0 || len >= (int)sizeof(name)) {
+					log_warn("Button name too long for"
+						 " a release event: %.32s...",
+						 buttons[id].name);
+					return -1;
+				}
+				// intern() might reallocate buttons.
+				release = intern(name, len, opts);
+				buttons[id].release_id = release;
+			}
+			return buttons[id].release_id;
+		};
 };
 
 
-/** Cache for keycode lookups. */
-static CodeCache code_cache = CodeCache();
+/** Interned buttons and their keycodes. */
+static ButtonTable button_table;
 
 /** Set by send_message(), used when sending release events. */
-static std::string last_button_press = std::string("");
+static int last_button_press = -1;
+
+/** Events generated from a single read(), see add_event(). */
+static struct input_event events[MAX_EVENTS];
+static int event_count = 0;
 
 
 /** Setup defaults for the CLI options parsing. */
@@ -389,6 +445,47 @@ static linux_input_code get_keycode(const char* button_name,
 }
 
 
+int ButtonTable::intern(const char* name, size_t len,
+			const struct options* opts)
+{
+	const unsigned int h = hash(name, len);
+	Button button;
+	size_t mask;
+	size_t i;
+	int id;
+
+	if (!slots.empty()) {
+		mask = slots.size() - 1;
+		for (i = h & mask; slots[i] != -1; i = (i + 1) & mask) {
+			id = slots[i];
+			if (buttons[id].hash == h
+			    && strncmp(buttons[id].name, name, len) == 0
+			    && buttons[id].name[len] == '\0')
+				return id;
+		}
+	}
+	button.name = strndup(name, len);
+	button.hash = h;
+	button.code = get_keycode(button.name,
+				  opts->release_suffix,
+				  &button.is_release);
+	button.disabled = opts->disabled_path != NULL
+			  && opts->disabled_buttons.count(button.name) == 1;
+	button.release_id = -1;
+	log_trace("Cache miss for %s", button.name);
+	buttons.push_back(button);
+	if (2 * buttons.size() > slots.size()) {
+		grow();
+	} else {
+		mask = slots.size() - 1;
+		for (i = h & mask; slots[i] != -1; i = (i + 1) & mask)
+			;
+		slots[i] = static_cast<int>(buttons.size() - 1);
+	}
+	return static_cast<int>(buttons.size() - 1);
+}
+
+
 /** Send a struct input_event to an uinput fd, return success. */
 static bool write_event(int fd, unsigned type, linux_input_code code, int val)
 {
@@ -402,69 +499,127 @@ static bool write_event(int fd, unsigned type, linux_input_code code, int val)
 }
 
 
-/** Given a button, format and send struct input_events to /dev/uinput. */
-static void send_message(const struct options* opts, const char* button, int reps)
+/** Send all events added by add_event() using a single write(). */
+static void flush_events(int fd)
 {
-	linux_input_code code;
-	bool is_release;
+	const ssize_t size = event_count * sizeof(struct input_event);
 
-	button = button == NULL ? "(null)" : button;
-	if (!code_cache.lookup(button, &code, &is_release)) {
-		log_trace("Cache miss for %s", button);
-		code = get_keycode(button, opts->release_suffix, &is_release);
-		code_cache.add(button, code, is_release);
-	}
-	if (code == KEY_RESERVED) {
-		log_info("Dropping non-standard symbol %s", button);
+	if (event_count == 0)
+		return;
+	if (write(fd, events, size) != size)
+		log_perror_err("Writing events to uinput failed");
+	event_count = 0;
+}
+
+
+/** Queue a struct input_event for flush_events(). */
+static void add_event(int fd, unsigned type, linux_input_code code, int val)
+{
+	struct input_event* event;
+
+	if (event_count == MAX_EVENTS)
+		flush_events(fd);
+	event = &events[event_count++];
+	memset(event, 0, sizeof(*event));
+	event->type = type;
+	event->code = code;
+	event->value = val;
+}
+
+
+/** Given a button id, format and queue struct input_events for uinput. */
+static void send_message(const struct options* opts, int id, int reps)
+{
+	const ButtonTable::Button& button = button_table[id];
+
+	if (button.code == KEY_RESERVED) {
+		log_info("Dropping non-standard symbol %s", button.name);
 		return;
 	}
 	// event.value: 0 => release, 1 => press, 2 => repeat
 	//       reps: -1 => release, 0 => press, > 0 => repeat
 	const int value = reps + 1 > 2 ? 2 : reps + 1;
-	log_debug("Sending %s as %d:%d", button, code, value);
+	log_debug("Sending %s as %d:%d", button.name, button.code, value);
 
-	if (!write_event(opts->uinputfd, EV_KEY, code, value))
-		log_perror_err("Writing regular event to uinput failed");
-	if (!write_event(opts->uinputfd, EV_SYN, SYN_REPORT, 0))
-		log_perror_err("Writing EV_SYN to uinput failed");
+	add_event(opts->uinputfd, EV_KEY, button.code, value);
+	add_event(opts->uinputfd, EV_SYN, SYN_REPORT, 0);
 	// send_release_event() needs to know if an event is required
-	if (opts->add_release_events && !is_release)
-		last_button_press = std::string(button);
+	if (opts->add_release_events && !button.is_release)
+		last_button_press = id;
 	else
-		last_button_press = "";
+		last_button_press = -1;
+}
+
+
+/** Find next whitespace separated token at *pos, return its length. */
+static size_t next_token(char** pos, char** token)
+{
+	size_t len;
+
+	*token = *pos + strspn(*pos, WHITE_SPACE);
+	len = strcspn(*token, WHITE_SPACE);
+	*pos = *token + len;
+	return len;
 }
 
 
 /** Process a single line of input from the socket (or test file). */
-static void process_line(const struct options* opts, std::string line)
+static void process_line(const struct options* opts, char* line)
 {
-	int r;
-	char button[PACKET_SIZE + 1];
-	char remote[PACKET_SIZE + 1];
+	char* pos = line;
+	char* token;
+	char* end;
+	char* button;
+	size_t button_len;
 	int reps;
 
-	r = sscanf(line.c_str(), "%*x %x %s %s\n", &reps, button, remote);
-	if (r != 3) {
-		log_warn("Cannot parse line: %s", line.c_str());
-		return;
+	// Parsing: code reps button remote
+	if (next_token(&pos, &token) == 0 || !isxdigit(*token))
+		goto bad_line;
+	if (next_token(&pos, &token) == 0)
+		goto bad_line;
+	reps = static_cast<int>(strtoul(token, &end, 16));
+	if (end == token)
+		goto bad_line;
+	button_len = next_token(&pos, &button);
+	if (button_len == 0 || next_token(&pos, &token) == 0)
+		goto bad_line;
+
+	{
+		const int id = button_table.intern(button, button_len, opts);
+
+		if (button_table[id].disabled)
+			log_debug("Skipping disabled key %s",
+				  button_table[id].name)
+		else
+			send_message(opts, id, reps);
 	}
-	if (opts->disabled_path && opts->disabled_buttons.count(button) == 1)
-		log_debug("Skipping disabled key %s", button)
-	else
-		send_message(opts, button, reps);
+	return;
+
+bad_line:
+	log_warn("Cannot parse line: %s", line);
 }
 
 
-/** Process all available lines in line_buffer. */
-static void process_lines(const struct options* opts, LineBuffer* line_buffer)
+/**
+ * Process all complete lines in buffer, return number of bytes used.
+ * The events are sent using a single write().
+ */
+static size_t process_lines(const struct options* opts,
+			    char* buffer,
+			    size_t size)
 {
-	std::string line;
+	char* line = buffer;
+	char* end;
 
-	while (line_buffer->has_lines()) {
-		line = line_buffer->get_next_line();
-		log_trace("Input: %s", line.c_str());
+	while ((end = (char*)memchr(line, '\n', buffer + size - line))) {
+		*end = '\0';
+		log_trace("Input: %s", line);
 		process_line(opts, line);
+		line = end + 1;
 	}
+	flush_events(opts->uinputfd);
+	return line - buffer;
 }
 
 
@@ -474,13 +629,18 @@ static void process_lines(const struct options* opts, LineBuffer* line_buffer)
  */
 static void send_release_event(const struct options* opts)
 {
+	int id;
+
 	if (!opts->add_release_events)
 		return;
-	if (last_button_press == "")
+	if (last_button_press == -1)
 		return;
-	std::string button_name = last_button_press + opts->release_suffix;
-	send_message(opts, button_name.c_str(), -1);
-	last_button_press = "";
+	id = button_table.release_id(last_button_press, opts);
+	if (id != -1) {
+		send_message(opts, id, -1);
+		flush_events(opts->uinputfd);
+	}
+	last_button_press = -1;
 }
 
 
@@ -488,8 +648,9 @@ static void send_release_event(const struct options* opts)
 static void lircd_uinput(const struct options* opts)
 {
 	int r;
-        char buffer[PACKET_SIZE + 1];
-	LineBuffer line_buffer;
+	static char buffer[INPUT_SIZE + 1];
+	size_t size = 0;
+	size_t used;
 	struct pollfd fds;
 	int timeout = opts->add_release_events ? opts->release_timeout : -1;
 
@@ -506,10 +667,16 @@ static void lircd_uinput(const struct options* opts)
 			log_notice("POLLERR or curl_poll() error, exiting.");
 			exit(EXIT_FAILURE);
 		}
-		r = read(opts->inputfd, buffer, PACKET_SIZE);
+		r = read(opts->inputfd, buffer + size, INPUT_SIZE - size);
 		if (r > 0) {
-			line_buffer.append(buffer, static_cast<size_t>(r));
-			process_lines(opts, &line_buffer);
+			size += r;
+			used = process_lines(opts, buffer, size);
+			size -= used;
+			if (size == static_cast<size_t>(INPUT_SIZE)) {
+				log_warn("Dropping too long input line");
+				size = 0;
+			}
+			memmove(buffer, buffer + used, size);
 		} else if (r == -1) {
 			log_perror_warn("lircd_uinput(): read() error");
 		} else  {
@@ -118,6 +118,66 @@ static const int WRITE_SLEEP_US = 20000;
 /** How many times we retry busy write sockets. */
 static const int WRITE_RETRIES = 50;
 
+/** How much earlier the repeat timer fires than the next frame, us. */
+static const int REPEAT_TIMER_MARGIN = 500;
+
+/** Max --tx-busy-wait, us. Longer waits only burn CPU. */
+static const int MAX_TX_BUSY_WAIT = 100000;
+
+/** Max number of steps in a SEND_SEQUENCE command. */
+static const int MAX_SEQUENCE_STEPS = 32;
+
+/**
+ * Max duration of a SEND_SEQUENCE command including all frames, gaps
+ * and delays, microseconds. lircd serves nothing else meanwhile.
+ */
+static const long long MAX_SEQUENCE_TIME = 2000000;
+
+/** Max extra delay after a SEND_SEQUENCE step, microseconds. */
+static const unsigned long MAX_SEQUENCE_DELAY = 1000000;
+
+/** A parsed SEND_SEQUENCE step. */
+struct send_step {
+	struct ir_remote*	remote;
+	struct ir_ncode*	code;
+	int			reps;   /**< -1 if not given. */
+	unsigned long		delay;  /**< Extra pause after step, us. */
+};
+
+/** Max number of queued SEND_TX commands. */
+static const int MAX_TX_JOBS = 256;
+
+/** Max number of transmitter sets with a SEND_TX queue. */
+#define MAX_TX_QUEUES 32
+
+/** A queued SEND_TX command. */
+struct tx_job {
+	struct tx_job*		next;
+	int			fd;      /**< Client to reply to, -1 if gone. */
+	char*			message;
+	struct ir_remote*	remote;
+	struct ir_ncode*	code;
+	int			reps;    /**< -1 if not given. */
+	int			started;
+	/* Repeat state of remote and code, saved between frames. */
+	int			countdown;
+	int			toggle_mask_state;
+	struct ir_code_node*	transmit_state;
+};
+
+/** SEND_TX commands for a transmitter set, with throughput counters. */
+struct tx_queue {
+	uint32_t		mask;
+	struct tx_job*		first;
+	struct tx_job*		last;
+	struct timespec		active;   /**< When queue became non-empty. */
+	unsigned long		commands;
+	unsigned long		errors;
+	unsigned long		frames;
+	unsigned long long	airtime;  /**< Sum of sent signals, us. */
+	unsigned long long	busy;     /**< Time with queued commands, us. */
+};
+
 struct peer_connection {
 	char*		host;
 	unsigned short	port;
@@ -146,10 +206,14 @@ static const char* const help =
 	"\t -D[level] --loglevel[=level]\t'info', 'warning', 'notice', etc., or 3..10.\n"
 	"\t -a --allow-simulate\t\tAccept SIMULATE command\n"
 	"\t -Y --dynamic-codes\t\tEnable dynamic code generation\n"
+	"\t -Z --lazy-codes\t\tParse remote codes on first use\n"
 	"\t -A --driver-options=key:value[|key:value...]\n"
 	"\t\t\t\t\tSet driver options\n"
 	"\t -e --effective-user=uid\tRun as uid after init as root\n"
-	"\t -R --repeat-max=limit\t\tAllow at most this many repeats\n";
+	"\t -R --repeat-max=limit\t\tAllow at most this many repeats\n"
+	"\t -B --tx-busy-wait=us\t\tSpin this long before sending a frame\n"
+	"\t -T --tx-realtime\t\tSend with SCHED_FIFO priority\n"
+	"\t -Q --reader-queue=items\tRead the device in a separate thread\n";
 
 
 static const struct option lircd_options[] = {
@@ -171,10 +235,14 @@ static const struct option lircd_options[] = {
 	{ "loglevel",	    optional_argument, NULL, 'D' },
 	{ "allow-simulate", no_argument,       NULL, 'a' },
 	{ "dynamic-codes",  no_argument,       NULL, 'Y' },
+	{ "lazy-codes",	    no_argument,       NULL, 'Z' },
 	{ "driver-options", required_argument, NULL, 'A' },
 	{ "effective-user", required_argument, NULL, 'e' },
 	{ "uinput",         no_argument,       NULL, 'u' },
 	{ "repeat-max",	    required_argument, NULL, 'R' },
+	{ "tx-busy-wait",   required_argument, NULL, 'B' },
+	{ "tx-realtime",    no_argument,       NULL, 'T' },
+	{ "reader-queue",   required_argument, NULL, 'Q' },
 	{ 0,		    0,		       0,    0	 }
 };
 
@@ -189,8 +257,15 @@ static int send_once(int fd, char* message, char* arguments);
 static int drv_option(int fd, char* message, char* arguments);
 static int send_start(int fd, char* message, char* arguments);
 static int send_stop(int fd, char* message, char* arguments);
+static int send_sequence(int fd, char* message, char* arguments);
+static int send_tx(int fd, char* message, char* arguments);
+static int tx_stats(int fd, char* message, char* arguments);
+static int rec_stats(int fd, char* message, char* arguments);
 static int send_core(int fd, char* message, char* arguments, int once);
 static int version(int fd, char* message, char* arguments);
+static void forget_tx_client(int fd);
+static void tx_deadline(uint32_t mask, struct timespec* deadline);
+static void tx_set_deadline(uint32_t mask, const struct timespec* deadline);
 
 struct protocol_directive {
 	const char* name;
@@ -216,7 +291,19 @@ static struct ir_remote* free_remotes = NULL;
 
 static int repeat_fd = -1;
 static char* repeat_message = NULL;
+
+/**
+ * Commands read from repeat_fd after the command whose reply waits for
+ * the repeats. They are handled when the repeats are done.
+ */
+static struct {
+	int	fd;
+	int	length;
+	char	buffer[PACKET_SIZE + 1];
+} held_commands = { -1, 0, "" };
 static uint32_t repeat_max = REPEAT_MAX_DEFAULT;
+static unsigned int tx_busy_wait = 0;
+static unsigned int reader_queue = 0;
 
 static const char* configfile = NULL;
 static FILE* pidf;
@@ -228,6 +315,10 @@ static const struct protocol_directive directives[] = {
 	{ "SEND_ONCE",	      send_once	       },
 	{ "SEND_START",	      send_start       },
 	{ "SEND_STOP",	      send_stop	       },
+	{ "SEND_SEQUENCE",    send_sequence    },
+	{ "SEND_TX",	      send_tx	       },
+	{ "TX_STATS",	      tx_stats	       },
+	{ "REC_STATS",	      rec_stats	       },
 	{ "SET_INPUTLOG",     set_inputlog     },
 	{ "DRV_OPTION",	      drv_option       },
 	{ "VERSION",	      version	       },
@@ -289,6 +380,13 @@ static int allow_simulate = 0;
 static sig_atomic_t term = 0, hup = 0, alrm = 0;
 static int termsig;
 
+static struct tx_queue tx_queues[MAX_TX_QUEUES];
+static int tx_queue_count = 0;
+static int tx_job_count = 0;
+static uint32_t tx_mask = 0;          /**< From SET_TRANSMITTERS, 0: all. */
+static uint32_t tx_mask_current = 0;  /**< Mask last set in driver. */
+static int send_batch = 0;            /**< Driver queues SEND_SEQUENCE. */
+
 static uint32_t setup_min_freq = 0, setup_max_freq = 0;
 static lirc_t setup_max_gap = 0;
 static lirc_t setup_min_pulse = 0, setup_min_space = 0;
@@ -297,12 +395,15 @@ static lirc_t setup_max_pulse = 0, setup_max_space = 0;
 /* Use already opened hardware? */
 int use_hw(void)
 {
-	return clin > 0 || repeat_remote != NULL;
+	return clin > 0 || repeat_remote != NULL || tx_job_count > 0;
 }
 
 /* set_transmitters only supports 32 bit int */
 #define MAX_TX (CHAR_BIT * sizeof(uint32_t))
 
+/** Earliest time for the next frame on each transmitter. */
+static struct timespec tx_next[MAX_TX];
+
 int max(int a, int b)
 {
 	return a > b ? a : b;
@@ -328,9 +429,20 @@ static int oatoi(const char* s)
 	return i;
 }
 
+/**
+ * Reply to the command being processed, sent using a single write()
+ * instead of one per protocol line. This keeps pipelining clients from
+ * filling their socket buffers with tiny writes.
+ */
+static struct {
+	int	fd;     /**< Client being replied to, or -1. */
+	int	len;
+	char	buf[4 * PACKET_SIZE];
+} reply_buf = { -1, 0, { 0 } };
+
 /* A safer write(), since sockets might not write all but only some of the
  * bytes requested */
-int write_socket(int fd, const char* buf, int len)
+static int write_socket_raw(int fd, const char* buf, int len)
 {
 	int done, todo = len;
 	int retries = WRITE_RETRIES;
@@ -355,6 +467,32 @@ int write_socket(int fd, const char* buf, int len)
 	return len;
 }
 
+/** Write buffered reply, return 0 on errors, else 1. */
+static int flush_reply(void)
+{
+	int len = reply_buf.len;
+
+	reply_buf.len = 0;
+	if (len == 0)
+		return 1;
+	return write_socket_raw(reply_buf.fd, reply_buf.buf, len) == len;
+}
+
+int write_socket(int fd, const char* buf, int len)
+{
+	if (fd != reply_buf.fd)
+		return write_socket_raw(fd, buf, len);
+	if (reply_buf.len + len > (int)sizeof(reply_buf.buf)) {
+		if (!flush_reply())
+			return -1;
+		if (len > (int)sizeof(reply_buf.buf))
+			return write_socket_raw(fd, buf, len);
+	}
+	memcpy(reply_buf.buf + reply_buf.len, buf, len);
+	reply_buf.len += len;
+	return len;
+}
+
 int write_socket_len(int fd, const char* buf)
 {
 	int len;
@@ -493,9 +631,36 @@ static int setup_hardware(void)
 				ret = setup_frequency() && setup_timeout();
 		}
 	}
+	if (reader_queue > 0 && curr_driver->fd != -1
+	    && curr_driver->rec_mode != 0) {
+		if (curr_driver->features & LIRC_CAN_USE_READER_THREAD) {
+			rec_reader_start(reader_queue);
+		} else {
+			log_warn("Driver %s cannot use --reader-queue, ignored",
+				 curr_driver->name);
+			reader_queue = 0;
+		}
+	}
 	return ret;
 }
 
+
+/** Stop the reader thread, if any, and deinit the driver. */
+static int deinit_hardware(void)
+{
+	rec_reader_stop();
+	return curr_driver->deinit_func();
+}
+
+
+/** The fd to poll for received data. */
+static int get_rec_fd(void)
+{
+	int fd = rec_reader_fd();
+
+	return fd != -1 ? fd : curr_driver->fd;
+}
+
 static void check_config_duplicates(const struct ir_remote* head)
 {
 	std::set<std::string> names;
@@ -578,10 +743,13 @@ void remove_client(int fd)
 			shutdown(clis[i], 2);
 			close(clis[i]);
 			log_info("removed client");
+			forget_tx_client(clis[i]);
+			if (held_commands.fd == clis[i])
+				held_commands.fd = -1;
 
 			clin--;
 			if (!use_hw() && curr_driver->deinit_func)
-				curr_driver->deinit_func();
+				deinit_hardware();
 			for (; i < clin; i++)
 				clis[i] = clis[i + 1];
 			return;
@@ -626,10 +794,11 @@ void dosigterm(int sig)
 	}
 	fclose(pidf);
 	(void)unlink(pidfile);
+	rec_reader_stop();
 	if (curr_driver->close_func)
 		curr_driver->close_func();
 	if (use_hw() && curr_driver->deinit_func)
-		curr_driver->deinit_func();
+		deinit_hardware();
 	if (curr_driver->close_func)
 		curr_driver->close_func();
 	lirc_log_close();
@@ -993,6 +1162,7 @@ void start_server(mode_t permission, int nodaemon, loglevel_t loglevel)
 	if (ftruncate(fileno(pidf), ftell(pidf)) != 0)
 		log_perror_warn("lircd: ftruncate()");
 	ir_remote_init(options_getboolean("lircd:dynamic-codes"));
+	read_config_lazy(options_getboolean("lircd:lazy-codes"));
 
 	/* create socket */
 	sockfd = -1;
@@ -1183,22 +1353,26 @@ void sigalrm(int sig)
 }
 
 
-static void schedule_repeat_timer (struct timespec* last)
+/**
+ * Arm the timer for the next repeat at repeat_remote->next_send, less
+ * the busy wait and REPEAT_TIMER_MARGIN for getting from the signal to
+ * dosigalrm(). send_ir_ncode() waits for the remaining time.
+ */
+static void schedule_repeat_timer(void)
 {
-	unsigned long secs;
-	lirc_t usecs, gap, diff;
+	long long diff;
+	lirc_t usecs;
 	struct timespec current;
 	struct itimerval repeat_timer;
-	gap = send_buffer_sum() + repeat_remote->min_remaining_gap;
-	clock_gettime (CLOCK_MONOTONIC, &current);
-	secs = current.tv_sec - last->tv_sec;
-	diff = 1000000 * secs + (current.tv_nsec - last->tv_nsec) / 1000;
-	usecs = (diff < gap ? gap - diff : 0);
-	if (usecs < 10)
-		usecs = 10;
+
+	clock_gettime(CLOCK_MONOTONIC, &current);
+	diff = (repeat_remote->next_send.tv_sec - current.tv_sec) * 1000000LL
+	       + (repeat_remote->next_send.tv_nsec - current.tv_nsec) / 1000
+	       - tx_busy_wait - REPEAT_TIMER_MARGIN;
+	usecs = diff < 10 ? 10 : diff;
 	log_trace("alarm in %lu usecs", (unsigned long)usecs);
-	repeat_timer.it_value.tv_sec = 0;
-	repeat_timer.it_value.tv_usec = usecs;
+	repeat_timer.it_value.tv_sec = usecs / 1000000;
+	repeat_timer.it_value.tv_usec = usecs % 1000000;
 	repeat_timer.it_interval.tv_sec = 0;
 	repeat_timer.it_interval.tv_usec = 0;
 
@@ -1223,7 +1397,7 @@ void dosigalrm(int sig)
 			repeat_message = NULL;
 		}
 		if (!use_hw() && curr_driver->deinit_func)
-			curr_driver->deinit_func();
+			deinit_hardware();
 		return;
 	}
 	if (repeat_code->next == NULL
@@ -1232,13 +1406,12 @@ void dosigalrm(int sig)
 	) {
 		repeat_remote->repeat_countdown--;
 	}
-	struct timespec before_send;
-	clock_gettime (CLOCK_MONOTONIC, &before_send);
-	if (send_ir_ncode(repeat_remote, repeat_code, 1)
-	    && repeat_remote->repeat_countdown > 0
-	) {
-		schedule_repeat_timer(&before_send);
-		return;
+	if (send_ir_ncode(repeat_remote, repeat_code, 1)) {
+		tx_set_deadline(tx_mask, &repeat_remote->next_send);
+		if (repeat_remote->repeat_countdown > 0) {
+			schedule_repeat_timer();
+			return;
+		}
 	}
 	repeat_remote = NULL;
 	repeat_code = NULL;
@@ -1249,7 +1422,7 @@ void dosigalrm(int sig)
 		repeat_fd = -1;
 	}
 	if (!use_hw() && curr_driver->deinit_func)
-		curr_driver->deinit_func();
+		deinit_hardware();
 }
 
 
@@ -1319,86 +1492,76 @@ arg_check:
 }
 
 
+/*
+ * Write a complete BEGIN ... END reply with the lines in data using a
+ * single write_socket() call. Large lists are otherwise written one
+ * line at a time, one syscall per line.
+ */
+static int send_data_reply(int fd,
+			   const char* message,
+			   int n,
+			   const std::string& data)
+{
+	std::string reply;
+	char buffer[PACKET_SIZE + 1];
+
+	reply.reserve(data.size() + strlen(message) + 64);
+	reply += protocol_string[P_BEGIN];
+	reply += message;
+	reply += protocol_string[P_SUCCESS];
+	if (n > 0) {
+		snprintf(buffer, sizeof(buffer), "%d\n", n);
+		reply += protocol_string[P_DATA];
+		reply += buffer;
+		reply += data;
+	}
+	reply += protocol_string[P_END];
+	return write_socket(fd, reply.c_str(), reply.size())
+	       == static_cast<int>(reply.size());
+}
+
+
 int send_remote_list(int fd, char* message)
 {
 	char buffer[PACKET_SIZE + 1];
+	std::string data;
 	struct ir_remote* all;
 	int n, len;
 
 	n = 0;
-	all = remotes;
-	while (all) {
-		n++;
-		all = all->next;
-	}
-
-	if (!(write_socket_len(fd, protocol_string[P_BEGIN])
-	      && write_socket_len(fd, message)
-	      && write_socket_len(fd, protocol_string[P_SUCCESS]))
-	) {
-		return 0;
-	}
-	if (n == 0)
-		return write_socket_len(fd, protocol_string[P_END]);
-	sprintf(buffer, "%d\n", n);
-	if (!(write_socket_len(fd, protocol_string[P_DATA])
-	      && write_socket_len(fd, buffer))
-	) {
-		return 0;
-	}
-	all = remotes;
-	while (all) {
+	for (all = remotes; all != NULL; all = all->next) {
 		len = snprintf(buffer, PACKET_SIZE + 1, "%s\n", all->name);
 		if (len >= PACKET_SIZE + 1)
 			len = sprintf(buffer, "name_too_long\n");
-		if (write_socket(fd, buffer, len) < len)
-			return 0;
-		all = all->next;
+		data.append(buffer, len);
+		n++;
 	}
-	return write_socket_len(fd, protocol_string[P_END]);
+	return send_data_reply(fd, message, n, data);
 }
 
 int send_remote(int fd, char* message, struct ir_remote* remote)
 {
 	struct ir_ncode* codes;
 	char buffer[PACKET_SIZE + 1];
+	std::string data;
 	int n, len;
 
 	n = 0;
+	if (remote->lazy_codes != NULL)
+		ir_remote_load_codes(remote);
 	codes = remote->codes;
 	if (codes != NULL) {
-		while (codes->name != NULL) {
+		for (; codes->name != NULL; codes++) {
+			len = snprintf(buffer, PACKET_SIZE, "%016llx %s\n",
+				       (unsigned long long)codes->code,
+				       codes->name);
+			if (len >= PACKET_SIZE + 1)
+				len = sprintf(buffer, "code_too_long\n");
+			data.append(buffer, len);
 			n++;
-			codes++;
 		}
 	}
-
-	if (!(write_socket_len(fd, protocol_string[P_BEGIN])
-	      && write_socket_len(fd, message)
-	      && write_socket_len(fd, protocol_string[P_SUCCESS]))
-	) {
-		return 0;
-	}
-	if (n == 0)
-		return write_socket_len(fd, protocol_string[P_END]);
-	sprintf(buffer, "%d\n", n);
-	if (!(write_socket_len(fd, protocol_string[P_DATA])
-	      && write_socket_len(fd, buffer))
-	) {
-		return 0;
-	}
-
-	codes = remote->codes;
-	while (codes->name != NULL) {
-		len = snprintf(buffer, PACKET_SIZE, "%016llx %s\n",
-			       (unsigned long long)codes->code, codes->name);
-		if (len >= PACKET_SIZE + 1)
-			len = sprintf(buffer, "code_too_long\n");
-		if (write_socket(fd, buffer, len) < len)
-			return 0;
-		codes++;
-	}
-	return write_socket_len(fd, protocol_string[P_END]);
+	return send_data_reply(fd, message, n, data);
 }
 
 int send_name(int fd, char* message, struct ir_ncode* code)
@@ -1440,51 +1603,106 @@ static int list(int fd, char* message, char* arguments)
 	return send_name(fd, message, code);
 }
 
-static int set_transmitters(int fd, char* message, char* arguments)
+/**
+ * Return NULL if the driver can select transmitters, else an error
+ * message.
+ */
+static const char* check_transmitters(void)
+{
+	if (curr_driver->send_mode == 0)
+		return "hardware does not support sending\n";
+	if (curr_driver->drvctl_func == NULL
+	    || !(curr_driver->features & LIRC_CAN_SET_TRANSMITTER_MASK))
+		return "hardware does not support multiple transmitters\n";
+	return NULL;
+}
+
+
+/**
+ * Parse transmitter numbers separated by chars in sep into a mask.
+ * Return NULL if OK, else an error message in errbuf.
+ */
+static const char* parse_transmitters(char*		list,
+				      const char*	sep,
+				      uint32_t*		mask,
+				      char*		errbuf,
+				      size_t		size)
 {
-	char* next_arg = NULL;
+	char* saveptr;
+	char* arg;
 	char* end_ptr;
-	uint32_t next_tx_int = 0;
-	uint32_t next_tx_hex = 0;
-	uint32_t channels = 0;
-	int retval = 0;
-	unsigned int i;
+	unsigned long tx;
+
+	*mask = 0;
+	for (arg = strtok_r(list, sep, &saveptr);
+	     arg != NULL;
+	     arg = strtok_r(NULL, sep, &saveptr)) {
+		errno = 0;
+		tx = strtoul(arg, &end_ptr, 10);
+		if (*end_ptr || tx == 0 || (tx == ULONG_MAX && errno == ERANGE))
+			return "invalid argument\n";
+		if (tx > MAX_TX) {
+			snprintf(errbuf, size,
+				 "cannot support more than %d transmitters\n",
+				 (int)MAX_TX);
+			return errbuf;
+		}
+		*mask |= (uint32_t)1 << (tx - 1);
+	}
+	if (*mask == 0)
+		return "no arguments given\n";
+	return NULL;
+}
+
+
+/**
+ * Set the transmitter mask in the driver unless already set, 0 enables
+ * all transmitters. Return the drvctl_func() result: 0 if OK, else < 0
+ * or the number of transmitters if mask is out of range.
+ */
+static int set_tx_mask(uint32_t mask)
+{
+	uint32_t channels = mask != 0 ? mask : ~(uint32_t)0;
+	int r;
+
+	if (mask == tx_mask_current)
+		return 0;
+	r = curr_driver->drvctl_func(LIRC_SET_TRANSMITTER_MASK, &channels);
+	if (r > 0 && r < (int)MAX_TX && mask == 0) {
+		channels = ((uint32_t)1 << r) - 1;
+		r = curr_driver->drvctl_func(LIRC_SET_TRANSMITTER_MASK,
+					     &channels);
+	}
+	if (r == 0)
+		tx_mask_current = mask;
+	return r;
+}
+
+
+/** Restore the SET_TRANSMITTERS mask after SEND_TX used others. */
+static void restore_tx_mask(void)
+{
+	if (set_tx_mask(tx_mask) != 0)
+		log_warn("Cannot restore transmitter mask");
+}
+
+
+static int set_transmitters(int fd, char* message, char* arguments)
+{
+	char errbuf[PACKET_SIZE + 1];
+	const char* err;
+	uint32_t channels;
+	int retval;
 
 	if (arguments == NULL)
-		goto string_error;
-	if (curr_driver->send_mode == 0) {
-		return send_error(fd,
-				  message,
-				  "hardware does not support sending\n");
-	}
-	if (curr_driver->drvctl_func == NULL
-	    || !(curr_driver->features & LIRC_CAN_SET_TRANSMITTER_MASK)
-	) {
-		return send_error(
-			fd,
-			message,
-			"hardware does not support multiple transmitters\n");
-	}
-	next_arg = strtok(arguments, WHITE_SPACE);
-	if (next_arg == NULL)
-		goto string_error;
-	do {
-		next_tx_int = strtoul(next_arg, &end_ptr, 10);
-		if (*end_ptr || next_tx_int == 0
-		    || (next_tx_int == ULONG_MAX && errno == ERANGE)
-		) {
-			return send_error(fd, message, "invalid argument\n");
-		}
-		if (next_tx_int > MAX_TX)
-			return send_error(
-				fd, message,
-				"cannot support more than %d transmitters\n",
-				MAX_TX);
-		next_tx_hex = 1;
-		for (i = 1; i < next_tx_int; i++)
-			next_tx_hex = next_tx_hex << 1;
-		channels |= next_tx_hex;
-	} while ((next_arg = strtok(NULL, WHITE_SPACE)) != NULL);
+		return send_error(fd, message, "no arguments given\n");
+	err = check_transmitters();
+	if (err != NULL)
+		return send_error(fd, message, "%s", err);
+	err = parse_transmitters(arguments, WHITE_SPACE, &channels,
+				 errbuf, sizeof(errbuf));
+	if (err != NULL)
+		return send_error(fd, message, "%s", err);
 
 	retval = curr_driver->drvctl_func(LIRC_SET_TRANSMITTER_MASK,
 					  &channels);
@@ -1497,10 +1715,9 @@ static int set_transmitters(int fd, char* message, char* arguments)
 				  "error - maximum of %d transmitters\n",
 				  retval);
 	}
+	tx_mask = channels;
+	tx_mask_current = channels;
 	return send_success(fd, message);
-
-string_error:
-	return send_error(fd, message, "no arguments given\n");
 }
 
 
@@ -1583,6 +1800,7 @@ static int send_core(int fd, char* message, char* arguments, int once)
 {
 	struct ir_remote* remote;
 	struct ir_ncode* code;
+	struct timespec deadline;
 	unsigned int reps;
 	int err;
 
@@ -1614,10 +1832,12 @@ static int send_core(int fd, char* message, char* arguments, int once)
 			(remote->toggle_bit_mask_state
 				^ remote->toggle_bit_mask);
 	code->transmit_state = NULL;
-	struct timespec before_send;
-	clock_gettime (CLOCK_MONOTONIC, &before_send);
+	restore_tx_mask();
+	tx_deadline(tx_mask, &deadline);
+	send_pacing_wait(&deadline);
 	if (!send_ir_ncode(remote, code, 1))
 		return send_error(fd, message, "transmission failed\n");
+	tx_set_deadline(tx_mask, &remote->next_send);
 	gettimeofday(&remote->last_send, NULL);
 	remote->last_code = code;
 	if (once)
@@ -1642,13 +1862,644 @@ static int send_core(int fd, char* message, char* arguments, int once)
 			repeat_code = NULL;
 			return 0;
 		}
-		schedule_repeat_timer(&before_send);
+		schedule_repeat_timer();
 		return 1;
 	} else {
 		return send_success(fd, message);
 	}
 }
 
+/**
+ * Parse a "remote code [repeats [delay]]" SEND_SEQUENCE step. Return
+ * NULL if OK, else an error message in errbuf.
+ */
+static const char* parse_send_step(char*		arguments,
+				   struct send_step*	step,
+				   char*		errbuf,
+				   size_t		size)
+{
+	char* saveptr;
+	char* name;
+	char* command;
+	char* arg;
+	char* end_ptr;
+	long reps;
+
+	name = strtok_r(arguments, WHITE_SPACE, &saveptr);
+	command = strtok_r(NULL, WHITE_SPACE, &saveptr);
+	if (name == NULL)
+		return "remote missing\n";
+	if (command == NULL)
+		return "code missing\n";
+	step->remote = get_ir_remote(remotes, name);
+	if (step->remote == NULL) {
+		snprintf(errbuf, size, "unknown remote: \"%s\"\n", name);
+		return errbuf;
+	}
+	step->code = get_code_by_name(step->remote, command);
+	if (step->code == NULL) {
+		snprintf(errbuf, size, "unknown command: \"%s\"\n", command);
+		return errbuf;
+	}
+	step->reps = -1;
+	step->delay = 0;
+	arg = strtok_r(NULL, WHITE_SPACE, &saveptr);
+	if (arg != NULL) {
+		reps = strtol(arg, &end_ptr, 10);
+		if (*end_ptr || reps < 0)
+			return "bad send packet (reps/eol)\n";
+		if (reps > (long)repeat_max) {
+			snprintf(errbuf, size,
+				 "too many repeats: \"%ld\" > \"%u\"\n",
+				 reps, repeat_max);
+			return errbuf;
+		}
+		step->reps = reps;
+		arg = strtok_r(NULL, WHITE_SPACE, &saveptr);
+	}
+	if (arg != NULL) {
+		step->delay = strtoul(arg, &end_ptr, 10);
+		if (*end_ptr || *arg == '-' || step->delay > MAX_SEQUENCE_DELAY)
+			return "bad send packet (delay)\n";
+		arg = strtok_r(NULL, WHITE_SPACE, &saveptr);
+	}
+	if (arg != NULL)
+		return "bad send packet (trailing ws)\n";
+	return NULL;
+}
+
+
+static void timespec_add_us(struct timespec* ts, unsigned long usecs)
+{
+	ts->tv_sec += usecs / 1000000;
+	ts->tv_nsec += (usecs % 1000000) * 1000;
+	if (ts->tv_nsec >= 1000000000) {
+		ts->tv_sec += 1;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+
+static int timespec_before(const struct timespec* a,
+			   const struct timespec* b)
+{
+	return a->tv_sec < b->tv_sec
+	       || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+
+/** Return a - b in microseconds. */
+static long long timespec_diff_us(const struct timespec* a,
+				  const struct timespec* b)
+{
+	return (a->tv_sec - b->tv_sec) * 1000000LL
+	       + (a->tv_nsec - b->tv_nsec) / 1000;
+}
+
+
+/**
+ * Set deadline to the earliest time for a frame on the transmitters in
+ * mask, 0 for all: the latest of their tx_next. Transmitter sets which
+ * share a transmitter must not send in each other's gaps.
+ */
+static void tx_deadline(uint32_t mask, struct timespec* deadline)
+{
+	unsigned int i;
+
+	deadline->tv_sec = 0;
+	deadline->tv_nsec = 0;
+	for (i = 0; i < MAX_TX; i++) {
+		if ((mask == 0 || (mask & ((uint32_t)1 << i)))
+		    && timespec_before(deadline, &tx_next[i]))
+			*deadline = tx_next[i];
+	}
+}
+
+
+/** Set tx_next of the transmitters in mask, 0 for all, to deadline. */
+static void tx_set_deadline(uint32_t mask, const struct timespec* deadline)
+{
+	unsigned int i;
+
+	for (i = 0; i < MAX_TX; i++) {
+		if ((mask == 0 || (mask & ((uint32_t)1 << i)))
+		    && timespec_before(&tx_next[i], deadline))
+			tx_next[i] = *deadline;
+	}
+}
+
+
+/**
+ * Send next frame of code. On exit, deadline is when the following
+ * frame can be sent: after this frame's signal and the remote's
+ * min_remaining_gap.
+ */
+static int send_frame(struct ir_remote*	remote,
+		      struct ir_ncode*		code,
+		      struct timespec*		deadline,
+		      int			delay)
+{
+	if (!send_ir_ncode(remote, code, delay))
+		return 0;
+	*deadline = remote->next_send;
+	return 1;
+}
+
+
+/**
+ * Wait until deadline unless first or the driver handles the gaps in a
+ * send batch, then send_frame(). Adds the frame and the gap after it to
+ * *elapsed (us), fails without sending if *elapsed already exceeds
+ * MAX_SEQUENCE_TIME.
+ */
+static int send_sequence_frame(struct ir_remote*	remote,
+			       struct ir_ncode*		code,
+			       struct timespec*		deadline,
+			       long long*		elapsed,
+			       int			first)
+{
+	if (*elapsed > MAX_SEQUENCE_TIME)
+		return 0;
+	if (!first && !send_batch)
+		send_pacing_wait(deadline);
+	if (!send_frame(remote, code, deadline, first))
+		return 0;
+	*elapsed += send_buffer_sum() + remote->min_remaining_gap;
+	return 1;
+}
+
+
+/** Send a step including repeats, the same frames as SEND_ONCE. */
+static int send_sequence_step(const struct send_step*	step,
+			      struct timespec*		deadline,
+			      long long*		elapsed,
+			      int			first)
+{
+	struct ir_remote* remote = step->remote;
+	struct ir_ncode* code = step->code;
+	int ok;
+
+	if (has_toggle_mask(remote))
+		remote->toggle_mask_state = 0;
+	if (has_toggle_bit_mask(remote))
+		remote->toggle_bit_mask_state =
+			(remote->toggle_bit_mask_state
+				^ remote->toggle_bit_mask);
+	code->transmit_state = NULL;
+	if (!send_sequence_frame(remote, code, deadline, elapsed, first))
+		return 0;
+	gettimeofday(&remote->last_send, NULL);
+	remote->last_code = code;
+	remote->repeat_countdown = max(remote->repeat_countdown, step->reps);
+	if (remote->repeat_countdown <= 0 && code->next == NULL)
+		return 1;
+	/* Like dosigalrm(), but blocking. */
+	repeat_remote = remote;
+	repeat_code = code;
+	do {
+		if (code->next == NULL
+		    || (code->transmit_state != NULL
+			&& code->transmit_state->next == NULL))
+			remote->repeat_countdown--;
+		ok = send_sequence_frame(remote, code, deadline, elapsed, 0);
+	} while (ok && remote->repeat_countdown > 0);
+	repeat_remote = NULL;
+	repeat_code = NULL;
+	return ok;
+}
+
+
+/**
+ * Send a sequence of codes back-to-back. Unlike consecutive SEND_ONCE
+ * commands there are no round trips, and each frame is sent as soon as
+ * the remote's min_remaining_gap allows. Drivers supporting send
+ * batches get all frames and delays before writing them to the device.
+ * Blocks until done, so sending stops with an error when the frames
+ * and delays sent exceed MAX_SEQUENCE_TIME.
+ */
+static int send_sequence(int fd, char* message, char* arguments)
+{
+	struct send_step steps[MAX_SEQUENCE_STEPS];
+	struct timespec deadline;
+	long long elapsed = 0;
+	char errbuf[PACKET_SIZE + 1];
+	const char* err;
+	char* saveptr;
+	char* step_args;
+	int count = 0;
+	int batched;
+	int delay;
+	int ok = 1;
+	int i;
+
+	if (curr_driver->send_mode == 0)
+		return send_error(fd, message,
+				  "hardware does not support sending\n");
+	if (arguments == NULL)
+		return send_error(fd, message, "no arguments given\n");
+	for (step_args = strtok_r(arguments, ",", &saveptr);
+	     step_args != NULL;
+	     step_args = strtok_r(NULL, ",", &saveptr)) {
+		if (count == MAX_SEQUENCE_STEPS)
+			return send_error(fd, message,
+					  "too many steps: max %d\n",
+					  MAX_SEQUENCE_STEPS);
+		err = parse_send_step(step_args, &steps[count],
+				      errbuf, sizeof(errbuf));
+		if (err != NULL)
+			return send_error(fd, message, "%s", err);
+		elapsed += steps[count].delay;
+		count += 1;
+	}
+	if (elapsed > MAX_SEQUENCE_TIME)
+		return send_error(fd, message,
+				  "sequence too long: max %lld ms\n",
+				  MAX_SEQUENCE_TIME / 1000);
+	elapsed = 0;
+	if (count == 0)
+		return send_error(fd, message, "no arguments given\n");
+	if (repeat_remote != NULL)
+		return send_error(fd, message, "busy: repeating\n");
+
+	restore_tx_mask();
+	tx_deadline(tx_mask, &deadline);
+	send_pacing_wait(&deadline);
+	send_batch = curr_driver->drvctl_func != NULL
+		     && curr_driver->drvctl_func(DRVCTL_BEGIN_SEND_BATCH,
+						 NULL) == 0;
+	batched = send_batch;
+	for (i = 0; ok && i < count; i++) {
+		ok = send_sequence_step(&steps[i], &deadline, &elapsed, i == 0);
+		elapsed += steps[i].delay;
+		if (!send_batch) {
+			timespec_add_us(&deadline, steps[i].delay);
+		} else if (ok && steps[i].delay > 0) {
+			delay = steps[i].delay;
+			ok = curr_driver->drvctl_func(DRVCTL_SEND_SPACE,
+						      &delay) == 0;
+		}
+	}
+	if (send_batch) {
+		send_batch = 0;
+		if (curr_driver->drvctl_func(DRVCTL_END_SEND_BATCH, NULL) != 0)
+			ok = 0;
+	}
+	if (i > 0) {
+		/* Batching drivers update next_send when written. */
+		if (batched)
+			deadline = steps[i - 1].remote->next_send;
+		tx_set_deadline(tx_mask, &deadline);
+	}
+	if (!ok && elapsed > MAX_SEQUENCE_TIME)
+		return send_error(fd, message,
+				  "sequence too long: stopped at %lld ms\n",
+				  MAX_SEQUENCE_TIME / 1000);
+	if (!ok)
+		return send_error(fd, message, "transmission failed\n");
+	return send_success(fd, message);
+}
+
+/**
+ * Return the SEND_TX queue for mask. A new queue is created when
+ * needed, reusing an idle one when there are MAX_TX_QUEUES.
+ */
+static struct tx_queue* get_tx_queue(uint32_t mask)
+{
+	struct tx_queue* q = NULL;
+	int i;
+
+	for (i = 0; i < tx_queue_count; i++) {
+		if (tx_queues[i].mask == mask)
+			return &tx_queues[i];
+		if (tx_queues[i].first == NULL && q == NULL)
+			q = &tx_queues[i];
+	}
+	if (tx_queue_count < MAX_TX_QUEUES)
+		q = &tx_queues[tx_queue_count++];
+	if (q != NULL) {
+		memset(q, 0, sizeof(*q));
+		q->mask = mask;
+	}
+	return q;
+}
+
+
+/**
+ * Queue a SEND_ONCE for the transmitters in a comma-separated list,
+ * replying when it is sent by dispatch_tx().
+ */
+static int send_tx(int fd, char* message, char* arguments)
+{
+	char errbuf[PACKET_SIZE + 1];
+	struct ir_remote* remote;
+	struct ir_ncode* code;
+	struct tx_queue* q;
+	struct tx_job* job;
+	const char* err;
+	unsigned int reps;
+	uint32_t mask;
+	int e;
+
+	err = check_transmitters();
+	if (err != NULL)
+		return send_error(fd, message, "%s", err);
+	if (arguments == NULL)
+		return send_error(fd, message, "no arguments given\n");
+	err = parse_transmitters(strtok(arguments, WHITE_SPACE), ",", &mask,
+				 errbuf, sizeof(errbuf));
+	if (err != NULL)
+		return send_error(fd, message, "%s", err);
+	if (parse_rc(fd, message, strtok(NULL, ""),
+		     &remote, &code, &reps, 2, &e) == 0)
+		return 0;
+	if (e)
+		return 1;
+	if (tx_job_count >= MAX_TX_JOBS)
+		return send_error(fd, message, "busy: transmit queue full\n");
+	q = get_tx_queue(mask);
+	if (q == NULL)
+		return send_error(fd, message,
+				  "busy: too many transmitter sets\n");
+	job = (struct tx_job*)calloc(1, sizeof(struct tx_job));
+	if (job == NULL || (job->message = strdup(message)) == NULL) {
+		free(job);
+		return send_error(fd, message, "out of memory\n");
+	}
+	job->fd = fd;
+	job->remote = remote;
+	job->code = code;
+	job->reps = reps;
+	if (q->first == NULL) {
+		q->first = job;
+		clock_gettime(CLOCK_MONOTONIC, &q->active);
+	} else {
+		q->last->next = job;
+	}
+	q->last = job;
+	tx_job_count += 1;
+	return 1;
+}
+
+
+/**
+ * Send next frame of first job in q, like send_core() and dosigalrm()
+ * but using the job's repeat state. Return -1 on errors, 1 if job is
+ * done, else 0.
+ */
+static int send_tx_frame(struct tx_queue* q)
+{
+	struct tx_job* job = q->first;
+	struct ir_remote* remote = job->remote;
+	struct ir_ncode* code = job->code;
+	struct timespec deadline;
+	int first = !job->started;
+	int ok;
+
+	if (first) {
+		if (has_toggle_mask(remote))
+			remote->toggle_mask_state = 0;
+		if (has_toggle_bit_mask(remote))
+			remote->toggle_bit_mask_state =
+				(remote->toggle_bit_mask_state
+					^ remote->toggle_bit_mask);
+		code->transmit_state = NULL;
+	} else {
+		remote->repeat_countdown = job->countdown;
+		remote->toggle_mask_state = job->toggle_mask_state;
+		code->transmit_state = job->transmit_state;
+		if (code->next == NULL
+		    || (code->transmit_state != NULL
+			&& code->transmit_state->next == NULL))
+			remote->repeat_countdown--;
+		repeat_remote = remote;
+	}
+	ok = send_frame(remote, code, &deadline, 0);
+	repeat_remote = NULL;
+	if (!ok)
+		return -1;
+	tx_set_deadline(q->mask, &deadline);
+	q->frames += 1;
+	q->airtime += send_buffer_sum();
+	if (first) {
+		remote->repeat_countdown =
+			max(remote->repeat_countdown, job->reps);
+		job->started = 1;
+	}
+	job->countdown = remote->repeat_countdown;
+	job->toggle_mask_state = remote->toggle_mask_state;
+	job->transmit_state = code->transmit_state;
+	return job->countdown <= 0 && (!first || code->next == NULL);
+}
+
+
+/** Remove first job in q, reply with err or success if NULL. */
+static void complete_tx_job(struct tx_queue* q, const char* err)
+{
+	struct tx_job* job = q->first;
+	struct timespec now;
+
+	q->first = job->next;
+	if (q->first == NULL) {
+		q->last = NULL;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		q->busy += timespec_diff_us(&now, &q->active);
+	}
+	if (err == NULL)
+		q->commands += 1;
+	else
+		q->errors += 1;
+	if (job->fd != -1) {
+		if (err == NULL)
+			send_success(job->fd, job->message);
+		else
+			send_error(job->fd, job->message, "%s", err);
+	}
+	free(job->message);
+	free(job);
+	tx_job_count -= 1;
+	if (!use_hw() && curr_driver->deinit_func)
+		deinit_hardware();
+}
+
+
+/**
+ * Send due SEND_TX frames, the most overdue first. The driver sends
+ * one signal at a time, so queues are interleaved: a frame for one
+ * transmitter set goes out in the gap after a frame for another. A
+ * queue is due when all its transmitters are past their gaps, see
+ * tx_deadline(). Sends at most one frame per queue so clients are
+ * served meanwhile, and waits while SEND_ONCE or SEND_START is
+ * repeating.
+ */
+static void dispatch_tx(void)
+{
+	struct timespec now;
+	struct timespec deadline;
+	struct timespec due = { 0, 0 };
+	struct tx_queue* q;
+	int sent;
+	int r;
+	int i;
+
+	for (sent = 0; sent < tx_queue_count; sent++) {
+		if (repeat_remote != NULL)
+			return;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		q = NULL;
+		for (i = 0; i < tx_queue_count; i++) {
+			if (tx_queues[i].first == NULL)
+				continue;
+			tx_deadline(tx_queues[i].mask, &deadline);
+			if (timespec_before(&now, &deadline))
+				continue;
+			if (q == NULL || timespec_before(&deadline, &due)) {
+				q = &tx_queues[i];
+				due = deadline;
+			}
+		}
+		if (q == NULL)
+			return;
+		if (set_tx_mask(q->mask) != 0) {
+			log_error("Cannot set transmitter mask 0x%x", q->mask);
+			complete_tx_job(q, "error - could not set transmitters\n");
+			continue;
+		}
+		r = send_tx_frame(q);
+		if (r != 0)
+			complete_tx_job(q, r > 0 ? NULL : "transmission failed\n");
+	}
+}
+
+
+/**
+ * If SEND_TX frames are waiting, set tv to the time until the next
+ * one, rounded up to the ms resolution of poll(), and return 1.
+ */
+static int get_tx_timeout(struct timeval* tv)
+{
+	struct timespec now;
+	struct timespec next = { 0, 0 };
+	struct timespec deadline;
+	long long usecs;
+	int found = 0;
+	int i;
+
+	if (tx_job_count == 0 || repeat_remote != NULL)
+		return 0;
+	for (i = 0; i < tx_queue_count; i++) {
+		if (tx_queues[i].first == NULL)
+			continue;
+		tx_deadline(tx_queues[i].mask, &deadline);
+		if (!found || timespec_before(&deadline, &next))
+			next = deadline;
+		found = 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	usecs = timespec_diff_us(&next, &now);
+	usecs = usecs > 0 ? (usecs + 999) / 1000 * 1000 : 0;
+	tv->tv_sec = usecs / 1000000;
+	tv->tv_usec = usecs % 1000000;
+	return 1;
+}
+
+
+/** Don't reply to a removed client. */
+static void forget_tx_client(int fd)
+{
+	struct tx_job* job;
+	int i;
+
+	for (i = 0; i < tx_queue_count; i++)
+		for (job = tx_queues[i].first; job != NULL; job = job->next)
+			if (job->fd == fd)
+				job->fd = -1;
+}
+
+
+static void format_transmitters(uint32_t mask, char* buf, size_t size)
+{
+	int len = 0;
+	unsigned int i;
+
+	buf[0] = '\0';
+	for (i = 0; i < MAX_TX && len < (int)size; i++)
+		if (mask & ((uint32_t)1 << i))
+			len += snprintf(buf + len, size - len, "%s%u",
+					len > 0 ? "," : "", i + 1);
+}
+
+
+/** Report SEND_TX throughput for each transmitter set. */
+static int tx_stats(int fd, char* message, char* arguments)
+{
+	char buffer[PACKET_SIZE + 1];
+	char transmitters[PACKET_SIZE + 1];
+	struct timespec now;
+	struct tx_queue* q;
+	struct send_pacing_stats pacing;
+	unsigned long long busy;
+	std::string data;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	for (i = 0; i < tx_queue_count; i++) {
+		q = &tx_queues[i];
+		busy = q->busy;
+		if (q->first != NULL)
+			busy += timespec_diff_us(&now, &q->active);
+		format_transmitters(q->mask, transmitters,
+				    sizeof(transmitters));
+		snprintf(buffer, sizeof(buffer),
+			 "%s: %lu commands, %lu errors, %lu frames,"
+			 " %llu ms signal, %llu ms busy, %.1f frames/s\n",
+			 transmitters, q->commands, q->errors, q->frames,
+			 q->airtime / 1000, busy / 1000,
+			 busy > 0 ? q->frames * 1e6 / busy : 0.0);
+		data += buffer;
+	}
+	send_pacing_get_stats(&pacing);
+	snprintf(buffer, sizeof(buffer),
+		 "pacing: %lu waits, %.1f us mean error, %.1f us max,"
+		 " %.1f us last\n", pacing.waits,
+		 pacing.waits > 0 ? pacing.error_sum / 1e3 / pacing.waits : 0.0,
+		 pacing.error_max / 1e3, pacing.error_last / 1e3);
+	data += buffer;
+	return send_data_reply(fd, message, tx_queue_count + 1, data);
+}
+
+
+static int rec_stats(int fd, char* message, char* arguments)
+{
+	char buffer[PACKET_SIZE + 1];
+	struct drv_rec_stats stats;
+	struct rec_reader_stats reader;
+	std::string data;
+	int n = 1;
+
+	if (curr_driver->drvctl_func != NULL
+	    && curr_driver->drvctl_func(DRVCTL_GET_REC_STATS, &stats) == 0) {
+		snprintf(buffer, sizeof(buffer),
+			 "driver: %llu packets, %llu bytes, %llu samples,"
+			 " %llu reads, %llu dropped, %llu errors\n",
+			 (unsigned long long)stats.packets,
+			 (unsigned long long)stats.bytes,
+			 (unsigned long long)stats.samples,
+			 (unsigned long long)stats.batches,
+			 (unsigned long long)stats.dropped,
+			 (unsigned long long)stats.errors);
+		data += buffer;
+		n += 1;
+	}
+	rec_reader_get_stats(&reader);
+	snprintf(buffer, sizeof(buffer),
+		 "reader: %lu items, %lu overflows, %lu max queued,"
+		 " %.1f ms max delay\n", reader.items, reader.overflows,
+		 reader.max_fill, reader.max_delay / 1e3);
+	data += buffer;
+	return send_data_reply(fd, message, n, data);
+}
+
+
 static int send_stop(int fd, char* message, char* arguments)
 {
 	struct ir_remote* remote;
@@ -1769,7 +2620,17 @@ static int set_inputlog(int fd, char* message, char* arguments)
 }
 
 
-int get_command(int fd)
+/** Return true if there is a complete command held for a client. */
+static int held_commands_ready(void)
+{
+	return held_commands.fd != -1
+	       && held_commands.fd != repeat_fd
+	       && memchr(held_commands.buffer, '\n',
+			 held_commands.length) != NULL;
+}
+
+
+static int get_commands(int fd)
 {
 	int length;
 	char buffer[PACKET_SIZE + 1], backup[PACKET_SIZE + 1];
@@ -1777,7 +2638,18 @@ int get_command(int fd)
 	int packet_length, i;
 	char* directive;
 
-	length = read_timeout(fd, buffer, PACKET_SIZE, 0);
+	if (held_commands.fd == fd) {
+		held_commands.fd = -1;
+		length = held_commands.length;
+		memcpy(buffer, held_commands.buffer, length);
+		if (memchr(buffer, '\n', length) == NULL) {
+			i = read_timeout(fd, buffer + length,
+					 PACKET_SIZE - length, 0);
+			length = i > 0 ? length + i : i;
+		}
+	} else {
+		length = read_timeout(fd, buffer, PACKET_SIZE, 0);
+	}
 	packet_length = 0;
 	while (length > packet_length) {
 		buffer[length] = 0;
@@ -1823,6 +2695,17 @@ int get_command(int fd)
 			return 0;
 		}
 skip:
+		if (!flush_reply())
+			return 0;
+		if (length > packet_length && repeat_fd == fd) {
+			/* The reply waits for the repeats, so must the rest. */
+			held_commands.fd = fd;
+			held_commands.length = length - packet_length;
+			memcpy(held_commands.buffer,
+			       buffer + packet_length,
+			       held_commands.length);
+			return 1;
+		}
 		if (length > packet_length) {
 			int new_length;
 
@@ -1853,6 +2736,20 @@ skip:
 	return 1;
 }
 
+
+int get_command(int fd)
+{
+	int r;
+
+	reply_buf.fd = fd;
+	reply_buf.len = 0;
+	r = get_commands(fd);
+	if (!flush_reply())
+		r = 0;
+	reply_buf.fd = -1;
+	return r;
+}
+
 static void input_message(const char* message,
 			  const char* remote_name,
 			  const char* button_name, int reps)
@@ -1946,7 +2843,8 @@ void free_old_remotes(void)
 			}
 		}
 	}
-	if (found == NULL && get_decoding() != free_remotes) {
+	if (found == NULL && tx_job_count == 0
+	    && get_decoding() != free_remotes) {
 		free_config(free_remotes);
 		free_remotes = NULL;
 	} else {
@@ -1973,8 +2871,8 @@ static union {
 static int mywaitfordata(uint32_t maxusec)
 {
 	int i;
-	int ret, reconnect;
-	struct timeval tv, start, now, timeout, release_time;
+	int ret, reconnect, tx_wait, pending;
+	struct timeval tv, start, now, timeout, release_time, tx_time;
 	loglevel_t oldlevel;
 
 	while (1) {
@@ -1991,6 +2889,7 @@ static int mywaitfordata(uint32_t maxusec)
 				dosigalrm(SIGALRM);
 				alrm = 0;
 			}
+			dispatch_tx();
 			memset(&poll_fds, 0, sizeof(poll_fds));
 			for (i = 0; i < (int)POLLFDS_SIZE; i += 1)
 				poll_fds.byindex[i].fd = -1;
@@ -2005,8 +2904,7 @@ static int mywaitfordata(uint32_t maxusec)
 			if (use_hw() && curr_driver->rec_mode != 0
 			    && curr_driver->fd != -1
 			) {
-				poll_fds.byname.curr_driver.fd =
-					curr_driver->fd;
+				poll_fds.byname.curr_driver.fd = get_rec_fd();
 				poll_fds.byname.curr_driver.events =
 					POLLIN;
 			}
@@ -2079,8 +2977,24 @@ static int mywaitfordata(uint32_t maxusec)
 						tv = gap;
 				}
 			}
-			if (timerisset(&tv) || timerisset(&release_time)
-			    || reconnect
+			tx_wait = get_tx_timeout(&tx_time);
+			if (tx_wait
+			    && (!(timerisset(&tv) || timerisset(&release_time)
+				  || reconnect)
+				|| timercmp(&tv, &tx_time, >)))
+				tv = tx_time;
+			/*
+			 * Data read ahead by the driver and commands held
+			 * while repeating are not seen by poll.
+			 */
+			pending = maxusec == 0 && use_hw()
+				  && rec_buffer_pending() > 0;
+			if (pending || (maxusec == 0 && held_commands_ready())) {
+				ret = curl_poll((
+					struct pollfd *) &poll_fds.byindex,
+					POLLFDS_SIZE, 0);
+			} else if (timerisset(&tv) || timerisset(&release_time)
+				   || reconnect || tx_wait
 			) {
 				ret = curl_poll((
 					struct pollfd *) &poll_fds.byindex,
@@ -2101,7 +3015,7 @@ static int mywaitfordata(uint32_t maxusec)
 			if (free_remotes != NULL)
 				free_old_remotes();
 			if (maxusec > 0) {
-				if (ret == 0)
+				if (ret == 0 && !tx_wait)
 					return 0;
 				if (time_elapsed(&start, &now) >= maxusec)
 					return 0;
@@ -2121,7 +3035,9 @@ static int mywaitfordata(uint32_t maxusec)
 			lirc_log_setlevel(oldlevel);
 		}
 		for (i = 0; i < clin; i++) {
-			if (poll_fds.byname.clis[i].revents & POLLIN) {
+			if (poll_fds.byname.clis[i].revents & POLLIN
+			    || (clis[i] == held_commands.fd
+				&& held_commands_ready())) {
 				poll_fds.byname.clis[i].revents = 0;
 				if (get_command(clis[i]) == 0) {
 					remove_client(clis[i]);
@@ -2154,6 +3070,8 @@ static int mywaitfordata(uint32_t maxusec)
 			log_trace("registering inet client");
 			add_client(sockinet);
 		}
+		if (pending)
+			return 1;
 		if (use_hw() && curr_driver->rec_mode != 0
 		    && curr_driver->fd != -1
 		    && poll_fds.byname.curr_driver.revents & POLLIN
@@ -2191,6 +3109,12 @@ void loop(void)
 
 			input_message(message, remote_name, button_name, reps);
 		}
+		if (rec_reader_failed()) {
+			/* Reopened by mywaitfordata(), like drivers closing
+			 * themselves on errors. */
+			log_error("Read error, closing driver");
+			deinit_hardware();
+		}
 	}
 }
 
@@ -2246,8 +3170,12 @@ static void lircd_add_defaults(void)
 		"lircd:debug",		level,
 		"lircd:allow-simulate",	"False",
 		"lircd:dynamic-codes",	"False",
+		"lircd:lazy-codes",	"False",
 		"lircd:plugindir",	PLUGINDIR,
 		"lircd:repeat-max",	DEFAULT_REPEAT_MAX,
+		"lircd:tx-busy-wait",	"0",
+		"lircd:tx-realtime",	"False",
+		"lircd:reader-queue",	"0",
 		"lircd:configfile",	LIRCDCFGFILE,
 		"lircd:driver-options",	"",
 		"lircd:effective-user",	"",
@@ -2278,7 +3206,7 @@ int parse_peer_connections(const char* opt)
 static void lircd_parse_options(int argc, char** const argv)
 {
 	int c;
-	const char* optstring = "A:e:O:hvnp:iH:d:o:U:P:l::L:c:aR:D::Yu";
+	const char* optstring = "A:e:O:hvnp:iH:d:o:U:P:l::L:c:aR:B:TQ:D::YZu";
 
 	strncpy(progname, "lircd", sizeof(progname));
 	optind = 1;
@@ -2352,9 +3280,21 @@ static void lircd_parse_options(int argc, char** const argv)
 		case 'R':
 			options_set_opt("lircd:repeat-max", optarg);
 			break;
+		case 'B':
+			options_set_opt("lircd:tx-busy-wait", optarg);
+			break;
+		case 'T':
+			options_set_opt("lircd:tx-realtime", "True");
+			break;
+		case 'Q':
+			options_set_opt("lircd:reader-queue", optarg);
+			break;
 		case 'Y':
 			options_set_opt("lircd:dynamic-codes", "True");
 			break;
+		case 'Z':
+			options_set_opt("lircd:lazy-codes", "True");
+			break;
 		case 'A':
 			options_set_opt("lircd:driver-options", optarg);
 			break;
@@ -2425,6 +3365,12 @@ static void log_options(void)
 		   optvalue("lircd:effective_user"));
 	log_notice("Options: allow_simulate: %d", allow_simulate);
 	log_notice("Options: repeat_max: %d", repeat_max);
+	log_notice("Options: tx_busy_wait: %s",
+		   optvalue("lircd:tx-busy-wait"));
+	log_notice("Options: tx_realtime: %s",
+		   optvalue("lircd:tx-realtime"));
+	log_notice("Options: reader_queue: %s",
+		   optvalue("lircd:reader-queue"));
 	log_notice("Options: configfile: %s", optvalue("lircd:configfile"));
 	log_notice("Options: dynamic_codes: %s",
 		   optvalue("lircd:dynamic_codes"));
@@ -2449,6 +3395,7 @@ int main(int argc, char** argv)
 	char errmsg[128];
 	const char* opt;
 	int immediate_init = 0;
+	int busy_wait;
 
 	address.s_addr = htonl(INADDR_ANY);
 	hw_choose_driver(NULL);
@@ -2518,6 +3465,17 @@ int main(int argc, char** argv)
 	loglevel_opt = (loglevel_t) options_getint("lircd:debug");
 	allow_simulate = options_getboolean("lircd:allow-simulate");
 	repeat_max = options_getint("lircd:repeat-max");
+	busy_wait = options_getint("lircd:tx-busy-wait");
+	if (busy_wait < 0 || busy_wait > MAX_TX_BUSY_WAIT) {
+		log_error("Bad tx-busy-wait: %d (0 - %d us)",
+			  busy_wait, MAX_TX_BUSY_WAIT);
+		fprintf(stderr, "%s: bad tx-busy-wait: %d (0 - %d us)\n",
+			progname, busy_wait, MAX_TX_BUSY_WAIT);
+		return EXIT_FAILURE;
+	}
+	tx_busy_wait = busy_wait;
+	send_pacing_set(tx_busy_wait, options_getboolean("lircd:tx-realtime"));
+	reader_queue = options_getint("lircd:reader-queue");
 	configfile = options_getstring("lircd:configfile");
 	curr_driver->open_func(device);
 	if (strcmp(curr_driver->name, "null") == 0 && peern == 0) {
@@ -2578,7 +3536,7 @@ int main(int argc, char** argv)
 			return(EXIT_FAILURE);
 		}
 		if (curr_driver->deinit_func) {
-			int status = curr_driver->deinit_func();
+			int status = deinit_hardware();
 			if (!status)
 				log_error("Failed to de-initialize hardware");
 		}
@@ -25,10 +25,13 @@
 #include <syslog.h>
 #include <errno.h>
 #include <getopt.h>
+#include <poll.h>
+#include <time.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/timerfd.h>
 #include <sys/un.h>
 
 #ifdef HAVE_LINUX_INPUT_H
@@ -44,6 +47,12 @@
 #define ALL ((char*)(-1))
 #define CIRCLE 10
 
+#define MOTION_RATE "250"	/* Default motion ticks per second */
+#define MIN_PERIOD 10000	/* usecs, shortest repeat period used */
+#define MAX_PERIOD 500000	/* usecs, longest repeat period used */
+#define DEFAULT_PERIOD 110000	/* usecs, used before first repeat */
+#define MAX_EVENTS 64		/* uinput events written at once */
+
 #define BUTTONS 3               /* 3 buttons supported */
 
 /* buttons chosen to match MouseSystem protocol*/
@@ -65,6 +74,26 @@ static int uinputfd = -1;
 static int useuinput = 0;
 static loglevel_t loglevel_opt = LIRC_NOLOG;
 
+#ifdef USE_UINPUT
+static struct input_event events[MAX_EVENTS];
+static int event_count = 0;
+#endif
+
+/*
+ * The motion engine. A repeated move moves the pointer the same distance
+ * as without it, but spread over the repeat period in small steps at
+ * rate ticks per second instead of a single jump. The timerfd is only
+ * armed while there is distance left to move.
+ */
+static struct {
+	int		fd;		/* timerfd, -1 if engine disabled. */
+	int		rate;		/* Ticks per second. */
+	int		dx, dy;		/* Distance to move in this period. */
+	int		tick, ticks;	/* Ticks done and total in period. */
+	long		period;		/* Last repeat period, usecs. */
+	struct timespec last;		/* Time of last move event. */
+} motion = { -1, 0, 0, 0, 0, 0, DEFAULT_PERIOD, { 0, 0 } };
+
 
 static const struct option lircmd_options[] = {
 	{ "help",	  no_argument,	     NULL, 'h' },
@@ -76,6 +105,7 @@ static const struct option lircmd_options[] = {
 	{ "uinput",	  no_argument,	     NULL, 'u' },
 #       endif
 	{ "loglevel",	  optional_argument, NULL, 'D' },
+	{ "rate",	  required_argument, NULL, 'r' },
 	{ 0,		  0,		     0,	   0   }
 };
 
@@ -91,6 +121,8 @@ static const char* const help =
 #       endif
 	"\t -D[level] --loglevel[=level]\n"
             "\t\t\t\t'info', 'warning', 'notice', etc., or 3..10.\n"
+	"\t -r --rate=hz\t\tSmooth motion update rate, 0 disables ["
+	MOTION_RATE "]\n"
 ;
 
 
@@ -305,17 +337,15 @@ setup_error:
 	return -1;
 }
 
-void write_uinput(uint16_t type, uint16_t code, int32_t value)
+void flush_uinput(void)
 {
 #ifdef USE_UINPUT
-	struct input_event event;
+	ssize_t size = event_count * sizeof(struct input_event);
 
-	memset(&event, 0, sizeof(event));
-	event.type = type;
-	event.code = code;
-	event.value = value;
-
-	if (write(uinputfd, &event, sizeof(event)) != sizeof(event)) {
+	if (event_count == 0)
+		return;
+	event_count = 0;
+	if (write(uinputfd, events, size) != size) {
 		static int once = 1;
 
 		if (once) {
@@ -330,20 +360,39 @@ void write_uinput(uint16_t type, uint16_t code, int32_t value)
 #endif
 }
 
-void msend(int dx, int dy, int dz, int rep, int buttp, int buttr)
+/** Queue an event, written by next flush_uinput(). */
+void write_uinput(uint16_t type, uint16_t code, int32_t value)
+{
+#ifdef USE_UINPUT
+	struct input_event* event;
+
+	if (event_count == MAX_EVENTS)
+		flush_uinput();
+	event = &events[event_count++];
+	memset(event, 0, sizeof(*event));
+	event->type = type;
+	event->code = code;
+	event->value = value;
+#endif
+}
+
+/** Number of steps moved for a repeated move, see ACCELERATOR. */
+int accel_factor(int rep)
+{
+	if (rep < ms.acc_start)
+		return 1;
+	if (rep * ms.acc_fak >= ms.acc_max)
+		return ms.acc_max;
+	return rep * ms.acc_fak;
+}
+
+/** Send f steps of dx, dy, dz and the button changes. */
+void msend(int dx, int dy, int dz, int f, int buttp, int buttr)
 {
 	static int buttons = 0;
 	int i;
-	int f = 1;
 	char buffer[5];
 
-	if (rep >= ms.acc_start) {
-		if (rep * ms.acc_fak >= ms.acc_max)
-			f = ms.acc_max;
-		else
-			f = rep * ms.acc_fak;
-	}
-
 	buttons |= buttp;
 	buttons &= ~buttr;
 
@@ -426,19 +475,20 @@ void msend(int dx, int dy, int dz, int rep, int buttp, int buttr)
 				write_uinput(EV_SYN, SYN_REPORT, 0);
 			}
 		}
+		flush_uinput();
 	}
 #endif
 }
 
 void mouse_move(int dx, int dy, int dz, int rep)
 {
-	msend(dx, dy, dz, rep, 0, 0);
+	msend(dx, dy, dz, accel_factor(rep), 0, 0);
 }
 
 void mouse_button(int down, int up, int rep)
 {
 	if (rep == 0) {
-		msend(0, 0, 0, rep, down, up);
+		msend(0, 0, 0, accel_factor(rep), down, up);
 		if (down & BUTTON1)
 			ms.buttons[map_buttons(BUTTON1)] = button_down;
 		if (down & BUTTON2)
@@ -502,10 +552,100 @@ void deactivate(void)
 	mouse_circle(CIRCLE, -1, 1);
 }
 
+/** Part of total moved after tick of ticks, rounded to nearest. */
+static int spread(int total, int tick, int ticks)
+{
+	if (total < 0)
+		return -((-total * tick + ticks / 2) / ticks);
+	return (total * tick + ticks / 2) / ticks;
+}
+
+static void motion_arm(long nsec)
+{
+	struct itimerspec its;
+
+	its.it_value.tv_sec = nsec / 1000000000;
+	its.it_value.tv_nsec = nsec % 1000000000;
+	its.it_interval = its.it_value;
+	if (timerfd_settime(motion.fd, 0, &its, NULL) == -1)
+		syslog(LOG_WARNING, "cannot set motion timer: %m");
+}
+
+/** Drop any remaining distance and disarm the timer. */
+void motion_stop(void)
+{
+	if (motion.ticks == 0)
+		return;
+	motion.ticks = 0;
+	motion.tick = 0;
+	motion_arm(0);
+}
+
+/**
+ * Handle a move event. The first event moves at once, repeats set up
+ * the accelerated distance to move until next repeat is expected.
+ */
+void motion_move(int dx, int dy, int rep)
+{
+	struct timespec now;
+	long period;
+	int rest_x = 0;
+	int rest_y = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	period = (now.tv_sec - motion.last.tv_sec) * 1000000
+		 + (now.tv_nsec - motion.last.tv_nsec) / 1000;
+	motion.last = now;
+	if (rep == 0) {
+		motion_stop();
+		mouse_move(dx, dy, 0, rep);
+		return;
+	}
+	if (period >= MIN_PERIOD && period <= MAX_PERIOD)
+		motion.period = period;
+	if (motion.ticks > 0) {
+		rest_x = motion.dx - spread(motion.dx, motion.tick, motion.ticks);
+		rest_y = motion.dy - spread(motion.dy, motion.tick, motion.ticks);
+	} else {
+		motion_arm(1000000000 / motion.rate);
+	}
+	motion.dx = dx * accel_factor(rep) + rest_x;
+	motion.dy = dy * accel_factor(rep) + rest_y;
+	motion.ticks = motion.period * motion.rate / 1000000;
+	if (motion.ticks < 1)
+		motion.ticks = 1;
+	motion.tick = 0;
+}
+
+/** Timer expired: move the steps due, all in one report. */
+void motion_tick(void)
+{
+	uint64_t expired;
+	int x = 0;
+	int y = 0;
+
+	if (read(motion.fd, &expired, sizeof(expired)) != sizeof(expired))
+		return;
+	if (motion.ticks == 0)
+		return;
+	if (expired > (uint64_t)(motion.ticks - motion.tick))
+		expired = motion.ticks - motion.tick;
+	x -= spread(motion.dx, motion.tick, motion.ticks);
+	y -= spread(motion.dy, motion.tick, motion.ticks);
+	motion.tick += expired;
+	x += spread(motion.dx, motion.tick, motion.ticks);
+	y += spread(motion.dy, motion.tick, motion.ticks);
+	if (motion.tick == motion.ticks)
+		motion_stop();
+	if (x != 0 || y != 0)
+		msend(x, y, 0, 1, 0, 0);
+}
+
 void mouse_conv(int rep, char* button, char* remote)
 {
 	struct trans_mouse* tm;
 	int found = 0;
+	int moving = 0;
 
 	tm = tm_first;
 	while (tm != NULL) {
@@ -549,8 +689,12 @@ void mouse_conv(int rep, char* button, char* remote)
 					up = config_table[i].up;
 					toggle = config_table[i].toggle;
 
-					if (x || y || z)
+					if ((x || y) && motion.fd != -1) {
+						motion_move(x, y, rep);
+						moving = 1;
+					} else if (x || y || z) {
 						mouse_move(x, y, z, rep);
+					}
 					if (toggle) {
 						/*
 						 * assert(down==up);
@@ -580,6 +724,9 @@ void mouse_conv(int rep, char* button, char* remote)
 		found = 1;
 		tm = tm->tm_next;
 	}
+	/* Release, timeout or another button: stop moving at once. */
+	if (!moving)
+		motion_stop();
 	if (found == 0)
 		if (ms.active == 1 && ms.always_active == 0 && ms.toggle_active == 0)
 			deactivate();
@@ -756,6 +903,7 @@ static void lircmd_add_defaults(void)
 		"lircmd:configfile", LIRCMDCFGFILE,
 		"lircmd:socket",     socket ? socket : LIRCD,
 		"lircmd:debug",      loglevel ? loglevel : "notice",
+		"lircmd:rate",       MOTION_RATE,
 		(const char*)NULL,   (const char*)NULL
 	};
 	options_add_defaults(defaults);
@@ -767,9 +915,9 @@ static void lircmd_parse_options(int argc, char** const argv)
 	int c;
 
 #       if defined(USE_UINPUT)
-	const char* const optstring = "hD::vns:uO";
+	const char* const optstring = "hD::vns:uOr:";
 #       else
-	const char* const optstring = "hD::vns:O";
+	const char* const optstring = "hD::vns:Or:";
 #       endif
 
 	lircmd_add_defaults();
@@ -794,6 +942,9 @@ static void lircmd_parse_options(int argc, char** const argv)
 		case 's':
 			options_set_opt("lircmd:socket", optarg);
 			break;
+		case 'r':
+			options_set_opt("lircmd:rate", optarg);
+			break;
 #               if defined(USE_UINPUT)
 		case 'u':
 			options_set_opt("lircmd:uinput", "True");
@@ -820,47 +971,94 @@ static void lircmd_parse_options(int argc, char** const argv)
 }
 
 
+/** Return next white space separated token in *s, NULL if none. */
+static char* next_token(char** s)
+{
+	char* token;
+
+	*s += strspn(*s, WHITE_SPACE);
+	if (**s == '\0')
+		return NULL;
+	token = *s;
+	*s += strcspn(*s, WHITE_SPACE);
+	if (**s != '\0')
+		*(*s)++ = '\0';
+	return token;
+}
+
+/** Parse a "code repeat button remote" line from lircd, convert it. */
+void handle_line(char* line)
+{
+	char* repeat;
+	char* button;
+	char* remote;
+	char* end;
+	int rep;
+
+	if (next_token(&line) == NULL)
+		return;
+	repeat = next_token(&line);
+	button = next_token(&line);
+	remote = next_token(&line);
+	if (remote == NULL)
+		return;
+	rep = strtol(repeat, &end, 16);
+	if (*end != '\0')
+		return;
+	mouse_conv(rep, button, remote);
+}
+
 void loop(void)
 {
-	ssize_t len = 0;
+	struct pollfd pfds[2];
 	char buffer[PACKET_SIZE + 1];
-	int rep, ret;
-	char button[PACKET_SIZE + 1];
-	char remote[PACKET_SIZE + 1];
+	size_t len = 0;
+	ssize_t r;
+	char* line;
 	char* end;
-	int end_len = 0;
 	sigset_t block;
 
 	sigemptyset(&block);
 	sigaddset(&block, SIGHUP);
-	buffer[0] = 0;
+	pfds[0].fd = lircd;
+	pfds[0].events = POLLIN;
+	pfds[1].fd = motion.fd;
+	pfds[1].events = POLLIN;
 	while (1) {
 		if (hup) {
 			dohup();
 			hup = 0;
 		}
-		if (strchr(buffer, '\n') == NULL) {
-			sigprocmask(SIG_UNBLOCK, &block, NULL);
-			len = read(lircd, buffer + end_len, PACKET_SIZE - end_len);
-			sigprocmask(SIG_BLOCK, &block, NULL);
-			if (len <= 0) {
-				if (len == -1 && errno == EINTR)
-					continue;
-				raise(SIGTERM);
-			}
+		sigprocmask(SIG_UNBLOCK, &block, NULL);
+		r = poll(pfds, motion.fd == -1 ? 1 : 2, -1);
+		sigprocmask(SIG_BLOCK, &block, NULL);
+		if (r == -1) {
+			if (errno == EINTR)
+				continue;
+			raise(SIGTERM);
 		}
-		buffer[len + end_len] = 0;
-		ret = sscanf(buffer, "%*x %x %s %s\n", &rep, button, remote);
-		end = strchr(buffer, '\n');
-		if (end == NULL) {
-			end_len = 0;
+		if (motion.fd != -1 && (pfds[1].revents & POLLIN))
+			motion_tick();
+		if (pfds[0].revents == 0)
 			continue;
+		r = read(lircd, buffer + len, PACKET_SIZE - len);
+		if (r <= 0) {
+			if (r == -1 && errno == EINTR)
+				continue;
+			raise(SIGTERM);
+		}
+		len += r;
+		buffer[len] = '\0';
+		line = buffer;
+		while ((end = strchr(line, '\n')) != NULL) {
+			*end = '\0';
+			handle_line(line);
+			line = end + 1;
 		}
-		end++;
-		end_len = strlen(end);
-		memmove(buffer, end, end_len + 1);
-		if (ret == 3)
-			mouse_conv(rep, button, remote);
+		len -= line - buffer;
+		if (len == PACKET_SIZE)
+			len = 0;	/* Line too long, drop it. */
+		memmove(buffer, line, len);
 	}
 }
 
@@ -877,7 +1075,13 @@ int main(int argc, char** argv)
 	useuinput = options_getboolean("lircmd:uinput");
 	nodaemon = options_getboolean("lircmd:nodaemon");
 	configfile = options_getstring("lircmd:configfile");
+	motion.rate = options_getint("lircmd:rate");
 	lirc_log_open("lircmd", nodaemon, loglevel_opt);
+	if (motion.rate < 0 || motion.rate > 1000) {
+		fprintf(stderr, "%s: bad rate %d, must be 0..1000\n",
+			progname, motion.rate);
+		exit(EXIT_FAILURE);
+	}
 
 	/* connect to lircd */
 	lircd = socket(AF_UNIX, SOCK_STREAM, 0);
@@ -945,6 +1149,15 @@ int main(int argc, char** argv)
 		ms = new_ms;
 	}
 
+	if (motion.rate > 0) {
+		motion.fd = timerfd_create(CLOCK_MONOTONIC,
+					   TFD_NONBLOCK | TFD_CLOEXEC);
+		if (motion.fd == -1) {
+			perror("could not create motion timer");
+			exit(EXIT_FAILURE);
+		}
+	}
+
 	if (!nodaemon)
 		daemonize();
 	signal(SIGPIPE, SIG_IGN);
@@ -31,15 +31,21 @@
 #include <sys/types.h>
 #include <syslog.h>
 
-#include <string>
-#include <deque>
-
 #include "lirc_client.h"
 #include "lirc/lirc_log.h"
 
 #define MAX_CLIENTS 100
 #define WHITE_SPACE " \t"
 
+/* Size of the per-client command buffer, a command must fit in PACKET_SIZE. */
+#define IN_BUF_SIZE (4 * PACKET_SIZE)
+
+/* Initial size of the per-client reply buffer, grows if needed. */
+#define OUT_BUF_SIZE (4 * PACKET_SIZE)
+
+/* Initial number of pending strings per client, grows if needed. */
+#define PENDING_SIZE 16
+
 static const logchannel_t logchannel = LOG_APP;
 
 struct config_info {
@@ -53,12 +59,25 @@ struct event_info {
 	struct event_info*	next;
 };
 
+/**
+ * Per client state. All buffers are allocated when the client connects
+ * and reused for all its requests.
+ */
 struct client_data {
 	int			fd;
 	char*			ident_string;
-	std::deque<std::string> pending_codes;
-	std::deque<std::string> pending_strings;
-	std::string             last_code;
+	char			in[IN_BUF_SIZE + 1];    /**< Unprocessed input. */
+	int			in_len;
+	char*			out;                    /**< Unsent replies. */
+	int			out_pos;
+	int			out_len;
+	int			out_size;
+	/** Strings for last_code not yet sent, owned by config. */
+	const char**		pending;
+	int			pending_pos;
+	int			pending_count;
+	int			pending_size;
+	char			last_code[PACKET_SIZE + 1];
 };
 
 struct protocol_directive {
@@ -66,11 +85,6 @@ struct protocol_directive {
 	int (*function)(int fd, char* message, char* arguments);
 };
 
-struct pfd_byname{
-	struct pollfd sockfd;
-	struct pollfd clis[MAX_CLIENTS];
-};
-
 
 static int code_func(int fd, char* message, char* arguments);
 static int ident_func(int fd, char* message, char* arguments);
@@ -113,7 +127,13 @@ const char* const protocol_string[] = {
 static sig_atomic_t term = 0;
 static int termsig;
 static int clin = 0;
-static struct client_data clis[MAX_CLIENTS];
+static struct client_data* clis[MAX_CLIENTS];
+
+/** Listening socket followed by clis[i] at pfds[i + 1]. */
+static struct pollfd pfds[MAX_CLIENTS + 1];
+
+/** Client whose commands are being processed, its replies are buffered. */
+static struct client_data* current = NULL;
 
 static int daemonized = 0;
 
@@ -127,7 +147,7 @@ static int get_client_index(int fd)
 	int i;
 
 	for (i = 0; i < clin; i++)
-		if (fd == clis[i].fd)
+		if (fd == clis[i]->fd)
 			return i;
 	/* shouldn't ever happen */
 	return -1;
@@ -153,12 +173,41 @@ static int oatoi(const char* s)
 	return i;
 }
 
+/** Make room for len more bytes in the reply buffer of cli. */
+static int reserve_output(struct client_data* cli, int len)
+{
+	char* out;
+	int size;
+
+	if (cli->out_len + len <= cli->out_size)
+		return 1;
+	size = cli->out_size;
+	while (size < cli->out_len + len)
+		size *= 2;
+	out = (char*)realloc(cli->out, size);
+	if (out == NULL)
+		return 0;
+	cli->out = out;
+	cli->out_size = size;
+	return 1;
+}
+
 /* A safer write(), since sockets might not write all but only some of the
- * bytes requested */
+ * bytes requested. Replies to the current client are buffered and sent
+ * by flush_client(). */
 inline int write_socket(int fd, const char* buf, int len)
 {
 	int done, todo = len;
 
+	if (current != NULL && current->fd == fd) {
+		if (!reserve_output(current, len)) {
+			log_error("out of memory");
+			return -1;
+		}
+		memcpy(current->out + current->out_len, buf, len);
+		current->out_len += len;
+		return len;
+	}
 	while (todo) {
 		done = write(fd, buf, todo);
 		if (done <= 0)
@@ -179,41 +228,6 @@ inline int write_socket_len(int fd, const char* buf)
 	return 1;
 }
 
-inline int read_timeout(int fd, char* buf, int len, int timeout_us)
-{
-	int ret, n;
-	struct pollfd  pfd = {fd, POLLIN, 0}; // fd, events, revents
-	int timeout = timeout_us > 0 ? timeout_us/1000 : -1;
-
-	/* CAVEAT: (from libc documentation)
-	 * Any signal will cause `select' to return immediately.  So if your
-	 * program uses signals, you can't rely on `select' to keep waiting
-	 * for the full time specified.  If you want to be sure of waiting
-	 * for a particular amount of time, you must check for `EINTR' and
-	 * repeat the `select' with a newly calculated timeout based on the
-	 * current time.  See the example below.
-	 *
-	 * The timeout is not recalculated here although it should, we keep
-	 * waiting as long as there are EINTR.
-	 */
-
-	do
-		ret = curl_poll(&pfd, 1, timeout * 1000);
-	while (ret == -1 && errno == EINTR);
-	if (ret == -1) {
-		log_perror_err("read_timeout, curl_poll() failed");
-		return -1;
-	};
-	if (ret == 0)
-		return 0;       /* timeout */
-	n = read(fd, buf, len);
-	if (n == -1) {
-		log_perror_err("read_timeout: read() failed");
-		return -1;
-	}
-	return n;
-}
-
 static void sigterm(int sig)
 {
 	/* all signals are blocked now */
@@ -231,18 +245,45 @@ static void nolinger(int sock)
 	setsockopt(sock, SOL_SOCKET, SO_LINGER, (void*)&linger, lsize);
 }
 
+static void free_client(struct client_data* cli)
+{
+	if (cli->ident_string)
+		free(cli->ident_string);
+	free(cli->out);
+	free(cli->pending);
+	free(cli);
+}
+
+static struct client_data* new_client(int fd)
+{
+	struct client_data* cli;
+
+	cli = (struct client_data*)calloc(1, sizeof(struct client_data));
+	if (cli == NULL)
+		return NULL;
+	cli->fd = fd;
+	cli->out = (char*)malloc(OUT_BUF_SIZE);
+	cli->out_size = OUT_BUF_SIZE;
+	cli->pending = (const char**)malloc(PENDING_SIZE * sizeof(char*));
+	cli->pending_size = PENDING_SIZE;
+	if (cli->out == NULL || cli->pending == NULL) {
+		free_client(cli);
+		return NULL;
+	}
+	return cli;
+}
+
 static void remove_client(int i)
 {
-	shutdown(clis[i].fd, 2);
-	close(clis[i].fd);
-	if (clis[i].ident_string)
-		free(clis[i].ident_string);
+	shutdown(clis[i]->fd, 2);
+	close(clis[i]->fd);
+	free_client(clis[i]);
 
 	log_trace("removed client");
 
 	clin--;
-	for (; i < clin; i++)
-		clis[i] = clis[i + 1];
+	clis[i] = clis[clin];
+	pfds[i + 1] = pfds[clin + 1];
 }
 
 void add_client(int sock)
@@ -266,13 +307,21 @@ void add_client(int sock)
 		close(fd);
 		return;
 	}
+	clis[clin] = new_client(fd);
+	if (clis[clin] == NULL) {
+		log_error("out of memory, connection rejected");
+		shutdown(fd, 2);
+		close(fd);
+		return;
+	}
 	nolinger(fd);
 	flags = fcntl(fd, F_GETFL, 0);
 	if (flags != -1)
 		fcntl(fd, F_SETFL, flags | O_NONBLOCK);
         log_trace2( "accepted new client");
-	clis[clin].fd = fd;
-	clis[clin].ident_string = NULL;
+	pfds[clin + 1].fd = fd;
+	pfds[clin + 1].events = POLLIN;
+	pfds[clin + 1].revents = 0;
 	clin++;
 }
 
@@ -348,54 +397,70 @@ opensocket_failed:
 }
 
 
+/** Queue a string for the client, see code_func(). */
+static int add_pending(struct client_data* cli, const char* s)
+{
+	const char** pending;
+
+	if (cli->pending_count == cli->pending_size) {
+		pending = (const char**)realloc(cli->pending,
+						2 * cli->pending_size
+						* sizeof(char*));
+		if (pending == NULL)
+			return 0;
+		cli->pending = pending;
+		cli->pending_size *= 2;
+	}
+	cli->pending[cli->pending_count++] = s;
+	return 1;
+}
+
+
 static int code_func(int fd, char* message, char* arguments)
 {
+	struct client_data* cli;
 	int index;
+	char* prog;
+	char* s;
+	int r;
 
 	if (arguments == NULL)
 		return send_error(fd, message, "protocol error\n");
 	index = get_client_index(fd);
 	if (index == -1)
 		return send_error(fd, message, "identify yourself first!\n");
-	log_trace2("%s asking for code -%s-", clis[index].ident_string, arguments);
+	cli = clis[index];
+	log_trace2("%s asking for code -%s-", cli->ident_string, arguments);
 
-	if (clis[index].last_code == arguments) {
+	if (strcmp(cli->last_code, arguments) == 0) {
 		// client checking for more strings
-		if (!clis[index].pending_strings.empty()) {
-			std::string s = clis[index].pending_strings.front();
-			clis[index].pending_strings.pop_front();
-			return send_result(fd, message, s.c_str());
-		} else {
-			clis[index].last_code = "A never used code";
-			return send_success(fd, message);
-		}
+		if (cli->pending_pos < cli->pending_count)
+			return send_result(fd, message,
+					   cli->pending[cli->pending_pos++]);
+		cli->last_code[0] = '\0';
+		return send_success(fd, message);
 	}
-	clis[index].last_code = arguments;
-	clis[index].pending_codes.push_back(arguments);
+	strcpy(cli->last_code, arguments);
+	cli->pending_pos = 0;
+	cli->pending_count = 0;
 
-	const char* const_code = clis[index].pending_codes.front().c_str();
-	char* var_code = strdup(const_code);
-	char* prog = clis[index].ident_string;
-	char* s;
-	int r;
-
-	clis[index].pending_codes.pop_front();
+	/*
+	 * Strings returned by lirc_code2charprog() belong to config which
+	 * is never reloaded, so just keep the pointers.
+	 */
+	prog = cli->ident_string;
 	while (true) {
-		r = lirc_code2charprog(config, var_code, &s, &prog);
-		if ( r != 0 || s == NULL || *s == '\0')
+		r = lirc_code2charprog(config, arguments, &s, &prog);
+		if (r != 0 || s == NULL || *s == '\0')
 			break;
-		clis[index].pending_strings.push_back(s);
+		if (!add_pending(cli, s))
+			return send_error(fd, message, "out of memory\n");
 	}
-	free(var_code);
-	if ( r != 0 ) {
-		return send_error(fd, message, "Cannor decode: %s", arguments);
-	} else if (clis[index].pending_strings.size() == 0) {
+	if (r != 0)
+		return send_error(fd, message, "Cannot decode: %s\n", arguments);
+	if (cli->pending_count == 0)
 		return send_success(fd, message);
-	} else {
-		std::string s = clis[index].pending_strings.front();
-		clis[index].pending_strings.pop_front();
-		return send_result(fd, message, s.c_str());
-	}
+	return send_result(fd, message, cli->pending[cli->pending_pos++]);
 }
 
 
@@ -407,13 +472,13 @@ static int ident_func(int fd, char* message, char* arguments)
 		return send_error(fd, message, "protocol error\n");
 	log_trace1("IDENT %s", arguments);
 	index = get_client_index(fd);
-	if (clis[index].ident_string != NULL)
+	if (clis[index]->ident_string != NULL)
 		return send_error(fd, message, "protocol error\n");
-	clis[index].ident_string = strdup(arguments);
-	if (clis[index].ident_string == NULL)
+	clis[index]->ident_string = strdup(arguments);
+	if (clis[index]->ident_string == NULL)
 		return send_error(fd, message, "out of memory\n");
 
-	log_trace("%s connected", clis[index].ident_string);
+	log_trace("%s connected", clis[index]->ident_string);
 	return send_success(fd, message);
 }
 
@@ -511,125 +576,155 @@ static int send_error(int fd, char* message, const char* format_str, ...)
 }
 
 
-static int get_command(int fd)
+/** Run a single command line, without the trailing newline. */
+static int run_command(int fd, char* line)
 {
-	int length;
-	char buffer[PACKET_SIZE + 1], backup[PACKET_SIZE + 1];
-	char* end;
-	int packet_length, i;
+	char backup[PACKET_SIZE + 1];
 	char* directive;
+	int i;
+
+	log_trace("received command: \"%s\"", line);
+	strcpy(backup, line);
+	strcat(backup, "\n");
+	directive = strtok(line, WHITE_SPACE);
+	if (directive == NULL)
+		return send_error(fd, backup, "bad send packet\n");
+	for (i = 0; directives[i].name != NULL; i++)
+		if (strcasecmp(directive, directives[i].name) == 0)
+			return directives[i].function(fd, backup, strtok(NULL, ""));
+	return send_error(fd, backup, "unknown directive: \"%s\"\n", directive);
+}
 
-	length = read_timeout(fd, buffer, PACKET_SIZE, 0);
-	packet_length = 0;
-	while (length > packet_length) {
-		buffer[length] = 0;
-		end = strchr(buffer, '\n');
-		if (end == NULL) {
-			log_error("bad send packet: \"%s\"", buffer);
-			/* remove clients that behave badly */
-			return 0;
-		}
-		end[0] = 0;
-		log_trace("received command: \"%s\"", buffer);
-		packet_length = strlen(buffer) + 1;
-
-		strcpy(backup, buffer);
-		strcat(backup, "\n");
-		directive = strtok(buffer, WHITE_SPACE);
-		if (directive == NULL) {
-			if (!send_error(fd, backup, "bad send packet\n"))
-				return 0;
-			goto skip;
-		}
-		for (i = 0; directives[i].name != NULL; i++) {
-			if (strcasecmp(directive, directives[i].name) == 0) {
-				if (!directives[i].function(fd, backup, strtok(NULL, "")))
-					return 0;
-				goto skip;
-			}
-		}
 
-		if (!send_error(fd, backup, "unknown directive: \"%s\"\n", directive))
+/**
+ * Send buffered replies to client. Returns 0 if the client should be
+ * removed, else 1; unsent data is left in the buffer when the socket
+ * is full.
+ */
+static int flush_client(struct client_data* cli)
+{
+	int done;
+
+	while (cli->out_pos < cli->out_len) {
+		done = write(cli->fd,
+			     cli->out + cli->out_pos,
+			     cli->out_len - cli->out_pos);
+		if (done == -1 && errno == EINTR)
+			continue;
+		if (done == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return 1;
+		if (done <= 0)
 			return 0;
-skip:
-		if (length > packet_length) {
-			int new_length;
-
-			memmove(buffer, buffer + packet_length, length - packet_length + 1);
-			if (strchr(buffer, '\n') == NULL) {
-				new_length = read_timeout(fd, buffer + length -
-							  packet_length, PACKET_SIZE - (length - packet_length), 5);
-				if (new_length > 0)
-					length = length - packet_length + new_length;
-				else
-					length = new_length;
-			} else {
-				length -= packet_length;
-			}
-			packet_length = 0;
-		}
+		cli->out_pos += done;
 	}
+	cli->out_pos = 0;
+	cli->out_len = 0;
+	return 1;
+}
+
 
+/**
+ * Read available data from client and run all complete commands, the
+ * replies are sent using a single write. Returns 0 if the client should
+ * be removed, else 1.
+ */
+static int get_commands(struct client_data* cli)
+{
+	char* line;
+	char* end;
+	int length;
+	int r = 1;
+
+	do
+		length = read(cli->fd,
+			      cli->in + cli->in_len,
+			      IN_BUF_SIZE - cli->in_len);
+	while (length == -1 && errno == EINTR);
+	if (length == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return 1;
+	if (length == -1) {
+		log_perror_err("get_commands: read() failed");
+		return 0;
+	}
 	if (length == 0)        /* EOF: connection closed by client */
 		return 0;
-	return 1;
+	cli->in_len += length;
+	cli->in[cli->in_len] = '\0';
+
+	line = cli->in;
+	current = cli;
+	while (r) {
+		end = (char*)memchr(line, '\n', cli->in + cli->in_len - line);
+		if (end == NULL)
+			break;
+		if (end - line >= PACKET_SIZE) {
+			log_error("bad send packet: command too long");
+			r = 0;
+			break;
+		}
+		*end = '\0';
+		r = run_command(cli->fd, line);
+		line = end + 1;
+	}
+	current = NULL;
+	if (!r)
+		return 0;
+	cli->in_len -= line - cli->in;
+	if (cli->in_len >= PACKET_SIZE) {
+		/* remove clients that behave badly */
+		log_error("bad send packet: \"%.*s\"", PACKET_SIZE, line);
+		return 0;
+	}
+	memmove(cli->in, line, cli->in_len);
+	return flush_client(cli);
 }
 
 
-
 static void loop(int sockfd)
 {
-	static const int POLLFDS_SIZE =
-		sizeof(struct pfd_byname) / sizeof(struct pollfd);
-	union {
-		struct pfd_byname byname;
-		struct pollfd byindex[POLLFDS_SIZE];
-	} poll_fds;
 	int i;
 	int ret;
 
+	pfds[0].fd = sockfd;
+	pfds[0].events = POLLIN;
 	while (1) {
-		do {
-			/* handle signals */
-			if (term) {
-				log_notice("caught signal");
-				return;
-			}
-			memset(&poll_fds, 0, sizeof(poll_fds));
-			for (i = 0; i < POLLFDS_SIZE; i += 1)
-				poll_fds.byindex[i].fd = -1;
-			poll_fds.byname.sockfd.fd = sockfd;
-			poll_fds.byname.sockfd.events = POLLIN;
-
-			for (i = 0; i < clin; i++) {
-				poll_fds.byname.clis[i].fd = clis[i].fd;
-				poll_fds.byname.clis[i].events = POLLIN;
-			}
-			log_trace2("poll");
-			ret = curl_poll((struct pollfd*) &poll_fds.byindex,
-				         POLLFDS_SIZE,
-				         0);
-			if (ret == -1 && errno != EINTR) {
+		/* handle signals */
+		if (term) {
+			log_notice("caught signal");
+			return;
+		}
+		/* Don't read more commands until replies are sent. */
+		for (i = 0; i < clin; i++)
+			pfds[i + 1].events =
+				clis[i]->out_len > 0 ? POLLOUT : POLLIN;
+		log_trace2("poll");
+		ret = curl_poll(pfds, clin + 1, -1);
+		if (ret == -1) {
+			if (errno != EINTR) {
 				log_perror_err("loop: curl_poll() failed");
 				raise(SIGTERM);
-				continue;
 			}
-		} while (ret == -1 && errno == EINTR);
+			continue;
+		}
 
 		for (i = 0; i < clin; i++) {
-			if (poll_fds.byname.clis[i].revents & POLLIN) {
-				poll_fds.byname.clis[i].revents	= 0;
-				if (get_command(clis[i].fd) == 0) {
-					remove_client(i);
-					i--;
-					if (clin == 0) {
-						log_info("last client disconnected, shutting down");
-						return;
-					}
+			if (pfds[i + 1].revents == 0)
+				continue;
+			if (pfds[i + 1].revents & POLLOUT)
+				ret = flush_client(clis[i]);
+			else
+				ret = get_commands(clis[i]);
+			pfds[i + 1].revents = 0;
+			if (ret == 0) {
+				remove_client(i);
+				i--;
+				if (clin == 0) {
+					log_info("last client disconnected, shutting down");
+					return;
 				}
 			}
 		}
-		if (poll_fds.byname.sockfd.revents & POLLIN) {
+		if (pfds[0].revents & POLLIN) {
 			log_trace("registering local client");
 			add_client(sockfd);
 		}
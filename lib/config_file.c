@@ -51,7 +51,8 @@
 
 static const logchannel_t logchannel = LOG_LIB;
 
-enum directive { ID_none, ID_remote, ID_codes, ID_raw_codes, ID_raw_name };
+enum directive { ID_none, ID_remote, ID_codes, ID_raw_codes, ID_raw_name,
+		 ID_lazy_codes };
 
 struct ptr_array {
 	void**	ptr;
@@ -78,6 +79,7 @@ const char* whitespace = " \t";
 
 static int line;
 static int parse_error;
+static int lazy_codes = 0;
 
 static struct ir_remote* read_config_recursive(FILE* f, const char* name, int depth);
 static void calculate_signal_lengths(struct ir_remote* remote);
@@ -622,11 +624,30 @@ int defineRemote(char* key, char* val, char* val2, struct ir_remote* rem)
 	return 0;
 }
 
-static int sanityChecks(struct ir_remote* rem, const char* path)
+/** Mask codes in rem which don't fit in rem->bits, with a warning. */
+static void check_codes(struct ir_remote* rem, const char* path)
 {
 	struct ir_ncode* codes;
 	struct ir_code_node* node;
 
+	for (codes = rem->codes; codes->name != NULL; codes++) {
+		if ((codes->code & gen_mask(rem->bits)) != codes->code) {
+			log_warn("%s: %s: Invalid code : %s",
+				  path, rem->name, codes->name);
+			codes->code &= gen_mask(rem->bits);
+		}
+		for (node = codes->next; node != NULL; node = node->next) {
+			if ((node->code & gen_mask(rem->bits)) != node->code) {
+				log_warn("%s: %s: Invalid code %s: %s",
+					  path, rem->name, codes->name);
+				node->code &= gen_mask(rem->bits);
+			}
+		}
+	}
+}
+
+static int sanityChecks(struct ir_remote* rem, const char* path)
+{
 	path = path != NULL ? path : "unknown file";
 
 	if (!rem->name) {
@@ -659,20 +680,7 @@ static int sanityChecks(struct ir_remote* rem, const char* path)
 		log_error("%s: %s: No codes", path, rem->name);
 		return 0;
 	}
-	for (codes = rem->codes; codes->name != NULL; codes++) {
-		if ((codes->code & gen_mask(rem->bits)) != codes->code) {
-			log_warn("%s: %s: Invalid code : %s",
-				  path, rem->name, codes->name);
-			codes->code &= gen_mask(rem->bits);
-		}
-		for (node = codes->next; node != NULL; node = node->next) {
-			if ((node->code & gen_mask(rem->bits)) != node->code) {
-				log_warn("%s: %s: Invalid code %s: %s",
-					  path, rem->name, codes->name);
-				node->code &= gen_mask(rem->bits);
-			}
-		}
-	}
+	check_codes(rem, path);
 	return 1;
 }
 
@@ -840,6 +848,8 @@ struct ir_remote* read_config(FILE* f, const char* name)
 
 	head = read_config_recursive(f, name, 0);
 	head = sort_by_bit_count(head);
+	if (head != NULL && head != (void*)-1)
+		ir_remote_index_build(head);
 	return head;
 }
 
@@ -919,6 +929,81 @@ static struct ir_remote* read_all_included(const char*		name,
 }
 
 
+/**
+ * Strip trailing newline and carriage return from a line read by fgets().
+ * Returns 0 if the line is too long, else 1.
+ */
+static int chop_line(char* buf)
+{
+	int len;
+
+	len = strlen(buf);
+	if (len == LINE_LEN && buf[len - 1] != '\n') {
+		log_error("line %d too long in config file", line);
+		return 0;
+	}
+	if (len > 0) {
+		len--;
+		if (buf[len] == '\n')
+			buf[len] = 0;
+	}
+	if (len > 0) {
+		len--;
+		if (buf[len] == '\r')
+			buf[len] = 0;
+	}
+	return 1;
+}
+
+
+/** Set initial toggle_bit_mask_state from the first code. */
+static void init_toggle_bit_mask_state(struct ir_remote* rem)
+{
+	if (has_toggle_bit_mask(rem)) {
+		if (!is_raw(rem) && rem->codes && rem->lazy_codes == NULL) {
+			rem->toggle_bit_mask_state = (rem->codes->code & rem->toggle_bit_mask);
+			if (rem->toggle_bit_mask_state)
+				/* start with state set to 0 for backwards compatibility */
+				rem->toggle_bit_mask_state ^= rem->toggle_bit_mask;
+		}
+	}
+}
+
+
+/**
+ * Record the position of the codes block following the current line in
+ * f instead of parsing it, see ir_remote_load_codes(). rem gets an empty
+ * list of codes until then. *path caches the absolute path for name.
+ * Returns 1 if the codes are deferred, else 0.
+ */
+static int defer_codes(struct ir_remote*	rem,
+		       FILE*			f,
+		       const char*		name,
+		       char**			path)
+{
+	long offset;
+
+	if (!lazy_codes || name == NULL)
+		return 0;
+	offset = ftell(f);
+	if (offset < 0)
+		return 0;
+	if (*path == NULL) {
+		*path = realpath(name, NULL);
+		if (*path == NULL)
+			return 0;
+	}
+	rem->lazy_codes = s_malloc(sizeof(struct ir_lazy_codes));
+	rem->codes = s_malloc(sizeof(struct ir_ncode));
+	if (rem->lazy_codes == NULL || rem->codes == NULL)
+		return 0;
+	rem->lazy_codes->path = s_strdup(*path);
+	rem->lazy_codes->offset = offset;
+	rem->lazy_codes->line = line;
+	return 1;
+}
+
+
 static void check_ncode_dups(const char* path,
 			     const char* name,
 			     struct void_array* ar,
@@ -942,7 +1027,8 @@ read_config_recursive(FILE* f, const char* name, int depth)
 	char* key;
 	char* val;
 	char* val2;
-	int len, argc;
+	char* path = NULL;
+	int argc;
 	struct ir_remote* top_rem = NULL;
 	struct ir_remote* rem = NULL;
 	struct void_array codes_list, raw_codes, signals;
@@ -957,23 +1043,10 @@ read_config_recursive(FILE* f, const char* name, int depth)
 
 	while (fgets(buf, LINE_LEN, f) != NULL) {
 		line++;
-		len = strlen(buf);
-		if (len == LINE_LEN && buf[len - 1] != '\n') {
-			log_error("line %d too long in config file", line);
+		if (!chop_line(buf)) {
 			parse_error = 1;
 			break;
 		}
-
-		if (len > 0) {
-			len--;
-			if (buf[len] == '\n')
-				buf[len] = 0;
-		}
-		if (len > 0) {
-			len--;
-			if (buf[len] == '\r')
-				buf[len] = 0;
-		}
 		/* ignore comments */
 		if (buf[0] == '#')
 			continue;
@@ -982,6 +1055,13 @@ read_config_recursive(FILE* f, const char* name, int depth)
 		if (key == NULL)
 			continue;
 		val = strtok(NULL, whitespace);
+		if (mode == ID_lazy_codes) {
+			/* skip deferred codes, see defer_codes() */
+			if (strcasecmp("end", key) == 0
+			    && val != NULL && strcasecmp("codes", val) == 0)
+				mode = ID_remote;
+			continue;
+		}
 		if (val != NULL) {
 			val2 = strtok(NULL, whitespace);
 			log_trace2("Tokens: \"%s\" \"%s\" \"%s\"", key, val, (val2 == NULL ? "(null)" : val));
@@ -1005,9 +1085,13 @@ read_config_recursive(FILE* f, const char* name, int depth)
 						parse_error = 1;
 						break;
 					}
-
-					init_void_array(&codes_list, 30, sizeof(struct ir_ncode));
-					mode = ID_codes;
+					if (defer_codes(rem, f, name, &path)) {
+						mode = ID_lazy_codes;
+					} else if (!parse_error) {
+						init_void_array(&codes_list, 30,
+								sizeof(struct ir_ncode));
+						mode = ID_codes;
+					}
 				} else if (strcasecmp("raw_codes", val) == 0) {
 					/* init raw_codes mode */
 					log_trace1("    begin raw_codes");
@@ -1232,12 +1316,15 @@ read_config_recursive(FILE* f, const char* name, int depth)
 		case ID_codes:
 			rem->codes = get_void_array(&codes_list);
 			break;
+		case ID_lazy_codes:
+			break;
 		}
 		if (!parse_error) {
 			log_error("unexpected end of file");
 			parse_error = 1;
 		}
 	}
+	free(path);
 	if (parse_error) {
 		static int print_error = 1;
 
@@ -1267,6 +1354,8 @@ read_config_recursive(FILE* f, const char* name, int depth)
 				codes->code = reverse(codes->code, rem->bits);
 				codes++;
 			}
+			if (rem->lazy_codes != NULL)
+				rem->lazy_codes->reverse = 1;
 			rem->flags = rem->flags & (~REVERSE);
 			rem->flags = rem->flags | COMPAT_REVERSE;
 			/* don't delete the flag because we still need
@@ -1288,14 +1377,7 @@ read_config_recursive(FILE* f, const char* name, int depth)
 			}
 			rem->toggle_bit = 0;
 		}
-		if (has_toggle_bit_mask(rem)) {
-			if (!is_raw(rem) && rem->codes) {
-				rem->toggle_bit_mask_state = (rem->codes->code & rem->toggle_bit_mask);
-				if (rem->toggle_bit_mask_state)
-					/* start with state set to 0 for backwards compatibility */
-					rem->toggle_bit_mask_state ^= rem->toggle_bit_mask;
-			}
-		}
+		init_toggle_bit_mask_state(rem);
 		if (is_serial(rem)) {
 			lirc_t base;
 
@@ -1316,12 +1398,134 @@ read_config_recursive(FILE* f, const char* name, int depth)
 			}
 		}
 		calculate_signal_lengths(rem);
+		ir_code_table_build(rem);
 		rem = rem->next;
 	}
 
 	return top_rem;
 }
 
+void read_config_lazy(int lazy)
+{
+	lazy_codes = lazy;
+}
+
+
+/** Free the names and sequences of codes, and codes itself. */
+static void free_codes(struct ir_ncode* codes)
+{
+	struct ir_ncode* code;
+	struct ir_code_node* node;
+	struct ir_code_node* next;
+
+	for (code = codes; code->name != NULL; code++) {
+		free(code->name);
+		for (node = code->next; node != NULL; node = next) {
+			next = node->next;
+			free(node);
+		}
+	}
+	free(codes);
+}
+
+
+/** Parse the lines up to "end codes" in f, return codes or NULL. */
+static struct ir_ncode* parse_lazy_codes(FILE*			f,
+					 const struct ir_remote* rem)
+{
+	char buf[LINE_LEN + 1];
+	struct void_array codes_list;
+	struct ir_ncode name_code = { NULL, 0, 0, NULL };
+	struct ir_ncode* code;
+	char* key;
+	char* val;
+	char* val2;
+
+	if (init_void_array(&codes_list, 30, sizeof(struct ir_ncode)) == NULL)
+		return NULL;
+	while (!parse_error && fgets(buf, LINE_LEN, f) != NULL) {
+		line++;
+		if (!chop_line(buf))
+			break;
+		if (buf[0] == '#')
+			continue;
+		key = strtok(buf, whitespace);
+		if (key == NULL)
+			continue;
+		val = strtok(NULL, whitespace);
+		if (val == NULL)
+			break;
+		if (strcasecmp("end", key) == 0 && strcasecmp("codes", val) == 0)
+			return get_void_array(&codes_list);
+		val2 = strtok(NULL, whitespace);
+		code = defineCode(key, val, &name_code);
+		while (!parse_error && val2 != NULL) {
+			if (val2[0] == '#')
+				break;  /* comment */
+			defineNode(code, val2);
+			val2 = strtok(NULL, whitespace);
+		}
+		code->current = NULL;
+		check_ncode_dups(rem->lazy_codes->path,
+				 rem->name,
+				 &codes_list,
+				 code);
+		add_void_array(&codes_list, code);
+	}
+	log_error("error in configfile line %d", line);
+	free_codes(get_void_array(&codes_list));
+	return NULL;
+}
+
+
+int ir_remote_load_codes(struct ir_remote* rem)
+{
+	struct ir_lazy_codes* lazy = rem->lazy_codes;
+	struct ir_ncode* codes = NULL;
+	struct ir_ncode* code;
+	FILE* f;
+
+	if (lazy == NULL)
+		return 0;
+	f = fopen(lazy->path, "r");
+	if (f == NULL) {
+		log_perror_err("Cannot open %s", lazy->path);
+	} else {
+		line = lazy->line;
+		parse_error = 0;
+		if (fseek(f, lazy->offset, SEEK_SET) == 0)
+			codes = parse_lazy_codes(f, rem);
+		fclose(f);
+	}
+	rem->lazy_codes = NULL;
+	if (codes == NULL) {
+		/* Keep the empty codes, don't retry on every signal. */
+		log_error("Cannot load codes for remote %s from %s",
+			  rem->name, lazy->path);
+		free(lazy->path);
+		free(lazy);
+		return -1;
+	}
+	ir_code_table_free(rem);
+	free(rem->codes);
+	rem->codes = codes;
+	check_codes(rem, lazy->path);
+	if (lazy->reverse) {
+		for (code = codes; code->name != NULL; code++)
+			code->code = reverse(code->code, rem->bits);
+	}
+	init_toggle_bit_mask_state(rem);
+	calculate_signal_lengths(rem);
+	ir_code_table_build(rem);
+	ir_remote_index_invalidate();
+	log_debug("Loaded codes for remote %s from %s:%d",
+		  rem->name, lazy->path, lazy->line);
+	free(lazy->path);
+	free(lazy);
+	return 0;
+}
+
+
 void calculate_signal_lengths(struct ir_remote* remote)
 {
 	if (is_const(remote)) {
@@ -1403,6 +1607,7 @@ void calculate_signal_lengths(struct ir_remote* remote)
 	}
 	log_trace("lengths: %lu %lu %lu %lu", remote->min_total_signal_length, remote->max_total_signal_length,
 		  remote->min_gap_length, remote->max_gap_length);
+	ir_remote_update_bounds(remote);
 }
 
 void free_config(struct ir_remote* remotes)
@@ -1410,6 +1615,8 @@ void free_config(struct ir_remote* remotes)
 	struct ir_remote* next;
 	struct ir_ncode* codes;
 
+	send_cache_clear();
+	ir_remote_index_free(remotes);
 	while (remotes != NULL) {
 		next = remotes->next;
 
@@ -1417,25 +1624,32 @@ void free_config(struct ir_remote* remotes)
 			free(remotes->dyncodes_name);
 		if (remotes->name != NULL)
 			free((void*)(remotes->name));
+		if (remotes->lazy_codes != NULL) {
+			free(remotes->lazy_codes->path);
+			free(remotes->lazy_codes);
+		}
 		if (remotes->codes != NULL) {
 			codes = remotes->codes;
 			while (codes->name != NULL) {
 				struct ir_code_node* node;
 				struct ir_code_node* next_node;
 
-				free(codes->name);
+				if (!ir_code_table_owns(remotes, codes->name))
+					free(codes->name);
 				if (codes->signals != NULL)
 					free(codes->signals);
 				node = codes->next;
 				while (node) {
 					next_node = node->next;
-					free(node);
+					if (!ir_code_table_owns(remotes, node))
+						free(node);
 					node = next_node;
 				}
 				codes++;
 			}
 			free(remotes->codes);
 		}
+		ir_code_table_free(remotes);
 		free(remotes);
 		remotes = next;
 	}
@@ -39,6 +39,21 @@ struct ir_remote* read_config(FILE* f, const char* name);
 /** Free() an ir_remote instance obtained using read_config(). */
 void free_config(struct ir_remote* remotes);
 
+/**
+ * Set lazy mode for subsequent read_config() calls. In lazy mode the
+ * "begin codes" blocks are not parsed. Instead, the remotes get an empty
+ * list of codes and the location of the block, which is parsed by
+ * ir_remote_load_codes() on first use. Raw codes are always parsed.
+ */
+void read_config_lazy(int lazy);
+
+/**
+ * Parse the deferred codes of a remote read in lazy mode, a no-op for
+ * other remotes. Returns 0 on success, else -1 leaving the remote without
+ * codes.
+ */
+int ir_remote_load_codes(struct ir_remote* remote);
+
 /** @} */
 
 #ifdef __cplusplus
@@ -39,6 +39,12 @@
 /** Testable flag for get_server_version() presence. */
 #define HAVE_SERVER_VERSION 1
 
+/**
+ * Driver feature flag, not used by the kernel: readdata() may run in a
+ * reader thread, see rec_reader_start().
+ */
+#define LIRC_CAN_USE_READER_THREAD      0x00008000
+
 /** Return numeric server version, m.v.r => 10000 * m + 100 * v + r. */
 int get_server_version(void);
 
@@ -108,6 +114,30 @@ int drv_handle_options(const char* options);
 
 #define DRVCTL_NOTIFY_DECODE            7
 
+/**
+ * Drvctl cmd: start a send batch, arg is unused. Until
+ * DRVCTL_END_SEND_BATCH, send_func() only queues the frames. They are
+ * sent with each remote's min_remaining_gap in between, extended by
+ * DRVCTL_SEND_SPACE, in as few device writes as possible.
+ */
+#define DRVCTL_BEGIN_SEND_BATCH         8
+
+/** Drvctl cmd: send the frames queued since DRVCTL_BEGIN_SEND_BATCH. */
+#define DRVCTL_END_SEND_BATCH           9
+
+/** Drvctl cmd: get receive counters, arg is a *struct drv_rec_stats. */
+#define DRVCTL_GET_REC_STATS            10
+
+/** Argument for DRVCTL_GET_REC_STATS, counters since init. */
+struct drv_rec_stats {
+	uint64_t	packets;        /**< Packets received. */
+	uint64_t	bytes;          /**< Bytes received. */
+	uint64_t	samples;        /**< Pulses and spaces received. */
+	uint64_t	batches;        /**< Reads, each one or more packets. */
+	uint64_t	dropped;        /**< Packets lost before being read. */
+	uint64_t	errors;         /**< Truncated or malformed packets. */
+};
+
 /** Last well-known command. Remaining is used in driver-specific controls.*/
 #define  DRVCTL_MAX                     128
 
@@ -217,7 +247,8 @@ struct driver {
 	 * @param timeout Max time to wait (us).
 	 * @return Length of pulse in lower 24 bits (us). PULSE_BIT
 	 * is set to reflect if this is a pulse or space. 0
-	 * indicates errors.
+	 * indicates errors. Drivers closing themselves on errors should
+	 * check rec_reader_read_error() first.
 	 */
 	lirc_t (*const readdata)(lirc_t timeout);
 
@@ -257,6 +288,22 @@ struct driver {
 	 *    - None          No device is silently configured.
 	 */
 	const char* const  device_hint;
+
+/* API version 5 addons: */
+	/**
+	 * Optional, NULL if not implemented. Like readdata(), but stores all
+	 * pulses and spaces which are available in one call, typically using
+	 * a single read(). Waits at most timeout us (0: forever) for the
+	 * first item, the remaining ones are stored only if they are
+	 * available without waiting.
+	 * @param buf Buffer for the data, each item formatted as returned by
+	 *     readdata().
+	 * @param max Number of items buf can hold, at least 1.
+	 * @param timeout Max time to wait for the first item (us).
+	 * @return Number of items stored, 0 on timeout or errors. Errors
+	 *     are handled as in readdata().
+	 */
+	int (*const readdata_batch)(lirc_t* buf, size_t max, lirc_t timeout);
 };
 
 /** @} */
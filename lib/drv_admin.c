@@ -12,8 +12,13 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <dirent.h>
 #include <dlfcn.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
 
 #ifdef HAVE_TERMIOS_H
 # include <termios.h>
@@ -28,6 +33,8 @@
 #include "lirc/drv_admin.h"
 #include "lirc/lirc_options.h"
 #include "lirc_log.h"
+#include "lirc_config.h"
+#include "paths.h"
 
 #include "driver.h"
 
@@ -50,6 +57,40 @@ typedef struct {
 /** Plugin currently in use, if non-NULL */
 static void* last_plugin = NULL;
 
+/** Format version written on first line of the plugin index file. */
+#define PLUGIN_INDEX_VERSION    1
+
+/** A driver in the plugin index: name, plugin path and basic metadata. */
+struct plugin_index_entry {
+	char*		name;
+	char*		path;
+	time_t		mtime;          /**< Modification time of path. */
+	unsigned int	features;
+	int		api_version;
+};
+
+/** A plugin directory covered by the index, with it's mtime. */
+struct plugin_index_dir {
+	char*		path;
+	time_t		mtime;
+};
+
+/**
+ * The plugin index: driver name -> plugin path for all drivers found in
+ * a given plugin search path. Lets hw_choose_driver() dlopen() just the
+ * plugin providing the driver instead of all of them. Persisted in a cache
+ * file, and refreshed when the mtime of a plugin directory changes.
+ */
+static struct {
+	char*				pluginpath;
+	struct plugin_index_dir*	dirs;
+	int				dir_count;
+	struct plugin_index_entry*	entries;
+	int				size;
+	int				capacity;
+	int				valid;
+} plugin_index = { NULL, NULL, 0, NULL, 0, 0, 0 };
+
 /** Default driver, a placeholder. */
 const struct driver drv_null = {
 	.name		= "null",
@@ -92,18 +133,16 @@ static int line_cmp(const void* arg1, const void* arg2)
 }
 
 
-/** hw_guest_func which adds name of driver to array in arg. */
-static struct driver* add_hw_name(struct driver* hw, void* arg)
+/** Add name of driver to array a, returns -1 if full, else 0. */
+static int add_hw_name(const char* name, char_array* a)
 {
-	char_array* a = (char_array*)arg;
-
 	if (a->size >= MAX_PLUGINS) {
 		log_error("Too many plugins(%d)", MAX_PLUGINS);
-		return hw;
+		return -1;
 	}
-	a->array[a->size] = strdup(hw->name);
+	a->array[a->size] = strdup(name);
 	a->size += 1;
-	return NULL;
+	return 0;
 }
 
 
@@ -185,6 +224,20 @@ static struct driver* for_each_plugin_in_dir(const char*	dirpath,
 }
 
 
+/** Return pluginpath_arg if non-NULL, else the configured plugin path. */
+static const char* get_pluginpath(const char* pluginpath_arg)
+{
+	const char* pluginpath;
+
+	if (pluginpath_arg != NULL)
+		return pluginpath_arg;
+	pluginpath = ciniparser_getstring(lirc_options,
+					  "lircd:plugindir",
+					  getenv(PLUGINDIR_VAR));
+	return pluginpath == NULL ? PLUGINDIR : pluginpath;
+}
+
+
 static struct driver* for_each_path(plugin_guest_func	plg_guest,
 				    drv_guest_func	drv_guest,
 				    void*		arg,
@@ -195,15 +248,7 @@ static struct driver* for_each_path(plugin_guest_func	plg_guest,
 	char* s;
 	struct driver* result = (struct driver*)NULL;
 
-	if (pluginpath_arg == NULL) {
-		pluginpath = ciniparser_getstring(lirc_options,
-						  "lircd:plugindir",
-						  getenv(PLUGINDIR_VAR));
-		if (pluginpath == NULL)
-			pluginpath = PLUGINDIR;
-	} else {
-		pluginpath = pluginpath_arg;
-	}
+	pluginpath = get_pluginpath(pluginpath_arg);
 	if (strchr(pluginpath, ':') == (char*)NULL) {
 		return for_each_plugin_in_dir(pluginpath,
 					      plg_guest,
@@ -240,6 +285,386 @@ void for_each_plugin(plugin_guest_func plugin_guest,
 }
 
 
+/** Free all data in plugin_index, leaving it empty and invalid. */
+static void plugin_index_clear(void)
+{
+	int i;
+
+	for (i = 0; i < plugin_index.size; i += 1) {
+		free(plugin_index.entries[i].name);
+		free(plugin_index.entries[i].path);
+	}
+	for (i = 0; i < plugin_index.dir_count; i += 1)
+		free(plugin_index.dirs[i].path);
+	free(plugin_index.entries);
+	free(plugin_index.dirs);
+	free(plugin_index.pluginpath);
+	memset(&plugin_index, 0, sizeof(plugin_index));
+}
+
+
+/** Add a driver to plugin_index. */
+static void plugin_index_add(const char*	name,
+			     const char*	path,
+			     time_t		mtime,
+			     unsigned int	features,
+			     int		api_version)
+{
+	struct plugin_index_entry* entry;
+	int capacity;
+
+	if (plugin_index.size >= plugin_index.capacity) {
+		capacity = plugin_index.capacity ? 2 * plugin_index.capacity : 64;
+		entry = realloc(plugin_index.entries,
+				capacity * sizeof(struct plugin_index_entry));
+		if (entry == NULL) {
+			log_error("plugin index: out of memory");
+			return;
+		}
+		plugin_index.entries = entry;
+		plugin_index.capacity = capacity;
+	}
+	entry = &plugin_index.entries[plugin_index.size];
+	entry->name = strdup(name);
+	entry->path = strdup(path);
+	entry->mtime = mtime;
+	entry->features = features;
+	entry->api_version = api_version;
+	plugin_index.size += 1;
+}
+
+
+/**
+ * Fill dirs with the directories in pluginpath and their mtime,
+ * return number of directories. Non-existing dirs gets mtime 0.
+ */
+static int get_plugin_dirs(const char*			pluginpath,
+			   struct plugin_index_dir**	dirs)
+{
+	struct stat st;
+	char* tmp_path;
+	char* s;
+	int count = 0;
+
+	*dirs = calloc(strlen(pluginpath) / 2 + 1,
+		       sizeof(struct plugin_index_dir));
+	if (*dirs == NULL)
+		return 0;
+	tmp_path = alloca(strlen(pluginpath) + 1);
+	strcpy(tmp_path, pluginpath);
+	for (s = strtok(tmp_path, ":"); s != NULL; s = strtok(NULL, ":")) {
+		(*dirs)[count].path = strdup(s);
+		(*dirs)[count].mtime = stat(s, &st) == 0 ? st.st_mtime : 0;
+		count += 1;
+	}
+	return count;
+}
+
+
+static void free_plugin_dirs(struct plugin_index_dir* dirs, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i += 1)
+		free(dirs[i].path);
+	free(dirs);
+}
+
+
+/** Return true if plugin_index is built from pluginpath with given dirs. */
+static int plugin_index_is_current(const char*			pluginpath,
+				   const struct plugin_index_dir*	dirs,
+				   int					count)
+{
+	int i;
+
+	if (!plugin_index.valid || plugin_index.pluginpath == NULL)
+		return 0;
+	if (strcmp(plugin_index.pluginpath, pluginpath) != 0)
+		return 0;
+	if (plugin_index.dir_count != count)
+		return 0;
+	for (i = 0; i < count; i += 1) {
+		if (strcmp(plugin_index.dirs[i].path, dirs[i].path) != 0)
+			return 0;
+		if (plugin_index.dirs[i].mtime != dirs[i].mtime)
+			return 0;
+	}
+	return 1;
+}
+
+
+/** mkdir -p path, returns 0 if path is an existing directory afterwards. */
+static int make_dirs(const char* path)
+{
+	char buff[MAXPATHLEN];
+	char* s;
+
+	strncpy(buff, path, sizeof(buff) - 1);
+	buff[sizeof(buff) - 1] = '\0';
+	for (s = strchr(buff + 1, '/'); s != NULL; s = strchr(s + 1, '/')) {
+		*s = '\0';
+		if (mkdir(buff, 0755) != 0 && errno != EEXIST)
+			return -1;
+		*s = '/';
+	}
+	if (mkdir(buff, 0755) != 0 && errno != EEXIST)
+		return -1;
+	return 0;
+}
+
+
+/**
+ * Return malloc'd path to the index file for pluginpath, or NULL if the
+ * index should not be persisted. The PLUGIN_INDEX_VAR environment variable
+ * overrides the default location, an empty value disables the cache file.
+ * The directory is created by plugin_index_write() when needed.
+ */
+static char* plugin_index_filename(const char* pluginpath)
+{
+	char dir[MAXPATHLEN];
+	char* path;
+	const char* s;
+	unsigned long hash = 5381;
+	int len;
+
+	s = getenv(PLUGIN_INDEX_VAR);
+	if (s != NULL)
+		return *s == '\0' ? NULL : strdup(s);
+	if (getuid() == 0)
+		len = snprintf(dir, sizeof(dir), "%s", PLUGIN_INDEX_DIR);
+	else if (getenv("XDG_CACHE_HOME") != NULL)
+		len = snprintf(dir, sizeof(dir),
+			       "%s/lirc", getenv("XDG_CACHE_HOME"));
+	else if (getenv("HOME") != NULL)
+		len = snprintf(dir, sizeof(dir),
+			       "%s/.cache/lirc", getenv("HOME"));
+	else
+		return NULL;
+	if (len < 0 || len >= (int)sizeof(dir)) {
+		log_debug("plugin index: cache directory path too long");
+		return NULL;
+	}
+	for (s = pluginpath; *s != '\0'; s += 1)
+		hash = hash * 33 + (unsigned char)*s;
+	path = malloc(len + sizeof("/plugins-ffffffff.index"));
+	if (path == NULL)
+		return NULL;
+	sprintf(path, "%s/plugins-%08lx.index", dir, hash & 0xffffffffUL);
+	return path;
+}
+
+
+/**
+ * Read the index file into plugin_index. Returns 0 on success, else -1
+ * with plugin_index cleared.
+ */
+static int plugin_index_read(const char* filename)
+{
+	FILE* f;
+	char line[2 * MAXPATHLEN];
+	char* tokens[6];
+	int count;
+	int version = 0;
+	struct plugin_index_dir* dir;
+
+	plugin_index_clear();
+	f = fopen(filename, "r");
+	if (f == NULL)
+		return -1;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (line[0] == '#')
+			continue;
+		for (count = 0; count < 6; count += 1) {
+			tokens[count] = strtok(count == 0 ? line : NULL, "\t\n");
+			if (tokens[count] == NULL)
+				break;
+		}
+		if (count == 2 && strcmp(tokens[0], "version") == 0) {
+			version = atoi(tokens[1]);
+		} else if (count == 2 && strcmp(tokens[0], "path") == 0) {
+			free(plugin_index.pluginpath);
+			plugin_index.pluginpath = strdup(tokens[1]);
+		} else if (count == 3 && strcmp(tokens[0], "dir") == 0) {
+			dir = realloc(plugin_index.dirs,
+				      (plugin_index.dir_count + 1)
+				      * sizeof(struct plugin_index_dir));
+			if (dir == NULL)
+				break;
+			plugin_index.dirs = dir;
+			dir += plugin_index.dir_count;
+			dir->path = strdup(tokens[1]);
+			dir->mtime = (time_t)strtoll(tokens[2], NULL, 10);
+			plugin_index.dir_count += 1;
+		} else if (count == 6 && strcmp(tokens[0], "driver") == 0) {
+			plugin_index_add(tokens[1],
+					 tokens[2],
+					 (time_t)strtoll(tokens[3], NULL, 10),
+					 strtoul(tokens[4], NULL, 16),
+					 atoi(tokens[5]));
+		} else {
+			log_warn("plugin index: bad line in %s", filename);
+			version = 0;
+			break;
+		}
+	}
+	fclose(f);
+	if (version != PLUGIN_INDEX_VERSION || plugin_index.pluginpath == NULL) {
+		plugin_index_clear();
+		return -1;
+	}
+	plugin_index.valid = 1;
+	return 0;
+}
+
+
+/** Write plugin_index to filename, atomically replacing any old file. */
+static void plugin_index_write(const char* filename)
+{
+	char tmpname[MAXPATHLEN];
+	char* s;
+	FILE* f;
+	int i;
+	int len;
+
+	len = snprintf(tmpname, sizeof(tmpname), "%s.%d", filename, getpid());
+	if (len < 0 || len >= (int)sizeof(tmpname)) {
+		log_debug("plugin index: path too long: %s", filename);
+		return;
+	}
+	s = strrchr(tmpname, '/');
+	if (s != NULL && s != tmpname) {
+		*s = '\0';
+		if (make_dirs(tmpname) != 0) {
+			log_debug("plugin index: cannot create %s", tmpname);
+			return;
+		}
+		*s = '/';
+	}
+	f = fopen(tmpname, "w");
+	if (f == NULL) {
+		log_debug("plugin index: cannot write %s", tmpname);
+		return;
+	}
+	fprintf(f, "# Generated by lirc, do not edit.\n");
+	fprintf(f, "version\t%d\n", PLUGIN_INDEX_VERSION);
+	fprintf(f, "path\t%s\n", plugin_index.pluginpath);
+	for (i = 0; i < plugin_index.dir_count; i += 1)
+		fprintf(f, "dir\t%s\t%lld\n",
+			plugin_index.dirs[i].path,
+			(long long)plugin_index.dirs[i].mtime);
+	for (i = 0; i < plugin_index.size; i += 1)
+		fprintf(f, "driver\t%s\t%s\t%lld\t%x\t%d\n",
+			plugin_index.entries[i].name,
+			plugin_index.entries[i].path,
+			(long long)plugin_index.entries[i].mtime,
+			plugin_index.entries[i].features,
+			plugin_index.entries[i].api_version);
+	if (fclose(f) != 0 || rename(tmpname, filename) != 0) {
+		log_perror_debug("plugin index: cannot write %s", filename);
+		unlink(tmpname);
+	}
+}
+
+
+/** Plugin being indexed, argument to index_driver(). */
+struct index_arg {
+	const char*	path;
+	time_t		mtime;
+};
+
+
+/** drv_guest_func adding driver to plugin_index, arg is a index_arg. */
+static struct driver* index_driver(struct driver* drv, void* arg)
+{
+	const struct index_arg* plugin = (const struct index_arg*)arg;
+
+	plugin_index_add(drv->name,
+			 plugin->path,
+			 plugin->mtime,
+			 drv->features,
+			 drv->api_version);
+	return NULL;
+}
+
+
+/** plugin_guest_func adding all drivers in plugin to plugin_index. */
+static struct driver*
+index_plugin(const char* path, drv_guest_func func, void* arg)
+{
+	struct stat st;
+	struct index_arg plugin;
+
+	if (stat(path, &st) != 0)
+		return NULL;
+	plugin.path = path;
+	plugin.mtime = st.st_mtime;
+	visit_plugin(path, index_driver, &plugin);
+	return NULL;
+}
+
+
+int plugin_index_refresh(const char* pluginpath_arg, int force)
+{
+	const char* pluginpath = get_pluginpath(pluginpath_arg);
+	struct plugin_index_dir* dirs;
+	int count;
+	char* filename;
+
+	count = get_plugin_dirs(pluginpath, &dirs);
+	if (!force && plugin_index_is_current(pluginpath, dirs, count)) {
+		free_plugin_dirs(dirs, count);
+		return 0;
+	}
+	filename = plugin_index_filename(pluginpath);
+	if (!force && filename != NULL
+	    && plugin_index_read(filename) == 0
+	    && plugin_index_is_current(pluginpath, dirs, count)) {
+		log_debug("Using plugin index %s", filename);
+		free_plugin_dirs(dirs, count);
+		free(filename);
+		return 0;
+	}
+	log_info("Rebuilding plugin index for %s", pluginpath);
+	plugin_index_clear();
+	for_each_path(index_plugin, NULL, NULL, pluginpath);
+	plugin_index.pluginpath = strdup(pluginpath);
+	plugin_index.dirs = dirs;
+	plugin_index.dir_count = count;
+	plugin_index.valid = 1;
+	if (filename != NULL) {
+		plugin_index_write(filename);
+		free(filename);
+	}
+	return 0;
+}
+
+
+const char* plugin_index_lookup(const char* name, const char* pluginpath)
+{
+	struct stat st;
+	int i;
+	int retry;
+
+	for (retry = 0; retry < 2; retry += 1) {
+		if (plugin_index_refresh(pluginpath, retry) != 0)
+			return NULL;
+		for (i = 0; i < plugin_index.size; i += 1) {
+			if (strcasecmp(plugin_index.entries[i].name, name) != 0)
+				continue;
+			if (stat(plugin_index.entries[i].path, &st) == 0
+			    && st.st_mtime == plugin_index.entries[i].mtime)
+				return plugin_index.entries[i].path;
+			/* Plugin updated in place: rebuild and try again. */
+			break;
+		}
+		if (i == plugin_index.size)
+			return NULL;
+	}
+	return NULL;
+}
+
+
 /** Best effort attempt to get column width and # columns for output file. */
 static void get_columns(FILE* f, char_array names, int* cols, int* width)
 {
@@ -276,9 +701,12 @@ void hw_print_drivers(FILE* file)
 	char format[16];
 
 	names.size = 0;
-	if (for_each_driver(add_hw_name, (void*)&names, NULL) != NULL) {
-		fprintf(stderr, "Too many plugins (%d)\n", MAX_PLUGINS);
-		return;
+	plugin_index_refresh(NULL, 0);
+	for (i = 0; i < plugin_index.size; i += 1) {
+		if (add_hw_name(plugin_index.entries[i].name, &names) != 0) {
+			fprintf(stderr, "Too many plugins (%d)\n", MAX_PLUGINS);
+			return;
+		}
 	}
 	qsort(names.array, names.size, sizeof(char*), line_cmp);
 	get_columns(file, names, &cols, &width);
@@ -296,7 +724,8 @@ void hw_print_drivers(FILE* file)
 
 int hw_choose_driver(const char* name)
 {
-	struct driver* found;
+	struct driver* found = (struct driver*)NULL;
+	const char* path;
 
 	if (name == NULL) {
 		memcpy(&drv, &drv_null, sizeof(struct driver));
@@ -306,7 +735,13 @@ int hw_choose_driver(const char* name)
 	if (strcasecmp(name, "dev/input") == 0)
 		/* backwards compatibility */
 		name = "devinput";
-	found = for_each_driver(match_hw_name, (void*)name, NULL);
+	path = plugin_index_lookup(name, NULL);
+	if (path != NULL)
+		found = visit_plugin(path, match_hw_name, (void*)name);
+	if (found == (struct driver*)NULL && path != NULL) {
+		log_warn("Plugin index out of sync for %s, scanning", name);
+		found = for_each_driver(match_hw_name, (void*)name, NULL);
+	}
 	if (found != (struct driver*)NULL) {
 		memcpy(&drv, found, sizeof(struct driver));
 		drv.fd = -1;
@@ -14,6 +14,11 @@
  *    - The "lircd:pluginpath" option.
  *    - The LIRC_PLUGIN_PATH environment variable.
  *    - The hardcoded PLUGINDIR constant.
+ *
+ *  To avoid loading all plugins when looking for a driver, a plugin index
+ *  mapping driver names to plugin paths is kept in a cache file, see
+ *  PLUGIN_INDEX_VAR and PLUGIN_INDEX_DIR. It is rebuilt when the mtime
+ *  of a plugin directory or an indexed plugin changes.
  */
 
 #include "driver.h"
@@ -71,6 +76,23 @@ void for_each_plugin(plugin_guest_func plugin_guest,
 		     void* arg,
 		     const char* pluginpath);
 
+/**
+ * Make sure the plugin index for pluginpath is up to date, reading it
+ * from the cache file or rebuilding it by loading all plugins as required.
+ * If force is true, the index is always rebuilt. A NULL pluginpath means
+ * the same default as in for_each_driver(). Returns 0 if the index is
+ * usable, else -1.
+ */
+int plugin_index_refresh(const char* pluginpath, int force);
+
+/**
+ * Return path to the plugin providing driver name according to the plugin
+ * index, or NULL if there is no such driver. The returned value is valid
+ * until next call to a plugin_index_* function. A NULL pluginpath means
+ * the same default as in for_each_driver().
+ */
+const char* plugin_index_lookup(const char* name, const char* pluginpath);
+
 
 #ifdef __cplusplus
 }
@@ -14,9 +14,11 @@
  */
 
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 #ifdef __linux__
 #include "lirc/input_map.h"
@@ -34,17 +36,38 @@ struct {
 	}
 };
 
+/* Perfect hash of the input_map names, see make_input_hash.py. */
+#include "input_map_hash.inc"
+
+
+/** Case folded hash of name, must match make_input_hash.py. */
+static uint32_t input_hash(const char* name, uint32_t seed)
+{
+	uint32_t h = 2166136261u ^ (seed * 0x9e3779b9u);
+	unsigned char c;
+
+	for (; *name != '\0'; name++) {
+		c = (unsigned char)*name;
+		if (c >= 'a' && c <= 'z')
+			c -= 'a' - 'A';
+		h = (h ^ c) * 16777619u;
+	}
+	return h ^ (h >> 15);
+}
+
+
 int get_input_code(const char* name, linux_input_code* code)
 {
+	uint32_t bucket;
 	int i;
 
-	for (i = 0; input_map[i].name != NULL; i++) {
-		if (strcasecmp(name, input_map[i].name) == 0) {
-			*code = input_map[i].code;
-			return i;
-		}
-	}
-	return -1;
+	bucket = input_hash(name, 0) % INPUT_HASH_BUCKETS;
+	i = input_hash(name, input_hash_seeds[bucket]) % INPUT_HASH_SLOTS;
+	i = input_hash_slots[i];
+	if (i == -1 || strcasecmp(name, input_map[i].name) != 0)
+		return -1;
+	*code = input_map[i].code;
+	return i;
 }
 
 void fprint_namespace(FILE* f)
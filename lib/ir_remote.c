@@ -22,11 +22,15 @@
 # include <config.h>
 #endif
 
+#include <errno.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <sched.h>
+#include <time.h>
 
 #include <sys/ioctl.h>
 
@@ -37,8 +41,11 @@
 #endif
 
 #include "lirc/ir_remote.h"
+#include "lirc/config_file.h"
 #include "lirc/driver.h"
+#include "lirc/receive.h"
 #include "lirc/release.h"
+#include "lirc/transmit.h"
 #include "lirc/lirc_log.h"
 
 static const logchannel_t logchannel = LOG_LIB;
@@ -64,6 +71,16 @@ struct ir_ncode* repeat_code;
 
 static int dyncodes = 0;
 
+/** send_ir_ncode() pacing, see send_pacing_set(). */
+static struct {
+	unsigned int			busy_wait;      /**< Spin this long (us). */
+	int				realtime;       /**< Use SCHED_FIFO. */
+	struct send_pacing_stats	stats;
+} pacing;
+
+/** Bumped by ir_remote_index_invalidate(), see struct ir_remote_index. */
+static unsigned int index_generation = 0;
+
 
 /** Create a malloc'd, deep copy of ncode. Use ncode_free() to dispose. */
 struct ir_ncode* ncode_dup(struct ir_ncode* ncode)
@@ -121,21 +138,668 @@ void ncode_free(struct ir_ncode* ncode)
 }
 
 
+/**
+ * Update the keys and remote data in an existing code table after the
+ * remote's pre/post data, masks or bits have changed. The names and nodes
+ * are already in the pools, so the table cannot be rebuilt from scratch.
+ */
+static int refresh_code_table(struct ir_remote* remote)
+{
+	struct ir_code_table* table = remote->code_table;
+	int i;
+
+	if (table->codes != NULL && table->codes != remote->codes) {
+		log_error("Cannot rebuild code table for %s", remote->name);
+		return -1;
+	}
+	for (i = 0; i < table->size; i++)
+		table->keys[i] = gen_ir_code(remote,
+					     remote->pre_data,
+					     remote->codes[i].code,
+					     remote->post_data)
+				 | remote->ignore_mask;
+	table->codes = remote->codes;
+	table->pre_data = remote->pre_data;
+	table->post_data = remote->post_data;
+	table->ignore_mask = remote->ignore_mask;
+	table->bits = remote->bits;
+	table->pre_data_bits = remote->pre_data_bits;
+	table->post_data_bits = remote->post_data_bits;
+	table->flags = remote->flags;
+	return 0;
+}
+
+
+int ir_code_table_build(struct ir_remote* remote)
+{
+	struct ir_code_table* table;
+	struct ir_ncode* ncode;
+	struct ir_code_node* node;
+	struct ir_code_node* next;
+	int size = 0;
+	unsigned int node_count = 0;
+	size_t names_size = 0;
+	size_t name_pos = 0;
+	unsigned int n = 0;
+	int i;
+
+	if (remote->code_table != NULL)
+		return refresh_code_table(remote);
+	if (remote->codes == NULL)
+		return -1;
+	for (ncode = remote->codes; ncode->name != NULL; ncode++) {
+		size += 1;
+		names_size += strlen(ncode->name) + 1;
+		for (node = ncode->next; node != NULL; node = node->next)
+			node_count += 1;
+	}
+	table = calloc(1, sizeof(struct ir_code_table));
+	if (table == NULL)
+		return -1;
+	table->keys = malloc((size + 1) * sizeof(ir_code));
+	table->seq_offset = malloc((size + 1) * sizeof(unsigned int));
+	table->seq_codes = malloc((size + 1) * sizeof(int));
+	table->nodes = malloc((node_count + 1) * sizeof(struct ir_code_node));
+	table->names = malloc(names_size + 1);
+	if (table->keys == NULL || table->seq_offset == NULL
+	    || table->seq_codes == NULL || table->nodes == NULL
+	    || table->names == NULL) {
+		remote->code_table = table;
+		ir_code_table_free(remote);
+		log_error("Out of memory building code table");
+		return -1;
+	}
+	for (i = 0, ncode = remote->codes; i < size; i++, ncode++) {
+		memcpy(table->names + name_pos,
+		       ncode->name, strlen(ncode->name) + 1);
+		free(ncode->name);
+		ncode->name = table->names + name_pos;
+		name_pos += strlen(ncode->name) + 1;
+
+		table->seq_offset[i] = n;
+		if (ncode->next != NULL)
+			table->seq_codes[table->seq_count++] = i;
+		for (node = ncode->next; node != NULL; node = next) {
+			next = node->next;
+			table->nodes[n].code = node->code;
+			table->nodes[n].next =
+				next == NULL ? NULL : &table->nodes[n + 1];
+			free(node);
+			n += 1;
+		}
+		ncode->next = table->seq_offset[i] == n ?
+			      NULL : &table->nodes[table->seq_offset[i]];
+		ncode->current = NULL;
+		ncode->transmit_state = NULL;
+	}
+	table->seq_offset[size] = n;
+	table->size = size;
+	table->names_size = names_size;
+	remote->code_table = table;
+	return refresh_code_table(remote);
+}
+
+
+void ir_code_table_free(struct ir_remote* remote)
+{
+	struct ir_code_table* table = remote->code_table;
+
+	if (table == NULL)
+		return;
+	free(table->keys);
+	free(table->seq_offset);
+	free(table->seq_codes);
+	free(table->nodes);
+	free(table->names);
+	free(table);
+	remote->code_table = NULL;
+}
+
+
+int ir_code_table_owns(const struct ir_remote* remote, const void* ptr)
+{
+	const struct ir_code_table* table = remote->code_table;
+	const char* p = (const char*)ptr;
+
+	if (table == NULL || ptr == NULL)
+		return 0;
+	if (p >= table->names && p < table->names + table->names_size)
+		return 1;
+	return p >= (const char*)table->nodes
+	       && p < (const char*)(table->nodes
+				    + table->seq_offset[table->size]);
+}
+
+
+const struct ir_code_table* ir_code_table_get(const struct ir_remote* remote)
+{
+	const struct ir_code_table* table = remote->code_table;
+
+	if (table == NULL
+	    || table->codes != remote->codes
+	    || table->pre_data != remote->pre_data
+	    || table->post_data != remote->post_data
+	    || table->ignore_mask != remote->ignore_mask
+	    || table->bits != remote->bits
+	    || table->pre_data_bits != remote->pre_data_bits
+	    || table->post_data_bits != remote->post_data_bits
+	    || table->flags != remote->flags)
+		return NULL;
+	return table;
+}
+
+
+void ir_remote_update_bounds(struct ir_remote* remote)
+{
+	lirc_t val[IR_B_COUNT];
+	int aeps = curr_driver->resolution > remote->aeps ?
+		   curr_driver->resolution : remote->aeps;
+	int all;
+	int i;
+
+	val[IR_B_PHEAD] = remote->phead;
+	val[IR_B_SHEAD] = remote->shead;
+	val[IR_B_PONE] = remote->pone;
+	val[IR_B_SONE] = remote->sone;
+	val[IR_B_PZERO] = remote->pzero;
+	val[IR_B_SZERO] = remote->szero;
+	val[IR_B_PTWO] = remote->ptwo;
+	val[IR_B_STWO] = remote->stwo;
+	val[IR_B_PTHREE] = remote->pthree;
+	val[IR_B_STHREE] = remote->sthree;
+	val[IR_B_PONE_X2] = 2 * remote->pone;
+	val[IR_B_SONE_X2] = 2 * remote->sone;
+	val[IR_B_PZERO_X2] = 2 * remote->pzero;
+	val[IR_B_SZERO_X2] = 2 * remote->szero;
+	val[IR_B_PLEAD] = remote->plead;
+	val[IR_B_PTRAIL] = remote->ptrail;
+	val[IR_B_PFOOT] = remote->pfoot;
+	val[IR_B_SFOOT] = remote->sfoot;
+	val[IR_B_PREPEAT] = remote->prepeat;
+	val[IR_B_SREPEAT] = remote->srepeat;
+	val[IR_B_PRE_P] = remote->pre_p;
+	val[IR_B_PRE_S] = remote->pre_s;
+	val[IR_B_POST_P] = remote->post_p;
+	val[IR_B_POST_S] = remote->post_s;
+	val[IR_B_HEAD] = remote->phead + remote->shead;
+	val[IR_B_ZERO] = remote->pzero + remote->szero;
+	val[IR_B_ONE] = remote->pone + remote->sone;
+	val[IR_B_TWO] = remote->ptwo + remote->stwo;
+	val[IR_B_THREE] = remote->pthree + remote->sthree;
+	val[IR_B_MIN_GAP] = min_gap(remote);
+	val[IR_B_MAX_GAP] = max_gap(remote);
+
+	all = remote->bounds_eps != remote->eps || remote->bounds_aeps != aeps;
+	for (i = 0; i < IR_B_COUNT; i++) {
+		if (all || remote->bounds[i].val != val[i])
+			init_bounds(remote, &remote->bounds[i], val[i]);
+	}
+	remote->bounds_eps = remote->eps;
+	remote->bounds_aeps = aeps;
+}
+
+
+/**
+ * Protocol parameters used by receive_decode(). Remotes with equal
+ * parameters decode a signal to the same pre, code and post data.
+ */
+struct remote_params {
+	int		flags;
+	int		eps;
+	unsigned int	aeps;
+	lirc_t		phead, shead;
+	lirc_t		pthree, sthree;
+	lirc_t		ptwo, stwo;
+	lirc_t		pone, sone;
+	lirc_t		pzero, szero;
+	lirc_t		plead, ptrail;
+	lirc_t		pfoot, sfoot;
+	lirc_t		prepeat, srepeat;
+	int		bits;
+	int		pre_data_bits;
+	int		post_data_bits;
+	lirc_t		pre_p, pre_s;
+	lirc_t		post_p, post_s;
+	uint32_t	gap, gap2, repeat_gap;
+	ir_code		toggle_bit_mask;
+	ir_code		rc6_mask;
+	ir_code		ignore_mask;
+	ir_code		repeat_mask;
+	unsigned int	baud, bits_in_byte, parity, stop_bits;
+};
+
+/** Remote and position in list used while sorting the index. */
+struct remote_entry {
+	const void*		key;
+	int			pos;
+	struct remote_params	params;
+};
+
+/** Normalized code of a grouped remote, see remote_key(). */
+struct remote_key {
+	int		group;
+	ir_code		key;
+	int		pos;
+};
+
+/** Decoding step: a single remote or a group, in list order. */
+struct remote_unit {
+	int	pos;
+	int	group;          /**< Index in group_rep or -1. */
+};
+
+struct ir_remote_index {
+	const struct ir_remote*	head;
+	const struct ir_remote*	tail;
+	int			count;
+	struct ir_remote**	remotes;        /**< List order. */
+	int*			by_name;        /**< Positions sorted by name. */
+	int*			by_addr;        /**< Positions sorted by address. */
+	int*			group_of;       /**< Group for each position or -1. */
+	struct remote_unit*	units;
+	int			unit_count;
+	int*			group_rep;      /**< First two members per group */
+	int			group_count;
+	struct remote_key*	keys;           /**< Sorted group, key, pos. */
+	int			key_count;
+	int*			pending;        /**< decode_all() candidates. */
+	int*			seq_remotes;    /**< Remotes with sequences. */
+	int			seq_count;
+	int			lazy_count;     /**< Remotes with lazy codes. */
+	unsigned int		generation;     /**< index_generation at build */
+};
+
+
+static void get_remote_params(const struct ir_remote*	remote,
+			      struct remote_params*	params)
+{
+	memset(params, 0, sizeof(struct remote_params));
+	params->flags = remote->flags;
+	params->eps = remote->eps;
+	params->aeps = remote->aeps;
+	params->phead = remote->phead;
+	params->shead = remote->shead;
+	params->pthree = remote->pthree;
+	params->sthree = remote->sthree;
+	params->ptwo = remote->ptwo;
+	params->stwo = remote->stwo;
+	params->pone = remote->pone;
+	params->sone = remote->sone;
+	params->pzero = remote->pzero;
+	params->szero = remote->szero;
+	params->plead = remote->plead;
+	params->ptrail = remote->ptrail;
+	params->pfoot = remote->pfoot;
+	params->sfoot = remote->sfoot;
+	params->prepeat = remote->prepeat;
+	params->srepeat = remote->srepeat;
+	params->bits = remote->bits;
+	params->pre_data_bits = remote->pre_data_bits;
+	params->post_data_bits = remote->post_data_bits;
+	params->pre_p = remote->pre_p;
+	params->pre_s = remote->pre_s;
+	params->post_p = remote->post_p;
+	params->post_s = remote->post_s;
+	params->gap = remote->gap;
+	params->gap2 = remote->gap2;
+	params->repeat_gap = remote->repeat_gap;
+	params->toggle_bit_mask = remote->toggle_bit_mask;
+	params->rc6_mask = remote->rc6_mask;
+	params->ignore_mask = remote->ignore_mask;
+	params->repeat_mask = remote->repeat_mask;
+	params->baud = remote->baud;
+	params->bits_in_byte = remote->bits_in_byte;
+	params->parity = remote->parity;
+	params->stop_bits = remote->stop_bits;
+}
+
+
+/**
+ * Return true if remote can share decoding with other remotes: it must
+ * be matched by plain code compares without any per-remote state.
+ * Remotes with lazy codes are matched on pre and post data only.
+ */
+static int is_groupable(const struct ir_remote* remote)
+{
+	const struct ir_code_table* table;
+
+	if (is_raw(remote) || has_toggle_mask(remote))
+		return 0;
+	if (remote->lazy_codes != NULL)
+		return 1;
+	table = ir_code_table_get(remote);
+	return table != NULL && table->size > 0 && table->seq_count == 0;
+}
+
+
+/** Code with bits which are ignored by get_code() masked out. */
+static ir_code remote_key(const struct ir_remote* remote, ir_code all)
+{
+	return (all | remote->ignore_mask) & ~remote->toggle_bit_mask;
+}
+
+
+/** Key for remotes with lazy codes: remote_key() without the code part. */
+static ir_code lazy_key(const struct ir_remote* remote, ir_code all)
+{
+	return remote_key(remote, all)
+	       & ~(gen_mask(remote->bits) << remote->post_data_bits);
+}
+
+
+static int cmp_by_name(const void* a, const void* b)
+{
+	const struct remote_entry* e1 = (const struct remote_entry*)a;
+	const struct remote_entry* e2 = (const struct remote_entry*)b;
+	int r;
+
+	r = strcasecmp((const char*)e1->key, (const char*)e2->key);
+	return r != 0 ? r : e1->pos - e2->pos;
+}
+
+
+static int cmp_by_addr(const void* a, const void* b)
+{
+	const struct remote_entry* e1 = (const struct remote_entry*)a;
+	const struct remote_entry* e2 = (const struct remote_entry*)b;
+
+	if (e1->key != e2->key)
+		return (uintptr_t)e1->key < (uintptr_t)e2->key ? -1 : 1;
+	return e1->pos - e2->pos;
+}
+
+
+static int cmp_by_params(const void* a, const void* b)
+{
+	const struct remote_entry* e1 = (const struct remote_entry*)a;
+	const struct remote_entry* e2 = (const struct remote_entry*)b;
+	int r;
+
+	r = memcmp(&e1->params, &e2->params, sizeof(struct remote_params));
+	return r != 0 ? r : e1->pos - e2->pos;
+}
+
+
+static int cmp_keys(const void* a, const void* b)
+{
+	const struct remote_key* k1 = (const struct remote_key*)a;
+	const struct remote_key* k2 = (const struct remote_key*)b;
+
+	if (k1->group != k2->group)
+		return k1->group - k2->group;
+	if (k1->key != k2->key)
+		return k1->key < k2->key ? -1 : 1;
+	return k1->pos - k2->pos;
+}
+
+
+void ir_remote_index_free(struct ir_remote* remotes)
+{
+	struct ir_remote_index* index;
+
+	if (remotes == NULL || remotes->index == NULL)
+		return;
+	index = remotes->index;
+	remotes->index = NULL;
+	if (index->head != remotes)
+		return;
+	free(index->remotes);
+	free(index->by_name);
+	free(index->by_addr);
+	free(index->group_of);
+	free(index->units);
+	free(index->group_rep);
+	free(index->keys);
+	free(index->pending);
+	free(index->seq_remotes);
+	free(index);
+}
+
+
+/** Form groups from the groupable remotes in entries, sorted in place. */
+static int build_groups(struct ir_remote_index*	index,
+			struct remote_entry*	entries,
+			int			n)
+{
+	const struct ir_code_table* table;
+	struct ir_remote* remote;
+	int first, last;
+	int i, j;
+	int pos;
+
+	qsort(entries, n, sizeof(struct remote_entry), cmp_by_params);
+	for (first = 0; first < n; first = last) {
+		for (last = first + 1; last < n; last++)
+			if (memcmp(&entries[first].params,
+				   &entries[last].params,
+				   sizeof(struct remote_params)) != 0)
+				break;
+		if (last - first < 2)
+			continue;
+		index->group_rep[2 * index->group_count] = entries[first].pos;
+		index->group_rep[2 * index->group_count + 1] =
+			entries[first + 1].pos;
+		for (i = first; i < last; i++) {
+			pos = entries[i].pos;
+			remote = index->remotes[pos];
+			index->group_of[pos] = index->group_count;
+			if (remote->lazy_codes != NULL) {
+				index->keys[index->key_count].group =
+					index->group_count;
+				index->keys[index->key_count].key =
+					lazy_key(remote,
+						 gen_ir_code(remote,
+							     remote->pre_data,
+							     0,
+							     remote->post_data));
+				index->keys[index->key_count].pos = pos;
+				index->key_count += 1;
+				index->lazy_count += 1;
+				continue;
+			}
+			table = ir_code_table_get(remote);
+			for (j = 0; j < table->size; j++) {
+				index->keys[index->key_count].group =
+					index->group_count;
+				index->keys[index->key_count].key =
+					remote_key(remote, table->keys[j]);
+				index->keys[index->key_count].pos = pos;
+				index->key_count += 1;
+			}
+		}
+		index->group_count += 1;
+	}
+	qsort(index->keys, index->key_count,
+	      sizeof(struct remote_key), cmp_keys);
+	return index->group_count;
+}
+
+
+int ir_remote_index_build(struct ir_remote* remotes)
+{
+	struct ir_remote_index* index;
+	struct remote_entry* entries;
+	struct ir_remote* remote;
+	int count = 0;
+	int key_count = 0;
+	int n;
+	int i;
+
+	ir_remote_index_free(remotes);
+	if (remotes == NULL)
+		return -1;
+	for (remote = remotes; remote != NULL; remote = remote->next) {
+		if (remote->name == NULL)
+			return -1;
+		if (remote->lazy_codes != NULL)
+			key_count += 1;
+		else if (is_groupable(remote))
+			key_count += ir_code_table_get(remote)->size;
+		count += 1;
+	}
+	index = calloc(1, sizeof(struct ir_remote_index));
+	entries = malloc(count * sizeof(struct remote_entry));
+	if (index == NULL || entries == NULL) {
+		free(index);
+		free(entries);
+		log_error("Out of memory building remotes index");
+		return -1;
+	}
+	index->head = remotes;
+	index->count = count;
+	index->generation = index_generation;
+	index->remotes = malloc(count * sizeof(struct ir_remote*));
+	index->by_name = malloc(count * sizeof(int));
+	index->by_addr = malloc(count * sizeof(int));
+	index->group_of = malloc(count * sizeof(int));
+	index->units = malloc(count * sizeof(struct remote_unit));
+	index->group_rep = malloc(count * sizeof(int));
+	index->keys = malloc((key_count + 1) * sizeof(struct remote_key));
+	index->pending = malloc(count * sizeof(int));
+	index->seq_remotes = malloc(count * sizeof(int));
+	remotes->index = index;
+	if (index->remotes == NULL || index->by_name == NULL
+	    || index->by_addr == NULL || index->group_of == NULL
+	    || index->units == NULL || index->group_rep == NULL
+	    || index->keys == NULL || index->pending == NULL
+	    || index->seq_remotes == NULL) {
+		free(entries);
+		ir_remote_index_free(remotes);
+		log_error("Out of memory building remotes index");
+		return -1;
+	}
+	for (i = 0, remote = remotes; remote != NULL; remote = remote->next) {
+		index->remotes[i] = remote;
+		index->group_of[i] = -1;
+		index->tail = remote;
+		if (remote->codes != NULL
+		    && (ir_code_table_get(remote) == NULL
+			|| ir_code_table_get(remote)->seq_count > 0))
+			index->seq_remotes[index->seq_count++] = i;
+		i++;
+	}
+
+	for (i = 0; i < count; i++) {
+		entries[i].key = index->remotes[i]->name;
+		entries[i].pos = i;
+	}
+	qsort(entries, count, sizeof(struct remote_entry), cmp_by_name);
+	for (i = 0; i < count; i++)
+		index->by_name[i] = entries[i].pos;
+
+	for (i = 0; i < count; i++) {
+		entries[i].key = index->remotes[i];
+		entries[i].pos = i;
+	}
+	qsort(entries, count, sizeof(struct remote_entry), cmp_by_addr);
+	for (i = 0; i < count; i++)
+		index->by_addr[i] = entries[i].pos;
+
+	for (i = 0, n = 0; i < count; i++) {
+		if (!is_groupable(index->remotes[i]))
+			continue;
+		get_remote_params(index->remotes[i], &entries[n].params);
+		entries[n].key = index->remotes[i];
+		entries[n].pos = i;
+		n++;
+	}
+	build_groups(index, entries, n);
+	free(entries);
+
+	for (i = 0; i < count; i++) {
+		if (index->group_of[i] >= 0
+		    && index->group_rep[2 * index->group_of[i]] != i)
+			continue;
+		index->units[index->unit_count].pos = i;
+		index->units[index->unit_count].group = index->group_of[i];
+		index->unit_count += 1;
+	}
+	log_debug("Indexed %d remotes, %d decoding groups, %d steps",
+		  count, index->group_count, index->unit_count);
+	return 0;
+}
+
+
+/** Return the index for remotes, or NULL if missing or out of date. */
+static struct ir_remote_index* remote_index_get(const struct ir_remote* remotes)
+{
+	struct ir_remote_index* index;
+
+	if (remotes == NULL || remotes->index == NULL)
+		return NULL;
+	index = remotes->index;
+	if (index->head != remotes || index->tail->next != NULL
+	    || index->generation != index_generation)
+		return NULL;
+	return index;
+}
+
+
+/**
+ * Return the index for remotes like remote_index_get(), first rebuilding
+ * it if it's outdated after ir_remote_index_invalidate().
+ */
+static struct ir_remote_index* remote_index_refresh(const struct ir_remote* remotes)
+{
+	if (remotes != NULL && remotes->index != NULL
+	    && remotes->index->head == remotes
+	    && remotes->index->generation != index_generation)
+		ir_remote_index_build((struct ir_remote*)remotes);
+	return remote_index_get(remotes);
+}
+
+
+void ir_remote_index_invalidate(void)
+{
+	index_generation += 1;
+}
+
+
+/** Return position of remote in the index, or -1 if not found. */
+static int remote_index_find(const struct ir_remote_index*	index,
+			     const struct ir_remote*		remote)
+{
+	int lo = 0;
+	int hi = index->count;
+	int mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if ((uintptr_t)index->remotes[index->by_addr[mid]]
+		    < (uintptr_t)remote)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo < index->count && index->remotes[index->by_addr[lo]] == remote)
+		return index->by_addr[lo];
+	return -1;
+}
+
+
 void ir_remote_init(int use_dyncodes)
 {
 	dyncodes = use_dyncodes;
 }
 
 
-static lirc_t time_left(struct timeval* current,
-			struct timeval* last,
-			lirc_t		gap)
+static void timespec_add_us(struct timespec* ts, unsigned long usecs)
 {
-	unsigned long secs, diff;
+	ts->tv_sec += usecs / 1000000;
+	ts->tv_nsec += (usecs % 1000000) * 1000;
+	if (ts->tv_nsec >= 1000000000) {
+		ts->tv_sec += 1;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
 
-	secs = current->tv_sec - last->tv_sec;
-	diff = 1000000 * secs + current->tv_usec - last->tv_usec;
-	return (lirc_t)(diff < gap ? gap - diff : 0);
+/** Return a - b in nanoseconds. */
+static long long timespec_diff_ns(const struct timespec* a,
+				  const struct timespec* b)
+{
+	return (a->tv_sec - b->tv_sec) * 1000000000LL
+	       + (a->tv_nsec - b->tv_nsec);
 }
 
 
@@ -239,6 +903,10 @@ void get_filter_parameters(const struct ir_remote*	remotes,
 const struct ir_remote* is_in_remotes(const struct ir_remote*	remotes,
 				      const struct ir_remote*	remote)
 {
+	const struct ir_remote_index* index = remote_index_refresh(remotes);
+
+	if (index != NULL)
+		return remote_index_find(index, remote) >= 0 ? remote : NULL;
 	while (remotes != NULL) {
 		if (remotes == remote)
 			return remote;
@@ -251,12 +919,32 @@ const struct ir_remote* is_in_remotes(const struct ir_remote*	remotes,
 struct ir_remote* get_ir_remote(const struct ir_remote* remotes,
 				const char*		name)
 {
+	const struct ir_remote_index* index;
 	const struct ir_remote* all;
+	int lo, hi, mid;
 
 	/* use remotes carefully, it may be changed on SIGHUP */
 	all = remotes;
 	if (strcmp(name, "lirc") == 0)
 		return &lirc_internal_remote;
+	index = remote_index_refresh(remotes);
+	if (index != NULL) {
+		lo = 0;
+		hi = index->count;
+		while (lo < hi) {
+			mid = lo + (hi - lo) / 2;
+			all = index->remotes[index->by_name[mid]];
+			if (strcasecmp(all->name, name) < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if (lo == index->count)
+			return NULL;
+		all = index->remotes[index->by_name[lo]];
+		return strcasecmp(all->name, name) == 0 ?
+		       (struct ir_remote*)all : NULL;
+	}
 	while (all) {
 		if (strcasecmp(all->name, name) == 0)
 			return (struct ir_remote*)all;
@@ -399,6 +1087,8 @@ struct ir_ncode* get_code_by_name(const struct ir_remote*	remote,
 {
 	const struct ir_ncode* all;
 
+	if (remote->lazy_codes != NULL)
+		ir_remote_load_codes((struct ir_remote*)remote);
 	all = remote->codes;
 	if (all == NULL)
 		return NULL;
@@ -468,6 +1158,52 @@ void find_longest_match(struct ir_remote*	remote,
 }
 
 
+/**
+ * Match the current code of ncode against all, updating the sequence
+ * state and found, found_code and have_code as used in get_code().
+ */
+static void match_ncode(struct ir_remote*	remote,
+			struct ir_ncode*	codes,
+			ir_code			all,
+			int			repeat_flag,
+			int*			have_code,
+			struct ir_ncode**	found,
+			int*			found_code)
+{
+	ir_code next_all;
+
+	next_all = gen_ir_code(remote,
+			       remote->pre_data,
+			       get_ir_code(codes, codes->current),
+			       remote->post_data);
+	if (match_ir_code(remote, next_all, all) ||
+	    (repeat_flag &&
+	     has_repeat_mask(remote) &&
+	     match_ir_code(remote, next_all, all ^ remote->repeat_mask))) {
+		*found_code = 1;
+		if (codes->next != NULL) {
+			if (codes->current == NULL)
+				codes->current = codes->next;
+			else
+				codes->current = codes->current->next;
+		}
+		if (!*have_code) {
+			*found = codes;
+			if (codes->current == NULL)
+				*have_code = 1;
+		}
+	} else {
+		find_longest_match(remote,
+				   codes,
+				   all,
+				   &next_all,
+				   *have_code,
+				   found,
+				   found_code);
+	}
+}
+
+
 static struct ir_ncode* get_code(struct ir_remote*	remote,
 				 ir_code		pre,
 				 ir_code		code,
@@ -479,6 +1215,11 @@ static struct ir_ncode* get_code(struct ir_remote*	remote,
 	int found_code, have_code;
 	struct ir_ncode* codes;
 	struct ir_ncode* found;
+	const struct ir_code_table* table;
+	ir_code keys[4];
+	int key_count;
+	int i;
+	int k;
 
 	pre_mask = code_mask = post_mask = 0;
 
@@ -546,43 +1287,41 @@ static struct ir_ncode* get_code(struct ir_remote*	remote,
 	found_code = 0;
 	have_code = 0;
 	codes = remote->codes;
-	if (codes != NULL) {
-		while (codes->name != NULL) {
-			ir_code next_all;
-
-			next_all = gen_ir_code(remote,
-					       remote->pre_data,
-					       get_ir_code(codes,
-							   codes->current),
-					       remote->post_data);
-			if (match_ir_code(remote, next_all, all) ||
-			    (*repeat_flag &&
-			     has_repeat_mask(remote) &&
-			     match_ir_code(remote,
-					   next_all,
-					   all ^ remote->repeat_mask))) {
-				found_code = 1;
-				if (codes->next != NULL) {
-					if (codes->current == NULL)
-						codes->current = codes->next;
-					else
-						codes->current =
-							codes->current->next;
-				}
-				if (!have_code) {
-					found = codes;
-					if (codes->current == NULL)
-						have_code = 1;
-				}
-			} else {
-				find_longest_match(remote,
-						   codes,
-						   all,
-						   &next_all,
-						   have_code,
-						   &found,
-						   &found_code);
+	table = ir_code_table_get(remote);
+	if (codes != NULL && table != NULL) {
+		key_count = 0;
+		keys[key_count++] = all | remote->ignore_mask;
+		keys[key_count++] = (all ^ remote->toggle_bit_mask)
+				    | remote->ignore_mask;
+		if (*repeat_flag && has_repeat_mask(remote)) {
+			keys[key_count++] = (all ^ remote->repeat_mask)
+					    | remote->ignore_mask;
+			keys[key_count++] = (all ^ remote->repeat_mask
+					     ^ remote->toggle_bit_mask)
+					    | remote->ignore_mask;
+		}
+		for (i = 0; i < table->size; i++) {
+			if (ir_code_table_has_seq(table, i)) {
+				match_ncode(remote, &codes[i], all,
+					    *repeat_flag,
+					    &have_code, &found, &found_code);
+				continue;
+			}
+			for (k = 0; k < key_count; k++)
+				if (table->keys[i] == keys[k])
+					break;
+			if (k == key_count)
+				continue;
+			found_code = 1;
+			if (!have_code) {
+				found = &codes[i];
+				have_code = 1;
 			}
+		}
+	} else if (codes != NULL) {
+		while (codes->name != NULL) {
+			match_ncode(remote, codes, all, *repeat_flag,
+				    &have_code, &found, &found_code);
 			codes++;
 		}
 	}
@@ -730,87 +1469,277 @@ int write_message(char*		buffer,
 }
 
 
-char* decode_all(struct ir_remote* remotes)
+/** Reset the current sequence position in all codes in remote. */
+static void reset_sequences(struct ir_remote* remote)
+{
+	const struct ir_code_table* table = ir_code_table_get(remote);
+	struct ir_ncode* ncode;
+	int i;
+
+	if (table != NULL) {
+		for (i = 0; i < table->seq_count; i++)
+			remote->codes[table->seq_codes[i]].current = NULL;
+		return;
+	}
+	for (ncode = remote->codes; ncode->name != NULL; ncode++)
+		ncode->current = NULL;
+}
+
+
+/** Reset the current sequence position in all remotes. */
+static void reset_all_sequences(struct ir_remote* remotes)
+{
+	const struct ir_remote_index* index = remote_index_get(remotes);
+	int i;
+
+	if (index != NULL) {
+		for (i = 0; i < index->seq_count; i++)
+			reset_sequences(index->remotes[index->seq_remotes[i]]);
+		return;
+	}
+	for (; remotes != NULL; remotes = remotes->next)
+		reset_sequences(remotes);
+}
+
+
+/**
+ * Return true if the decoded pre and post data in ctx matches remote,
+ * whose lazy codes then must be loaded before get_code().
+ */
+static int lazy_codes_match(struct ir_remote*		remote,
+			    const struct decode_ctx_t*	ctx)
+{
+	ir_code key;
+	ir_code all;
+
+	if (has_toggle_mask(remote))
+		return 1;
+	key = lazy_key(remote, gen_ir_code(remote,
+					   remote->pre_data, 0,
+					   remote->post_data));
+	all = gen_ir_code(remote, ctx->pre, 0, ctx->post);
+	return lazy_key(remote, all) == key
+	       || (has_repeat_mask(remote)
+		   && lazy_key(remote, all ^ remote->repeat_mask) == key);
+}
+
+
+/**
+ * Try to decode the current signal using remote, see decode_all().
+ * Returns 1 if decode_all() is done and should return *result, else 0.
+ */
+static int decode_remote(struct ir_remote* remote, char** result)
 {
-	struct ir_remote* remote;
 	static char message[PACKET_SIZE + 1];
 	struct ir_ncode* ncode;
 	ir_code toggle_bit_mask_state;
-	struct ir_remote* scan;
-	struct ir_ncode* scan_ncode;
 	struct decode_ctx_t ctx;
+	int len;
+	int reps;
+
+	*result = NULL;
+	log_trace("trying \"%s\" remote", remote->name);
+	if (curr_driver->decode_func(remote, &ctx)) {
+		if (remote->lazy_codes != NULL && lazy_codes_match(remote, &ctx))
+			ir_remote_load_codes(remote);
+		ncode = get_code(remote,
+				 ctx.pre, ctx.code, ctx.post,
+				 &ctx.repeat_flag,
+				 &toggle_bit_mask_state);
+		if (ncode) {
+			if (ncode == &NCODE_EOF) {
+				log_debug("decode all: returning EOF");
+				strncpy(message, PACKET_EOF, sizeof(message));
+				*result = message;
+				return 1;
+			}
+			ctx.code = set_code(remote,
+					    ncode,
+					    toggle_bit_mask_state,
+					    &ctx);
+			if ((has_toggle_mask(remote)
+			     && remote->toggle_mask_state % 2)
+			    || ncode->current != NULL) {
+				decoding = NULL;
+				return 1;
+			}
 
-	/* use remotes carefully, it may be changed on SIGHUP */
-	decoding = remote = remotes;
-	while (remote) {
-		log_trace("trying \"%s\" remote", remote->name);
-		if (curr_driver->decode_func(remote, &ctx)) {
-			ncode = get_code(remote,
-					 ctx.pre, ctx.code, ctx.post,
-					 &ctx.repeat_flag,
-					 &toggle_bit_mask_state);
-			if (ncode) {
-				int len;
-				int reps;
-
-				if (ncode == &NCODE_EOF) {
-					log_debug("decode all: returning EOF");
-					strncpy(message,
-						PACKET_EOF, sizeof(message));
-					return message;
-				}
-				ctx.code = set_code(remote,
-						    ncode,
-						    toggle_bit_mask_state,
-						    &ctx);
-				if ((has_toggle_mask(remote)
-				     && remote->toggle_mask_state % 2)
-				    || ncode->current != NULL) {
+			reset_all_sequences(decoding);
+			if (is_xmp(remote))
+				remote->last_code->current =
+					remote->last_code->next;
+			reps = remote->reps - (ncode->next ? 1 : 0);
+			if (reps > 0) {
+				if (reps <= remote->suppress_repeat) {
 					decoding = NULL;
-					return NULL;
-				}
-
-				for (scan = decoding;
-				     scan != NULL;
-				     scan = scan->next)
-					for (scan_ncode = scan->codes;
-					     scan_ncode->name != NULL;
-					     scan_ncode++)
-						scan_ncode->current = NULL;
-				if (is_xmp(remote))
-					remote->last_code->current =
-						remote->last_code->next;
-				reps = remote->reps - (ncode->next ? 1 : 0);
-				if (reps > 0) {
-					if (reps <= remote->suppress_repeat) {
-						decoding = NULL;
-						return NULL;
-					}
-					reps -= remote->suppress_repeat;
-				}
-				register_button_press(remote,
-						      remote->last_code,
-						      ctx.code,
-						      reps);
-				len = write_message(message, PACKET_SIZE + 1,
-						    remote->name,
-						    remote->last_code->name,
-						    "",
-						    ctx.code,
-						    reps);
-				decoding = NULL;
-				if (len >= PACKET_SIZE + 1) {
-					log_error("message buffer overflow");
-					return NULL;
-				} else {
-					return message;
+					return 1;
 				}
-			} else {
-				log_trace("failed \"%s\" remote",
-					  remote->name);
+				reps -= remote->suppress_repeat;
 			}
+			register_button_press(remote,
+					      remote->last_code,
+					      ctx.code,
+					      reps);
+			len = write_message(message, PACKET_SIZE + 1,
+					    remote->name,
+					    remote->last_code->name,
+					    "",
+					    ctx.code,
+					    reps);
+			decoding = NULL;
+			if (len >= PACKET_SIZE + 1) {
+				log_error("message buffer overflow");
+				return 1;
+			}
+			*result = message;
+			return 1;
 		}
-		remote->toggle_mask_state = 0;
+		log_trace("failed \"%s\" remote", remote->name);
+	}
+	remote->toggle_mask_state = 0;
+	return 0;
+}
+
+
+/** Insert pos into the sorted pending list unless present. */
+static int add_pending(struct ir_remote_index* index, int count, int pos)
+{
+	int i;
+
+	for (i = count; i > 0 && index->pending[i - 1] >= pos; i--)
+		if (index->pending[i - 1] == pos)
+			return count;
+	memmove(&index->pending[i + 1], &index->pending[i],
+		(count - i) * sizeof(int));
+	index->pending[i] = pos;
+	return count + 1;
+}
+
+
+/** Add all remotes in group with a code matching all to pending. */
+static int add_matching(struct ir_remote_index*	index,
+			int			group,
+			ir_code			key,
+			int			count)
+{
+	const struct remote_key* k;
+	int lo = 0;
+	int hi = index->key_count;
+	int mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		k = &index->keys[mid];
+		if (k->group < group || (k->group == group && k->key < key))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (k = &index->keys[lo];
+	     lo < index->key_count && k->group == group && k->key == key;
+	     lo++, k++)
+		count = add_pending(index, count, k->pos);
+	return count;
+}
+
+
+/**
+ * Decode the current signal once for all remotes in group and add the
+ * ones which might match it to the pending list. last_remote, which
+ * also accepts repeat codes, is always added if it's a member.
+ */
+static int add_group_candidates(struct ir_remote_index* index,
+				int			group,
+				int			count)
+{
+	struct ir_remote* remote;
+	struct decode_ctx_t ctx;
+	ir_code all;
+	int pos;
+
+	if (last_remote != NULL) {
+		pos = remote_index_find(index, last_remote);
+		if (pos >= 0 && index->group_of[pos] == group)
+			count = add_pending(index, count, pos);
+	}
+	pos = index->group_rep[2 * group];
+	if (index->remotes[pos] == last_remote)
+		pos = index->group_rep[2 * group + 1];
+	remote = index->remotes[pos];
+	log_trace("trying \"%s\" remote group", remote->name);
+	if (!curr_driver->decode_func(remote, &ctx))
+		return count;
+	all = gen_ir_code(remote, ctx.pre, ctx.code, ctx.post);
+	count = add_matching(index, group, remote_key(remote, all), count);
+	if (has_repeat_mask(remote))
+		count = add_matching(index, group,
+				     remote_key(remote,
+						all ^ remote->repeat_mask),
+				     count);
+	if (index->lazy_count > 0) {
+		count = add_matching(index, group, lazy_key(remote, all), count);
+		if (has_repeat_mask(remote))
+			count = add_matching(index, group,
+					     lazy_key(remote,
+						      all ^ remote->repeat_mask),
+					     count);
+	}
+	return count;
+}
+
+
+/**
+ * decode_all() using the index: remotes in a group are only tried if
+ * the group's common decoding matches one of their codes. Remotes are
+ * still tried in list order, so the result is the same as trying them
+ * all.
+ */
+static int decode_indexed(struct ir_remote_index* index, char** result)
+{
+	const struct remote_unit* unit;
+	int count = 0;
+	int next = 0;
+	int u;
+
+	for (u = 0; u < index->unit_count; u++) {
+		unit = &index->units[u];
+		for (; next < count && index->pending[next] < unit->pos; next++)
+			if (decode_remote(index->remotes[index->pending[next]],
+					  result))
+				return 1;
+		if (unit->group < 0) {
+			if (decode_remote(index->remotes[unit->pos], result))
+				return 1;
+			continue;
+		}
+		count = add_group_candidates(index, unit->group, count);
+	}
+	for (; next < count; next++)
+		if (decode_remote(index->remotes[index->pending[next]], result))
+			return 1;
+	return 0;
+}
+
+
+char* decode_all(struct ir_remote* remotes)
+{
+	struct ir_remote_index* index;
+	struct ir_remote* remote;
+	char* message;
+
+	/* use remotes carefully, it may be changed on SIGHUP */
+	decoding = remote = remotes;
+	index = remote_index_refresh(remotes);
+	if (index != NULL && index->group_count > 0 && !dyncodes
+	    && curr_driver->decode_func == receive_decode
+	    && !rec_get_update_mode() && !rec_buffer_at_eof()) {
+		if (decode_indexed(index, &message))
+			return message;
+		remote = NULL;
+	}
+	while (remote) {
+		if (decode_remote(remote, &message))
+			return message;
 		remote = remote->next;
 	}
 	decoding = NULL;
@@ -820,33 +1749,118 @@ char* decode_all(struct ir_remote* remotes)
 }
 
 
-int send_ir_ncode(struct ir_remote* remote, struct ir_ncode* code, int delay)
+/** Run with SCHED_FIFO, return previous policy or -1 if unchanged. */
+static int pacing_enable_realtime(void)
 {
-	int ret;
+	static int warned = 0;
+	struct sched_param param = { .sched_priority = 1 };
+	int policy;
+
+	policy = sched_getscheduler(0);
+	if (policy != SCHED_OTHER)
+		/* Already realtime, or a policy we do not restore. */
+		return -1;
+	if (sched_setscheduler(0, SCHED_FIFO, &param) < 0) {
+		if (!warned)
+			log_warn("Cannot send with SCHED_FIFO: %s",
+				 strerror(errno));
+		warned = 1;
+		return -1;
+	}
+	return policy;
+}
 
-	if (delay) {
-		/* insert pause when needed: */
-		if (remote->last_code != NULL) {
-			struct timeval current;
-			unsigned long usecs;
-
-			gettimeofday(&current, NULL);
-			usecs = time_left(&current,
-					  &remote->last_send,
-					  remote->min_remaining_gap * 2);
-			if (usecs > 0) {
-				if (repeat_remote == NULL || remote !=
-				    repeat_remote
-				    || remote->last_code != code)
-					usleep(usecs);
-			}
+
+static void pacing_restore(int policy)
+{
+	struct sched_param param = { .sched_priority = 0 };
+
+	if (policy == -1)
+		return;
+	if (sched_setscheduler(0, policy, &param) < 0)
+		log_warn("Restoring scheduling policy failed: %s",
+			 strerror(errno));
+}
+
+
+void send_pacing_set(unsigned int busy_wait, int realtime)
+{
+	pacing.busy_wait = busy_wait;
+	pacing.realtime = realtime;
+}
+
+
+void send_pacing_wait(const struct timespec* deadline)
+{
+	struct timespec now;
+	struct timespec wakeup;
+	long long error;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (timespec_diff_ns(deadline, &now) <= 0)
+		return;
+	wakeup = *deadline;
+	if (pacing.busy_wait > 0) {
+		wakeup.tv_sec -= pacing.busy_wait / 1000000;
+		wakeup.tv_nsec -= (pacing.busy_wait % 1000000) * 1000;
+		if (wakeup.tv_nsec < 0) {
+			wakeup.tv_sec -= 1;
+			wakeup.tv_nsec += 1000000000;
 		}
 	}
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+			       &wakeup, NULL) == EINTR)
+		;
+	do
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	while (timespec_diff_ns(deadline, &now) > 0);
+	error = timespec_diff_ns(&now, deadline);
+	pacing.stats.waits += 1;
+	pacing.stats.error_sum += error;
+	pacing.stats.error_last = error;
+	if (error > (long long)pacing.stats.error_max)
+		pacing.stats.error_max = error;
+}
+
+
+void send_pacing_get_stats(struct send_pacing_stats* stats)
+{
+	*stats = pacing.stats;
+}
+
+
+void send_pacing_clear_stats(void)
+{
+	memset(&pacing.stats, 0, sizeof(pacing.stats));
+}
+
+
+int send_ir_ncode(struct ir_remote* remote, struct ir_ncode* code, int delay)
+{
+	struct timespec before;
+	struct timespec after;
+	int policy = -1;
+	int ret;
+
+	if (pacing.realtime)
+		policy = pacing_enable_realtime();
+	/* Wait for the previous frame and the gap, also between repeats. */
+	if (delay && remote->last_code != NULL)
+		send_pacing_wait(&remote->next_send);
+	clock_gettime(CLOCK_MONOTONIC, &before);
 	ret = curr_driver->send_func(remote, code);
+	pacing_restore(policy);
 
 	if (ret) {
 		gettimeofday(&remote->last_send, NULL);
 		remote->last_code = code;
+		/* Drivers blocking until the signal is sent return after it. */
+		clock_gettime(CLOCK_MONOTONIC, &after);
+		remote->next_send = before;
+		timespec_add_us(&remote->next_send, send_buffer_sum());
+		if (timespec_diff_ns(&after, &remote->next_send) > 0)
+			remote->next_send = after;
+		timespec_add_us(&remote->next_send, remote->min_remaining_gap);
 	}
 	return ret;
 }
@@ -43,6 +43,59 @@ struct ir_ncode* ncode_dup(struct ir_ncode* ncode);
 /** Dispose an ir_ncode instance obtained from ncode_dup(). */
 void ncode_free(struct ir_ncode* ncode);
 
+/**
+ * Build the compact code table for remote, moving the names and
+ * sequence nodes of all codes into the table's pools. Called after
+ * parsing. If remote already has a table its keys are refreshed from
+ * the current pre/post data, masks and bits. Returns 0 on success, else
+ * -1 leaving remote unchanged.
+ */
+int ir_code_table_build(struct ir_remote* remote);
+
+/** Dispose the code table built by ir_code_table_build(), if any. */
+void ir_code_table_free(struct ir_remote* remote);
+
+/** Return true if ptr is a name or node owned by remote's code table. */
+int ir_code_table_owns(const struct ir_remote* remote, const void* ptr);
+
+/**
+ * Return remote's code table, or NULL if it's missing or not in sync
+ * with the remote's current pre/post data, masks and bit counts.
+ */
+const struct ir_code_table* ir_code_table_get(const struct ir_remote* remote);
+
+/** Return true if remote->codes[i] has a sequence i. e., a next list. */
+static inline int ir_code_table_has_seq(const struct ir_code_table*	table,
+					int				i)
+{
+	return table->seq_offset[i] != table->seq_offset[i + 1];
+}
+
+/**
+ * Build the lookup index for the remotes list, stored in the list head.
+ * It makes get_ir_remote() and is_in_remotes() logarithmic and lets
+ * decode_all() decode remotes sharing the same protocol parameters only
+ * once. Called after parsing; the list should not be modified afterwards.
+ * Returns 0 on success, else -1 leaving remotes unindexed.
+ */
+int ir_remote_index_build(struct ir_remote* remotes);
+
+/** Dispose the index built by ir_remote_index_build(), if any. */
+void ir_remote_index_free(struct ir_remote* remotes);
+
+/**
+ * Mark all indexes as outdated after remotes have changed, e. g. when
+ * lazy codes are loaded. They are rebuilt on next use.
+ */
+void ir_remote_index_invalidate(void);
+
+/**
+ * Refresh the precomputed timing bounds in remote->bounds which have
+ * changed since last call, e. g. after modifying the remote or changing
+ * the driver resolution. Cheap if nothing has changed.
+ */
+void ir_remote_update_bounds(struct ir_remote* remote);
+
 
 /**
  * TODO
@@ -394,6 +447,27 @@ static inline lirc_t lower_limit(const struct ir_remote* remote, lirc_t val)
 	return eps_val < aeps_val ? eps_val : aeps_val;
 }
 
+/** Set b to the range of values accepted by expect() for val. */
+static inline void init_bounds(const struct ir_remote*	remote,
+			       struct ir_bounds*	b,
+			       lirc_t			val)
+{
+	int aeps = curr_driver->resolution > remote->aeps ?
+		   curr_driver->resolution : remote->aeps;
+	lirc_t eps_val = val * remote->eps / 100;
+	lirc_t tolerance = eps_val > aeps ? eps_val : aeps;
+
+	b->val = val;
+	b->min = val - tolerance;
+	b->max = val + tolerance;
+}
+
+/** Like expect(), using bounds from init_bounds(). */
+static inline int expect_bounds(const struct ir_bounds* b, lirc_t delta)
+{
+	return delta >= b->min && delta <= b->max;
+}
+
 /* only works if last <= current */
 static inline unsigned long time_elapsed(const struct timeval*	last,
 					 const struct timeval*	current)
@@ -504,16 +578,48 @@ char* decode_all(struct ir_remote* remotes);
  * Transmits the actual code in the second  argument by calling the
  * current hardware driver.  The processing depends on global
  * repeat-remote. If this is not-NULL, the codes are sent using repeat
- * formatting if the remote supports it.
+ * formatting if the remote supports it. On success, remote->next_send
+ * is updated for the next frame.
  * @param remote Currently active remote, used as database for timing,
  *     and as keeper of an internal state.
  * @param code IR code to be transmitted
- * @param delay If true (normal case), generate a delay corresponding
- *     to the time it takes to send the code. If not (test case), don't.
+ * @param delay If true (normal case), wait until remote->next_send:
+ *     the previous frame's signal and min_remaining_gap after its
+ *     start. If not (test case, or caller waits itself), don't.
  * @return Non-zero if success.
  */
 int send_ir_ncode(struct ir_remote* remote, struct ir_ncode* code, int delay);
 
+/** Gap errors of the frames send_ir_ncode() waited for, see send_pacing_wait(). */
+struct send_pacing_stats {
+	unsigned long		waits;          /**< Number of waits for a deadline. */
+	unsigned long long	error_sum;      /**< Sum of errors (ns). */
+	unsigned long		error_max;      /**< Largest error (ns). */
+	unsigned long		error_last;     /**< Error of the last wait (ns). */
+};
+
+/**
+ * Configure how send_ir_ncode() waits for the next frame.
+ * @param busy_wait Spin on CLOCK_MONOTONIC instead of sleeping for the
+ *     last busy_wait microseconds before a deadline.
+ * @param realtime If true, run with SCHED_FIFO while waiting and
+ *     sending. Requires CAP_SYS_NICE, else a warning is logged.
+ */
+void send_pacing_set(unsigned int busy_wait, int realtime);
+
+/**
+ * Wait until the absolute CLOCK_MONOTONIC deadline, as configured by
+ * send_pacing_set(). If the deadline is in the future, the time
+ * between it and the return is added to the pacing statistics.
+ */
+void send_pacing_wait(const struct timespec* deadline);
+
+/** Get the pacing statistics since start or send_pacing_clear_stats(). */
+void send_pacing_get_stats(struct send_pacing_stats* stats);
+
+/** Reset the pacing statistics. */
+void send_pacing_clear_stats(void);
+
 #ifdef __cplusplus
 }
 #endif
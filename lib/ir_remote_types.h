@@ -89,6 +89,81 @@ struct ir_ncode {
 	struct ir_ncode*	next_ncode;
 };
 
+/**
+ * Compact, struct-of-arrays representation of the codes in a remote,
+ * built by ir_code_table_build() after parsing. Entry i describes
+ * remote->codes[i]. The ir_ncode array remains the public API, but the
+ * names and sequence nodes it points to live in the pools below.
+ */
+struct ir_code_table {
+	int			size;           /**< Number of codes. */
+	/** Complete code (pre + code + post) | ignore_mask for each ncode. */
+	ir_code*		keys;
+	/** Offset into nodes for each ncode's sequence, size + 1 items. */
+	unsigned int*		seq_offset;
+	/** Flattened sequence table backing all ncode->next lists. */
+	struct ir_code_node*	nodes;
+	/** Indexes of ncodes with a sequence, i. e., a next list. */
+	int*			seq_codes;
+	int			seq_count;      /**< Number of items in seq_codes */
+	char*			names;          /**< String pool for ncode->name */
+	size_t			names_size;     /**< Size of names pool. */
+
+	/* Remote data the table is built from, see ir_code_table_get(). */
+	const struct ir_ncode*	codes;
+	ir_code			pre_data;
+	ir_code			post_data;
+	ir_code			ignore_mask;
+	int			bits;
+	int			pre_data_bits;
+	int			post_data_bits;
+	int			flags;
+};
+
+/**
+ * Location of a "begin codes" block which is parsed on first use, see
+ * ir_remote_load_codes().
+ */
+struct ir_lazy_codes {
+	char*		path;           /**< Absolute path of config file. */
+	long		offset;         /**< File offset after "begin codes". */
+	int		line;           /**< Line number of "begin codes". */
+	int		reverse;        /**< Codes must be reversed (REVERSE). */
+};
+
+/** Lookup index for a list of remotes, see ir_remote_index_build(). */
+struct ir_remote_index;
+
+/**
+ * Timing values with precomputed bounds in struct ir_remote, see
+ * ir_remote_update_bounds(). The _X2 entries are doubled values used
+ * by biphase encodings, the sums are used by RC-MM and Grundig.
+ */
+enum ir_bound {
+	IR_B_PHEAD, IR_B_SHEAD,
+	IR_B_PONE, IR_B_SONE,
+	IR_B_PZERO, IR_B_SZERO,
+	IR_B_PTWO, IR_B_STWO,
+	IR_B_PTHREE, IR_B_STHREE,
+	IR_B_PONE_X2, IR_B_SONE_X2,
+	IR_B_PZERO_X2, IR_B_SZERO_X2,
+	IR_B_PLEAD, IR_B_PTRAIL,
+	IR_B_PFOOT, IR_B_SFOOT,
+	IR_B_PREPEAT, IR_B_SREPEAT,
+	IR_B_PRE_P, IR_B_PRE_S,
+	IR_B_POST_P, IR_B_POST_S,
+	IR_B_HEAD, IR_B_ZERO, IR_B_ONE, IR_B_TWO, IR_B_THREE,
+	IR_B_MIN_GAP, IR_B_MAX_GAP,
+	IR_B_COUNT
+};
+
+/** Range [min, max] accepted by expect() for the nominal value val. */
+struct ir_bounds {
+	lirc_t	val;
+	lirc_t	min;
+	lirc_t	max;
+};
+
 /*
  * struct ir_remote
  * defines the encoding of a remote control
@@ -240,6 +315,13 @@ struct ir_remote {
 	int			release_detected;       /**< set by release generator */
 	int			manual_sort;            /**< If set in any remote, disables automatic sorting. */
 	struct ir_remote*	next;
+	struct ir_code_table*	code_table;     /**< Compact codes, or NULL. */
+	struct ir_remote_index* index;          /**< List index, head only. */
+	struct ir_lazy_codes*	lazy_codes;     /**< Unparsed codes, or NULL. */
+	struct ir_bounds	bounds[IR_B_COUNT];     /**< Timing bounds. */
+	int			bounds_eps;             /**< eps used by bounds. */
+	int			bounds_aeps;            /**< aeps used by bounds. */
+	struct timespec		next_send;      /**< Earliest start of next frame sent, CLOCK_MONOTONIC. */
 };
 
 #ifdef __cplusplus
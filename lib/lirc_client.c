@@ -21,6 +21,7 @@
 #endif
 
 #include <errno.h>
+#include <fcntl.h>
 #include <libgen.h>
 #include <limits.h>
 #include <netdb.h>
@@ -38,6 +39,7 @@
 #include <sys/wait.h>
 #include <sys/un.h>
 #include <unistd.h>
+#include <ctype.h>
 
 #include "lirc_client.h"
 
@@ -60,6 +62,10 @@ static const struct timeval CMD_TIMEOUT = { .tv_sec = 1, .tv_usec = 0 };
 #define MAX_INCLUDES 10
 #define LIRC_READ 255
 #define LIRC_PACKET_SIZE 255
+/* max steps in a SEND_SEQUENCE command, as accepted by lircd */
+#define LIRC_SEQUENCE_STEPS 32
+/* initial lirc_nextcodes() buffer, room for a burst of events */
+#define LIRC_RBUF_SIZE (4 * PACKET_SIZE)
 /* three seconds */
 #define LIRC_TIMEOUT 3
 
@@ -94,7 +100,14 @@ unsigned int lirc_flags(char* string);
 static int lirc_lircd = -1;
 static int lirc_verbose = 0;
 static char* lirc_prog = NULL;
-static char* lirc_buffer = NULL;
+
+/** Receive buffer shared by lirc_nextcode() and lirc_nextcodes(). */
+static struct {
+	char*	data;
+	size_t	size;   /**< Allocated size. */
+	size_t	head;   /**< Start of first line not yet returned. */
+	size_t	tail;   /**< End of received data. */
+} lirc_rbuf = { NULL, 0, 0, 0 };
 
 char* prog;
 
@@ -370,9 +383,12 @@ int lirc_deinit(void)
 		free(lirc_prog);
 		lirc_prog = NULL;
 	}
-	if (lirc_buffer != NULL) {
-		free(lirc_buffer);
-		lirc_buffer = NULL;
+	if (lirc_rbuf.data != NULL) {
+		free(lirc_rbuf.data);
+		lirc_rbuf.data = NULL;
+		lirc_rbuf.size = 0;
+		lirc_rbuf.head = 0;
+		lirc_rbuf.tail = 0;
 	}
 	if (lirc_lircd != -1) {
 		r = close(lirc_lircd);
@@ -1412,6 +1428,7 @@ static int lirc_readconfig_only_internal(const char*		file,
 		else
 			(*config)->lircrc_class = NULL;
 		(*config)->sockfd = -1;
+		(*config)->index = NULL;
 		if (full_name != NULL) {
 			*full_name = save_full_name;
 			save_full_name = NULL;
@@ -1523,11 +1540,65 @@ lirc_readconfig_compat:
 }
 
 
+static struct lirc_config_index* lirc_buildconfigindex(
+	struct lirc_config* config);
+
+
 int lirc_readconfig_only(const char*		file,
 			 struct lirc_config**	config,
 			 int			(check) (char* s))
 {
-	return lirc_readconfig_only_internal(file, config, check, NULL);
+	int ret;
+
+	ret = lirc_readconfig_only_internal(file, config, check, NULL);
+	/* Users like lircrcd dispatch many codes, build index up front. */
+	if (ret == 0)
+		(*config)->index = lirc_buildconfigindex(*config);
+	return ret;
+}
+
+
+/**
+ * Index of the entries in a lirc_config used by lirc_code2char(). Entries
+ * matching a single, given remote and button are hashed on mode, remote
+ * and button. Wildcard entries and entries which have state changing
+ * also for other buttons (sequences, toggle_reset) are kept in separate
+ * lists which are always checked. Entries are referred to by position
+ * in the config list so candidates can be checked in list order.
+ */
+struct lirc_config_index {
+	struct lirc_config_entry**	entries;        /**< Entries, in order. */
+	int				count;
+	int*				buckets;        /**< First node, or -1. */
+	unsigned int			bucket_mask;
+	struct lircrc_node*		nodes;          /**< One per hashed entry */
+	int*				wildcards;      /**< Positions, ascending. */
+	int				wildcard_count;
+	int*				sequences;      /**< Positions, ascending. */
+	int				sequence_count;
+	int*				candidates;     /**< Scratch, see get_candidates() */
+	int				next_pos;       /**< Position of next. */
+};
+
+/** Hashed entry, linked in order within its bucket. */
+struct lircrc_node {
+	unsigned int	hash;
+	int		pos;
+	int		next;
+};
+
+
+static void lirc_freeconfigindex(struct lirc_config_index* index)
+{
+	if (index == NULL)
+		return;
+	free(index->entries);
+	free(index->buckets);
+	free(index->nodes);
+	free(index->wildcards);
+	free(index->sequences);
+	free(index->candidates);
+	free(index);
 }
 
 
@@ -1540,6 +1611,7 @@ void lirc_freeconfig(struct lirc_config* config)
 		}
 		if (config->lircrc_class != NULL)
 			free(config->lircrc_class);
+		lirc_freeconfigindex(config->index);
 		lirc_freeconfigentries(config->first);
 		free(config->current_mode);
 		free(config);
@@ -1739,25 +1811,274 @@ char* lirc_ir2char(struct lirc_config* config, char* code)
 }
 
 
+/**
+ * Case insensitive FNV-1a hash of s, continuing from hash. NULL (no
+ * mode) and LIRC_ALL (any remote) hash as an empty string.
+ */
+static unsigned int hash_string(unsigned int hash, const char* s)
+{
+	if (s == NULL || s == LIRC_ALL)
+		s = "";
+	for (; *s != '\0'; s++) {
+		hash ^= (unsigned char)tolower((unsigned char)*s);
+		hash *= 16777619U;
+	}
+	hash ^= 0xff;
+	hash *= 16777619U;
+	return hash;
+}
+
+
+static unsigned int hash_key(const char* mode,
+			     const char* remote,
+			     const char* button)
+{
+	unsigned int hash = 2166136261U;
+
+	hash = hash_string(hash, mode);
+	hash = hash_string(hash, remote);
+	return hash_string(hash, button);
+}
+
+
+/**
+ * Return true if lirc_iscode() can only match scan for a single
+ * button on a single or any remote and has no side effects for other
+ * buttons.
+ */
+static int is_hashable(const struct lirc_config_entry* scan)
+{
+	return scan->code != NULL
+	       && scan->code->next == NULL
+	       && scan->code->remote != NULL
+	       && scan->code->button != NULL
+	       && scan->code->button != LIRC_ALL;
+}
+
+
+static struct lirc_config_index* lirc_buildconfigindex(
+	struct lirc_config* config)
+{
+	struct lirc_config_index* index;
+	struct lirc_config_entry* scan;
+	struct lircrc_node* node;
+	unsigned int bucket_count;
+	unsigned int slot;
+	int* tail;
+	int count = 0;
+	int pos;
+
+	for (scan = config->first; scan != NULL; scan = scan->next)
+		count++;
+	for (bucket_count = 16; bucket_count < 2 * (unsigned)count; )
+		bucket_count *= 2;
+	index = calloc(1, sizeof(struct lirc_config_index));
+	if (index == NULL)
+		return NULL;
+	index->count = count;
+	index->bucket_mask = bucket_count - 1;
+	index->entries = calloc(count + 1, sizeof(struct lirc_config_entry*));
+	index->buckets = malloc(bucket_count * sizeof(int));
+	index->nodes = calloc(count + 1, sizeof(struct lircrc_node));
+	index->wildcards = calloc(count + 1, sizeof(int));
+	index->sequences = calloc(count + 1, sizeof(int));
+	index->candidates = calloc(4 * count + 1, sizeof(int));
+	tail = malloc(bucket_count * sizeof(int));
+	if (index->entries == NULL || index->buckets == NULL
+	    || index->nodes == NULL || index->wildcards == NULL
+	    || index->sequences == NULL || index->candidates == NULL
+	    || tail == NULL) {
+		free(tail);
+		lirc_freeconfigindex(index);
+		return NULL;
+	}
+	memset(index->buckets, -1, bucket_count * sizeof(int));
+	for (pos = 0, scan = config->first; scan != NULL; pos++) {
+		index->entries[pos] = scan;
+		if (scan->code != NULL && scan->code->next != NULL) {
+			index->sequences[index->sequence_count++] = pos;
+		} else if (scan->flags & toggle_reset) {
+			index->sequences[index->sequence_count++] = pos;
+		} else if (!is_hashable(scan)) {
+			index->wildcards[index->wildcard_count++] = pos;
+		} else {
+			node = &index->nodes[pos];
+			node->hash = hash_key(scan->mode,
+					      scan->code->remote,
+					      scan->code->button);
+			node->pos = pos;
+			node->next = -1;
+			slot = node->hash & index->bucket_mask;
+			if (index->buckets[slot] == -1)
+				index->buckets[slot] = pos;
+			else
+				index->nodes[tail[slot]].next = pos;
+			tail[slot] = pos;
+		}
+		scan = scan->next;
+	}
+	free(tail);
+	return index;
+}
+
+
+static int cmp_int(const void* a, const void* b)
+{
+	return *(const int*)a - *(const int*)b;
+}
+
+
+/** Append hashed positions for key to candidates, return new count. */
+static int add_hashed(const struct lirc_config_index*	index,
+		      int				n,
+		      const char*			mode,
+		      const char*			remote,
+		      const char*			button)
+{
+	unsigned int hash = hash_key(mode, remote, button);
+	int pos;
+
+	pos = index->buckets[hash & index->bucket_mask];
+	for (; pos != -1; pos = index->nodes[pos].next) {
+		if (index->nodes[pos].hash == hash)
+			index->candidates[n++] = pos;
+	}
+	return n;
+}
+
+
+/**
+ * Fill index->candidates with the positions of all entries which
+ * lirc_iscode() might match or must update for remote and button in
+ * current mode, in list order. Return the number of candidates.
+ */
+static int get_candidates(struct lirc_config*	config,
+			  const char*		remote,
+			  const char*		button)
+{
+	struct lirc_config_index* index = config->index;
+	int n = 0;
+	int i;
+	int j;
+
+	n = add_hashed(index, n, NULL, remote, button);
+	n = add_hashed(index, n, NULL, LIRC_ALL, button);
+	if (config->current_mode != NULL) {
+		n = add_hashed(index, n, config->current_mode, remote, button);
+		n = add_hashed(index, n, config->current_mode, LIRC_ALL, button);
+	}
+	memcpy(index->candidates + n, index->wildcards,
+	       index->wildcard_count * sizeof(int));
+	n += index->wildcard_count;
+	memcpy(index->candidates + n, index->sequences,
+	       index->sequence_count * sizeof(int));
+	n += index->sequence_count;
+	qsort(index->candidates, n, sizeof(int), cmp_int);
+	for (i = 0, j = 0; i < n; i++) {
+		if (j == 0 || index->candidates[j - 1] != index->candidates[i])
+			index->candidates[j++] = index->candidates[i];
+	}
+	return j;
+}
+
+
+/** Return the list position of config->next, count if NULL. */
+static int get_next_pos(struct lirc_config* config)
+{
+	struct lirc_config_index* index = config->index;
+	int pos;
+
+	if (config->next == NULL)
+		return index->count;
+	if (index->next_pos < index->count
+	    && index->entries[index->next_pos] == config->next)
+		return index->next_pos;
+	for (pos = 0; pos < index->count; pos++) {
+		if (index->entries[pos] == config->next)
+			return pos;
+	}
+	return index->count;
+}
+
+
+/**
+ * Handle a single entry while translating a code: run lirc_iscode() and
+ * possibly execute it, see lirc_code2char_internal().
+ * @return 1 if a string is found and the search should stop, 2 if the
+ *     entry was executed and might have changed mode, else 0.
+ */
+static int dispatch_entry(struct lirc_config*		config,
+			  struct lirc_config_entry*	scan,
+			  char*				remote,
+			  char*				button,
+			  int				rep,
+			  char**			s,
+			  char**			prog,
+			  int*				quit_happened)
+{
+	int exec_level;
+	int r = 0;
+
+	exec_level = lirc_iscode(scan, remote, button, rep);
+	if (exec_level > 0 &&
+	    (scan->mode == NULL ||
+	     (scan->mode != NULL &&
+	      config->current_mode != NULL &&
+	      strcasecmp(scan->mode,
+			 config->current_mode) == 0)) &&
+	    *quit_happened == 0) {
+		if (exec_level > 1) {
+			*s = lirc_execute(config, scan);
+			if (*s != NULL && prog != NULL)
+				*prog = scan->prog;
+			if (scan->change_mode != NULL || (scan->flags & mode))
+				r = 2;
+		} else {
+			*s = NULL;
+		}
+		if (scan->flags & quit) {
+			*quit_happened = 1;
+			config->next = NULL;
+		} else if (*s != NULL) {
+			config->next = scan->next;
+			return 1;
+		}
+	}
+	return r;
+}
+
+
 static int lirc_code2char_internal(struct lirc_config*	config,
 				   char*		code,
 				   char**		string,
 				   char**		prog)
 {
 	int rep;
+	char buff[PACKET_SIZE + 1];
 	char* backup;
 	char* remote;
 	char* button;
 	char* s = NULL;
 	struct lirc_config_entry* scan;
-	int exec_level;
+	struct lirc_config_index* index;
+	size_t len;
 	int quit_happened;
+	int count;
+	int start;
+	int pos;
+	int r;
+	int i;
 
 	*string = NULL;
 	if (sscanf(code, "%*x %x %*s %*s\n", &rep) == 1) {
-		backup = strdup(code);
-		if (backup == NULL)
-			return -1;
+		len = strlen(code);
+		if (len < sizeof(buff)) {
+			backup = memcpy(buff, code, len + 1);
+		} else {
+			backup = strdup(code);
+			if (backup == NULL)
+				return -1;
+		}
 
 		strtok(backup, " ");
 		strtok(NULL, " ");
@@ -1765,47 +2086,57 @@ static int lirc_code2char_internal(struct lirc_config*	config,
 		remote = strtok(NULL, "\n");
 
 		if (button == NULL || remote == NULL) {
-			free(backup);
+			if (backup != buff)
+				free(backup);
 			return 0;
 		}
 
-		scan = config->next;
+		if (config->index == NULL)
+			config->index = lirc_buildconfigindex(config);
+		index = config->index;
 		quit_happened = 0;
-		while (scan != NULL) {
-			exec_level = lirc_iscode(scan, remote, button, rep);
-			if (exec_level > 0 &&
-			    (scan->mode == NULL ||
-			     (scan->mode != NULL &&
-			      config->current_mode != NULL &&
-			      strcasecmp(scan->mode,
-					 config->current_mode) == 0)) &&
-			    quit_happened == 0) {
-				if (exec_level > 1) {
-					s = lirc_execute(config, scan);
-					if (s != NULL && prog != NULL)
-						*prog = scan->prog;
-				} else {
-					s = NULL;
-				}
-				if (scan->flags & quit) {
-					quit_happened = 1;
-					config->next = NULL;
-					scan = scan->next;
+		if (index != NULL) {
+			start = get_next_pos(config);
+			count = get_candidates(config, remote, button);
+			for (i = 0; i < count; i++) {
+				pos = index->candidates[i];
+				if (pos < start)
 					continue;
-				} else if (s != NULL) {
-					config->next = scan->next;
+				scan = index->entries[pos];
+				r = dispatch_entry(config, scan, remote, button,
+						   rep, &s, prog, &quit_happened);
+				if (r == 1) {
+					index->next_pos = pos + 1;
 					break;
 				}
+				if (r == 2) {
+					/* Following entries see the new mode. */
+					count = get_candidates(config,
+							       remote, button);
+					start = pos + 1;
+					i = -1;
+				}
+			}
+		} else {
+			scan = config->next;
+			while (scan != NULL) {
+				r = dispatch_entry(config, scan, remote, button,
+						   rep, &s, prog, &quit_happened);
+				if (r == 1)
+					break;
+				scan = scan->next;
 			}
-			scan = scan->next;
 		}
-		free(backup);
+		if (backup != buff)
+			free(backup);
 		if (s != NULL) {
 			*string = s;
 			return 0;
 		}
 	}
 	config->next = config->first;
+	if (config->index != NULL)
+		config->index->next_pos = 0;
 	return 0;
 }
 
@@ -1876,60 +2207,95 @@ char* lirc_nextir(void)
 }
 
 
-int lirc_nextcode(char** code)
+/**
+ * Split next complete line off the receive buffer, replacing the
+ * newline with a nul. Return 1 and the line in *line, 0 if there is no
+ * complete line.
+ */
+static int lirc_rbuf_getline(char** line)
 {
-	static int packet_size = PACKET_SIZE;
-	static int end_len = 0;
-	ssize_t len = 0;
+	char* start = lirc_rbuf.data + lirc_rbuf.head;
 	char* end;
-	char c;
 
-	*code = NULL;
-	if (lirc_buffer == NULL) {
-		lirc_buffer = (char*)malloc(packet_size + 1);
-		if (lirc_buffer == NULL) {
+	end = (char*)memchr(start, '\n', lirc_rbuf.tail - lirc_rbuf.head);
+	if (end == NULL)
+		return 0;
+	*end = '\0';
+	*line = start;
+	lirc_rbuf.head = end + 1 - lirc_rbuf.data;
+	return 1;
+}
+
+
+int lirc_nextcodes(char** codes, int max)
+{
+	int count = 0;
+	ssize_t len;
+	char* new_data;
+
+	if (lirc_rbuf.data == NULL) {
+		lirc_rbuf.data = (char*)malloc(LIRC_RBUF_SIZE);
+		if (lirc_rbuf.data == NULL) {
 			lirc_printf("%s: out of memory\n", lirc_prog);
 			return -1;
 		}
-		lirc_buffer[0] = 0;
+		lirc_rbuf.size = LIRC_RBUF_SIZE;
 	}
-	while ((end = strchr(lirc_buffer, '\n')) == NULL) {
-		if (end_len >= packet_size) {
-			char* new_buffer;
-
-			packet_size += PACKET_SIZE;
-			new_buffer =
-				(char*)realloc(lirc_buffer, packet_size + 1);
-			if (new_buffer == NULL)
-				return -1;
-			lirc_buffer = new_buffer;
-		}
-		len = read(lirc_lircd, lirc_buffer + end_len,
-			   packet_size - end_len);
-		if (len <= 0) {
-			if (len == -1 && errno == EAGAIN)
-				return 0;
-			else
-				return -1;
-		}
-		end_len += len;
-		lirc_buffer[end_len] = 0;
-		/* return if next code not yet available completely */
-		end = strchr(lirc_buffer, '\n');
-		if (end == NULL)
+	while (count < max && lirc_rbuf_getline(&codes[count]))
+		count++;
+	if (count > 0 || max <= 0)
+		return count;
+
+	/* All lines are consumed, keep a partial one at buffer start. */
+	if (lirc_rbuf.head > 0) {
+		memmove(lirc_rbuf.data,
+			lirc_rbuf.data + lirc_rbuf.head,
+			lirc_rbuf.tail - lirc_rbuf.head);
+		lirc_rbuf.tail -= lirc_rbuf.head;
+		lirc_rbuf.head = 0;
+	}
+	if (lirc_rbuf.tail >= lirc_rbuf.size) {
+		new_data = (char*)realloc(lirc_rbuf.data,
+					  lirc_rbuf.size + PACKET_SIZE);
+		if (new_data == NULL)
+			return -1;
+		lirc_rbuf.data = new_data;
+		lirc_rbuf.size += PACKET_SIZE;
+	}
+	len = read(lirc_lircd,
+		   lirc_rbuf.data + lirc_rbuf.tail,
+		   lirc_rbuf.size - lirc_rbuf.tail);
+	if (len <= 0) {
+		if (len == -1 && errno == EAGAIN)
 			return 0;
+		else
+			return -1;
 	}
-	/* copy first line to buffer (code) and move remaining chars to
-	 * lirc_buffers start */
-	end++;
-	end_len = strlen(end);
-	c = end[0];
-	end[0] = 0;
-	*code = strdup(lirc_buffer);
-	end[0] = c;
-	memmove(lirc_buffer, end, end_len + 1);
+	lirc_rbuf.tail += len;
+	while (count < max && lirc_rbuf_getline(&codes[count]))
+		count++;
+	return count;
+}
+
+
+int lirc_nextcode(char** code)
+{
+	char* line;
+	size_t len;
+	int r;
+
+	*code = NULL;
+	r = lirc_nextcodes(&line, 1);
+	if (r <= 0)
+		return r;
+	/* Historically, the returned code includes the newline. */
+	len = strlen(line);
+	*code = (char*)malloc(len + 2);
 	if (*code == NULL)
 		return -1;
+	memcpy(*code, line, len);
+	(*code)[len] = '\n';
+	(*code)[len + 1] = '\0';
 	return 0;
 }
 
@@ -2007,6 +2373,70 @@ int lirc_send_one(int fd, const char* remote, const char* keysym)
 }
 
 
+int lirc_send_sequence(int				fd,
+		       const struct lirc_send_step*	steps,
+		       int				count)
+{
+	lirc_cmd_ctx command;
+	char buff[PACKET_SIZE];
+	char step[PACKET_SIZE];
+	size_t len;
+	int first = 0;
+	int n;
+	int i;
+	int r;
+
+	while (first < count) {
+		len = snprintf(buff, sizeof(buff), "SEND_SEQUENCE");
+		for (i = first;
+		     i < count && i - first < LIRC_SEQUENCE_STEPS; i++) {
+			n = snprintf(step, sizeof(step), "%s %s %s",
+				     i > first ? "," : "",
+				     steps[i].remote, steps[i].keysym);
+			if (n < 0 || (size_t)n >= sizeof(step))
+				goto too_long;
+			if (steps[i].delay > 0)
+				r = snprintf(step + n, sizeof(step) - n,
+					     " %d %u",
+					     steps[i].repeats > 0 ?
+						steps[i].repeats : 0,
+					     steps[i].delay);
+			else if (steps[i].repeats > 0)
+				r = snprintf(step + n, sizeof(step) - n,
+					     " %d", steps[i].repeats);
+			else
+				r = 0;
+			if (r < 0 || (size_t)r >= sizeof(step) - n)
+				goto too_long;
+			n += r;
+			/* Leave room for newline. */
+			if (len + n + 1 >= sizeof(buff))
+				break;
+			strcpy(buff + len, step);
+			len += n;
+		}
+		if (i == first)
+			goto too_long;
+		r = lirc_command_init(&command, "%s\n", buff);
+		if (r != 0)
+			return r;
+		do
+			r = lirc_command_run(&command, fd);
+		while (r == EAGAIN);
+		if (r != 0)
+			return r;
+		first = i;
+	}
+	return 0;
+
+too_long:
+	logprintf(LIRC_NOTICE, "Sequence step too big: %s %s",
+		  steps[i].remote, steps[i].keysym);
+	errno = EMSGSIZE;
+	return EMSGSIZE;
+}
+
+
 int lirc_simulate(int		fd,
 		  const char*	remote,
 		  const char*	keysym,
@@ -2099,3 +2529,384 @@ int lirc_get_remote_socket(const char* address, int port, int quiet)
 	freeaddrinfo(addrinfos);
 	return r;
 }
+
+
+/** A command queued by lirc_async_command(). */
+struct lirc_async_cmd {
+	struct lirc_async_cmd*	next;
+	lirc_reply_func		on_reply;
+	void*			data;
+	char			packet[PACKET_SIZE + 1];
+};
+
+
+/** Growable byte buffer, data lives in [head, tail). */
+struct lirc_async_buf {
+	char*	data;
+	size_t	size;
+	size_t	head;
+	size_t	tail;
+};
+
+
+struct lirc_async {
+	int			fd;
+	lirc_event_func		on_event;
+	void*			data;
+
+	struct lirc_async_cmd*	first;  /**< Outstanding, oldest first. */
+	struct lirc_async_cmd*	last;
+	struct lirc_async_cmd*	unused; /**< Completed, for reuse. */
+	int			pending;
+
+	struct lirc_async_buf	out;
+	struct lirc_async_buf	in;
+	struct lirc_async_buf	reply;
+
+	/* Reply parser state, in_reply is false between replies. */
+	int			in_reply;
+	enum packet_state	state;
+	struct lirc_async_cmd*	cmd;    /**< Command replied to, or NULL. */
+	int			status;
+	uint32_t		data_n;
+	uint32_t		n;
+};
+
+
+/** Make room for len more bytes at buf->tail, 0 or ENOMEM. */
+static int async_buf_reserve(struct lirc_async_buf* buf, size_t len)
+{
+	size_t size;
+	char* data;
+
+	if (buf->head > 0 && buf->head == buf->tail) {
+		buf->head = 0;
+		buf->tail = 0;
+	}
+	if (buf->tail + len <= buf->size)
+		return 0;
+	if (buf->head > 0) {
+		memmove(buf->data, buf->data + buf->head,
+			buf->tail - buf->head);
+		buf->tail -= buf->head;
+		buf->head = 0;
+		if (buf->tail + len <= buf->size)
+			return 0;
+	}
+	size = buf->size > 0 ? buf->size : PACKET_SIZE;
+	while (size < buf->tail + len)
+		size *= 2;
+	data = (char*)realloc(buf->data, size);
+	if (data == NULL)
+		return ENOMEM;
+	buf->data = data;
+	buf->size = size;
+	return 0;
+}
+
+
+static int async_buf_append(struct lirc_async_buf*	buf,
+			    const char*			s,
+			    size_t			len)
+{
+	if (async_buf_reserve(buf, len) != 0)
+		return ENOMEM;
+	memcpy(buf->data + buf->tail, s, len);
+	buf->tail += len;
+	return 0;
+}
+
+
+static struct lirc_async_cmd* async_find_cmd(lirc_async* ctx,
+					     const char* message)
+{
+	struct lirc_async_cmd* cmd;
+	size_t len = strlen(message);
+
+	for (cmd = ctx->first; cmd != NULL; cmd = cmd->next) {
+		if (strcspn(cmd->packet, "\n") == len
+		    && strncasecmp(cmd->packet, message, len) == 0)
+			return cmd;
+	}
+	return NULL;
+}
+
+
+/** Unlink cmd from the outstanding list and invoke its callback. */
+static void async_complete(lirc_async*			ctx,
+			   struct lirc_async_cmd*	cmd,
+			   int				status,
+			   const char*			reply)
+{
+	struct lirc_async_cmd** prev;
+	struct lirc_async_cmd* last = NULL;
+
+	for (prev = &ctx->first; *prev != cmd; prev = &(*prev)->next)
+		last = *prev;
+	*prev = cmd->next;
+	if (ctx->last == cmd)
+		ctx->last = last;
+	ctx->pending -= 1;
+	if (cmd->on_reply != NULL)
+		cmd->on_reply(cmd->data, status, cmd->packet, reply);
+	cmd->next = ctx->unused;
+	ctx->unused = cmd;
+}
+
+
+static void async_complete_all(lirc_async* ctx, int status)
+{
+	while (ctx->first != NULL)
+		async_complete(ctx, ctx->first, status, "");
+	ctx->in_reply = 0;
+	ctx->cmd = NULL;
+}
+
+
+static void async_end_reply(lirc_async* ctx, int status)
+{
+	const char* reply = "";
+
+	if (ctx->cmd != NULL) {
+		if (async_buf_append(&ctx->reply, "", 1) == 0)
+			reply = ctx->reply.data + ctx->reply.head;
+		async_complete(ctx, ctx->cmd, status, reply);
+	}
+	ctx->in_reply = 0;
+	ctx->cmd = NULL;
+}
+
+
+/** Feed one line, using the same protocol as lirc_command_run(). */
+static void async_parse_line(lirc_async* ctx, char* line)
+{
+	char* endptr;
+
+	if (!ctx->in_reply) {
+		if (strcasecmp(line, "BEGIN") == 0) {
+			ctx->in_reply = 1;
+			ctx->state = P_MESSAGE;
+		} else if (*line && ctx->on_event != NULL) {
+			ctx->on_event(ctx->data, line);
+		}
+		return;
+	}
+	switch (ctx->state) {
+	case P_MESSAGE:
+		/* NULL for broadcasts like SIGHUP, parsed and dropped. */
+		ctx->cmd = async_find_cmd(ctx, line);
+		ctx->status = 0;
+		ctx->n = 0;
+		ctx->reply.head = 0;
+		ctx->reply.tail = 0;
+		ctx->state = P_STATUS;
+		return;
+	case P_STATUS:
+		if (strcasecmp(line, "SUCCESS") == 0) {
+			ctx->state = P_DATA;
+		} else if (strcasecmp(line, "ERROR") == 0) {
+			ctx->status = EIO;
+			ctx->state = P_DATA;
+		} else if (strcasecmp(line, "END") == 0) {
+			async_end_reply(ctx, 0);
+		} else {
+			goto bad_packet;
+		}
+		return;
+	case P_DATA:
+		if (strcasecmp(line, "END") == 0)
+			async_end_reply(ctx, ctx->status);
+		else if (strcasecmp(line, "DATA") == 0)
+			ctx->state = P_N;
+		else
+			goto bad_packet;
+		return;
+	case P_N:
+		ctx->data_n = (uint32_t)strtoul(line, &endptr, 0);
+		if (!*line || *endptr)
+			goto bad_packet;
+		ctx->state = ctx->data_n == 0 ? P_END : P_DATA_N;
+		return;
+	case P_DATA_N:
+		if (ctx->n > 0)
+			async_buf_append(&ctx->reply, "\n", 1);
+		async_buf_append(&ctx->reply, line, strlen(line));
+		ctx->n += 1;
+		if (ctx->n == ctx->data_n)
+			ctx->state = P_END;
+		return;
+	case P_END:
+		if (strcasecmp(line, "END") == 0)
+			async_end_reply(ctx, ctx->status);
+		else
+			goto bad_packet;
+		return;
+	default:
+		goto bad_packet;
+	}
+bad_packet:
+	logprintf(LIRC_WARNING, "%s: bad return packet\n", prog);
+	logprintf(LIRC_DEBUG, "State %d: bad packet: %s\n", ctx->state, line);
+	ctx->reply.head = 0;
+	ctx->reply.tail = 0;
+	async_end_reply(ctx, EPROTO);
+}
+
+
+lirc_async* lirc_async_new(int fd, lirc_event_func on_event, void* data)
+{
+	lirc_async* ctx;
+	int flags;
+
+	ctx = (lirc_async*)calloc(1, sizeof(lirc_async));
+	if (ctx == NULL)
+		return NULL;
+	ctx->fd = fd;
+	ctx->on_event = on_event;
+	ctx->data = data;
+	flags = fcntl(fd, F_GETFL);
+	if (flags != -1)
+		fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+	return ctx;
+}
+
+
+void lirc_async_free(lirc_async* ctx)
+{
+	struct lirc_async_cmd* cmd;
+
+	if (ctx == NULL)
+		return;
+	async_complete_all(ctx, ECANCELED);
+	while (ctx->unused != NULL) {
+		cmd = ctx->unused;
+		ctx->unused = cmd->next;
+		free(cmd);
+	}
+	free(ctx->out.data);
+	free(ctx->in.data);
+	free(ctx->reply.data);
+	free(ctx);
+}
+
+
+int lirc_async_fd(const lirc_async* ctx)
+{
+	return ctx->fd;
+}
+
+
+int lirc_async_want_write(const lirc_async* ctx)
+{
+	return ctx->out.tail > ctx->out.head;
+}
+
+
+int lirc_async_pending(const lirc_async* ctx)
+{
+	return ctx->pending;
+}
+
+
+int lirc_async_command(lirc_async*	ctx,
+		       lirc_reply_func	on_reply,
+		       void*		data,
+		       const char*	fmt,
+		       ...)
+{
+	struct lirc_async_cmd* cmd;
+	va_list ap;
+	int n;
+
+	cmd = ctx->unused;
+	if (cmd != NULL) {
+		ctx->unused = cmd->next;
+	} else {
+		cmd = (struct lirc_async_cmd*)malloc(sizeof(*cmd));
+		if (cmd == NULL)
+			return ENOMEM;
+	}
+	va_start(ap, fmt);
+	n = vsnprintf(cmd->packet, sizeof(cmd->packet), fmt, ap);
+	va_end(ap);
+	if (n >= PACKET_SIZE
+	    || async_buf_append(&ctx->out, cmd->packet, n) != 0) {
+		if (n >= PACKET_SIZE)
+			logprintf(LIRC_NOTICE,
+				  "Message too big: %s", cmd->packet);
+		cmd->next = ctx->unused;
+		ctx->unused = cmd;
+		return n >= PACKET_SIZE ? EMSGSIZE : ENOMEM;
+	}
+	logprintf(LIRC_DEBUG, "lirc_async_command: Queuing: %s", cmd->packet);
+	cmd->on_reply = on_reply;
+	cmd->data = data;
+	cmd->next = NULL;
+	if (ctx->last != NULL)
+		ctx->last->next = cmd;
+	else
+		ctx->first = cmd;
+	ctx->last = cmd;
+	ctx->pending += 1;
+	return lirc_async_on_writable(ctx);
+}
+
+
+int lirc_async_on_writable(lirc_async* ctx)
+{
+	ssize_t n;
+
+	while (ctx->out.tail > ctx->out.head) {
+		n = write(ctx->fd,
+			  ctx->out.data + ctx->out.head,
+			  ctx->out.tail - ctx->out.head);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 0;
+			return errno;
+		}
+		ctx->out.head += n;
+	}
+	ctx->out.head = 0;
+	ctx->out.tail = 0;
+	return 0;
+}
+
+
+int lirc_async_on_readable(lirc_async* ctx)
+{
+	struct lirc_async_buf* in = &ctx->in;
+	char* line;
+	char* end;
+	ssize_t n;
+	int r;
+
+	while (1) {
+		if (async_buf_reserve(in, PACKET_SIZE) != 0)
+			return ENOMEM;
+		n = read(ctx->fd, in->data + in->tail, in->size - in->tail);
+		if (n == 0) {
+			async_complete_all(ctx, ECONNRESET);
+			return ECONNRESET;
+		}
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 0;
+			r = errno;
+			async_complete_all(ctx, r);
+			return r;
+		}
+		in->tail += n;
+		while ((end = (char*)memchr(in->data + in->head, '\n',
+					    in->tail - in->head)) != NULL) {
+			line = in->data + in->head;
+			*end = '\0';
+			in->head = end + 1 - in->data;
+			async_parse_line(ctx, line);
+		}
+	}
+}
@@ -153,6 +153,9 @@ struct lirc_code {
 	struct lirc_code*	next;
 };
 
+/** Lookup index for lirc_code2char(), private to lirc_client. */
+struct lirc_config_index;
+
 struct lirc_config {
 	char*				lircrc_class; /**< The lircrc instance used, if any. */
 	char*				current_mode;
@@ -160,6 +163,7 @@ struct lirc_config {
 	struct lirc_config_entry*	first;
 
 	int				sockfd;
+	struct lirc_config_index*	index; /**< Built on read or first use. */
 };
 
 struct lirc_config_entry {
@@ -250,13 +254,30 @@ char* lirc_ir2char(struct lirc_config* config, char* code);
  */
 int lirc_nextcode(char** code);
 
+/**
+ * Get all complete codes available from the lircd daemon without
+ * allocating memory. Codes already buffered are returned first; if
+ * there are none, one read() is done and all complete lines it
+ * provides are returned.
+ *
+ * @param codes On exit, codes[0] ... codes[n - 1] points to nul-terminated
+ *     code strings without trailing newline. These are views into an
+ *     internal buffer, valid until next call to lirc_nextcodes(),
+ *     lirc_nextcode() or lirc_deinit(). Caller must not free() them.
+ * @param max Max number of codes to store in codes.
+ * @return -1 on errors, else number n of codes returned. 0 means that
+ *     no complete code was available.
+ */
+int lirc_nextcodes(char** codes, int max);
+
 /**
  * Translate a code string to an application string using .lircrc.
  * An translation might return more than one string so this function should
  * be called several times until *string == NULL.
  *
  * @param config Parsed lircrc data from e. g. lirc_readconfig().
- * @param code Code string e. g., as from lirc_nextcode().
+ * @param code Code string e. g., as from lirc_nextcode() or
+ *     lirc_nextcodes().
  * @param string On successfull exit points to a static application
  *     string, NULL if no more translations are available.
  * @return -1 on errors, else 0.
@@ -267,6 +288,7 @@ int lirc_code2char(struct lirc_config* config, char* code, char** string);
 /* new interface for client daemon */
 /**
  * Parse a lircrc configuration file without connecting to lircrcd.
+ * The lookup index used by lirc_code2char() is built up front.
  *
  * @param path Path to lircrc config file. If  NULL the default
  *     file is used.
@@ -367,6 +389,34 @@ void lirc_command_reply_to_stdout(lirc_cmd_ctx* ctx);
 int lirc_send_one(int fd, const char* remote, const char* keysym);
 
 
+/** A step in a lirc_send_sequence() call. */
+struct lirc_send_step {
+	const char*	remote;  /**< Remote name as in the config file. */
+	const char*	keysym;  /**< Code to send. */
+	int		repeats; /**< Repeats as for SEND_ONCE, <= 0: default. */
+	unsigned int	delay;   /**< Extra pause after step, microseconds. */
+};
+
+
+/**
+ * Send a sequence of keys, possibly from different remotes, e. g. the
+ * digits of a channel number. lircd sends them back-to-back with the
+ * minimal gaps allowed by each remote, without a round trip for each
+ * key. Very long sequences are split in several requests. This call
+ * blocks until all keys are sent.
+ *
+ * @param fd File descriptor for lircd socket, as for lirc_send_one().
+ * @param steps Keys to send.
+ * @param count Number of items in steps.
+ * @return 0 on OK, else a kernel error code, EMSGSIZE if a step does
+ *     not fit in a request.
+ * @since 0.11.0
+ */
+int lirc_send_sequence(int				fd,
+		       const struct lirc_send_step*	steps,
+		       int				count);
+
+
 /**
  * Send a simulated lirc event.This call might block for some time
  * since it involves communication with lircd.
@@ -414,6 +464,108 @@ int lirc_get_remote_socket(const char* address, int port, int quiet);
  */
 int lirc_get_local_socket(const char* path, int quiet);
 
+/* 0.11.0: Asynchronous interface for event loops. */
+
+/** Opaque state of an asynchronous lircd connection. */
+typedef struct lirc_async lirc_async;
+
+/**
+ * Callback invoked for each decoded event received.
+ *
+ * @param data Opaque data as given to lirc_async_new().
+ * @param code Event line without trailing newline e. g.,
+ *     "0000000000001bde 00 KEY_RIGHT Acer_Aspire_6530G_MCE", suitable
+ *     for lirc_code2char(). Only valid during the call.
+ */
+typedef void (*lirc_event_func)(void* data, char* code);
+
+/**
+ * Callback invoked when a command is completed.
+ *
+ * @param data Opaque data as given to lirc_async_command().
+ * @param status 0 on success, EIO if lircd reported an error, else a
+ *     kernel error code e. g., ECONNRESET if connection was lost.
+ * @param command The command as queued.
+ * @param reply Reply payload, data lines separated by newline, possibly
+ *     empty. Only valid during the call.
+ */
+typedef void (*lirc_reply_func)(void*		data,
+				int		status,
+				const char*	command,
+				const char*	reply);
+
+/**
+ * Create a non-blocking client on an open lircd socket as returned by
+ * lirc_init() or lirc_get_local_socket(). The socket is set
+ * non-blocking; it is not closed by lirc_async_free().
+ *
+ * @param fd Open socket connected to lircd.
+ * @param on_event Callback for decoded events, possibly NULL.
+ * @param data Opaque data passed to on_event.
+ * @return New client, NULL if out of memory.
+ * @since 0.11.0
+ */
+lirc_async* lirc_async_new(int fd, lirc_event_func on_event, void* data);
+
+/**
+ * Release a client created by lirc_async_new(). Commands still
+ * outstanding are completed with status ECANCELED. Must not be called
+ * from a callback.
+ * @since 0.11.0
+ */
+void lirc_async_free(lirc_async* ctx);
+
+/** Return the socket to watch for input in the caller's event loop. */
+int lirc_async_fd(const lirc_async* ctx);
+
+/**
+ * Return true if queued output remains; the caller should then call
+ * lirc_async_on_writable() when lirc_async_fd() is writable.
+ */
+int lirc_async_want_write(const lirc_async* ctx);
+
+/** Return number of commands sent but not yet completed. */
+int lirc_async_pending(const lirc_async* ctx);
+
+/**
+ * Queue a command without waiting for the reply. Any number of commands
+ * can be outstanding; on_reply is invoked from lirc_async_on_readable()
+ * as each reply arrives.
+ *
+ * @param ctx Client from lirc_async_new().
+ * @param on_reply Completion callback, possibly NULL.
+ * @param data Opaque data passed to on_reply.
+ * @param fmt,... printf-style formatting for command. Don't forget
+ *     trailing "\n"!
+ * @return 0 on OK, else a kernel error code.
+ * @since 0.11.0
+ */
+int lirc_async_command(lirc_async*	ctx,
+		       lirc_reply_func	on_reply,
+		       void*		data,
+		       const char*	fmt,
+		       ...);
+
+/**
+ * Process available input: read until the socket would block and
+ * invoke callbacks for all complete events and replies. Never blocks.
+ *
+ * @return 0 on OK, else a kernel error code; ECONNRESET if lircd has
+ *     closed the connection. On errors all outstanding commands are
+ *     completed with the error status and the socket should be closed.
+ * @since 0.11.0
+ */
+int lirc_async_on_readable(lirc_async* ctx);
+
+/**
+ * Write queued output. Never blocks.
+ *
+ * @return 0 on OK (including when output remains), else a kernel
+ *     error code.
+ * @since 0.11.0
+ */
+int lirc_async_on_writable(lirc_async* ctx);
+
 
 /** @} */
 
@@ -86,6 +86,12 @@
 /** Environment variable holding defaults for PLUGINDIR. */
 #define PLUGINDIR_VAR           "LIRC_PLUGIN_PATH"
 
+/** Environment variable overriding the plugin index file path. */
+#define PLUGIN_INDEX_VAR        "LIRC_PLUGIN_INDEX"
+
+/** Directory for the plugin index cache file when running as root. */
+#define PLUGIN_INDEX_DIR        LOCALSTATEDIR "/cache/" PACKAGE
+
 /** Bit manipulator in lirc_t, see lirc.h . Signals eof from remote. */
 #define LIRC_EOF                0x08000000
 
@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+''' Generate a perfect hash table for the input_map.inc button names.
+
+Usage: make_input_hash.py input_map.inc > input_map_hash.inc
+
+Reads the {"NAME", code} lines in input_map.inc and writes C tables
+used by get_input_code() in input_map.c. Keys are case folded.
+
+The table uses hash and displace: names are split in buckets using
+input_hash(name, 0). For each bucket a seed is searched so that
+input_hash(name, seed) maps all names in the bucket to free slots.
+A lookup is thus two hashes, two table reads and one strcasecmp().
+input_hash() must match the C version in input_map.c.
+'''
+
+import re
+import sys
+
+_FNV_BASIS = 2166136261
+_FNV_PRIME = 16777619
+
+
+def input_hash(name, seed):
+    ''' 32-bit FNV-1a of upper case name, mixed with seed. '''
+    h = (_FNV_BASIS ^ (seed * 0x9e3779b9)) & 0xffffffff
+    for c in name.upper().encode('ascii'):
+        h = ((h ^ c) * _FNV_PRIME) & 0xffffffff
+    h ^= h >> 15
+    return h
+
+
+def build(names):
+    ''' Return (buckets, seeds, slots) perfect hash table for names. '''
+    size = 1
+    while size < len(names):
+        size *= 2
+    bucket_count = 1
+    while bucket_count < len(names) // 2:
+        bucket_count *= 2
+    buckets = [[] for _ in range(bucket_count)]
+    for i, name in enumerate(names):
+        buckets[input_hash(name, 0) % bucket_count].append(i)
+    seeds = [0] * bucket_count
+    slots = [-1] * size
+    order = sorted(range(bucket_count), key=lambda b: -len(buckets[b]))
+    for b in order:
+        if not buckets[b]:
+            continue
+        for seed in range(1, 65536):
+            wanted = [input_hash(names[i], seed) % size for i in buckets[b]]
+            if len(set(wanted)) != len(wanted):
+                continue
+            if all(slots[s] == -1 for s in wanted):
+                break
+        else:
+            sys.stderr.write('Cannot find seed for bucket %d\n' % b)
+            sys.exit(1)
+        seeds[b] = seed
+        for i, s in zip(buckets[b], wanted):
+            slots[s] = i
+    return bucket_count, seeds, slots
+
+
+def c_array(decl, values):
+    ''' Format values as a C array initializer. '''
+    lines = [decl + ' = {']
+    for i in range(0, len(values), 12):
+        lines.append('\t' + ', '.join(str(v) for v in values[i:i + 12]) + ',')
+    lines.append('};')
+    return '\n'.join(lines)
+
+
+def main():
+    ''' Indeed: main program. '''
+    if len(sys.argv) != 2:
+        sys.stderr.write('Usage: make_input_hash.py input_map.inc\n')
+        sys.exit(1)
+    with open(sys.argv[1]) as f:
+        names = re.findall(r'^\{"([^"]+)",', f.read(), re.MULTILINE)
+    if len(set(n.upper() for n in names)) != len(names):
+        sys.stderr.write('Duplicate names in %s\n' % sys.argv[1])
+        sys.exit(1)
+    bucket_count, seeds, slots = build(names)
+    print('/* Generated by make_input_hash.py from %s, do not edit. */'
+          % sys.argv[1].split('/')[-1])
+    print()
+    print('#define INPUT_HASH_BUCKETS %d' % bucket_count)
+    print('#define INPUT_HASH_SLOTS %d' % len(slots))
+    print()
+    print(c_array('static const uint16_t input_hash_seeds[INPUT_HASH_BUCKETS]',
+                  seeds))
+    print()
+    print(c_array('static const int16_t input_hash_slots[INPUT_HASH_SLOTS]',
+                  slots))
+
+
+if __name__ == '__main__':
+    main()
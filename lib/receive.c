@@ -19,9 +19,16 @@
 #endif
 
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #ifdef HAVE_KERNEL_LIRC_H
 #include <linux/lirc.h>
@@ -38,6 +45,15 @@
 
 #define REC_SYNC 8
 
+/** Max items the reader thread gets from the driver at a time. */
+#define READER_BATCH 512
+
+/** Max size of the reader thread's queue. */
+#define READER_MAX_SIZE (1 << 20)
+
+/** Max time the reader thread waits without checking the driver fd, ms. */
+#define READER_POLL_TIMEOUT 1000
+
 static const logchannel_t logchannel = LOG_LIB;
 
 /**
@@ -52,10 +68,15 @@ struct rbuf {
 	int		is_biphase;
 	lirc_t		pendingp;
 	lirc_t		pendings;
+	const struct ir_bounds* pendingp_bounds;        /**< Or NULL. */
+	const struct ir_bounds* pendings_bounds;        /**< Or NULL. */
 	lirc_t		sum;
 	struct timeval	last_signal_time;
 	int		at_eof;
 	FILE*		input_log;
+	lirc_t		ahead[RBUF_SIZE];       /**< From readdata_batch(). */
+	int		ahead_rptr;
+	int		ahead_count;
 };
 
 
@@ -71,14 +92,366 @@ void rec_set_update_mode(int mode)
 	update_mode = mode;
 }
 
+
+int rec_get_update_mode(void)
+{
+	return update_mode;
+}
+
+
 int (*lircd_waitfordata)(uint32_t timeout) = NULL;
 
 
+/** An item in the reader thread's queue. */
+struct reader_item {
+	lirc_t		data;
+	struct timespec	time;           /**< When read, CLOCK_MONOTONIC. */
+};
+
+/**
+ * The optional reader thread, see rec_reader_start(). The queue is a
+ * lock-free ring: tail is only updated by the reader thread, head only
+ * by the decoding thread.
+ */
+static struct {
+	pthread_t		thread;
+	int			running;        /**< Started, not yet joined. */
+	int			stop;
+	int			finished;       /**< Thread has returned. */
+	int			error;          /**< Driver read error. */
+	int			notify[2];      /**< Readable when items added. */
+	int			wakeup[2];      /**< Readable when stop is set. */
+	struct reader_item*	items;
+	unsigned int		size;           /**< A power of two. */
+	unsigned int		head;
+	unsigned int		tail;
+	struct rec_reader_stats stats;
+	unsigned long		overflows_logged;
+} reader = { .notify = { -1, -1 }, .wakeup = { -1, -1 } };
+
+/** Set in the reader thread, where waitfordata() polls the driver fd. */
+static __thread int in_reader_thread = 0;
+
+
+static void reader_notify(int fd)
+{
+	static const char byte = 0;
+
+	/* A full pipe is readable anyway. */
+	if (write(fd, &byte, 1) == -1 && errno != EAGAIN)
+		log_perror_warn("receive: Cannot notify reader fd");
+}
+
+
+/** Queue items read at time, those not fitting are overflows. */
+static void reader_push(const lirc_t* data, int count,
+			const struct timespec* time)
+{
+	unsigned int head = __atomic_load_n(&reader.head, __ATOMIC_ACQUIRE);
+	unsigned int start = reader.tail;
+	unsigned int tail = start;
+	struct reader_item* item;
+	int i;
+
+	for (i = 0; i < count && tail - head < reader.size; i++, tail++) {
+		item = &reader.items[tail & (reader.size - 1)];
+		item->data = data[i];
+		item->time = *time;
+	}
+	__atomic_store_n(&reader.stats.items, reader.stats.items + i,
+			 __ATOMIC_RELAXED);
+	if (i < count)
+		__atomic_store_n(&reader.stats.overflows,
+				 reader.stats.overflows + count - i,
+				 __ATOMIC_RELAXED);
+	if (tail - head > reader.stats.max_fill)
+		__atomic_store_n(&reader.stats.max_fill, tail - head,
+				 __ATOMIC_RELAXED);
+	__atomic_store_n(&reader.tail, tail, __ATOMIC_SEQ_CST);
+	/* If head has not reached start, the decoder sees the new tail
+	 * before it waits, see reader_readdata(). */
+	if (tail != start
+	    && __atomic_load_n(&reader.head, __ATOMIC_SEQ_CST) == start)
+		reader_notify(reader.notify[1]);
+}
+
+
+/** waitfordata() in the reader thread: 0 on timeout, stop or no fd. */
+static int reader_waitfordata(uint32_t maxusec)
+{
+	struct pollfd pfd[2];
+	int timeout;
+	int ret;
+
+	do {
+		if (curr_driver->fd == -1)
+			return 0;
+		pfd[0].fd = curr_driver->fd;
+		pfd[0].events = POLLIN;
+		pfd[1].fd = reader.wakeup[0];
+		pfd[1].events = POLLIN;
+		timeout = maxusec > 0 ? maxusec / 1000 : READER_POLL_TIMEOUT;
+		ret = curl_poll(pfd, 2, timeout);
+		if (ret == -1 && errno != EINTR) {
+			log_perror_err("receive: curl_poll() failed");
+			return 0;
+		}
+		if (ret > 0 && pfd[1].revents != 0)
+			return 0;
+	} while (ret <= 0 && maxusec == 0);
+	return ret > 0;
+}
+
+
+/** Read from the driver and queue the items until stopped. */
+static void* reader_main(void* arg)
+{
+	lirc_t data[READER_BATCH];
+	struct timespec now;
+	int count;
+
+	in_reader_thread = 1;
+	while (!__atomic_load_n(&reader.stop, __ATOMIC_ACQUIRE)) {
+		if (curr_driver->api_version >= 5
+		    && curr_driver->readdata_batch != NULL) {
+			count = curr_driver->readdata_batch(data, READER_BATCH,
+							    0);
+		} else {
+			data[0] = curr_driver->readdata(0);
+			count = data[0] != 0 ? 1 : 0;
+		}
+		if (count == 0) {
+			/* See rec_reader_read_error(). */
+			if (__atomic_load_n(&reader.error, __ATOMIC_ACQUIRE)
+			    || curr_driver->fd == -1)
+				break;
+			continue;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		reader_push(data, count, &now);
+		if (data[count - 1] & LIRC_EOF)
+			break;
+	}
+	__atomic_store_n(&reader.finished, 1, __ATOMIC_RELEASE);
+	reader_notify(reader.notify[1]);
+	return NULL;
+}
+
+
+/** Return next queued item, 0 if none. */
+static lirc_t reader_pop(void)
+{
+	struct reader_item* item;
+	struct timespec now;
+	unsigned long delay;
+	lirc_t data;
+
+	if (reader.head == __atomic_load_n(&reader.tail, __ATOMIC_SEQ_CST))
+		return 0;
+	item = &reader.items[reader.head & (reader.size - 1)];
+	data = item->data;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	delay = (now.tv_sec - item->time.tv_sec) * 1000000
+		+ (now.tv_nsec - item->time.tv_nsec) / 1000;
+	if (delay > reader.stats.max_delay)
+		__atomic_store_n(&reader.stats.max_delay, delay,
+				 __ATOMIC_RELAXED);
+	__atomic_store_n(&reader.head, reader.head + 1, __ATOMIC_SEQ_CST);
+	return data;
+}
+
+
+/** Like readdata(), but from the reader thread's queue. */
+static lirc_t reader_readdata(lirc_t timeout)
+{
+	unsigned long overflows;
+	char buf[64];
+	lirc_t data;
+
+	overflows = __atomic_load_n(&reader.stats.overflows, __ATOMIC_RELAXED);
+	if (overflows != reader.overflows_logged) {
+		log_warn("receive: Reader queue full, %lu items dropped",
+			 overflows - reader.overflows_logged);
+		reader.overflows_logged = overflows;
+	}
+	while (1) {
+		data = reader_pop();
+		if (data != 0)
+			return data;
+		/* Items queued before the drain are seen by reader_pop(). */
+		while (read(reader.notify[0], buf, sizeof(buf)) > 0)
+			;
+		data = reader_pop();
+		if (data != 0)
+			return data;
+		if (__atomic_load_n(&reader.finished, __ATOMIC_ACQUIRE))
+			return 0;
+		if (!waitfordata(timeout))
+			return 0;
+	}
+}
+
+
+static int open_pipe(int fds[2])
+{
+	if (pipe(fds) != 0) {
+		log_perror_err("receive: Cannot create pipe");
+		return 0;
+	}
+	fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+	return 1;
+}
+
+
+static void close_pipe(int fds[2])
+{
+	if (fds[0] != -1)
+		close(fds[0]);
+	if (fds[1] != -1)
+		close(fds[1]);
+	fds[0] = -1;
+	fds[1] = -1;
+}
+
+
+int rec_reader_start(unsigned int size)
+{
+	struct reader_item* items;
+	sigset_t all;
+	sigset_t old;
+	unsigned int n;
+	int r;
+
+	if (reader.running
+	    && !__atomic_load_n(&reader.finished, __ATOMIC_ACQUIRE))
+		return 1;
+	/* Exited on EOF or errors. */
+	rec_reader_stop();
+	if (curr_driver->rec_mode == LIRC_MODE_LIRCCODE
+	    || curr_driver->readdata == NULL
+	    || !(curr_driver->features & LIRC_CAN_USE_READER_THREAD)) {
+		log_warn("receive: Driver %s cannot use a reader thread",
+			 curr_driver->name);
+		return 0;
+	}
+	for (n = 2; n < size && n < READER_MAX_SIZE; n *= 2)
+		;
+	if (n != reader.size) {
+		items = (struct reader_item*)calloc(n, sizeof(*items));
+		if (items == NULL) {
+			log_error("receive: Out of memory");
+			return 0;
+		}
+		free(reader.items);
+		reader.items = items;
+		reader.size = n;
+	}
+	if (!open_pipe(reader.notify) || !open_pipe(reader.wakeup)) {
+		close_pipe(reader.notify);
+		close_pipe(reader.wakeup);
+		return 0;
+	}
+	memset(&reader.stats, 0, sizeof(reader.stats));
+	reader.overflows_logged = 0;
+	reader.head = 0;
+	reader.tail = 0;
+	reader.stop = 0;
+	reader.finished = 0;
+	reader.error = 0;
+	/* Signals are handled by the other threads. */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	r = pthread_create(&reader.thread, NULL, reader_main, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (r != 0) {
+		errno = r;
+		log_perror_err("receive: Cannot start reader thread");
+		close_pipe(reader.notify);
+		close_pipe(reader.wakeup);
+		return 0;
+	}
+	reader.running = 1;
+	log_debug("receive: Reader thread started, queue size %u", n);
+	return 1;
+}
+
+
+void rec_reader_stop(void)
+{
+	if (!reader.running)
+		return;
+	__atomic_store_n(&reader.stop, 1, __ATOMIC_RELEASE);
+	reader_notify(reader.wakeup[1]);
+	pthread_join(reader.thread, NULL);
+	close_pipe(reader.notify);
+	close_pipe(reader.wakeup);
+	reader.head = 0;
+	reader.tail = 0;
+	reader.running = 0;
+	log_debug("receive: Reader thread stopped");
+}
+
+
+int rec_reader_read_error(void)
+{
+	if (!in_reader_thread)
+		return 0;
+	__atomic_store_n(&reader.error, 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+
+int rec_reader_failed(void)
+{
+	return reader.running
+	       && __atomic_load_n(&reader.finished, __ATOMIC_ACQUIRE)
+	       && reader.error
+	       && reader.head == reader.tail;
+}
+
+
+int rec_reader_fd(void)
+{
+	return reader.running ? reader.notify[0] : -1;
+}
+
+
+void rec_reader_get_stats(struct rec_reader_stats* stats)
+{
+	stats->items = __atomic_load_n(&reader.stats.items, __ATOMIC_RELAXED);
+	stats->overflows = __atomic_load_n(&reader.stats.overflows,
+					   __ATOMIC_RELAXED);
+	stats->max_fill = __atomic_load_n(&reader.stats.max_fill,
+					  __ATOMIC_RELAXED);
+	stats->max_delay = reader.stats.max_delay;
+}
+
+
+/**
+ * Return next item from the driver, or from the reader thread if it
+ * runs. Drivers with readdata_batch() are read in chunks, the items are
+ * returned from rec_buffer.ahead.
+ */
 static lirc_t readdata(lirc_t timeout)
 {
 	lirc_t data;
+	int count;
 
-	data = curr_driver->readdata(timeout);
+	if (reader.running) {
+		data = reader_readdata(timeout);
+	} else if (rec_buffer.ahead_rptr < rec_buffer.ahead_count) {
+		data = rec_buffer.ahead[rec_buffer.ahead_rptr++];
+	} else if (curr_driver->api_version >= 5
+		   && curr_driver->readdata_batch != NULL) {
+		count = curr_driver->readdata_batch(rec_buffer.ahead,
+						    RBUF_SIZE, timeout);
+		rec_buffer.ahead_count = count > 0 ? count : 0;
+		rec_buffer.ahead_rptr = count > 0 ? 1 : 0;
+		data = count > 0 ? rec_buffer.ahead[0] : 0;
+	} else {
+		data = curr_driver->readdata(timeout);
+	}
 	rec_buffer.at_eof = data & LIRC_EOF ? 1 : 0;
 	if (rec_buffer.at_eof)
 		log_debug("receive: Got EOF");
@@ -95,12 +468,28 @@ static void set_pending_pulse(lirc_t deltap)
 {
 	log_trace2("pending pulse: %lu", deltap);
 	rec_buffer.pendingp = deltap;
+	rec_buffer.pendingp_bounds = NULL;
 }
 
 static void set_pending_space(lirc_t deltas)
 {
 	log_trace2("pending space: %lu", deltas);
 	rec_buffer.pendings = deltas;
+	rec_buffer.pendings_bounds = NULL;
+}
+
+/** Like set_pending_pulse(), with precomputed bounds for the value. */
+static void set_pending_pulse_bounds(const struct ir_bounds* b)
+{
+	set_pending_pulse(b->val);
+	rec_buffer.pendingp_bounds = b;
+}
+
+/** Like set_pending_space(), with precomputed bounds for the value. */
+static void set_pending_space_bounds(const struct ir_bounds* b)
+{
+	set_pending_space(b->val);
+	rec_buffer.pendings_bounds = b;
 }
 
 
@@ -178,8 +567,12 @@ int waitfordata(uint32_t maxusec)
 	struct pollfd pfd = {
 		.fd = curr_driver->fd, .events = POLLIN, .revents = 0 };
 
+	if (in_reader_thread)
+		return reader_waitfordata(maxusec);
 	if (lircd_waitfordata != NULL)
 		return lircd_waitfordata(maxusec);
+	if (reader.running)
+		pfd.fd = reader.notify[0];
 
 	while (1) {
 		do {
@@ -234,6 +627,18 @@ void rec_buffer_reset_wptr(void)
 	rec_buffer.wptr = 0;
 }
 
+int rec_buffer_pending(void)
+{
+	return rec_buffer.ahead_count - rec_buffer.ahead_rptr
+	       + __atomic_load_n(&reader.tail, __ATOMIC_ACQUIRE) - reader.head;
+}
+
+
+int rec_buffer_at_eof(void)
+{
+	return rec_buffer.at_eof && rec_buffer.wptr - rec_buffer.rptr <= 1;
+}
+
 int rec_buffer_clear(void)
 {
 	int move, i;
@@ -333,7 +738,9 @@ static int sync_pending_pulse(struct ir_remote* remote)
 		deltap = get_next_pulse(rec_buffer.pendingp);
 		if (deltap == 0)
 			return 0;
-		if (!expect(remote, deltap, rec_buffer.pendingp))
+		if (rec_buffer.pendingp_bounds != NULL ?
+		    !expect_bounds(rec_buffer.pendingp_bounds, deltap) :
+		    !expect(remote, deltap, rec_buffer.pendingp))
 			return 0;
 		set_pending_pulse(0);
 	}
@@ -348,59 +755,61 @@ static int sync_pending_space(struct ir_remote* remote)
 		deltas = get_next_space(rec_buffer.pendings);
 		if (deltas == 0)
 			return 0;
-		if (!expect(remote, deltas, rec_buffer.pendings))
+		if (rec_buffer.pendings_bounds != NULL ?
+		    !expect_bounds(rec_buffer.pendings_bounds, deltas) :
+		    !expect(remote, deltas, rec_buffer.pendings))
 			return 0;
 		set_pending_space(0);
 	}
 	return 1;
 }
 
-static int expectpulse(struct ir_remote* remote, int exdelta)
+static int expectpulse(struct ir_remote* remote, const struct ir_bounds* b)
 {
 	lirc_t deltap;
 	int retval;
 
-	log_trace2("expecting pulse: %lu", exdelta);
+	log_trace2("expecting pulse: %lu", b->val);
 	if (!sync_pending_space(remote))
 		return 0;
 
-	deltap = get_next_pulse(rec_buffer.pendingp + exdelta);
+	deltap = get_next_pulse(rec_buffer.pendingp + b->val);
 	if (deltap == 0)
 		return 0;
 	if (rec_buffer.pendingp > 0) {
 		if (rec_buffer.pendingp > deltap)
 			return 0;
-		retval = expect(remote, deltap - rec_buffer.pendingp, exdelta);
+		retval = expect_bounds(b, deltap - rec_buffer.pendingp);
 		if (!retval)
 			return 0;
 		set_pending_pulse(0);
 	} else {
-		retval = expect(remote, deltap, exdelta);
+		retval = expect_bounds(b, deltap);
 	}
 	return retval;
 }
 
-static int expectspace(struct ir_remote* remote, int exdelta)
+static int expectspace(struct ir_remote* remote, const struct ir_bounds* b)
 {
 	lirc_t deltas;
 	int retval;
 
-	log_trace2("expecting space: %lu", exdelta);
+	log_trace2("expecting space: %lu", b->val);
 	if (!sync_pending_pulse(remote))
 		return 0;
 
-	deltas = get_next_space(rec_buffer.pendings + exdelta);
+	deltas = get_next_space(rec_buffer.pendings + b->val);
 	if (deltas == 0)
 		return 0;
 	if (rec_buffer.pendings > 0) {
 		if (rec_buffer.pendings > deltas)
 			return 0;
-		retval = expect(remote, deltas - rec_buffer.pendings, exdelta);
+		retval = expect_bounds(b, deltas - rec_buffer.pendings);
 		if (!retval)
 			return 0;
 		set_pending_space(0);
 	} else {
-		retval = expect(remote, deltas, exdelta);
+		retval = expect_bounds(b, deltas);
 	}
 	return retval;
 }
@@ -413,39 +822,45 @@ static int expectone(struct ir_remote* remote, int bit)
 
 		mask = ((ir_code)1) << (all_bits - 1 - bit);
 		if (mask & remote->rc6_mask) {
-			if (remote->sone > 0 && !expectspace(remote, 2 * remote->sone)) {
+			if (remote->sone > 0
+			    && !expectspace(remote, &remote->bounds[IR_B_SONE_X2])) {
 				unget_rec_buffer(1);
 				return 0;
 			}
-			set_pending_pulse(2 * remote->pone);
+			set_pending_pulse_bounds(&remote->bounds[IR_B_PONE_X2]);
 		} else {
-			if (remote->sone > 0 && !expectspace(remote, remote->sone)) {
+			if (remote->sone > 0
+			    && !expectspace(remote, &remote->bounds[IR_B_SONE])) {
 				unget_rec_buffer(1);
 				return 0;
 			}
-			set_pending_pulse(remote->pone);
+			set_pending_pulse_bounds(&remote->bounds[IR_B_PONE]);
 		}
 	} else if (is_space_first(remote)) {
-		if (remote->sone > 0 && !expectspace(remote, remote->sone)) {
+		if (remote->sone > 0
+		    && !expectspace(remote, &remote->bounds[IR_B_SONE])) {
 			unget_rec_buffer(1);
 			return 0;
 		}
-		if (remote->pone > 0 && !expectpulse(remote, remote->pone)) {
+		if (remote->pone > 0
+		    && !expectpulse(remote, &remote->bounds[IR_B_PONE])) {
 			unget_rec_buffer(2);
 			return 0;
 		}
 	} else {
-		if (remote->pone > 0 && !expectpulse(remote, remote->pone)) {
+		if (remote->pone > 0
+		    && !expectpulse(remote, &remote->bounds[IR_B_PONE])) {
 			unget_rec_buffer(1);
 			return 0;
 		}
 		if (remote->ptrail > 0) {
-			if (remote->sone > 0 && !expectspace(remote, remote->sone)) {
+			if (remote->sone > 0
+			    && !expectspace(remote, &remote->bounds[IR_B_SONE])) {
 				unget_rec_buffer(2);
 				return 0;
 			}
 		} else {
-			set_pending_space(remote->sone);
+			set_pending_space_bounds(&remote->bounds[IR_B_SONE]);
 		}
 	}
 	return 1;
@@ -459,39 +874,41 @@ static int expectzero(struct ir_remote* remote, int bit)
 
 		mask = ((ir_code)1) << (all_bits - 1 - bit);
 		if (mask & remote->rc6_mask) {
-			if (!expectpulse(remote, 2 * remote->pzero)) {
+			if (!expectpulse(remote, &remote->bounds[IR_B_PZERO_X2])) {
 				unget_rec_buffer(1);
 				return 0;
 			}
-			set_pending_space(2 * remote->szero);
+			set_pending_space_bounds(&remote->bounds[IR_B_SZERO_X2]);
 		} else {
-			if (!expectpulse(remote, remote->pzero)) {
+			if (!expectpulse(remote, &remote->bounds[IR_B_PZERO])) {
 				unget_rec_buffer(1);
 				return 0;
 			}
-			set_pending_space(remote->szero);
+			set_pending_space_bounds(&remote->bounds[IR_B_SZERO]);
 		}
 	} else if (is_space_first(remote)) {
-		if (remote->szero > 0 && !expectspace(remote, remote->szero)) {
+		if (remote->szero > 0
+		    && !expectspace(remote, &remote->bounds[IR_B_SZERO])) {
 			unget_rec_buffer(1);
 			return 0;
 		}
-		if (remote->pzero > 0 && !expectpulse(remote, remote->pzero)) {
+		if (remote->pzero > 0
+		    && !expectpulse(remote, &remote->bounds[IR_B_PZERO])) {
 			unget_rec_buffer(2);
 			return 0;
 		}
 	} else {
-		if (!expectpulse(remote, remote->pzero)) {
+		if (!expectpulse(remote, &remote->bounds[IR_B_PZERO])) {
 			unget_rec_buffer(1);
 			return 0;
 		}
 		if (remote->ptrail > 0) {
-			if (!expectspace(remote, remote->szero)) {
+			if (!expectspace(remote, &remote->bounds[IR_B_SZERO])) {
 				unget_rec_buffer(2);
 				return 0;
 			}
 		} else {
-			set_pending_space(remote->szero);
+			set_pending_space_bounds(&remote->bounds[IR_B_SZERO]);
 		}
 	}
 	return 1;
@@ -501,6 +918,7 @@ static lirc_t sync_rec_buffer(struct ir_remote* remote)
 {
 	int count;
 	lirc_t deltas, deltap;
+	struct ir_bounds gap;
 
 	count = 0;
 	deltas = get_next_space(1000000);
@@ -508,7 +926,8 @@ static lirc_t sync_rec_buffer(struct ir_remote* remote)
 		return 0;
 
 	if (last_remote != NULL && !is_rcmm(remote)) {
-		while (!expect_at_least(last_remote, deltas, last_remote->min_remaining_gap)) {
+		init_bounds(last_remote, &gap, last_remote->min_remaining_gap);
+		while (deltas < gap.min) {
 			deltap = get_next_pulse(1000000);
 			if (deltap == 0)
 				return 0;
@@ -547,24 +966,29 @@ static int get_header(struct ir_remote* remote)
 			return 0;
 		}
 		sum = deltap + deltas;
-		if (expect(remote, sum, remote->phead + remote->shead))
+		if (expect_bounds(&remote->bounds[IR_B_HEAD], sum))
 			return 1;
 		unget_rec_buffer(2);
 		return 0;
 	} else if (is_bo(remote)) {
-		if (expectpulse(remote, remote->pone) && expectspace(remote, remote->sone)
-		    && expectpulse(remote, remote->pone) && expectspace(remote, remote->sone)
-		    && expectpulse(remote, remote->phead) && expectspace(remote, remote->shead))
+		const struct ir_bounds* b = remote->bounds;
+
+		if (expectpulse(remote, &b[IR_B_PONE])
+		    && expectspace(remote, &b[IR_B_SONE])
+		    && expectpulse(remote, &b[IR_B_PONE])
+		    && expectspace(remote, &b[IR_B_SONE])
+		    && expectpulse(remote, &b[IR_B_PHEAD])
+		    && expectspace(remote, &b[IR_B_SHEAD]))
 			return 1;
 		return 0;
 	}
 	if (remote->shead == 0) {
 		if (!sync_pending_space(remote))
 			return 0;
-		set_pending_pulse(remote->phead);
+		set_pending_pulse_bounds(&remote->bounds[IR_B_PHEAD]);
 		return 1;
 	}
-	if (!expectpulse(remote, remote->phead)) {
+	if (!expectpulse(remote, &remote->bounds[IR_B_PHEAD])) {
 		unget_rec_buffer(1);
 		return 0;
 	}
@@ -582,15 +1006,15 @@ static int get_header(struct ir_remote* remote)
 		}
 	}
 
-	set_pending_space(remote->shead);
+	set_pending_space_bounds(&remote->bounds[IR_B_SHEAD]);
 	return 1;
 }
 
 static int get_foot(struct ir_remote* remote)
 {
-	if (!expectspace(remote, remote->sfoot))
+	if (!expectspace(remote, &remote->bounds[IR_B_SFOOT]))
 		return 0;
-	if (!expectpulse(remote, remote->pfoot))
+	if (!expectpulse(remote, &remote->bounds[IR_B_PFOOT]))
 		return 0;
 	return 1;
 }
@@ -601,14 +1025,14 @@ static int get_lead(struct ir_remote* remote)
 		return 1;
 	if (!sync_pending_space(remote))
 		return 0;
-	set_pending_pulse(remote->plead);
+	set_pending_pulse_bounds(&remote->bounds[IR_B_PLEAD]);
 	return 1;
 }
 
 static int get_trail(struct ir_remote* remote)
 {
 	if (remote->ptrail != 0)
-		if (!expectpulse(remote, remote->ptrail))
+		if (!expectpulse(remote, &remote->bounds[IR_B_PTRAIL]))
 			return 0;
 	if (rec_buffer.pendingp > 0)
 		if (!sync_pending_pulse(remote))
@@ -616,12 +1040,12 @@ static int get_trail(struct ir_remote* remote)
 	return 1;
 }
 
-static int get_gap(struct ir_remote* remote, lirc_t gap)
+static int get_gap(struct ir_remote* remote, const struct ir_bounds* gap)
 {
 	lirc_t data;
 
 	log_trace1("sum: %d", rec_buffer.sum);
-	data = get_next_rec_buffer(gap - gap * remote->eps / 100);
+	data = get_next_rec_buffer(gap->val - gap->val * remote->eps / 100);
 	if (data == 0)
 		return 1;
 	if (!is_space(data)) {
@@ -629,7 +1053,7 @@ static int get_gap(struct ir_remote* remote, lirc_t gap)
 		return 0;
 	}
 	unget_rec_buffer(1);
-	if (!expect_at_least(remote, data, gap)) {
+	if (data < gap->min) {
 		log_trace("end of signal not found");
 		return 0;
 	}
@@ -638,27 +1062,31 @@ static int get_gap(struct ir_remote* remote, lirc_t gap)
 
 static int get_repeat(struct ir_remote* remote)
 {
+	struct ir_bounds gap;
+
 	if (!get_lead(remote))
 		return 0;
 	if (is_biphase(remote)) {
-		if (!expectspace(remote, remote->srepeat))
+		if (!expectspace(remote, &remote->bounds[IR_B_SREPEAT]))
 			return 0;
-		if (!expectpulse(remote, remote->prepeat))
+		if (!expectpulse(remote, &remote->bounds[IR_B_PREPEAT]))
 			return 0;
 	} else {
-		if (!expectpulse(remote, remote->prepeat))
+		if (!expectpulse(remote, &remote->bounds[IR_B_PREPEAT]))
 			return 0;
-		set_pending_space(remote->srepeat);
+		set_pending_space_bounds(&remote->bounds[IR_B_SREPEAT]);
 	}
 	if (!get_trail(remote))
 		return 0;
-	if (!get_gap
-		    (remote,
-		    is_const(remote) ? (min_gap(remote) >
-					rec_buffer.sum ?
-					min_gap(remote) - rec_buffer.sum : 0) :
-		    (has_repeat_gap(remote) ? remote->repeat_gap : min_gap(remote))
-		    ))
+	if (is_const(remote)) {
+		init_bounds(remote, &gap, min_gap(remote) > rec_buffer.sum ?
+			    min_gap(remote) - rec_buffer.sum : 0);
+	} else if (has_repeat_gap(remote)) {
+		init_bounds(remote, &gap, remote->repeat_gap);
+	} else {
+		gap = remote->bounds[IR_B_MIN_GAP];
+	}
+	if (!get_gap(remote, &gap))
 		return 0;
 	return 1;
 }
@@ -689,16 +1117,16 @@ static ir_code get_data(struct ir_remote* remote, int bits, int done)
 			}
 			sum = deltap + deltas;
 			log_trace2("rcmm: sum %ld", (uint32_t)sum);
-			if (expect(remote, sum, remote->pzero + remote->szero)) {
+			if (expect_bounds(&remote->bounds[IR_B_ZERO], sum)) {
 				code |= 0;
 				log_trace1("00");
-			} else if (expect(remote, sum, remote->pone + remote->sone)) {
+			} else if (expect_bounds(&remote->bounds[IR_B_ONE], sum)) {
 				code |= 1;
 				log_trace1("01");
-			} else if (expect(remote, sum, remote->ptwo + remote->stwo)) {
+			} else if (expect_bounds(&remote->bounds[IR_B_TWO], sum)) {
 				code |= 2;
 				log_trace1("10");
-			} else if (expect(remote, sum, remote->pthree + remote->sthree)) {
+			} else if (expect_bounds(&remote->bounds[IR_B_THREE], sum)) {
 				code |= 3;
 				log_trace1("11");
 			} else {
@@ -726,16 +1154,16 @@ static ir_code get_data(struct ir_remote* remote, int bits, int done)
 			}
 			sum = deltas + deltap;
 			log_trace2("grundig: sum %ld", (uint32_t)sum);
-			if (expect(remote, sum, remote->szero + remote->pzero)) {
+			if (expect_bounds(&remote->bounds[IR_B_ZERO], sum)) {
 				state = 0;
 				log_trace1("2T");
-			} else if (expect(remote, sum, remote->sone + remote->pone)) {
+			} else if (expect_bounds(&remote->bounds[IR_B_ONE], sum)) {
 				state = 1;
 				log_trace1("3T");
-			} else if (expect(remote, sum, remote->stwo + remote->ptwo)) {
+			} else if (expect_bounds(&remote->bounds[IR_B_TWO], sum)) {
 				state = 2;
 				log_trace1("4T");
-			} else if (expect(remote, sum, remote->sthree + remote->pthree)) {
+			} else if (expect_bounds(&remote->bounds[IR_B_THREE], sum)) {
 				state = 3;
 				log_trace2("6T");
 			} else {
@@ -775,7 +1203,8 @@ static ir_code get_data(struct ir_remote* remote, int bits, int done)
 		int received;
 		int space, stop_bit, parity_bit;
 		int parity;
-		lirc_t delta, origdelta, pending, expecting, gap_delta;
+		lirc_t delta, origdelta, pending, gap_delta;
+		const struct ir_bounds* expecting;
 		lirc_t base, stop;
 		lirc_t max_space, max_pulse;
 
@@ -842,9 +1271,9 @@ static ir_code get_data(struct ir_remote* remote, int bits, int done)
 				}
 				continue;
 			}
-			expecting = (space ? remote->sone : remote->pzero);
-			if (delta > expecting || expect(remote, delta, expecting)) {
-				delta -= (expecting > delta ? delta : expecting);
+			expecting = &remote->bounds[space ? IR_B_SONE : IR_B_PZERO];
+			if (delta > expecting->val || expect_bounds(expecting, delta)) {
+				delta -= (expecting->val > delta ? delta : expecting->val);
 				received++;
 				code <<= 1;
 				code |= space;
@@ -892,8 +1321,10 @@ static ir_code get_data(struct ir_remote* remote, int bits, int done)
 	} else if (is_bo(remote)) {
 		int lastbit = 1;
 		lirc_t deltap, deltas;
-		lirc_t pzero, szero;
-		lirc_t pone, sone;
+		const struct ir_bounds* pzero;
+		const struct ir_bounds* szero;
+		const struct ir_bounds* pone;
+		const struct ir_bounds* sone;
 
 		for (i = 0; i < bits; i++) {
 			code <<= 1;
@@ -904,19 +1335,20 @@ static ir_code get_data(struct ir_remote* remote, int bits, int done)
 				return (ir_code) -1;
 			}
 			if (lastbit == 1) {
-				pzero = remote->pone;
-				szero = remote->sone;
-				pone = remote->ptwo;
-				sone = remote->stwo;
+				pzero = &remote->bounds[IR_B_PONE];
+				szero = &remote->bounds[IR_B_SONE];
+				pone = &remote->bounds[IR_B_PTWO];
+				sone = &remote->bounds[IR_B_STWO];
 			} else {
-				pzero = remote->ptwo;
-				szero = remote->stwo;
-				pone = remote->pthree;
-				sone = remote->sthree;
+				pzero = &remote->bounds[IR_B_PTWO];
+				szero = &remote->bounds[IR_B_STWO];
+				pone = &remote->bounds[IR_B_PTHREE];
+				sone = &remote->bounds[IR_B_STHREE];
 			}
-			log_trace2("%lu %lu %lu %lu", pzero, szero, pone, sone);
-			if (expect(remote, deltap, pzero)) {
-				if (expect(remote, deltas, szero)) {
+			log_trace2("%lu %lu %lu %lu",
+				   pzero->val, szero->val, pone->val, sone->val);
+			if (expect_bounds(pzero, deltap)) {
+				if (expect_bounds(szero, deltas)) {
 					code |= 0;
 					lastbit = 0;
 					log_trace1("0");
@@ -924,8 +1356,8 @@ static ir_code get_data(struct ir_remote* remote, int bits, int done)
 				}
 			}
 
-			if (expect(remote, deltap, pone)) {
-				if (expect(remote, deltas, sone)) {
+			if (expect_bounds(pone, deltap)) {
+				if (expect_bounds(sone, deltas)) {
 					code |= 1;
 					lastbit = 1;
 					log_trace1("1");
@@ -1013,9 +1445,9 @@ static ir_code get_pre(struct ir_remote* remote)
 		}
 	}
 	if (remote->pre_p > 0 && remote->pre_s > 0) {
-		if (!expectpulse(remote, remote->pre_p))
+		if (!expectpulse(remote, &remote->bounds[IR_B_PRE_P]))
 			return (ir_code) -1;
-		set_pending_space(remote->pre_s);
+		set_pending_space_bounds(&remote->bounds[IR_B_PRE_S]);
 	}
 	return pre;
 }
@@ -1025,9 +1457,9 @@ static ir_code get_post(struct ir_remote* remote)
 	ir_code post;
 
 	if (remote->post_p > 0 && remote->post_s > 0) {
-		if (!expectpulse(remote, remote->post_p))
+		if (!expectpulse(remote, &remote->bounds[IR_B_POST_P]))
 			return (ir_code) -1;
-		set_pending_space(remote->post_s);
+		set_pending_space_bounds(&remote->bounds[IR_B_POST_S]);
 	}
 
 	post = get_data(remote, remote->post_data_bits, remote->pre_data_bits + remote->bits);
@@ -1044,6 +1476,7 @@ int receive_decode(struct ir_remote* remote, struct decode_ctx_t* ctx)
 	lirc_t sync;
 	int header;
 	struct timeval current;
+	struct ir_bounds gap;
 
 	sync = 0;               /* make compiler happy */
 	memset(ctx, 0, sizeof(struct decode_ctx_t));
@@ -1056,6 +1489,7 @@ int receive_decode(struct ir_remote* remote, struct decode_ctx_t* ctx)
 		rec_buffer.at_eof = 0;
 		return 1;
 	}
+	ir_remote_update_bounds(remote);
 	if (curr_driver->rec_mode == LIRC_MODE_MODE2 ||
 	    curr_driver->rec_mode == LIRC_MODE_PULSE ||
 	    curr_driver->rec_mode == LIRC_MODE_RAW) {
@@ -1110,7 +1544,8 @@ int receive_decode(struct ir_remote* remote, struct decode_ctx_t* ctx)
 			header = 1;
 			if (!get_header(remote)) {
 				header = 0;
-				if (!(remote->flags & NO_HEAD_REP && expect_at_most(remote, sync, max_gap(remote)))) {
+				if (!(remote->flags & NO_HEAD_REP
+				      && sync <= remote->bounds[IR_B_MAX_GAP].max)) {
 					log_trace("failed on header");
 					return 0;
 				}
@@ -1122,6 +1557,7 @@ int receive_decode(struct ir_remote* remote, struct decode_ctx_t* ctx)
 	if (is_raw(remote)) {
 		struct ir_ncode* codes;
 		struct ir_ncode* found;
+		struct ir_bounds signal;
 		int i;
 
 		if (curr_driver->rec_mode == LIRC_MODE_LIRCCODE)
@@ -1132,13 +1568,17 @@ int receive_decode(struct ir_remote* remote, struct decode_ctx_t* ctx)
 		while (codes->name != NULL && found == NULL) {
 			found = codes;
 			for (i = 0; i < codes->length; ) {
-				if (!expectpulse(remote, codes->signals[i++])) {
+				init_bounds(remote, &signal, codes->signals[i++]);
+				if (!expectpulse(remote, &signal)) {
 					found = NULL;
 					rec_buffer_rewind();
 					sync_rec_buffer(remote);
 					break;
 				}
-				if (i < codes->length && !expectspace(remote, codes->signals[i++])) {
+				if (i >= codes->length)
+					break;
+				init_bounds(remote, &signal, codes->signals[i++]);
+				if (!expectspace(remote, &signal)) {
 					found = NULL;
 					rec_buffer_rewind();
 					sync_rec_buffer(remote);
@@ -1147,10 +1587,12 @@ int receive_decode(struct ir_remote* remote, struct decode_ctx_t* ctx)
 			}
 			codes++;
 			if (found != NULL) {
-				if (!get_gap
-					    (remote, is_const(remote) ?
-					    min_gap(remote) - rec_buffer.sum :
-					    min_gap(remote)))
+				if (is_const(remote))
+					init_bounds(remote, &gap,
+						    min_gap(remote) - rec_buffer.sum);
+				else
+					gap = remote->bounds[IR_B_MIN_GAP];
+				if (!get_gap(remote, &gap))
 					found = NULL;
 			}
 		}
@@ -1215,7 +1657,11 @@ int receive_decode(struct ir_remote* remote, struct decode_ctx_t* ctx)
 				log_trace("failed on trailing pulse");
 				return 0;
 			}
-			if (has_foot(remote)) {
+			/* A repeat without header has no foot either. */
+			if (has_foot(remote)
+			    && !(header == 0 && has_header(remote)
+				 && remote->flags & NO_HEAD_REP
+				 && remote->flags & NO_FOOT_REP)) {
 				if (!get_foot(remote)) {
 					log_trace("failed on foot");
 					return 0;
@@ -1224,17 +1670,16 @@ int receive_decode(struct ir_remote* remote, struct decode_ctx_t* ctx)
 			if (header == 1 && is_const(remote) && (remote->flags & NO_HEAD_REP))
 				rec_buffer.sum -= remote->phead + remote->shead;
 			if (is_rcmm(remote)) {
-				if (!get_gap(remote, 1000))
-					return 0;
+				init_bounds(remote, &gap, 1000);
 			} else if (is_const(remote)) {
-				if (!get_gap(remote, min_gap(remote) > rec_buffer.sum ?
-					     min_gap(remote) - rec_buffer.sum :
-					     0))
-					return 0;
+				init_bounds(remote, &gap,
+					    min_gap(remote) > rec_buffer.sum ?
+					    min_gap(remote) - rec_buffer.sum : 0);
 			} else {
-				if (!get_gap(remote, min_gap(remote)))
-					return 0;
+				gap = remote->bounds[IR_B_MIN_GAP];
 			}
+			if (!get_gap(remote, &gap))
+				return 0;
 		}               /* end of mode specific code */
 	}
 	if ((!has_repeat(remote) || remote->reps < remote->min_code_repeat)
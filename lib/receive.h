@@ -40,6 +40,9 @@ extern "C" {
  */
 void rec_set_update_mode(int mode);
 
+/** Return the mode set by rec_set_update_mode(). */
+int rec_get_update_mode(void);
+
 /**
  * Set a file logging input from driver in same format as mode2(1).
  * @param f Open file to write on or NULL to disable logging.
@@ -95,6 +98,81 @@ void rec_buffer_rewind(void);
 /** Reset internal fifo's write pointer.  */
 void rec_buffer_reset_wptr(void);
 
+/**
+ * Return true if the driver has signalled EOF and no data remains, i. e.,
+ * the next receive_decode() call reports LIRC_EOF.
+ */
+int rec_buffer_at_eof(void);
+
+/**
+ * Return number of items read by the driver's readdata_batch() or the
+ * reader thread which are not yet in the fifo. If non-zero, the driver's
+ * rec_func() should be called without waiting for the driver's fd.
+ */
+int rec_buffer_pending(void);
+
+/** Statistics of the reader thread since rec_reader_start(). */
+struct rec_reader_stats {
+	unsigned long	items;          /**< Items queued. */
+	unsigned long	overflows;      /**< Items dropped, queue full. */
+	unsigned long	max_fill;       /**< Max items queued at a time. */
+	unsigned long	max_delay;      /**< Max us from read to decode. */
+};
+
+/**
+ * Start a thread which reads from the driver as soon as data is
+ * available, timestamps it and queues it for the decoder. The
+ * decoder, i. e., receive_decode() and rec_buffer_clear(), then reads
+ * from the queue. Used so that data is read in time while the decoding
+ * thread is busy. Items which do not fit in the queue are dropped and
+ * counted as overflows.
+ *
+ * The driver must be initialized, must wait using waitfordata() and
+ * must set LIRC_CAN_USE_READER_THREAD in its features. Only the reader
+ * thread calls readdata() or readdata_batch(), other driver functions
+ * are called by the decoding thread as usual, so the driver must not
+ * read its fd elsewhere, e. g., for command replies when sending. Does
+ * nothing if the thread runs, restarts it if it has exited on EOF or
+ * errors.
+ *
+ * @param size Queue size in items, rounded up to a power of two.
+ * @return 1 if the thread runs, else 0 (unsupported drivers, errors).
+ */
+int rec_reader_start(unsigned int size);
+
+/**
+ * Stop the reader thread, if running, and discard queued items. Must
+ * be called before the driver is deinitialized.
+ */
+void rec_reader_stop(void);
+
+/**
+ * To be called by a driver's readdata() or readdata_batch() on read
+ * errors where it would deinitialize itself. In the reader thread, the
+ * decoding thread may use the driver meanwhile: the error is recorded,
+ * the thread exits when readdata() returns 0, and the application
+ * deinitializes the driver when rec_reader_failed() is true.
+ * @return 1 in the reader thread, the driver must not deinitialize
+ *     itself. Else 0.
+ */
+int rec_reader_read_error(void);
+
+/**
+ * Return true if the reader thread has exited after a driver read error
+ * and the queued data is consumed, see rec_reader_read_error(). The
+ * driver should then be deinitialized.
+ */
+int rec_reader_failed(void);
+
+/**
+ * Return a fd which is readable when the reader thread has queued data,
+ * used instead of drv.fd when polling. -1 if the thread is not started.
+ */
+int rec_reader_fd(void);
+
+/** Get the statistics of the reader thread. */
+void rec_reader_get_stats(struct rec_reader_stats* stats);
+
 
 /** @} */
 #ifdef __cplusplus
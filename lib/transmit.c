@@ -22,6 +22,11 @@
  * signals and send the signal chain at a single blow */
 #define LIRCD_EXACT_GAP_THRESHOLD 10000
 
+/* log2 of number of entries in the encoded signals cache, 2 per set. */
+#define SEND_CACHE_BITS 9
+
+#include <stdint.h>
+
 #ifdef HAVE_KERNEL_LIRC_H
 #include <linux/lirc.h>
 #else
@@ -39,7 +44,8 @@ static const logchannel_t logchannel = LOG_LIB;
 static struct sbuf {
 	lirc_t* data;
 
-	lirc_t	_data[WBUF_SIZE]; /**< Actual sending data. */
+	lirc_t* _data;		/**< Actual sending data. */
+	int	size;		/**< Allocated size of _data. */
 	int	wptr;
 	int	too_long;
 	int	is_biphase;
@@ -48,20 +54,77 @@ static struct sbuf {
 	lirc_t	sum;
 } send_buffer;
 
+/**
+ * A cached encoded signal: the send buffer contents added when encoding
+ * a code in a given state, starting with no pending pulse or space.
+ */
+struct send_cache_entry {
+	const struct ir_remote* remote;	/**< Owner, NULL if unused. */
+	ir_code			code;	/**< Code sent incl. repeat_mask. */
+	ir_code			toggle_bit_mask_state;
+	int			toggle_mask_odd;
+	int			repeat;
+	int			first;	/**< Encoded into an empty buffer. */
+	lirc_t			pendingp;
+	lirc_t			pendings;
+	lirc_t			sum;	/**< Added to send_buffer.sum. */
+	int			length;
+	lirc_t*			data;
+};
+
+static struct send_cache_entry send_cache[1 << SEND_CACHE_BITS];
+
 
 static void send_signals(lirc_t* signals, int n);
-static int init_send_or_sim(struct ir_remote* remote, struct ir_ncode* code, int sim, int repeat_preset);
+static int init_send_or_sim(struct ir_remote* remote, struct ir_ncode* code,
+			    int sim, int repeat_preset,
+			    send_chunk_func chunk, void* arg);
 
 /*
  * sending stuff
  */
 
 /**
- * Initializes the global sending buffer. (Just fills it with zeros.)
+ * Initializes the global sending buffer. (Just fills it with zeros, but
+ * keeps the allocated data.)
  */
 void send_buffer_init(void)
 {
+	lirc_t* data = send_buffer._data;
+	int size = send_buffer.size;
+
 	memset(&send_buffer, 0, sizeof(send_buffer));
+	send_buffer._data = data;
+	send_buffer.size = size;
+}
+
+/**
+ * Make room for at least size items. The buffer is never shrunk, so
+ * once grown to the longest signal sent nothing is allocated.
+ */
+static int grow_send_buffer(int size)
+{
+	lirc_t* data;
+	int new_size = send_buffer.size > 0 ? send_buffer.size : WBUF_SIZE;
+
+	if (size <= send_buffer.size)
+		return 1;
+	if (size > WBUF_MAX_SIZE)
+		return 0;
+	while (new_size < size)
+		new_size *= 2;
+	if (new_size > WBUF_MAX_SIZE)
+		new_size = WBUF_MAX_SIZE;
+	data = (lirc_t*)realloc(send_buffer._data, new_size * sizeof(lirc_t));
+	if (data == NULL) {
+		log_error("out of memory for transmit buffer");
+		return 0;
+	}
+	if (send_buffer.data == send_buffer._data)
+		send_buffer.data = data;
+	send_buffer._data = data;
+	send_buffer.size = new_size;
+	return 1;
 }
 
 static void clear_send_buffer(void)
@@ -77,7 +140,8 @@ static void clear_send_buffer(void)
 
 static void add_send_buffer(lirc_t data)
 {
-	if (send_buffer.wptr < WBUF_SIZE) {
+	if (send_buffer.wptr < send_buffer.size
+	    || grow_send_buffer(send_buffer.wptr + 1)) {
 		log_trace2("adding to transmit buffer: %u", data);
 		send_buffer.sum += data;
 		send_buffer._data[send_buffer.wptr] = data;
@@ -121,12 +185,13 @@ static int bad_send_buffer(void)
 {
 	if (send_buffer.too_long != 0)
 		return 1;
-	if (send_buffer.wptr == WBUF_SIZE && send_buffer.pendingp > 0)
+	if (send_buffer.wptr == WBUF_MAX_SIZE && send_buffer.pendingp > 0)
 		return 1;
 	return 0;
 }
 
-static int check_send_buffer(void)
+/** Check that items from start up to wptr are valid. */
+static int check_send_buffer(int start)
 {
 	int i;
 
@@ -134,7 +199,7 @@ static int check_send_buffer(void)
 		log_trace("nothing to send");
 		return 0;
 	}
-	for (i = 0; i < send_buffer.wptr; i++) {
+	for (i = start; i < send_buffer.wptr; i++) {
 		if (send_buffer.data[i] == 0) {
 			if (i % 2) {
 				log_trace("invalid space: %d", i);
@@ -173,6 +238,13 @@ static void sync_send_buffer(void)
 static void send_header(struct ir_remote* remote)
 {
 	if (has_header(remote)) {
+		if (is_bo(remote)) {
+			/* two start bits in front of the header */
+			send_pulse(remote->pone);
+			send_space(remote->sone);
+			send_pulse(remote->pone);
+			send_space(remote->sone);
+		}
 		send_pulse(remote->phead);
 		send_space(remote->shead);
 	}
@@ -198,6 +270,152 @@ static void send_trail(struct ir_remote* remote)
 		send_pulse(remote->ptrail);
 }
 
+/**
+ * Return data, bits done .. done + bits - 1 of the complete code, with
+ * the toggle_bit_mask and toggle_mask state applied like send_data()
+ * does bit by bit.
+ */
+static ir_code toggle_data(struct ir_remote* remote, ir_code data, int bits, int done)
+{
+	int i;
+	int all_bits = bit_count(remote);
+	int toggle_bit_mask_bits = bits_set(remote->toggle_bit_mask);
+	ir_code mask;
+	ir_code bit;
+
+	mask = ((ir_code)1) << (all_bits - 1 - done);
+	for (i = bits - 1; i >= 0; i--, mask >>= 1) {
+		bit = ((ir_code)1) << i;
+		if (has_toggle_bit_mask(remote) && mask & remote->toggle_bit_mask) {
+			if (toggle_bit_mask_bits == 1) {
+				/* backwards compatibility */
+				data &= ~bit;
+				if (remote->toggle_bit_mask_state & mask)
+					data |= bit;
+			} else {
+				if (remote->toggle_bit_mask_state & mask)
+					data ^= bit;
+			}
+		}
+		if (has_toggle_mask(remote) && mask & remote->toggle_mask && remote->toggle_mask_state % 2)
+			data ^= bit;
+	}
+	return data;
+}
+
+/**
+ * Grundig: bit pairs, most significant first, as space + pulse sums
+ * of 6T (00), 4T 2T (01), 3T 3T (10) or 2T 4T (11) using the three,
+ * two, one and zero timings.
+ */
+static void send_grundig_data(struct ir_remote* remote, ir_code data, int bits, int done)
+{
+	int i;
+
+	if (bits % 2 || done % 2) {
+		log_error("invalid bit number.");
+		return;
+	}
+	for (i = bits - 2; i >= 0; i -= 2) {
+		switch ((data >> i) & 3) {
+		case 0:
+			send_space(remote->sthree);
+			send_pulse(remote->pthree);
+			break;
+		case 1:
+			send_space(remote->stwo);
+			send_pulse(remote->ptwo);
+			send_space(remote->szero);
+			send_pulse(remote->pzero);
+			break;
+		case 2:
+			send_space(remote->sone);
+			send_pulse(remote->pone);
+			send_space(remote->sone);
+			send_pulse(remote->pone);
+			break;
+		case 3:
+			send_space(remote->szero);
+			send_pulse(remote->pzero);
+			send_space(remote->stwo);
+			send_pulse(remote->ptwo);
+			break;
+		}
+	}
+}
+
+/**
+ * Serial: bytes of bits_in_byte bits, most significant byte first.
+ * Each byte is a start bit pulse, the bits least significant first as
+ * pulse (0) or space (1), an optional parity bit and the stop bits.
+ */
+static void send_serial_data(struct ir_remote* remote, ir_code data, int bits)
+{
+	lirc_t base;
+	ir_code byte;
+	int parity;
+	int i;
+	int j;
+
+	if (remote->baud == 0 || bits % remote->bits_in_byte) {
+		log_error("invalid bit number.");
+		return;
+	}
+	base = 1000000 / remote->baud;
+	for (i = bits - remote->bits_in_byte; i >= 0; i -= remote->bits_in_byte) {
+		byte = data >> i;
+		parity = remote->parity == IR_PARITY_ODD ? 1 : 0;
+		send_pulse(base);
+		for (j = 0; j < remote->bits_in_byte; j++, byte >>= 1) {
+			if (byte & 1)
+				send_space(remote->sone);
+			else
+				send_pulse(remote->pzero);
+			parity ^= byte & 1;
+		}
+		if (remote->parity != IR_PARITY_NONE) {
+			if (parity)
+				send_space(remote->sone);
+			else
+				send_pulse(remote->pzero);
+		}
+		send_space(base * remote->stop_bits / 2);
+	}
+}
+
+/**
+ * Bang & Olufsen: the timing of a bit depends on the previous one,
+ * starting as if it was a 1. After a 1, a 0 is sent using the one
+ * timing and a 1 using two; after a 0, a 0 is two and a 1 is three.
+ */
+static void send_bo_data(struct ir_remote* remote, ir_code data, int bits)
+{
+	int lastbit = 1;
+	int i;
+
+	for (i = bits - 1; i >= 0; i--) {
+		if ((data >> i) & 1) {
+			if (lastbit) {
+				send_pulse(remote->ptwo);
+				send_space(remote->stwo);
+			} else {
+				send_pulse(remote->pthree);
+				send_space(remote->sthree);
+			}
+			lastbit = 1;
+		} else {
+			if (lastbit) {
+				send_pulse(remote->pone);
+				send_space(remote->sone);
+			} else {
+				send_pulse(remote->ptwo);
+				send_space(remote->stwo);
+			}
+			lastbit = 0;
+		}
+	}
+}
+
 static void send_data(struct ir_remote* remote, ir_code data, int bits, int done)
 {
 	int i;
@@ -205,6 +423,16 @@ static void send_data(struct ir_remote* remote, ir_code data, int bits, int done
 	int toggle_bit_mask_bits = bits_set(remote->toggle_bit_mask);
 	ir_code mask;
 
+	if (is_grundig(remote)) {
+		send_grundig_data(remote, toggle_data(remote, data, bits, done), bits, done);
+		return;
+	} else if (is_serial(remote)) {
+		send_serial_data(remote, toggle_data(remote, data, bits, done), bits);
+		return;
+	} else if (is_bo(remote)) {
+		send_bo_data(remote, toggle_data(remote, data, bits, done), bits);
+		return;
+	}
 	data = reverse(data, bits);
 	if (is_rcmm(remote)) {
 		mask = 1 << (all_bits - 1 - done);
@@ -344,6 +572,106 @@ static void send_code(struct ir_remote* remote, ir_code code, int repeat)
 		send_buffer.sum -= remote->phead + remote->shead;
 }
 
+static void encode_signal(struct ir_remote* remote, ir_code code, int repeat)
+{
+	if (repeat && has_repeat(remote)) {
+		if (remote->flags & REPEAT_HEADER && has_header(remote))
+			send_header(remote);
+		send_repeat(remote);
+	} else {
+		send_code(remote, code, repeat);
+	}
+}
+
+/** Return first of the two entries in the set for given key. */
+static struct send_cache_entry* send_cache_set(struct ir_remote* remote,
+					       ir_code code, int repeat)
+{
+	uint64_t h;
+
+	h = (uint64_t)(uintptr_t)remote;
+	h ^= code * 0x9e3779b97f4a7c15ULL;
+	h ^= remote->toggle_bit_mask_state * 0xc2b2ae3d27d4eb4fULL;
+	h ^= (remote->toggle_mask_state % 2) << 1 | (repeat != 0);
+	h ^= h >> 29;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	return &send_cache[(h >> (65 - SEND_CACHE_BITS)) * 2];
+}
+
+/**
+ * encode_signal() using the cache: the output for a given remote, code,
+ * repeat flag and toggle state never changes, so it's just copied on
+ * hits.
+ */
+static void send_cached(struct ir_remote* remote, ir_code code, int repeat)
+{
+	struct send_cache_entry* set;
+	struct send_cache_entry* e;
+	struct send_cache_entry tmp;
+	int start = send_buffer.wptr;
+	lirc_t sum = send_buffer.sum;
+	lirc_t* data;
+	int i;
+
+	if (send_buffer.pendingp > 0 || send_buffer.pendings > 0) {
+		encode_signal(remote, code, repeat);
+		return;
+	}
+	set = send_cache_set(remote, code, repeat);
+	for (i = 0; i < 2; i++) {
+		e = &set[i];
+		if (e->remote == remote
+		    && e->code == code
+		    && e->repeat == repeat
+		    && e->first == (start == 0)
+		    && e->toggle_bit_mask_state == remote->toggle_bit_mask_state
+		    && e->toggle_mask_odd == remote->toggle_mask_state % 2)
+			break;
+	}
+	if (i < 2 && grow_send_buffer(start + e->length)) {
+		memcpy(send_buffer._data + start, e->data,
+		       e->length * sizeof(lirc_t));
+		send_buffer.wptr += e->length;
+		send_buffer.pendingp = e->pendingp;
+		send_buffer.pendings = e->pendings;
+		send_buffer.sum += e->sum;
+		return;
+	}
+	encode_signal(remote, code, repeat);
+	if (send_buffer.too_long)
+		return;
+	/* Replace the least recently added entry, keep newest first. */
+	tmp = set[1];
+	set[1] = set[0];
+	set[0] = tmp;
+	e = &set[0];
+	data = (lirc_t*)realloc(e->data,
+				(send_buffer.wptr - start + 1) * sizeof(lirc_t));
+	if (data == NULL)
+		return;
+	e->data = data;
+	e->length = send_buffer.wptr - start;
+	memcpy(e->data, send_buffer._data + start, e->length * sizeof(lirc_t));
+	e->remote = remote;
+	e->code = code;
+	e->repeat = repeat;
+	e->first = start == 0;
+	e->toggle_bit_mask_state = remote->toggle_bit_mask_state;
+	e->toggle_mask_odd = remote->toggle_mask_state % 2;
+	e->pendingp = send_buffer.pendingp;
+	e->pendings = send_buffer.pendings;
+	e->sum = send_buffer.sum - sum;
+}
+
+void send_cache_clear(void)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(send_cache) / sizeof(send_cache[0]); i++)
+		free(send_cache[i].data);
+	memset(send_cache, 0, sizeof(send_cache));
+}
+
 static void send_signals(lirc_t* signals, int n)
 {
 	int i;
@@ -354,7 +682,14 @@ static void send_signals(lirc_t* signals, int n)
 
 int send_buffer_put(struct ir_remote* remote, struct ir_ncode* code)
 {
-	return init_send_or_sim(remote, code, 0, 0);
+	return init_send_or_sim(remote, code, 0, 0, NULL, NULL);
+}
+
+
+int send_buffer_stream(struct ir_remote* remote, struct ir_ncode* code,
+		       send_chunk_func chunk, void* arg)
+{
+	return init_send_or_sim(remote, code, 0, 0, chunk, arg);
 }
 
 /**
@@ -363,7 +698,7 @@ int send_buffer_put(struct ir_remote* remote, struct ir_ncode* code)
  */
 int init_sim(struct ir_remote* remote, struct ir_ncode* code, int repeat_preset)
 {
-	return init_send_or_sim(remote, code, 1, repeat_preset);
+	return init_send_or_sim(remote, code, 1, repeat_preset, NULL, NULL);
 }
 /**
  *@endcond
@@ -386,17 +721,37 @@ lirc_t send_buffer_sum(void)
 	return send_buffer.sum;
 }
 
-static int init_send_or_sim(struct ir_remote* remote, struct ir_ncode* code, int sim, int repeat_preset)
+/**
+ * Check and pass the items added since *done to chunk, if any.
+ * Returns 0 on errors.
+ */
+static int send_chunk(int* done, send_chunk_func chunk, void* arg)
 {
-	int i, repeat = repeat_preset;
-
-	if (is_grundig(remote) || is_serial(remote) || is_bo(remote)) {
-		if (!sim)
-			log_error("sorry, can't send this protocol yet");
+	if (chunk == NULL || *done == send_buffer.wptr)
+		return 1;
+	if (!check_send_buffer(*done)) {
+		log_error("invalid send buffer");
+		log_error("this remote configuration cannot be used to transmit");
 		return 0;
 	}
+	if (!chunk(send_buffer.data + *done, send_buffer.wptr - *done, arg))
+		return 0;
+	*done = send_buffer.wptr;
+	return 1;
+}
+
+static int init_send_or_sim(struct ir_remote* remote, struct ir_ncode* code,
+			    int sim, int repeat_preset,
+			    send_chunk_func chunk, void* arg)
+{
+	int i, repeat = repeat_preset;
+	int done = 0;
+
 	clear_send_buffer();
 	if (strcmp(remote->name, "lirc") == 0) {
+		if (!grow_send_buffer(1))
+			return 0;
+		send_buffer.data = send_buffer._data;
 		send_buffer.data[send_buffer.wptr] = LIRC_EOF | 1;
 		send_buffer.wptr += 1;
 		goto final_check;
@@ -412,14 +767,10 @@ static int init_send_or_sim(struct ir_remote* remote, struct ir_ncode* code, int
 	}
 
 init_send_loop:
-	if (repeat && has_repeat(remote)) {
-		if (remote->flags & REPEAT_HEADER && has_header(remote))
-			send_header(remote);
-		send_repeat(remote);
-	} else {
-		if (!is_raw(remote)) {
-			ir_code next_code;
+	if (!is_raw(remote) || (repeat && has_repeat(remote))) {
+		ir_code next_code = 0;
 
+		if (!(repeat && has_repeat(remote))) {
 			if (sim || code->transmit_state == NULL)
 				next_code = code->code;
 			else
@@ -427,28 +778,31 @@ init_send_loop:
 
 			if (repeat && has_repeat_mask(remote))
 				next_code ^= remote->repeat_mask;
-
-			send_code(remote, next_code, repeat);
-			if (!sim && has_toggle_mask(remote)) {
-				remote->toggle_mask_state++;
-				if (remote->toggle_mask_state == 4)
-					remote->toggle_mask_state = 2;
-			}
-			send_buffer.data = send_buffer._data;
+		}
+		if (sim)
+			encode_signal(remote, next_code, repeat);
+		else
+			send_cached(remote, next_code, repeat);
+		if (!sim && has_toggle_mask(remote)
+		    && !(repeat && has_repeat(remote))) {
+			remote->toggle_mask_state++;
+			if (remote->toggle_mask_state == 4)
+				remote->toggle_mask_state = 2;
+		}
+		send_buffer.data = send_buffer._data;
+	} else {
+		if (code->signals == NULL) {
+			if (!sim)
+				log_error("no signals for raw send");
+			return 0;
+		}
+		if (send_buffer.wptr > 0) {
+			send_signals(code->signals, code->length);
 		} else {
-			if (code->signals == NULL) {
-				if (!sim)
-					log_error("no signals for raw send");
-				return 0;
-			}
-			if (send_buffer.wptr > 0) {
-				send_signals(code->signals, code->length);
-			} else {
-				send_buffer.data = code->signals;
-				send_buffer.wptr = code->length;
-				for (i = 0; i < code->length; i++)
-					send_buffer.sum += code->signals[i];
-			}
+			send_buffer.data = code->signals;
+			send_buffer.wptr = code->length;
+			for (i = 0; i < code->length; i++)
+				send_buffer.sum += code->signals[i];
 		}
 	}
 	sync_send_buffer();
@@ -507,6 +861,8 @@ init_send_loop:
 		send_space(remote->min_remaining_gap);
 		flush_send_buffer();
 		send_buffer.sum = 0;
+		if (!send_chunk(&done, chunk, arg))
+			return 0;
 
 		repeat = 1;
 		goto init_send_loop;
@@ -514,12 +870,12 @@ init_send_loop:
 	log_trace2("transmit buffer ready");
 
 final_check:
-	if (!check_send_buffer()) {
+	if (!check_send_buffer(done)) {
 		if (!sim) {
 			log_error("invalid send buffer");
 			log_error("this remote configuration cannot be used to transmit");
 		}
 		return 0;
 	}
-	return 1;
+	return send_chunk(&done, chunk, arg);
 }
@@ -32,8 +32,20 @@
 extern "C" {
 #endif
 
+/** Initial size of the transmit buffer, it grows as required. */
 #define WBUF_SIZE 256
 
+/** Max number of pulses and spaces in a transmitted signal. */
+#define WBUF_MAX_SIZE 65536
+
+/**
+ * Callback for send_buffer_stream(), invoked with the next n items of
+ * the encoded signal. Each chunk starts with a pulse. All but the last
+ * chunk ends with a space; the last one ends with a pulse.
+ * @return 0 to abort the transmission, else 1.
+ */
+typedef int (*send_chunk_func)(const lirc_t* data, int n, void* arg);
+
 /** Clear and re-initiate the buffer. */
 void send_buffer_init(void);
 
@@ -46,6 +58,21 @@ void send_buffer_init(void);
  */
 int send_buffer_put(struct ir_remote* remote, struct ir_ncode* code);
 
+/**
+ * Like send_buffer_put(), but passes the signal to chunk as soon as
+ * parts of it are ready. Repeats which are concatenated because of a
+ * short gap are passed one by one, so a driver can start transmitting
+ * before the complete signal is encoded. When done, the complete signal
+ * is also available in send_buffer_data().
+ * @param remote ir_remote containing code to send.
+ * @param code ir_ncode to send.
+ * @param chunk Invoked with each part of the signal.
+ * @param arg Passed to chunk.
+ * @return 0 on failures, else 1.
+ */
+int send_buffer_stream(struct ir_remote* remote, struct ir_ncode* code,
+		       send_chunk_func chunk, void* arg);
+
 /** @cond */
 int init_sim(struct ir_remote*	remote,
 	     struct ir_ncode*	code,
@@ -61,6 +88,13 @@ const lirc_t* send_buffer_data(void);
 /** @return Total length of send buffer in microseconds. */
 lirc_t send_buffer_sum(void);
 
+/**
+ * Drop all cached encoded signals. send_buffer_put() caches the encoded
+ * signals by remote address; this must be called before a remote is
+ * freed or modified. free_config() does this.
+ */
+void send_cache_clear(void);
+
 /** @} */
 
 #ifdef __cplusplus
@@ -625,6 +625,9 @@ static int commandir_ioctl(unsigned int cmd, void* arg)
 		return 0;
 
 	default:
+		/* Generic commands like DRVCTL_BEGIN_SEND_BATCH are optional. */
+		if (cmd <= DRVCTL_MAX)
+			return DRV_ERR_NOT_IMPLEMENTED;
 		log_error("Unknown ioctl - %d", cmd);
 		return -1;
 	}
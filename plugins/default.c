@@ -25,7 +25,9 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <time.h>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <sys/types.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
@@ -43,6 +45,13 @@
 
 static const logchannel_t logchannel = LOG_DRIVER;
 
+/*
+ * Kernel limits for a single LIRC_MODE_PULSE write: max number of
+ * items (LIRCBUF_SIZE) and total duration in us (IR_MAX_DURATION).
+ */
+#define BATCH_MAX_ITEMS         1024
+#define BATCH_MAX_DURATION      500000
+
 static uint32_t supported_send_modes[] = {
 	/* LIRC_CAN_SEND_LIRCCODE, */
 	/* LIRC_CAN_SEND_MODE2, this one would be very easy */
@@ -66,6 +75,7 @@ static int default_send(struct ir_remote* remote, struct ir_ncode* code);
 static char* default_rec(struct ir_remote* remotes);
 static int default_ioctl(unsigned int cmd, void* arg);
 static lirc_t default_readdata(lirc_t timeout);
+static int default_readdata_batch(lirc_t* buf, size_t max, lirc_t timeout);
 static int my_open(const char* path);
 static int drvctl(unsigned int cmd, void* arg);
 
@@ -87,7 +97,8 @@ static const struct driver hw_default = {
 	.decode_func	= receive_decode,
 	.drvctl_func	= drvctl,
 	.readdata	= default_readdata,
-	.api_version	= 3,
+	.readdata_batch = default_readdata_batch,
+	.api_version	= 5,
 	.driver_version = "0.9.4",
 	.info		= "See file://" PLUGINDOCS "/default.html",
 	.device_hint    = "drvctl",
@@ -105,6 +116,26 @@ const struct driver* hardwares[] = { &hw_default, (const struct driver*)NULL };
 
 static int write_send_buffer(int lirc);
 
+/** Last carrier and duty cycle programmed into the device. */
+static struct {
+	int		valid;
+	unsigned int	freq;
+	unsigned int	duty_cycle;
+} send_params;
+
+/**
+ * Frames sent between DRVCTL_BEGIN_SEND_BATCH and DRVCTL_END_SEND_BATCH,
+ * separated by their gaps and written in as few writes as possible.
+ */
+static struct {
+	int	active;
+	lirc_t	data[BATCH_MAX_ITEMS];
+	int	length;
+	lirc_t	duration;       /**< Sum of data. */
+	lirc_t	gap;            /**< Space before next frame. */
+	struct ir_remote*	remote; /**< Remote of the last frame. */
+} batch;
+
 /***************************************************
 *
 * /sys/class/rc  stuff.
@@ -268,10 +299,13 @@ int my_open(const char* path)
 * decode stuff
 *
 **********************************************************************/
+/** Last item returned by default_readdata() or default_readdata_batch(). */
+static lirc_t last_space = 0;
+
+
 int default_readdata(lirc_t timeout)
 {
 	int data, ret;
-	static int last_space = (lirc_t) 0;
 
 	if (!waitfordata((long)timeout))
 		return 0;
@@ -280,7 +314,8 @@ int default_readdata(lirc_t timeout)
 	if (ret != sizeof(data)) {
 		log_perror_err("error reading from %s (ret %d, expected %d)",
 			  drv.device, ret, sizeof(data));
-		default_deinit();
+		if (!rec_reader_read_error())
+			default_deinit();
 
 		return 0;
 	}
@@ -294,7 +329,8 @@ int default_readdata(lirc_t timeout)
 			log_perror_err(
 				"error reading from %s (got %d, expected %d)",
 				drv.device, ret, sizeof(data));
-			default_deinit();
+			if (!rec_reader_read_error())
+				default_deinit();
 			return 0;
 		}
 	}
@@ -312,6 +348,51 @@ int default_readdata(lirc_t timeout)
 	return data;
 }
 
+
+/** Like default_readdata(), but reads all available data at once. */
+static int default_readdata_batch(lirc_t* buf, size_t max, lirc_t timeout)
+{
+	static int data_warning = 1;
+	lirc_t data;
+	int count;
+	int ret;
+	int i;
+
+	do {
+		if (!waitfordata((long)timeout))
+			return 0;
+		ret = read(drv.fd, buf, max * sizeof(lirc_t));
+		if (ret <= 0 || ret % sizeof(lirc_t) != 0) {
+			log_perror_err("error reading from %s (ret %d)",
+				       drv.device, ret);
+			if (!rec_reader_read_error())
+				default_deinit();
+			return 0;
+		}
+		count = 0;
+		for (i = 0; i < ret / (int)sizeof(lirc_t); i++) {
+			data = buf[i];
+			if (last_space == LIRC_SPACE(LIRC_VALUE_MASK)
+			    && LIRC_IS_SPACE(data)) {
+				/* Work around #172, like default_readdata(). */
+				last_space = 0;
+				continue;
+			}
+			if (data == 0) {
+				if (data_warning) {
+					log_warn("read invalid data from device %s",
+						 drv.device);
+					data_warning = 0;
+				}
+				data = 1;
+			}
+			buf[count++] = data;
+			last_space = data;
+		}
+	} while (count == 0);
+	return count;
+}
+
 /*
  * interface functions
  */
@@ -323,6 +404,9 @@ int default_init(void)
 	/* FIXME: other modules might need this, too */
 	rec_buffer_init();
 	send_buffer_init();
+	send_params.valid = 0;
+	batch.active = 0;
+	batch.length = 0;
 
 	if (set_rc_protocol(drv.device) != 0)
 		log_info("Cannot configure the rc device for %s",
@@ -357,7 +441,8 @@ int default_init(void)
 		}
 
 		log_trace("using unix socket lirc device");
-		drv.features = LIRC_CAN_REC_MODE2 | LIRC_CAN_SEND_PULSE;
+		drv.features = LIRC_CAN_REC_MODE2 | LIRC_CAN_SEND_PULSE
+			       | LIRC_CAN_USE_READER_THREAD;
 		drv.rec_mode = LIRC_MODE_MODE2; /* this might change in future */
 		drv.send_mode = LIRC_MODE_PULSE;
 		return 1;
@@ -370,7 +455,7 @@ int default_init(void)
 	}
 	if (S_ISFIFO(s.st_mode)) {
 		log_trace("using defaults for the Irman");
-		drv.features = LIRC_CAN_REC_MODE2;
+		drv.features = LIRC_CAN_REC_MODE2 | LIRC_CAN_USE_READER_THREAD;
 		drv.rec_mode = LIRC_MODE_MODE2; /* this might change in future */
 		return 1;
 	} else if (!S_ISCHR(s.st_mode)) {
@@ -449,11 +534,15 @@ int default_init(void)
 		default_deinit();
 		return 0;
 	}
+	drv.features |= LIRC_CAN_USE_READER_THREAD;
 	return 1;
 }
 
 int default_deinit(void)
 {
+	send_params.valid = 0;
+	batch.active = 0;
+	batch.length = 0;
 	if (drv.fd != -1) {
 		close(drv.fd);
 		drv.fd = -1;
@@ -470,34 +559,167 @@ static int write_send_buffer(int lirc)
 	return write(lirc, send_buffer_data(), send_buffer_length() * sizeof(lirc_t));
 }
 
-int default_send(struct ir_remote* remote, struct ir_ncode* code)
+/** Write batched frames, if any. Returns 0 on errors. */
+static int flush_batch(void)
 {
-	/* things are easy, because we only support one mode */
-	if (drv.send_mode != LIRC_MODE_PULSE)
+	int r;
+
+	if (batch.length == 0)
+		return 1;
+	r = write(drv.fd, batch.data, batch.length * sizeof(lirc_t));
+	batch.length = 0;
+	batch.duration = 0;
+	if (r == -1) {
+		log_error("write failed");
+		log_perror_err(NULL);
 		return 0;
+	}
+	return 1;
+}
 
-	if (drv.features & LIRC_CAN_SET_SEND_CARRIER) {
-		unsigned int freq;
+/**
+ * Write batched frames, if any, and wait for the pending gap since the
+ * write returns when the signal is sent. Used before the next frame
+ * which cannot be added to the batch. Returns 0 on errors.
+ */
+static int write_batch(void)
+{
+	if (!flush_batch())
+		return 0;
+	if (batch.gap > 0)
+		usleep(batch.gap);
+	batch.gap = 0;
+	return 1;
+}
 
-		freq = remote->freq;
-		if (default_ioctl(LIRC_SET_SEND_CARRIER, &freq) == -1) {
-			log_error("could not set modulation frequency");
+/**
+ * Add the send buffer to the batch after the pending gap. The batch is
+ * written first if the frame does not fit, or if it is empty since the
+ * previous frames were written. Returns 0 on errors.
+ */
+static int add_batch(struct ir_remote* remote)
+{
+	const lirc_t* data = send_buffer_data();
+	int length = send_buffer_length();
+	lirc_t duration = 0;
+	int i;
+
+	if (length == 0) {
+		log_trace("nothing to send");
+		return 0;
+	}
+	for (i = 0; i < length; i++)
+		duration += data[i];
+	if (batch.length == 0
+	    || batch.gap == 0
+	    || batch.length + 1 + length > BATCH_MAX_ITEMS
+	    || batch.duration + batch.gap + duration > BATCH_MAX_DURATION) {
+		if (!write_batch())
+			return 0;
+	}
+	if (batch.length == 0 && length > BATCH_MAX_ITEMS) {
+		if (write_send_buffer(drv.fd) == -1) {
+			log_error("write failed");
 			log_perror_err(NULL);
 			return 0;
 		}
+	} else {
+		if (batch.length > 0) {
+			batch.data[batch.length++] = batch.gap;
+			batch.duration += batch.gap;
+		}
+		memcpy(batch.data + batch.length, data, length * sizeof(lirc_t));
+		batch.length += length;
+		batch.duration += duration;
 	}
-	if (drv.features & LIRC_CAN_SET_SEND_DUTY_CYCLE) {
-		unsigned int duty_cycle;
+	batch.gap = remote->min_remaining_gap;
+	batch.remote = remote;
+	return 1;
+}
+
+/**
+ * Write the remaining batched frames. remote->next_send of the last
+ * frame's remote was computed when the frame was queued, make it count
+ * from the end of the write, which returns when the signal is sent.
+ * Frames of other remotes were followed by at least their gap. Returns
+ * 0 on errors.
+ */
+static int end_batch(void)
+{
+	struct timespec* next_send;
+
+	batch.active = 0;
+	if (!flush_batch())
+		return 0;
+	if (batch.remote != NULL) {
+		next_send = &batch.remote->next_send;
+		clock_gettime(CLOCK_MONOTONIC, next_send);
+		next_send->tv_sec += batch.gap / 1000000;
+		next_send->tv_nsec += (batch.gap % 1000000) * 1000;
+		if (next_send->tv_nsec >= 1000000000) {
+			next_send->tv_sec += 1;
+			next_send->tv_nsec -= 1000000000;
+		}
+	}
+	batch.gap = 0;
+	return 1;
+}
 
-		duty_cycle = get_duty_cycle(remote);
-		if (default_ioctl(LIRC_SET_SEND_DUTY_CYCLE, &duty_cycle) == -1) {
+/**
+ * Program carrier and duty cycle for remote unless already set. Batched
+ * frames are written first since they use the current values, followed
+ * by their gap.
+ */
+static int set_send_params(struct ir_remote* remote)
+{
+	unsigned int freq = remote->freq;
+	unsigned int duty_cycle = get_duty_cycle(remote);
+	int set_freq = drv.features & LIRC_CAN_SET_SEND_CARRIER
+		       && !(send_params.valid && send_params.freq == freq);
+	int set_duty_cycle = drv.features & LIRC_CAN_SET_SEND_DUTY_CYCLE
+			     && !(send_params.valid
+				  && send_params.duty_cycle == duty_cycle);
+	unsigned int arg;
+
+	if (!set_freq && !set_duty_cycle)
+		return 1;
+	if (!write_batch())
+		return 0;
+	send_params.valid = 0;
+	if (set_freq) {
+		arg = freq;
+		if (default_ioctl(LIRC_SET_SEND_CARRIER, &arg) == -1) {
+			log_error("could not set modulation frequency");
+			log_perror_err(NULL);
+			return 0;
+		}
+	}
+	if (set_duty_cycle) {
+		arg = duty_cycle;
+		if (default_ioctl(LIRC_SET_SEND_DUTY_CYCLE, &arg) == -1) {
 			log_error("could not set duty cycle");
 			log_perror_err(NULL);
 			return 0;
 		}
 	}
+	send_params.freq = freq;
+	send_params.duty_cycle = duty_cycle;
+	send_params.valid = 1;
+	return 1;
+}
+
+int default_send(struct ir_remote* remote, struct ir_ncode* code)
+{
+	/* things are easy, because we only support one mode */
+	if (drv.send_mode != LIRC_MODE_PULSE)
+		return 0;
+
+	if (!set_send_params(remote))
+		return 0;
 	if (!send_buffer_put(remote, code))
 		return 0;
+	if (batch.active)
+		return add_batch(remote);
 	if (write_send_buffer(drv.fd) == -1) {
 		log_error("write failed");
 		log_perror_err(NULL);
@@ -540,7 +762,27 @@ static int drvctl(unsigned int cmd, void* arg)
 		drv_enum_free((glob_t*) arg);
 		return 0;
 	case LIRC_SET_TRANSMITTER_MASK:
+		if (!write_batch())
+			return DRV_ERR_BAD_STATE;
 		return default_ioctl(LIRC_SET_TRANSMITTER_MASK, arg);
+	case DRVCTL_BEGIN_SEND_BATCH:
+		if (drv.send_mode != LIRC_MODE_PULSE)
+			return DRV_ERR_NOT_IMPLEMENTED;
+		batch.active = 1;
+		batch.length = 0;
+		batch.duration = 0;
+		batch.gap = 0;
+		batch.remote = NULL;
+		return 0;
+	case DRVCTL_SEND_SPACE:
+		if (!batch.active)
+			return DRV_ERR_BAD_STATE;
+		batch.gap += *(int*)arg;
+		return 0;
+	case DRVCTL_END_SEND_BATCH:
+		if (!batch.active)
+			return DRV_ERR_BAD_STATE;
+		return end_batch() ? 0 : DRV_ERR_BAD_STATE;
 	default:
 		return DRV_ERR_NOT_IMPLEMENTED;
 	}
@@ -83,7 +83,7 @@ const struct driver hw_devinput = {
 	.decode_func	= devinput_decode,
 	.drvctl_func	= drvctl,
 	.readdata	= NULL,
-	.api_version	= 4,
+	.api_version	= 5,
 	.driver_version = "0.9.3",
 	.info		= "See file://" PLUGINDOCS "/devinput.html",
 	.device_hint    = "drvctl"
@@ -112,6 +112,20 @@ enum {
 
 static int repeat_state = RPT_UNKNOWN;
 
+/** Max number of events read at once. */
+#define MAX_EVENTS 64
+
+/**
+ * Events read but not yet handled by devinput_rec(). While there are
+ * some, drv.fd is /dev/zero so lircd calls devinput_rec() again without
+ * waiting for the device, like in the udp driver.
+ */
+static struct input_event events[MAX_EVENTS];
+static int event_count = 0;
+static int event_ptr = 0;
+static int evfd = -1;           /* the input device */
+static int zerofd = -1;         /* /dev/zero, or -1: read single events */
+
 static int setup_uinputfd(const char* name, int source)
 {
 	int fd;
@@ -372,6 +386,12 @@ int devinput_init(void)
 		log_error("unable to open '%s'", drv.device);
 		return 0;
 	}
+	evfd = drv.fd;
+	event_count = 0;
+	event_ptr = 0;
+	zerofd = open("/dev/zero", O_RDONLY);
+	if (zerofd == -1)
+		log_perror_warn("can't open /dev/zero, reading single events");
 #ifdef EVIOCGRAB
 	exclusive = 1;
 	if (ioctl(drv.fd, EVIOCGRAB, 1) == -1) {
@@ -401,8 +421,15 @@ int devinput_deinit(void)
 		close(uinputfd);
 		uinputfd = -1;
 	}
-	close(drv.fd);
+	if (zerofd != -1) {
+		close(zerofd);
+		zerofd = -1;
+	}
+	close(evfd);
+	evfd = -1;
 	drv.fd = -1;
+	event_count = 0;
+	event_ptr = 0;
 	return 1;
 }
 
@@ -450,13 +477,20 @@ char* devinput_rec(struct ir_remote* remotes)
 	last = end;
 	gettimeofday(&start, NULL);
 
-	rd = read(drv.fd, &event, sizeof(event));
-	if (rd != sizeof(event)) {
-		log_error("error reading '%s'", drv.device);
-		if (rd <= 0 && errno != EINTR)
-			devinput_deinit();
-		return 0;
+	if (event_ptr >= event_count) {
+		rd = read(evfd, events,
+			  zerofd == -1 ? sizeof(event) : sizeof(events));
+		if (rd <= 0 || rd % sizeof(event) != 0) {
+			log_error("error reading '%s'", drv.device);
+			if (rd <= 0 && errno != EINTR)
+				devinput_deinit();
+			return 0;
+		}
+		event_count = rd / sizeof(event);
+		event_ptr = 0;
 	}
+	event = events[event_ptr++];
+	drv.fd = event_ptr < event_count ? zerofd : evfd;
 
 	log_trace("time %ld.%06ld  type %d  code %d  value %d", event.time.tv_sec, event.time.tv_usec, event.type,
 		  event.code, event.value);
@@ -57,15 +57,16 @@ static int send_func(struct ir_remote* remote, struct ir_ncode* code);
 static char* receive_func(struct ir_remote* remotes);
 static int open_func(const char* path);
 static int close_func(void);
-static int decode_func(struct ir_remote* remote, struct decode_ctx_t* ctx);
 static lirc_t readdata(lirc_t timeout);
+static int readdata_batch(lirc_t* buf, size_t max, lirc_t timeout);
 static int drvctl_func(unsigned int cmd, void* arg);
 
 
 const struct driver drv_test = {
 	.name		= "file",
 	.device		= "testdata.sym",
-	.features	= LIRC_CAN_REC_MODE2 | LIRC_CAN_SEND_PULSE,
+	.features	= LIRC_CAN_REC_MODE2 | LIRC_CAN_SEND_PULSE
+			  | LIRC_CAN_USE_READER_THREAD,
 	.send_mode	= LIRC_MODE_PULSE,
 	.rec_mode	= LIRC_MODE_MODE2,
 	.code_length	= 0,
@@ -75,10 +76,11 @@ const struct driver drv_test = {
 	.close_func	= close_func,
 	.send_func	= send_func,
 	.rec_func	= receive_func,
-	.decode_func	= decode_func,
+	.decode_func	= receive_decode,
 	.drvctl_func	= drvctl_func,
 	.readdata	= readdata,
-	.api_version	= 3,
+	.readdata_batch = readdata_batch,
+	.api_version	= 5,
 	.driver_version = "0.9.3",
 	.info		= "See file://" PLUGINDOCS "/file.html",
 	.device_hint    = "/tmp/*",
@@ -96,17 +98,6 @@ static int outfile_fd = -1;
 static int lineno = 1;
 static int at_eof = 0;
 
-static int decode_func(struct ir_remote* remote, struct decode_ctx_t* ctx)
-{
-	int res;
-
-	log_trace("decode: enter");
-	res = receive_decode(remote, ctx);
-	log_trace("decode: %d", res);
-	return res;
-}
-
-
 static lirc_t readdata(lirc_t timeout)
 {
 	char line[64];
@@ -143,6 +134,22 @@ static lirc_t readdata(lirc_t timeout)
 };
 
 
+/** Read lines until max, EOF or a bad line. */
+static int readdata_batch(lirc_t* buf, size_t max, lirc_t timeout)
+{
+	size_t count = 0;
+	lirc_t data;
+
+	while (count < max && !at_eof) {
+		data = readdata(count == 0 ? timeout : 0);
+		if (data == 0)
+			break;
+		buf[count++] = data;
+	}
+	return count;
+}
+
+
 static int open_func(const char* device)
 {
 	if (device == NULL)
@@ -179,7 +186,8 @@ static char* receive_func(struct ir_remote* remotes)
 {
 	static char* EOF_PACKET = "0000000008000000 00 __EOF lirc";
 
-	if (at_eof) {
+	/* at_eof is set when reading ahead, decode the data read first. */
+	if (at_eof && rec_buffer_pending() == 0) {
 		log_trace("file.c: At eof");
 		at_eof = 0;
 		return EOF_PACKET;
@@ -210,10 +218,18 @@ static void write_line(const char* type, int duration)
 }
 
 
-static int send_func(struct ir_remote* remote, struct ir_ncode* code)
+static int write_chunk(const lirc_t* data, int n, void* arg)
 {
 	int i;
 
+	for (i = 0; i < n; i++)
+		write_line(i % 2 == 0 ? "pulse" : "space", data[i]);
+	return 1;
+}
+
+
+static int send_func(struct ir_remote* remote, struct ir_ncode* code)
+{
 	log_trace("file.c: sending, code: %s", code->name);
 
 	if (remote->pzero == 0 && remote->szero == 0
@@ -222,16 +238,10 @@ static int send_func(struct ir_remote* remote, struct ir_ncode* code)
 		write_line("code", code->code);
 		return 1;
 	}
-	if (!send_buffer_put(remote, code)) {
-		log_debug("file.c: Cannot make send_buffer_put");
+	if (!send_buffer_stream(remote, code, write_chunk, NULL)) {
+		log_debug("file.c: Cannot make send_buffer_stream");
 		return 0;
 	}
-	for (i = 0;; ) {
-		write_line("pulse", send_buffer_data()[i++]);
-		if (i >= send_buffer_length())
-			break;
-		write_line("space", send_buffer_data()[i++]);
-	}
 	write_line("space", remote->min_remaining_gap);
 	return 1;
 }
@@ -956,11 +956,6 @@ static int send_ir(struct ir_remote* remote, struct ir_ncode* code)
 
 	char buf[LONG_LINE_SIZE];
 
-	if (dev.read_pending)
-		syncronize(); // kill possible ongoing receive
-
-	dev.send_pending = 1;
-
 	int freq = remote->freq;
 
 	if (freq == 0)
@@ -976,6 +971,11 @@ static int send_ir(struct ir_remote* remote, struct ir_ncode* code)
 		char b[SMALLSTRINGSIZE];
 
 		snprintf(b, SMALLSTRINGSIZE - 1, " %d", (unsigned int) signals[i]);
+		if (strlen(buf) + strlen(b) + 3 > LONG_LINE_SIZE) {
+			log_error(DRIVER_NAME ": signal too long (%d items)",
+				  length);
+			return 0;
+		}
 		strncat(buf, b, SMALLSTRINGSIZE - 1);
 	}
 
@@ -983,6 +983,10 @@ static int send_ir(struct ir_remote* remote, struct ir_ncode* code)
 	// differently. Just add a 1 microsecond space.
 	strncat(buf, " 1", 2);
 
+	if (dev.read_pending)
+		syncronize(); // kill possible ongoing receive
+
+	dev.send_pending = 1;
 	sendcommandln(buf);
 	int success = readline(buf, LONG_LINE_SIZE, TIMEOUT_SEND);
 	int enable_receive_success = dev.receive ? enable_receive() : 1;
@@ -99,7 +99,8 @@ static const logchannel_t logchannel = LOG_DRIVER;
 
 static irtoy_t* dev = NULL;
 
-static unsigned char rawSB[WBUF_SIZE * 2 + 2];
+static unsigned char* rawSB = NULL;
+static int rawSB_size = 0;
 
 /* exported functions  */
 static int init(void);
@@ -682,6 +683,16 @@ static int send(struct ir_remote* remote, struct ir_ncode* code)
 	length = send_buffer_length();
 	signals = send_buffer_data();
 
+	if (2 * length + 2 > rawSB_size) {
+		unsigned char* buf = realloc(rawSB, 2 * length + 2);
+
+		if (buf == NULL) {
+			log_error("irtoy: send: out of memory");
+			return 0;
+		}
+		rawSB = buf;
+		rawSB_size = 2 * length + 2;
+	}
 	for (i = 0; i < length; i++) {
 		val = (lirc_t)(((double)signals[i]) / IRTOY_UNIT);
 		rawSB[2 * i] = val >> 8;
@@ -39,9 +39,17 @@
  *
  * to use port 8766 and 1 microsecond timing resolution.
  *
+ * Up to UDP_BATCH queued packets are received at a time, using recvmmsg()
+ * if available, and all their samples are decoded at once. The socket
+ * receive buffer can be set using `-A rcvbuf:bytes`, a larger buffer
+ * holds longer bursts. Packet, byte and sample counts, and packets lost
+ * when the receive buffer is full, are reported by DRVCTL_GET_REC_STATS.
+ *
  * \note Little endian is not conventional network byte order.
  */
 
+#define _GNU_SOURCE 1
+
 #ifdef HAVE_CONFIG_H
 # include <config.h>
 #endif
@@ -53,8 +61,12 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/fcntl.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <errno.h>
+#ifdef __linux__
+#include <linux/sock_diag.h>
+#endif
 
 #include "lirc_driver.h"
 
@@ -66,8 +78,30 @@ static const int FIRST_PORT = 6000;
 /** Last port checked in --list-devices/DRVCTL_GET_DEVIVES. */
 static const int LAST_PORT = 6006;
 
+/** Max packets received at a time. */
+#define UDP_BATCH       8
+
+/** Max packet size, larger packets are truncated. */
+#define UDP_PACKET_SIZE 8192
+
+/** Max SO_RCVBUF setting. */
+#define MAX_RCVBUF      (64 * 1024 * 1024)
+
 static int zerofd;              /* /dev/zero */
-static int sockfd;              /* the socket */
+static int sockfd = -1;         /* the socket */
+static int rcvbuf = 0;          /* SO_RCVBUF, 0 for system default */
+
+/* Last packets received. */
+static u_int8_t buffers[UDP_BATCH][UDP_PACKET_SIZE];
+static struct mmsghdr msgs[UDP_BATCH];
+static struct iovec iovecs[UDP_BATCH];
+
+/* Samples decoded from the last packets, not yet returned. */
+static lirc_t samples[UDP_BATCH * UDP_PACKET_SIZE / 2];
+static int sample_count = 0;
+static int sample_ptr = 0;
+
+static struct drv_rec_stats stats;
 
 
 /** List available udp devices starting at 6000. */
@@ -107,6 +141,40 @@ static int list_devices(glob_t* glob)
 }
 
 
+/** Apply rcvbuf to the socket, log the size actually used. */
+static void setup_rcvbuf(void)
+{
+	int size = 0;
+	socklen_t len = sizeof(size);
+
+	if (rcvbuf == 0)
+		return;
+	if (setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF,
+		       &rcvbuf, sizeof(rcvbuf)) != 0) {
+		log_perror_warn("Cannot set UDP receive buffer");
+		return;
+	}
+	/* Linux doubles the size, and limits it to net.core.rmem_max. */
+	getsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &size, &len);
+	log_info("UDP receive buffer: %d bytes requested, %d used",
+		 rcvbuf, size);
+}
+
+
+/** Update the count of packets dropped by the kernel, e. g. when full. */
+static void update_drops(void)
+{
+#if defined(SO_MEMINFO) && defined(__linux__)
+	u_int32_t meminfo[SK_MEMINFO_VARS];
+	socklen_t len = sizeof(meminfo);
+
+	if (sockfd != -1
+	    && getsockopt(sockfd, SOL_SOCKET, SO_MEMINFO, meminfo, &len) == 0)
+		stats.dropped = meminfo[SK_MEMINFO_DROPS];
+#endif
+}
+
+
 /**
  * Driver control.
  *
@@ -115,6 +183,9 @@ static int list_devices(glob_t* glob)
  *  clocktick:value
  *	Set the timing resolution to specified value.
  *
+ *  rcvbuf:bytes
+ *	Set the socket receive buffer size (SO_RCVBUF).
+ *
  * \retval 0	Success.
  * \retval !=0	drvctl error.
  */
@@ -129,6 +200,10 @@ static int udp_drvctl_func(unsigned int cmd, void* arg)
 	case DRVCTL_FREE_DEVICES:
 		drv_enum_free((glob_t*) arg);
 		return 0;
+	case DRVCTL_GET_REC_STATS:
+		update_drops();
+		*(struct drv_rec_stats*)arg = stats;
+		return 0;
 	case DRVCTL_SET_OPTION:
 		opt = (struct option_t*)arg;
 		if (strcmp(opt->key, "clocktick") == 0) {
@@ -140,6 +215,16 @@ static int udp_drvctl_func(unsigned int cmd, void* arg)
 			}
 			drv.resolution = value;
 			return 0;
+		} else if (strcmp(opt->key, "rcvbuf") == 0) {
+			value = strtol(opt->value, NULL, 10);
+			if (value < 1 || MAX_RCVBUF < value) {
+				log_error("invalid rcvbuf: %s", opt->value);
+				return DRV_ERR_BAD_VALUE;
+			}
+			rcvbuf = value;
+			if (sockfd != -1)
+				setup_rcvbuf();
+			return 0;
 		} else {
 			return DRV_ERR_BAD_OPTION;
 		}
@@ -200,12 +285,17 @@ int udp_init(void)
 	if (bind(sockfd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
 		log_error("can't bind socket to port %d: %s", port, strerror(errno));
 		close(sockfd);
+		sockfd = -1;
 		close(zerofd);
 		return 0;
 	}
 
 	log_info("Listening on port %d/udp", port);
 
+	setup_rcvbuf();
+	memset(&stats, 0, sizeof(stats));
+	sample_count = 0;
+	sample_ptr = 0;
 	drv.fd = sockfd;
 
 	return 1;
@@ -218,8 +308,10 @@ int udp_init(void)
  */
 int udp_deinit(void)
 {
+	update_drops();
 	close(sockfd);
 	close(zerofd);
+	sockfd = -1;
 	drv.fd = -1;
 	return 1;
 }
@@ -236,82 +328,9 @@ char* udp_rec(struct ir_remote* remotes)
 	return decode_all(remotes);
 }
 
-/**
- * Read data from the UDP port.
- *
- * Data read from the UDP port is converted to lirc mode2 format and returned
- * one measured time interval at a time.
- * \param timeout  Time to wait for data.
- * \return         IR timing data in lirc mode2 format.
- */
-lirc_t udp_readdata(lirc_t timeout)
+/** Convert a time value to microseconds using drv.resolution. */
+static lirc_t udp_duration(u_int64_t tmp)
 {
-	static u_int8_t buffer[8192];
-	static int buflen = 0;
-	static int bufptr = 0;
-	lirc_t data;
-	u_int8_t packed[4];
-	u_int64_t tmp;
-
-	/* Assume buffer is empty; LIRC should select on the socket */
-	drv.fd = sockfd;
-
-	/* If buffer is empty, get data into it */
-	if ((bufptr + 2) > buflen) {
-		if (!waitfordata(timeout))
-			return 0;
-		buflen = recv(sockfd, &buffer, sizeof(buffer), 0);
-		if (buflen < 0) {
-			log_info("Error reading from UDP socket");
-			return 0;
-		}
-		if (buflen & 1)
-			buflen--;
-		if (buflen == 0)
-			return 0;
-		bufptr = 0;
-	}
-
-	/* Read as 2 bytes to avoid endian-ness issues */
-	packed[0] = buffer[bufptr++];
-	packed[1] = buffer[bufptr++];
-
-	/* Low indicates that the receiver has detected the marking state
-	 * i.e. is receiving IR pulses.
-	 */
-	data = (packed[1] & 0x80) ? 0 : PULSE_BIT;
-
-	tmp = (((u_int32_t) packed[1]) << 8) | packed[0];
-	tmp &= 0x7FFF;
-	if (tmp == 0) {
-		/*
-		 * A zero flags the following  bytes as an extended time value.
-		 * If buffer is empty, get data into it.
-		 */
-		if ((bufptr + 4) > buflen) {
-			if (!waitfordata(timeout))
-				return 0;
-			buflen = recv(sockfd, &buffer, sizeof(buffer), 0);
-			if (buflen < 0) {
-				log_info("Error reading from UDP socket");
-				return 0;
-			}
-			if (buflen & 1)
-				buflen--;
-			if (buflen == 0)
-				return 0;
-			bufptr = 0;
-		}
-		/* Read as 4 bytes to avoid endian-ness issues. */
-		packed[0] = buffer[bufptr++];
-		packed[1] = buffer[bufptr++];
-		packed[2] = buffer[bufptr++];
-		packed[3] = buffer[bufptr++];
-		tmp = (((u_int64_t) packed[3]) << 24)
-		    | (((u_int64_t) packed[2]) << 16)
-		    | (((u_int64_t) packed[1]) << 8)
-		    | packed[0];
-	}
 	switch (drv.resolution) {
 	case 1:
 		break;
@@ -333,20 +352,164 @@ lirc_t udp_readdata(lirc_t timeout)
 	}
 	if (tmp > PULSE_MASK)
 		tmp = PULSE_MASK;
+	return tmp;
+}
+
+/** Decode a packet, add the IR timing data to samples. */
+static void udp_decode(const u_int8_t* packet, int length)
+{
+	lirc_t data;
+	u_int64_t tmp;
+	int ptr = 0;
+
+	while (ptr + 2 <= length) {
+		/* Low indicates that the receiver has detected the marking
+		 * state i.e. is receiving IR pulses.
+		 * Read byte by byte to avoid endian-ness issues.
+		 */
+		data = (packet[ptr + 1] & 0x80) ? 0 : PULSE_BIT;
+		tmp = (((u_int32_t)packet[ptr + 1] & 0x7F) << 8)
+		      | packet[ptr];
+		ptr += 2;
+		if (tmp == 0) {
+			/* A zero flags the following 4 bytes as an
+			 * extended time value. */
+			if (ptr + 4 > length) {
+				stats.errors += 1;
+				return;
+			}
+			tmp = (((u_int64_t)packet[ptr + 3]) << 24)
+			      | (((u_int64_t)packet[ptr + 2]) << 16)
+			      | (((u_int64_t)packet[ptr + 1]) << 8)
+			      | packet[ptr];
+			ptr += 4;
+		}
+		data |= udp_duration(tmp);
+		/* A zero length space reads as no data. */
+		if (data != 0)
+			samples[sample_count++] = data;
+	}
+}
+
+/**
+ * Receive all queued packets up to UDP_BATCH without waiting, the first
+ * available in msgs[0]. Returns number of packets, -1 on errors.
+ */
+static int udp_recv(void)
+{
+	int i;
+
+	for (i = 0; i < UDP_BATCH; i++) {
+		iovecs[i].iov_base = buffers[i];
+		iovecs[i].iov_len = UDP_PACKET_SIZE;
+		memset(&msgs[i], 0, sizeof(msgs[i]));
+		msgs[i].msg_hdr.msg_iov = &iovecs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+#ifdef HAVE_RECVMMSG
+	return recvmmsg(sockfd, msgs, UDP_BATCH, MSG_DONTWAIT, NULL);
+#else
+	for (i = 0; i < UDP_BATCH; i++) {
+		ssize_t r = recvmsg(sockfd, &msgs[i].msg_hdr, MSG_DONTWAIT);
+
+		if (r < 0)
+			return i > 0 ? i : -1;
+		msgs[i].msg_len = r;
+	}
+	return UDP_BATCH;
+#endif
+}
+
+/**
+ * Wait for data, receive the queued packets and decode them into
+ * samples.
+ * \param timeout  Time to wait for data.
+ * \return         Number of samples, 0 on timeout or errors.
+ */
+static int udp_receive(lirc_t timeout)
+{
+	int count;
+	int i;
+
+	sample_count = 0;
+	sample_ptr = 0;
+	if (!waitfordata(timeout))
+		return 0;
+	count = udp_recv();
+	if (count < 0) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+			log_info("Error reading from UDP socket");
+		return 0;
+	}
+	stats.batches += 1;
+	stats.packets += count;
+	for (i = 0; i < count; i++) {
+		stats.bytes += msgs[i].msg_len;
+		if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+			stats.errors += 1;
+		udp_decode(buffers[i], msgs[i].msg_len);
+	}
+	stats.samples += sample_count;
+	return sample_count;
+}
+
+/**
+ * Read data from the UDP port.
+ *
+ * Data read from the UDP port is converted to lirc mode2 format and returned
+ * one measured time interval at a time.
+ * \param timeout  Time to wait for data.
+ * \return         IR timing data in lirc mode2 format.
+ */
+lirc_t udp_readdata(lirc_t timeout)
+{
+	lirc_t data;
+
+	/* Assume buffer is empty; LIRC should select on the socket */
+	drv.fd = sockfd;
 
-	data |= tmp;
+	/* If buffer is empty, get data into it */
+	if (sample_ptr >= sample_count && udp_receive(timeout) == 0)
+		return 0;
+	data = samples[sample_ptr++];
 
 	/* If our buffer still has data, give LIRC /dev/zero to select on */
-	if ((bufptr + 2) <= buflen)
+	if (sample_ptr < sample_count)
 		drv.fd = zerofd;
 
 	return data;
 }
 
+/**
+ * Read data from the UDP port, returning the samples of all packets
+ * received at once.
+ * \param buf      Buffer for the IR timing data in lirc mode2 format.
+ * \param max      Size of buf.
+ * \param timeout  Time to wait for data.
+ * \return         Number of items stored in buf.
+ */
+int udp_readdata_batch(lirc_t* buf, size_t max, lirc_t timeout)
+{
+	size_t count;
+
+	drv.fd = sockfd;
+	if (sample_ptr >= sample_count && udp_receive(timeout) == 0)
+		return 0;
+	count = sample_count - sample_ptr;
+	if (count > max)
+		count = max;
+	memcpy(buf, samples + sample_ptr, count * sizeof(lirc_t));
+	sample_ptr += count;
+	if (sample_ptr < sample_count)
+		drv.fd = zerofd;
+	return count;
+}
+
 const struct driver hw_udp = {
 	.name		=	"udp",
 	.device		=	"8765",
-	.features	=	LIRC_CAN_REC_MODE2,
+	.features	=	LIRC_CAN_REC_MODE2
+				| LIRC_CAN_USE_READER_THREAD,
 	.send_mode	=	0,
 	.rec_mode	=	LIRC_MODE_MODE2,
 	.code_length	=	0,
@@ -359,8 +522,9 @@ const struct driver hw_udp = {
 	.decode_func	=	receive_decode,
 	.drvctl_func	=	udp_drvctl_func,
 	.readdata	=	udp_readdata,
+	.readdata_batch =	udp_readdata_batch,
 	.resolution	=	61,
-	.api_version	=	3,
+	.api_version	=	5,
 	.driver_version =	"0.9.3",
 	.info		=	"See file://" PLUGINDOCS "/udp.html",
 	.device_hint    =       "drvctl",
@@ -19,6 +19,7 @@ from .client import DrvOptionCommand
 from .client import ListKeysCommand
 from .client import ListRemotesCommand
 from .client import SendCommand
+from .client import SendSequenceCommand
 from .client import SetLogCommand
 from .client import SetTransmittersCommand
 from .client import SimulateCommand
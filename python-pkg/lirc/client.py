@@ -609,6 +609,27 @@ class SendCommand(Command):
         Command.__init__(self, cmd, connection)
 
 
+class SendSequenceCommand(Command):
+    ''' Send keys back-to-back, see SEND_SEQUENCE in lircd(8) manpage.
+
+    Arguments:
+        steps: List of (remote, key[, repeats[, delay]]) tuples. repeats
+            is as for SEND_ONCE, delay is an extra pause after the key
+            in microseconds.
+    '''
+
+    def __init__(self, connection: AbstractConnection, steps: list):
+        if not len(steps):
+            raise ValueError('No keys to send given')
+        items = []
+        for step in steps:
+            if not 2 <= len(step) <= 4:
+                raise ValueError('Bad sequence step: %s' % str(step))
+            items.append(' '.join([str(s) for s in step]))
+        cmd = 'SEND_SEQUENCE %s\n' % ', '.join(items)
+        Command.__init__(self, cmd, connection)
+
+
 class SetTransmittersCommand(Command):
     ''' Set transmitters to use, see SET_TRANSMITTERS in lircd(8) manpage.
 
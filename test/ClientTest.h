@@ -3,13 +3,16 @@
 
 #include	<stdio.h>
 #include	<signal.h>
+#include	<poll.h>
 #include 	<netinet/in.h>
 #include	<sys/socket.h>
 #include	<sys/types.h>
 #include	<sys/un.h>
 
 #include    <iostream>
+#include    <sstream>
 #include    <unordered_map>
+#include    <vector>
 #include    <cppunit/TestFixture.h>
 #include    <cppunit/TestSuite.h>
 #include    <cppunit/TestCaller.h>
@@ -48,13 +51,18 @@ class ClientTest : public CppUnit::TestFixture
             CppUnit::TestSuite* testSuite =
                  new CppUnit::TestSuite( "ClientTest" );
             ADD_TEST("testReceive", testReceive);
+            ADD_TEST("testReceiveCodes", testReceiveCodes);
             ADD_TEST("testReadConfig", testReadConfig);
             ADD_TEST("testReadConfig1", testReadConfig1);
             ADD_TEST("testReadConfig2", testReadConfig2);
             ADD_TEST("testReadConfigOnly", testReadConfigOnly);
             ADD_TEST("testReadConfigNew", testReadConfigNew);
             ADD_TEST("testCode2Char", testCode2Char);
+            ADD_TEST("testCode2CharModes", testCode2CharModes);
             ADD_TEST("testSetMode", testSetMode);
+            ADD_TEST("testAsync", testAsync);
+            ADD_TEST("testAsyncSendOnce", testAsyncSendOnce);
+            ADD_TEST("testSendSequence", testSendSequence);
             ADD_TEST("testGetMode", testSetMode);
             return testSuite;
         };
@@ -218,6 +226,22 @@ class ClientTest : public CppUnit::TestFixture
         };
 
 
+        void testReceiveCodes()
+        {
+            char* codes[4];
+            int count = 0;
+
+            sendCode(fd, 0x1bf3, "KEY_POWER", SEND_DELAY);
+
+            setenv("LIRC_SOCKET_PATH", "var/lircd.socket", 0);
+            while (count == 0)
+                count = lirc_nextcodes(codes, 4);
+            CPPUNIT_ASSERT(count > 0);
+            CPPUNIT_ASSERT(string(codes[0]).find("1bf3") != string::npos);
+            CPPUNIT_ASSERT(string(codes[0]).find('\n') == string::npos);
+        };
+
+
         void testReadConfigOnly()
         {
             struct lirc_config* config;
@@ -257,6 +281,42 @@ class ClientTest : public CppUnit::TestFixture
         }
 
 
+        /** Return all strings lirc_code2char() yields for button. */
+        string code2chars(struct lirc_config* config, const char* button)
+        {
+            char code[128];
+            char* chars;
+            string all;
+
+            snprintf(code, sizeof(code),
+                     "0000000000001bde 00 %s Acer_Aspire_6530G_MCE\n",
+                     button);
+            while (lirc_code2char(config, code, &chars) == 0
+                   && chars != NULL)
+                all += string("[") + chars + "]";
+            return all;
+        }
+
+
+        void testCode2CharModes()
+        {
+            struct lirc_config* config;
+
+            CPPUNIT_ASSERT(lirc_readconfig_only(abspath("etc/modes.lircrc"),
+                                                &config, NULL) == 0);
+            CPPUNIT_ASSERT(code2chars(config, "KEY_RIGHT") == "[Right]");
+            CPPUNIT_ASSERT(code2chars(config, "key_menu") == "[MenuAny]");
+            CPPUNIT_ASSERT(string(config->current_mode) == "menu");
+            CPPUNIT_ASSERT(code2chars(config, "KEY_RIGHT")
+                           == "[Right][MenuRight][MenuAny]");
+            CPPUNIT_ASSERT(code2chars(config, "KEY_UP") == "[MenuAny]");
+            CPPUNIT_ASSERT(code2chars(config, "KEY_BACK") == "");
+            CPPUNIT_ASSERT(config->current_mode == NULL);
+            CPPUNIT_ASSERT(code2chars(config, "KEY_UP") == "");
+            lirc_freeconfig(config);
+        }
+
+
         void testSetMode()
         {
             struct lirc_config* config;
@@ -298,6 +358,132 @@ class ClientTest : public CppUnit::TestFixture
 
 
 
+        static void onAsyncEvent(void* data, char* code)
+        {
+            ((vector<string>*) data)->push_back(string("event ") + code);
+        }
+
+
+        static void onAsyncReply(void* data,
+                                 int status,
+                                 const char* command,
+                                 const char* reply)
+        {
+            ostringstream s;
+
+            s << status << " " << reply;
+            ((vector<string>*) data)->push_back(s.str());
+        }
+
+
+        void testAsync()
+        {
+            vector<string> events;
+            vector<string> replies;
+            struct pollfd pfd;
+            lirc_async* ctx;
+            int sock;
+
+            sock = lirc_get_local_socket("var/lircd.socket", 0);
+            CPPUNIT_ASSERT(sock >= 0);
+            ctx = lirc_async_new(sock, onAsyncEvent, &events);
+            CPPUNIT_ASSERT(ctx != NULL);
+            CPPUNIT_ASSERT(lirc_async_fd(ctx) == sock);
+            lirc_async_command(ctx, onAsyncReply, &replies,
+                "LIST Acer_Aspire_6530G_MCE KEY_POWER\n");
+            lirc_async_command(ctx, onAsyncReply, &replies,
+                "BOGUS\n");
+            lirc_async_command(ctx, onAsyncReply, &replies,
+                "SIMULATE 0000000000001bf3 00 KEY_POWER"
+                " Acer_Aspire_6530G_MCE\n");
+            CPPUNIT_ASSERT(lirc_async_pending(ctx) == 3);
+            pfd.fd = sock;
+            while (lirc_async_pending(ctx) > 0) {
+                pfd.events = POLLIN;
+                if (lirc_async_want_write(ctx))
+                    pfd.events |= POLLOUT;
+                CPPUNIT_ASSERT(poll(&pfd, 1, 2000) == 1);
+                if (pfd.revents & POLLOUT)
+                    CPPUNIT_ASSERT(lirc_async_on_writable(ctx) == 0);
+                if (pfd.revents & POLLIN)
+                    CPPUNIT_ASSERT(lirc_async_on_readable(ctx) == 0);
+            }
+            CPPUNIT_ASSERT(replies.size() == 3);
+            CPPUNIT_ASSERT(replies[0] == "0 0000000000001bf3 KEY_POWER");
+            CPPUNIT_ASSERT(replies[1].find("5 unknown directive") == 0);
+            CPPUNIT_ASSERT(replies[2] == "0 ");
+            CPPUNIT_ASSERT(events.size() == 1);
+            CPPUNIT_ASSERT(events[0].find("1bf3 00 KEY_POWER") != string::npos);
+            lirc_async_free(ctx);
+            close(sock);
+        }
+
+
+        void testAsyncSendOnce()
+        // The pioneer remote has min_repeat 1, so lircd replies to the
+        // first SEND_ONCE after the repeat while the second is queued.
+        {
+            vector<string> replies;
+            struct pollfd pfd;
+            lirc_async* ctx;
+            int sock;
+
+            sock = lirc_get_local_socket("var/lircd.socket", 0);
+            CPPUNIT_ASSERT(sock >= 0);
+            ctx = lirc_async_new(sock, onAsyncEvent, &replies);
+            CPPUNIT_ASSERT(ctx != NULL);
+            lirc_async_command(ctx, onAsyncReply, &replies,
+                "SEND_ONCE pioneer KEY_POWER\n");
+            lirc_async_command(ctx, onAsyncReply, &replies,
+                "SEND_ONCE pioneer KEY_VOLUMEUP\n");
+            pfd.fd = sock;
+            while (lirc_async_pending(ctx) > 0) {
+                pfd.events = POLLIN;
+                if (lirc_async_want_write(ctx))
+                    pfd.events |= POLLOUT;
+                CPPUNIT_ASSERT(poll(&pfd, 1, 2000) == 1);
+                if (pfd.revents & POLLOUT)
+                    CPPUNIT_ASSERT(lirc_async_on_writable(ctx) == 0);
+                if (pfd.revents & POLLIN)
+                    CPPUNIT_ASSERT(lirc_async_on_readable(ctx) == 0);
+            }
+            CPPUNIT_ASSERT(replies.size() == 2);
+            CPPUNIT_ASSERT(replies[0] == "0 ");
+            CPPUNIT_ASSERT(replies[1] == "0 ");
+            lirc_async_free(ctx);
+            close(sock);
+        }
+
+
+        void testSendSequence()
+        {
+            const struct lirc_send_step steps[] = {
+                { "Acer_Aspire_6530G_MCE", "KEY_1", 0, 0 },
+                { "Acer_Aspire_6530G_MCE", "KEY_2", 1, 1000 },
+                { "Acer_Aspire_6530G_MCE", "KEY_ENTER", 0, 0 },
+            };
+            const struct lirc_send_step bad[] = {
+                { "Acer_Aspire_6530G_MCE", "KEY_1", 0, 0 },
+                { "Acer_Aspire_6530G_MCE", "KEY_NONE", 0, 0 },
+            };
+            int sock;
+            string line;
+            int pulses = 0;
+
+            sock = lirc_get_local_socket("var/lircd.socket", 0);
+            CPPUNIT_ASSERT(sock >= 0);
+            CPPUNIT_ASSERT(lirc_send_sequence(sock, bad, 2) == EIO);
+            CPPUNIT_ASSERT(lirc_send_sequence(sock, steps, 3) == 0);
+            close(sock);
+
+            ifstream out("var/file-driver.out");
+            while (getline(out, line))
+                if (line.find("pulse") == 0)
+                    pulses += 1;
+            CPPUNIT_ASSERT(pulses > 0);
+        }
+
+
         void testDefaults()
         {
         };
@@ -37,6 +37,9 @@ class DecodeTest : public CppUnit::TestFixture
             ADD_TEST("testRc5", testSpaceEnc1);
             ADD_TEST("testRc6", testSpaceEnc1);
             ADD_TEST("testRaw", testSpaceEnc1);
+            ADD_TEST("testGrundig", testGrundig);
+            ADD_TEST("testSerial", testSerial);
+            ADD_TEST("testBo", testBo);
             return testSuite;
         };
 
@@ -99,6 +102,27 @@ class DecodeTest : public CppUnit::TestFixture
             unsetenv("LIRC_LOGLEVEL");
             system("tests/raw/run-test.sh");
         }
+
+        void testGrundig()
+        {
+            unsetenv("LIRC_SOCKET_PATH");
+            unsetenv("LIRC_LOGLEVEL");
+            system("tests/grundig/run-test.sh");
+        }
+
+        void testSerial()
+        {
+            unsetenv("LIRC_SOCKET_PATH");
+            unsetenv("LIRC_LOGLEVEL");
+            system("tests/serial/run-test.sh");
+        }
+
+        void testBo()
+        {
+            unsetenv("LIRC_SOCKET_PATH");
+            unsetenv("LIRC_LOGLEVEL");
+            system("tests/bo/run-test.sh");
+        }
 };
 
 #endif
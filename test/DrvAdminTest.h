@@ -53,6 +53,7 @@ class DrvAdminTest : public CppUnit::TestFixture
             ADD_TEST("testLoad", testLoad);
             ADD_TEST("testCount", testCount);
             ADD_TEST("testListPlugins", testListPlugins);
+            ADD_TEST("testPluginIndex", testPluginIndex);
             return testSuite;
         };
 
@@ -96,6 +97,22 @@ class DrvAdminTest : public CppUnit::TestFixture
                 cout << "Plugin count: " << count << "\n";
             CPPUNIT_ASSERT(count == PLUGIN_COUNT );
         }
+
+        void testPluginIndex()
+        {
+            const char* path;
+
+            setenv("LIRC_PLUGIN_INDEX", "var/plugins.index", 1);
+            CPPUNIT_ASSERT(plugin_index_refresh(NULL, 1) == 0);
+            path = plugin_index_lookup("dvico", NULL);
+            CPPUNIT_ASSERT(path != NULL);
+            CPPUNIT_ASSERT(string(path).find("hiddev.so") != string::npos);
+            CPPUNIT_ASSERT(plugin_index_lookup("nosuchdriver", NULL) == 0);
+            CPPUNIT_ASSERT(access("var/plugins.index", R_OK) == 0);
+            CPPUNIT_ASSERT(hw_choose_driver("dvico") == 0);
+            CPPUNIT_ASSERT(string(curr_driver->name) == "dvico");
+            unsetenv("LIRC_PLUGIN_INDEX");
+        }
 };
 
 #endif
@@ -43,6 +43,10 @@ class IrRemoteTest : public CppUnit::TestFixture
             ADD_TEST("testImplicitInclude", testImplicitInclude);
             ADD_TEST("testRawSorting", testRawSorting);
             ADD_TEST("testManualSorting", testManualSorting);
+            ADD_TEST("testCodeTable", testCodeTable);
+            ADD_TEST("testRemoteIndex", testRemoteIndex);
+            ADD_TEST("testLazyCodes", testLazyCodes);
+            ADD_TEST("testBounds", testBounds);
             return testSuite;
         };
 
@@ -174,6 +178,91 @@ class IrRemoteTest : public CppUnit::TestFixture
             CPPUNIT_ASSERT(string(last) == "Melectronic_PP3600");
         }
 
+        void testCodeTable()
+        {
+            std_setup();
+            const struct ir_code_table* table =
+                ir_code_table_get(acer_config);
+            CPPUNIT_ASSERT(table != NULL);
+            CPPUNIT_ASSERT(table->size == 45);
+            CPPUNIT_ASSERT(table->seq_count == 0);
+            for (int i = 0; i < table->size; i += 1) {
+                const struct ir_ncode* c = &acer_config->codes[i];
+                CPPUNIT_ASSERT(ir_code_table_owns(acer_config, c->name));
+                CPPUNIT_ASSERT(table->keys[i] ==
+                    (gen_ir_code(acer_config, acer_config->pre_data,
+                                 c->code, acer_config->post_data)
+                     | acer_config->ignore_mask));
+            }
+            acer_config->pre_data ^= 1;
+            CPPUNIT_ASSERT(ir_code_table_get(acer_config) == NULL);
+            acer_config->pre_data ^= 1;
+        }
+
+        void testRemoteIndex()
+        {
+            std_setup();
+            CPPUNIT_ASSERT(config->index != NULL);
+            for (ir_remote* r = config; r != NULL; r = r->next) {
+                CPPUNIT_ASSERT(get_ir_remote(config, r->name) == r);
+                CPPUNIT_ASSERT(is_in_remotes(config, r) == r);
+            }
+            CPPUNIT_ASSERT(get_ir_remote(config,
+                                         "acer_aspire_6530g_mce")
+                           == acer_config);
+            CPPUNIT_ASSERT(get_ir_remote(config, "no_such_remote") == NULL);
+            CPPUNIT_ASSERT(string(get_ir_remote(config, "lirc")->name)
+                           == "lirc");
+            CPPUNIT_ASSERT(is_in_remotes(config, config->next->next)
+                           != NULL);
+            ir_remote other = *acer_config;
+            CPPUNIT_ASSERT(is_in_remotes(config, &other) == NULL);
+        }
+
+        void testLazyCodes()
+        {
+            struct ir_remote* acer;
+            struct ir_ncode* code;
+            int count = 0;
+
+            read_config_lazy(1);
+            std_setup();
+            read_config_lazy(0);
+            acer = acer_config;
+            CPPUNIT_ASSERT(acer->lazy_codes != NULL);
+            CPPUNIT_ASSERT(acer->bits == 13);
+            CPPUNIT_ASSERT(acer->codes != NULL);
+            CPPUNIT_ASSERT(acer->codes->name == NULL);
+            code = get_code_by_name(acer, "KEY_POWER");
+            CPPUNIT_ASSERT(code != NULL);
+            CPPUNIT_ASSERT(acer->lazy_codes == NULL);
+            for (code = acer->codes; code->name != NULL; code++)
+                count += 1;
+            CPPUNIT_ASSERT(count > 1);
+            CPPUNIT_ASSERT(get_ir_remote(config, acer->name) == acer);
+            free_config(config);
+        }
+
+        void testBounds()
+        {
+            const struct ir_bounds* b;
+
+            std_setup();
+            b = &acer_config->bounds[IR_B_PHEAD];
+            CPPUNIT_ASSERT(b->val == acer_config->phead);
+            for (lirc_t delta = 0; delta < 2 * b->val; delta++) {
+                CPPUNIT_ASSERT(expect_bounds(b, delta)
+                               == expect(acer_config, delta, b->val));
+                CPPUNIT_ASSERT((delta >= b->min)
+                               == expect_at_least(acer_config, delta, b->val));
+                CPPUNIT_ASSERT((delta <= b->max)
+                               == expect_at_most(acer_config, delta, b->val));
+            }
+            acer_config->phead += 100;
+            ir_remote_update_bounds(acer_config);
+            CPPUNIT_ASSERT(b->val == acer_config->phead);
+            acer_config->phead -= 100;
+        }
 
 };
 
@@ -0,0 +1,229 @@
+/****************************************************************************
+** decode-bench.c **********************************************************
+****************************************************************************
+*
+* decode-bench - measure decode_all() cost vs. number of remotes.
+*
+* Generates configs with a growing number of NEC- and Samsung-style
+* remotes which only differ in pre_data, feeds simulated signals for
+* random buttons through an in-memory driver and reports the average
+* decoding time per event. With the remotes index the time should be
+* roughly flat, without it it grows linearly. On x86 the best of a few
+* rounds is also reported as CPU cycles per event (frame).
+*
+* Usage: decode-bench [events [remotes...]]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+#include "lirc_private.h"
+
+static const int DEFAULT_SIZES[] = { 10, 100, 1000, 10000, 0 };
+
+static const int CODES_PER_REMOTE = 32;
+
+static const int ROUNDS = 5;
+
+static lirc_t* signal_data;
+static int signal_size;
+static int signal_pos;
+
+
+static lirc_t bench_readdata(lirc_t timeout)
+{
+	if (signal_pos >= signal_size)
+		return 0;
+	return signal_data[signal_pos++];
+}
+
+
+static const struct driver bench_driver = {
+	.name		= "decode-bench",
+	.device		= "/dev/null",
+	.features	= LIRC_CAN_REC_MODE2,
+	.send_mode	= 0,
+	.rec_mode	= LIRC_MODE_MODE2,
+	.code_length	= 0,
+	.decode_func	= receive_decode,
+	.readdata	= bench_readdata,
+	.api_version	= 3,
+	.driver_version = "0.10.0"
+};
+
+
+static struct ir_remote* make_remotes(int count)
+{
+	struct ir_remote* remotes;
+	char* buf = NULL;
+	size_t size = 0;
+	FILE* f;
+	int i;
+	int c;
+
+	f = open_memstream(&buf, &size);
+	for (i = 0; i < count; i++) {
+		fprintf(f, "begin remote\n");
+		fprintf(f, "  name bench_%05d\n", i);
+		fprintf(f, "  bits 16\n");
+		fprintf(f, "  flags SPACE_ENC|CONST_LENGTH\n");
+		fprintf(f, "  eps 30\n");
+		fprintf(f, "  aeps 100\n");
+		fprintf(f, "  header %s\n", i % 4 == 3 ? "4500 4500" : "9000 4500");
+		fprintf(f, "  one 560 1690\n");
+		fprintf(f, "  zero 560 560\n");
+		fprintf(f, "  ptrail 560\n");
+		fprintf(f, "  pre_data_bits 16\n");
+		fprintf(f, "  pre_data 0x%04X\n", i);
+		fprintf(f, "  gap 108000\n");
+		fprintf(f, "  begin codes\n");
+		for (c = 0; c < CODES_PER_REMOTE; c++)
+			fprintf(f, "    KEY_%02d 0x%02X%02X\n", c, c, ~c & 0xff);
+		fprintf(f, "  end codes\n");
+		fprintf(f, "end remote\n\n");
+	}
+	fclose(f);
+	f = fmemopen(buf, size, "r");
+	remotes = read_config(f, "decode-bench");
+	fclose(f);
+	free(buf);
+	if (remotes == NULL || remotes == (void*)-1) {
+		fputs("Cannot parse generated config\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+	return remotes;
+}
+
+
+/** Fill signal_data with events random buttons, return expected hits. */
+static int make_signals(struct ir_remote* remotes, int count, int events)
+{
+	struct ir_remote** all;
+	struct ir_remote* remote;
+	struct ir_ncode* code;
+	const lirc_t* data;
+	unsigned int seed = 4711;
+	int i;
+	int j;
+	int len;
+
+	all = malloc(count * sizeof(struct ir_remote*));
+	for (i = 0, remote = remotes; remote != NULL; remote = remote->next)
+		all[i++] = remote;
+	free(signal_data);
+	signal_data = malloc(events * (WBUF_SIZE + 2) * sizeof(lirc_t));
+	signal_size = 0;
+	signal_pos = 0;
+	signal_data[signal_size++] = 200000;
+	for (i = 0; i < events; i++) {
+		seed = seed * 1103515245 + 12345;
+		remote = all[(seed >> 8) % count];
+		code = &remote->codes[(seed >> 4) % CODES_PER_REMOTE];
+		if (!init_sim(remote, code, 0)) {
+			fprintf(stderr, "Cannot encode %s\n", code->name);
+			exit(EXIT_FAILURE);
+		}
+		data = send_buffer_data();
+		len = send_buffer_length();
+		for (j = 0; j < len; j++)
+			signal_data[signal_size++] =
+				j % 2 == 0 ? data[j] | PULSE_BIT : data[j];
+		signal_data[signal_size++] = remote->min_remaining_gap
+					     + 100000;
+	}
+	free(all);
+	return events;
+}
+
+
+static double elapsed_us(const struct timespec* start,
+			 const struct timespec* end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000000.0
+	       + (end->tv_nsec - start->tv_nsec) / 1000.0;
+}
+
+
+static unsigned long long cycles(void)
+{
+#ifdef HAVE_RDTSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+
+static void bench(int count, int events)
+{
+	struct ir_remote* remotes;
+	struct timespec start;
+	struct timespec end;
+	unsigned long long start_cycles;
+	unsigned long long best_cycles = 0;
+	double best_us = 0;
+	double us;
+	int decoded = 0;
+	int round;
+	char* s;
+
+	remotes = make_remotes(count);
+	make_signals(remotes, count, events);
+	for (round = 0; round < ROUNDS; round++) {
+		signal_pos = 0;
+		decoded = 0;
+		rec_buffer_init();
+		last_remote = NULL;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		start_cycles = cycles();
+		while (signal_pos < signal_size) {
+			if (!rec_buffer_clear())
+				continue;
+			s = decode_all(remotes);
+			if (s != NULL)
+				decoded += 1;
+		}
+		start_cycles = cycles() - start_cycles;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		us = elapsed_us(&start, &end);
+		if (round == 0 || us < best_us) {
+			best_us = us;
+			best_cycles = start_cycles;
+		}
+	}
+	printf("%6d remotes: %6d/%d events decoded, %8.2f us/event",
+	       count, decoded, events, best_us / events);
+#ifdef HAVE_RDTSC
+	printf(", %8llu cycles/event", best_cycles / events);
+#endif
+	printf("\n");
+	free_config(remotes);
+}
+
+
+int main(int argc, char** argv)
+{
+	int events = 2000;
+	int i;
+
+	lirc_log_open("decode-bench", 0, LIRC_ERROR);
+	memcpy((void*)curr_driver, &bench_driver, sizeof(struct driver));
+	send_buffer_init();
+	if (argc > 1)
+		events = atoi(argv[1]);
+	if (argc > 2) {
+		for (i = 2; i < argc; i++)
+			bench(atoi(argv[i]), events);
+	} else {
+		for (i = 0; DEFAULT_SIZES[i] != 0; i++)
+			bench(DEFAULT_SIZES[i], events);
+	}
+	return 0;
+}
@@ -0,0 +1,226 @@
+/****************************************************************************
+** default-receive-bench.c *************************************************
+****************************************************************************
+*
+* default-receive-bench - count the default driver's syscalls when receiving.
+*
+* Loads the default plugin with a fifo as device, like an Irman. The
+* codes of a NEC remote are encoded, written to the fifo as mode2 data
+* after a gap, and decoded using the driver's rec_func(). Each
+* decoded code must be the one sent. read(), and poll() and select() as
+* used by waitfordata(), are replaced by versions which count the calls
+* for the fifo.
+*
+* Reports reads and waits per frame, with the driver's readdata_batch()
+* and with only readdata(), as drivers before API version 5.
+*
+* Usage: default-receive-bench [rounds [default.so]]
+*/
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "lirc_driver.h"
+#include "lirc_private.h"
+
+/* Frames written to the fifo at a time, well below its capacity. */
+#define CHUNK_FRAMES    8
+
+static const char* const CONFIG =
+	"begin remote\n  name nec\n  bits 16\n"
+	"  flags SPACE_ENC|CONST_LENGTH\n  eps 30\n  aeps 100\n"
+	"  header 9000 4500\n  one 560 1690\n  zero 560 560\n"
+	"  ptrail 560\n  repeat 9000 2250\n"
+	"  pre_data_bits 16\n  pre_data 0x20DF\n  gap 108000\n"
+	"  begin codes\n"
+	"    KEY_0 0x08F7\n    KEY_1 0x8877\n    KEY_2 0x48B7\n"
+	"    KEY_3 0xC837\n    KEY_4 0x28D7\n    KEY_5 0xA857\n"
+	"    KEY_6 0x6897\n    KEY_7 0xE817\n    KEY_8 0x18E7\n"
+	"    KEY_9 0x9867\n    KEY_UP 0x02FD\n    KEY_DOWN 0x827D\n"
+	"  end codes\nend remote\n";
+
+struct counts {
+	int	reads;
+	int	waits;
+	int	frames;
+};
+
+static int device_fd = -1;
+static struct counts counts;
+
+
+ssize_t read(int fd, void* buf, size_t count)
+{
+	if (fd == device_fd)
+		counts.reads += 1;
+	return syscall(SYS_read, fd, buf, count);
+}
+
+
+int poll(struct pollfd* fds, nfds_t nfds, int timeout)
+{
+	static int (*next)(struct pollfd*, nfds_t, int) = NULL;
+
+	if (next == NULL)
+		next = dlsym(RTLD_NEXT, "poll");
+	if (nfds == 1 && fds[0].fd == device_fd)
+		counts.waits += 1;
+	return next(fds, nfds, timeout);
+}
+
+
+int select(int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds,
+	   struct timeval* timeout)
+{
+	static int (*next)(int, fd_set*, fd_set*, fd_set*,
+			   struct timeval*) = NULL;
+
+	if (next == NULL)
+		next = dlsym(RTLD_NEXT, "select");
+	if (device_fd != -1 && readfds != NULL && FD_ISSET(device_fd, readfds))
+		counts.waits += 1;
+	return next(nfds, readfds, writefds, exceptfds, timeout);
+}
+
+
+/** Write the gap and code as mode2 data, return items written. */
+static int put_frame(int fd, struct ir_remote* remote, struct ir_ncode* code)
+{
+	lirc_t data[WBUF_SIZE + 1];
+	const lirc_t* signal;
+	int length;
+	int i;
+
+	if (!send_buffer_put(remote, code))
+		return 0;
+	signal = send_buffer_data();
+	length = send_buffer_length();
+	data[0] = remote->max_gap_length;
+	for (i = 0; i < length; i++)
+		data[i + 1] = i % 2 == 0 ? signal[i] | PULSE_BIT : signal[i];
+	length += 1;
+	if (write(fd, data, length * sizeof(lirc_t))
+	    != (ssize_t)(length * sizeof(lirc_t)))
+		return 0;
+	return length;
+}
+
+
+/** Send and decode all codes, return number of errors. */
+static int receive_codes(struct ir_remote* remotes)
+{
+	struct ir_ncode* code;
+	struct ir_ncode* sent[CHUNK_FRAMES];
+	char expected[128];
+	char* message;
+	int count;
+	int errors = 0;
+	int i;
+
+	code = remotes->codes;
+	while (code->name != NULL) {
+		for (count = 0; count < CHUNK_FRAMES && code->name != NULL;
+		     code++) {
+			if (!put_frame(device_fd, remotes, code))
+				return errors + 1;
+			sent[count++] = code;
+		}
+		for (i = 0; i < count; i++) {
+			message = drv.rec_func(remotes);
+			snprintf(expected, sizeof(expected), " %s %s\n",
+				 sent[i]->name, remotes->name);
+			if (message == NULL
+			    || strstr(message, expected) == NULL) {
+				fprintf(stderr, "Expected%s", expected);
+				errors += 1;
+			}
+			counts.frames += 1;
+		}
+	}
+	return errors;
+}
+
+
+static void report(const char* label, const struct counts* c)
+{
+	printf("%-8s %6d frames: %6.2f reads, %6.2f waits per frame\n",
+	       label, c->frames, (double)c->reads / c->frames,
+	       (double)c->waits / c->frames);
+}
+
+
+int main(int argc, char** argv)
+{
+	const char* plugin = "../plugins/.libs/default.so";
+	const struct driver* const* hardwares;
+	char fifo[] = "/tmp/default-receive-bench.XXXXXX";
+	struct ir_remote* remotes;
+	struct counts batched;
+	void* handle;
+	int rounds = 20;
+	int errors = 0;
+	FILE* f;
+	int i;
+
+	if (argc > 1)
+		rounds = atoi(argv[1]);
+	if (argc > 2)
+		plugin = argv[2];
+	lirc_log_open("default-receive-bench", 0, LIRC_ERROR);
+	f = fmemopen((void*)CONFIG, strlen(CONFIG), "r");
+	remotes = read_config(f, "nec");
+	fclose(f);
+	if (remotes == NULL || remotes == (void*)-1) {
+		fputs("Cannot parse nec config\n", stderr);
+		return EXIT_FAILURE;
+	}
+	handle = dlopen(plugin, RTLD_NOW);
+	if (handle == NULL) {
+		fprintf(stderr, "%s\n", dlerror());
+		return EXIT_FAILURE;
+	}
+	hardwares = (const struct driver* const*)dlsym(handle, "hardwares");
+	if (hardwares == NULL || hardwares[0] == NULL) {
+		fprintf(stderr, "No driver in %s\n", plugin);
+		return EXIT_FAILURE;
+	}
+	/* A unique name: create a directory, replace it by the fifo. */
+	if (mkdtemp(fifo) == NULL || rmdir(fifo) != 0
+	    || mkfifo(fifo, 0600) != 0) {
+		perror(fifo);
+		return EXIT_FAILURE;
+	}
+	memcpy(&drv, hardwares[0], sizeof(struct driver));
+	drv.device = fifo;
+	drv.fd = -1;
+	if (!drv.init_func()) {
+		fputs("Cannot init default driver\n", stderr);
+		unlink(fifo);
+		return EXIT_FAILURE;
+	}
+	device_fd = drv.fd;
+
+	for (i = 0; i < rounds && errors == 0; i++)
+		errors += receive_codes(remotes);
+	batched = counts;
+	/* Like a driver without readdata_batch(). */
+	memset((void*)&drv.readdata_batch, 0, sizeof(drv.readdata_batch));
+	memset(&counts, 0, sizeof(counts));
+	for (i = 0; i < rounds && errors == 0; i++)
+		errors += receive_codes(remotes);
+	printf("%d frames decoded, %d errors\n", batched.frames + counts.frames,
+	       errors);
+	report("single:", &counts);
+	report("batched:", &batched);
+	drv.deinit_func();
+	unlink(fifo);
+	return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,386 @@
+/****************************************************************************
+** default-send-bench.c ****************************************************
+****************************************************************************
+*
+* default-send-bench - count the default driver's syscalls when sending.
+*
+* Loads the default plugin with /dev/null as device. ioctl(), write()
+* and usleep() are replaced by versions which make /dev/null look like
+* a LIRC device able to set carrier and duty cycle, and which count the
+* calls instead of sleeping. Before carrier and duty cycle were cached,
+* each frame cost two ioctls and a write.
+*
+* A sequence of codes with repeats and an extra delay, like a
+* SEND_SEQUENCE command, is sent frame by frame and then as a send
+* batch (DRVCTL_BEGIN_SEND_BATCH ... DRVCTL_END_SEND_BATCH). Reports
+* ioctls, writes and sleeps per frame for both. The batched writes must
+* contain the same frames and gaps within the kernel's write limits, and
+* the remote's next_send must be a gap after the batch was written. A
+* batch changing carrier and transmitter mask between frames must sleep
+* the gaps before the frames following the changes.
+*
+* Usage: default-send-bench [rounds [lircd.conf [default.so]]]
+*/
+
+#include <dlfcn.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#include "lirc_driver.h"
+#include "lirc_private.h"
+
+/* Kernel limits for a single write, see plugins/default.c */
+#define MAX_WRITE_ITEMS         1024
+#define MAX_WRITE_DURATION      500000
+
+#define SIGNAL_SIZE             (64 * 1024)
+
+static const int STEPS = 5;
+static const int REPS = 2;
+static const int DELAY_STEP = 2;
+static const int DELAY = 20000;
+
+struct signal {
+	lirc_t*	data;
+	int	length;
+};
+
+struct counts {
+	int	ioctls;
+	int	writes;
+	int	sleeps;
+	int	frames;
+};
+
+static int device_fd = -1;
+static struct counts counts;
+static struct signal written;
+static int* write_lengths;
+static lirc_t* write_sleeps;
+static int write_count;
+static int recording;
+static lirc_t slept;
+
+
+int ioctl(int fd, unsigned long request, ...)
+{
+	va_list ap;
+	void* arg;
+
+	va_start(ap, request);
+	arg = va_arg(ap, void*);
+	va_end(ap);
+	if (request == LIRC_GET_FEATURES) {
+		device_fd = fd;
+		*(uint32_t*)arg = LIRC_CAN_SEND_PULSE
+				  | LIRC_CAN_SET_SEND_CARRIER
+				  | LIRC_CAN_SET_SEND_DUTY_CYCLE;
+		return 0;
+	}
+	if (fd == device_fd) {
+		counts.ioctls += 1;
+		return 0;
+	}
+	return syscall(SYS_ioctl, fd, request, arg);
+}
+
+
+ssize_t write(int fd, const void* buf, size_t count)
+{
+	int n = count / sizeof(lirc_t);
+
+	if (fd != device_fd)
+		return syscall(SYS_write, fd, buf, count);
+	counts.writes += 1;
+	if (recording && written.length + n <= SIGNAL_SIZE) {
+		memcpy(written.data + written.length, buf, count);
+		written.length += n;
+		write_lengths = realloc(write_lengths,
+					(write_count + 1) * sizeof(int));
+		write_sleeps = realloc(write_sleeps,
+				       (write_count + 1) * sizeof(lirc_t));
+		write_lengths[write_count] = n;
+		write_sleeps[write_count++] = slept;
+	}
+	slept = 0;
+	return count;
+}
+
+
+int usleep(useconds_t usec)
+{
+	counts.sleeps += 1;
+	slept += usec;
+	return 0;
+}
+
+
+static void add_signal(struct signal* s, const lirc_t* data, int n)
+{
+	memcpy(s->data + s->length, data, n * sizeof(lirc_t));
+	s->length += n;
+}
+
+
+/**
+ * Send the sequence: STEPS codes, each REPS times repeated, with DELAY
+ * after step DELAY_STEP. Frame by frame, the gaps are slept like lircd
+ * does. Returns 0 on errors. If expected is not NULL, the frames and
+ * the gaps between them are added to it.
+ */
+static int send_sequence(struct ir_remote* remote, int batch,
+			 struct signal* expected)
+{
+	struct ir_ncode* code = remote->codes;
+	lirc_t gap = 0;
+	int first = 1;
+	int delay;
+	int i;
+	int r;
+
+	if (batch && drv.drvctl_func(DRVCTL_BEGIN_SEND_BATCH, NULL) != 0)
+		return 0;
+	for (i = 0; i < STEPS; i++, code++) {
+		if (code->name == NULL)
+			code = remote->codes;
+		for (r = 0; r <= REPS; r++) {
+			repeat_remote = r == 0 ? NULL : remote;
+			if (!batch && !first)
+				usleep(gap);
+			if (!drv.send_func(remote, code))
+				return 0;
+			counts.frames += 1;
+			first = 0;
+			if (expected != NULL && expected->length > 0)
+				add_signal(expected, &gap, 1);
+			if (expected != NULL)
+				add_signal(expected, send_buffer_data(),
+					   send_buffer_length());
+			gap = remote->min_remaining_gap;
+		}
+		if (i == DELAY_STEP) {
+			gap += DELAY;
+			delay = DELAY;
+			if (batch
+			    && drv.drvctl_func(DRVCTL_SEND_SPACE, &delay) != 0)
+				return 0;
+		}
+	}
+	repeat_remote = NULL;
+	return batch ? drv.drvctl_func(DRVCTL_END_SEND_BATCH, NULL) == 0 : 1;
+}
+
+
+/**
+ * Check the batched writes: expected split at gaps, each write within
+ * the kernel limits. Returns number of errors.
+ */
+static int check_writes(const struct signal* expected)
+{
+	const lirc_t* data = written.data;
+	lirc_t duration;
+	int pos = 0;
+	int i;
+	int j;
+
+	for (i = 0; i < write_count; data += write_lengths[i++]) {
+		duration = 0;
+		for (j = 0; j < write_lengths[i]; j++)
+			duration += data[j];
+		if (write_lengths[i] > MAX_WRITE_ITEMS
+		    || write_lengths[i] % 2 == 0
+		    || duration > MAX_WRITE_DURATION) {
+			fprintf(stderr, "Write %d: bad length or duration\n", i);
+			return 1;
+		}
+		if (i > 0)
+			pos += 1;       /* the gap between writes */
+		if (pos + write_lengths[i] > expected->length
+		    || memcmp(data, expected->data + pos,
+			      write_lengths[i] * sizeof(lirc_t)) != 0) {
+			fprintf(stderr, "Write %d differs from frames\n", i);
+			return 1;
+		}
+		pos += write_lengths[i];
+	}
+	if (pos != expected->length) {
+		fputs("Batched writes are incomplete\n", stderr);
+		return 1;
+	}
+	return 0;
+}
+
+
+/**
+ * Check that remote->next_send is the gap after the last batched frame
+ * counted from now, i. e., when the batch was written. Returns number
+ * of errors.
+ */
+static int check_next_send(const struct ir_remote* remote, lirc_t gap)
+{
+	struct timespec now;
+	long long diff;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	diff = (remote->next_send.tv_sec - now.tv_sec) * 1000000LL
+	       + (remote->next_send.tv_nsec - now.tv_nsec) / 1000;
+	if (diff > gap || diff < gap - 10000) {
+		fprintf(stderr, "next_send in %lld us, expected %u\n",
+			diff, (unsigned int)gap);
+		return 1;
+	}
+	return 0;
+}
+
+
+/**
+ * Send a batch of three frames, changing the carrier before the second
+ * and the transmitter mask before the third, with DELAY after the
+ * first. Each change writes the batch, the gap must be slept before the
+ * next write. Returns number of errors.
+ */
+static int check_param_changes(struct ir_remote* remote)
+{
+	struct ir_remote other = *remote;
+	unsigned int mask = 2;
+	int delay = DELAY;
+	lirc_t gaps[3];
+	int i;
+
+	other.freq = remote->freq + 2000;
+	repeat_remote = NULL;
+	recording = 1;
+	written.length = 0;
+	write_count = 0;
+	if (drv.drvctl_func(DRVCTL_BEGIN_SEND_BATCH, NULL) != 0
+	    || !drv.send_func(remote, remote->codes)
+	    || drv.drvctl_func(DRVCTL_SEND_SPACE, &delay) != 0
+	    || !drv.send_func(&other, remote->codes)
+	    || drv.drvctl_func(LIRC_SET_TRANSMITTER_MASK, &mask) != 0
+	    || !drv.send_func(&other, remote->codes)
+	    || drv.drvctl_func(DRVCTL_END_SEND_BATCH, NULL) != 0) {
+		recording = 0;
+		fputs("Cannot send carrier and mask changes\n", stderr);
+		return 1;
+	}
+	recording = 0;
+	gaps[0] = 0;
+	gaps[1] = remote->min_remaining_gap + DELAY;
+	gaps[2] = other.min_remaining_gap;
+	if (write_count != 3) {
+		fprintf(stderr, "Carrier and mask changes: %d writes\n",
+			write_count);
+		return 1;
+	}
+	for (i = 0; i < write_count; i++) {
+		if (write_sleeps[i] != gaps[i]) {
+			fprintf(stderr, "Write %d after %u us, expected %u\n",
+				i, (unsigned int)write_sleeps[i],
+				(unsigned int)gaps[i]);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+static void report(const char* label, const struct counts* c)
+{
+	printf("%-8s %6d frames: %5.2f ioctls, %5.2f writes, %5.2f sleeps"
+	       " per frame\n", label, c->frames,
+	       (double)c->ioctls / c->frames, (double)c->writes / c->frames,
+	       (double)c->sleeps / c->frames);
+}
+
+
+int main(int argc, char** argv)
+{
+	const char* file = "etc/lircd.conf.Aspire_6530G";
+	const char* plugin = "../plugins/.libs/default.so";
+	const struct driver* const* hardwares;
+	struct ir_remote* remote;
+	struct ir_remote saved;
+	struct signal expected;
+	struct counts single;
+	void* handle;
+	int rounds = 100;
+	int errors = 0;
+	FILE* f;
+	int i;
+
+	if (argc > 1)
+		rounds = atoi(argv[1]);
+	if (argc > 2)
+		file = argv[2];
+	if (argc > 3)
+		plugin = argv[3];
+	lirc_log_open("default-send-bench", 0, LIRC_ERROR);
+	f = fopen(file, "r");
+	if (f == NULL) {
+		perror(file);
+		return EXIT_FAILURE;
+	}
+	remote = read_config(f, file);
+	fclose(f);
+	if (remote == NULL || remote == (void*)-1) {
+		fprintf(stderr, "Cannot parse %s\n", file);
+		return EXIT_FAILURE;
+	}
+	handle = dlopen(plugin, RTLD_NOW);
+	if (handle == NULL) {
+		fprintf(stderr, "%s\n", dlerror());
+		return EXIT_FAILURE;
+	}
+	hardwares = (const struct driver* const*)dlsym(handle, "hardwares");
+	if (hardwares == NULL || hardwares[0] == NULL) {
+		fprintf(stderr, "No driver in %s\n", plugin);
+		return EXIT_FAILURE;
+	}
+	memcpy(&drv, hardwares[0], sizeof(struct driver));
+	drv.device = "/dev/null";
+	drv.fd = -1;
+	if (!drv.init_func()) {
+		fputs("Cannot init default driver\n", stderr);
+		return EXIT_FAILURE;
+	}
+	written.data = malloc(SIGNAL_SIZE * sizeof(lirc_t));
+	expected.data = malloc(SIGNAL_SIZE * sizeof(lirc_t));
+	expected.length = 0;
+	saved = *remote;
+
+	recording = 1;
+	if (!send_sequence(remote, 0, &expected))
+		errors += 1;
+	*remote = saved;
+	written.length = 0;
+	write_count = 0;
+	remote->next_send.tv_sec = 0;
+	remote->next_send.tv_nsec = 0;
+	if (!send_sequence(remote, 1, NULL))
+		errors += 1;
+	recording = 0;
+	errors += check_writes(&expected);
+	errors += check_next_send(remote, remote->min_remaining_gap);
+	printf("%d items in %d batched writes checked, %d errors\n",
+	       expected.length, write_count, errors);
+	*remote = saved;
+	errors += check_param_changes(remote);
+
+	memset(&counts, 0, sizeof(counts));
+	for (i = 0; i < rounds && errors == 0; i++)
+		errors += !send_sequence(remote, 0, NULL);
+	single = counts;
+	memset(&counts, 0, sizeof(counts));
+	for (i = 0; i < rounds && errors == 0; i++)
+		errors += !send_sequence(remote, 1, NULL);
+	report("single:", &single);
+	report("batched:", &counts);
+	drv.deinit_func();
+	return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+/****************************************************************************
+** input-map-bench.c *******************************************************
+****************************************************************************
+*
+* input-map-bench - check and time get_input_code().
+*
+* Looks up all names in input_map.inc, in upper and lower case, and
+* some names which are not there. Each result is checked against a
+* linear strcasecmp() scan like the one get_input_code() used before
+* the perfect hash. Reports the average lookup time for both.
+*
+* Usage: input-map-bench [rounds]
+*/
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "lirc/input_map.h"
+
+static const struct {
+	const char*		name;
+	linux_input_code	code;
+} reference[] = {
+#include "lirc/input_map.inc"
+	{ NULL, 0 }
+};
+
+static const char* const MISSES[] = {
+	"KEY_", "KEY_NONEXISTENT", "BTN_LEFTX", "key_0_", "", "EV_KEY",
+	"KEY_VOLUMEUP_EVUP", NULL
+};
+
+
+static int linear_lookup(const char* name, linux_input_code* code)
+{
+	int i;
+
+	for (i = 0; reference[i].name != NULL; i++) {
+		if (strcasecmp(name, reference[i].name) == 0) {
+			*code = reference[i].code;
+			return i;
+		}
+	}
+	return -1;
+}
+
+
+static double elapsed_ns(const struct timespec* start,
+			 const struct timespec* end)
+{
+	return (end->tv_sec - start->tv_sec) * 1e9
+	       + (end->tv_nsec - start->tv_nsec);
+}
+
+
+static double bench(int (*lookup)(const char*, linux_input_code*),
+		    char** names, int count, int rounds)
+{
+	struct timespec start;
+	struct timespec end;
+	linux_input_code code;
+	volatile int found = 0;
+	int r;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < count; i++)
+			found += lookup(names[i], &code) != -1;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return elapsed_ns(&start, &end) / ((double)rounds * count);
+}
+
+
+int main(int argc, char** argv)
+{
+	int rounds = argc > 1 ? atoi(argv[1]) : 200;
+	char** names;
+	linux_input_code code1;
+	linux_input_code code2;
+	int count = 0;
+	int errors = 0;
+	int r1;
+	int r2;
+	int i;
+	char* s;
+
+	for (i = 0; reference[i].name != NULL; i++)
+		;
+	names = malloc((2 * i + 8) * sizeof(char*));
+	for (i = 0; reference[i].name != NULL; i++) {
+		names[count++] = strdup(reference[i].name);
+		s = strdup(reference[i].name);
+		for (r1 = 0; s[r1] != '\0'; r1++)
+			s[r1] = tolower(s[r1]);
+		names[count++] = s;
+	}
+	for (i = 0; MISSES[i] != NULL; i++)
+		names[count++] = strdup(MISSES[i]);
+
+	for (i = 0; i < count; i++) {
+		r1 = get_input_code(names[i], &code1);
+		r2 = linear_lookup(names[i], &code2);
+		if (r1 != r2 || (r1 != -1 && code1 != code2)) {
+			fprintf(stderr, "Mismatch for \"%s\"\n", names[i]);
+			errors += 1;
+		}
+	}
+	printf("%d names checked, %d errors\n", count, errors);
+	printf("linear scan:  %8.1f ns/lookup\n",
+	       bench(linear_lookup, names, count, rounds / 10 + 1));
+	printf("perfect hash: %8.1f ns/lookup\n",
+	       bench(get_input_code, names, count, rounds));
+	for (i = 0; i < count; i++)
+		free(names[i]);
+	free(names);
+	return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,238 @@
+/****************************************************************************
+** lircrcd-bench.c *********************************************************
+****************************************************************************
+*
+* lircrcd-bench - measure lircrcd CODE throughput with many clients.
+*
+* Connects a number of clients to a running lircrcd, each of them sending
+* CODE requests for random buttons as fast as replies arrive. Like
+* lirc_code2char() a client repeats a request until there are no more
+* strings for the code. Reports requests per second and the average and
+* worst latency of a request.
+*
+* Usage: lircrcd-bench socket [clients [requests [remote button...]]]
+*
+* E. g., using the mythtv lircrc in this directory:
+*
+*     lircrcd -o /tmp/bench.socket etc/mythtv.lircrc
+*     lircrcd-bench /tmp/bench.socket 50 20000 mceusb KEY_UP KEY_1 KEY_OK
+*/
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define MAX_CLIENTS 100
+#define BUF_SIZE 4096
+
+static const char* const DEFAULT_BUTTONS[] = {
+	"KEY_UP", "KEY_DOWN", "KEY_LEFT", "KEY_RIGHT", "KEY_OK", "KEY_1",
+	"KEY_2", "KEY_MENU", "KEY_BACK", "KEY_NOT_CONFIGURED", NULL
+};
+
+struct client {
+	int		fd;
+	char		code[256];
+	char		buf[BUF_SIZE];
+	int		len;
+	struct timespec	sent;
+};
+
+static const char* remote = "mceusb";
+static const char* const* buttons = DEFAULT_BUTTONS;
+static int button_count;
+static unsigned int seed = 4711;
+static long requests;
+static long sent;
+static long completed;
+static double total_us;
+static double max_us;
+
+
+static double elapsed_us(const struct timespec* start,
+			 const struct timespec* end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000000.0
+	       + (end->tv_nsec - start->tv_nsec) / 1000.0;
+}
+
+
+static void do_write(struct client* cli, const char* buf)
+{
+	int len = strlen(buf);
+
+	if (write(cli->fd, buf, len) != len) {
+		perror("write");
+		exit(EXIT_FAILURE);
+	}
+}
+
+
+static void send_code(struct client* cli, int again)
+{
+	char buf[300];
+
+	if (!again) {
+		seed = seed * 1103515245 + 12345;
+		snprintf(cli->code, sizeof(cli->code),
+			 "%016x %02x %s %s", seed >> 16, (seed >> 8) & 3,
+			 buttons[(seed >> 4) % button_count], remote);
+		sent += 1;
+	}
+	snprintf(buf, sizeof(buf), "CODE %s\n", cli->code);
+	clock_gettime(CLOCK_MONOTONIC, &cli->sent);
+	do_write(cli, buf);
+}
+
+
+static int connect_client(const char* path, struct client* cli)
+{
+	struct sockaddr_un addr;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	cli->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (cli->fd == -1
+	    || connect(cli->fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+		perror(path);
+		return 0;
+	}
+	cli->len = 0;
+	do_write(cli, "IDENT mythtv\n");
+	return 1;
+}
+
+
+/**
+ * Handle a complete reply in cli->buf ending at end. Return 1 if the
+ * client should continue, 0 when all requests are sent.
+ */
+static int handle_reply(struct client* cli, char* end)
+{
+	struct timespec now;
+	double us;
+	int has_data;
+	int is_code;
+
+	*end = '\0';
+	if (strstr(cli->buf, "\nERROR\n") != NULL) {
+		fprintf(stderr, "lircrcd error: %s\n", cli->buf);
+		exit(EXIT_FAILURE);
+	}
+	is_code = strncmp(cli->buf, "BEGIN\nCODE ", 11) == 0;
+	has_data = strstr(cli->buf, "\nDATA\n") != NULL;
+	if (is_code) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		us = elapsed_us(&cli->sent, &now);
+		total_us += us;
+		if (us > max_us)
+			max_us = us;
+		completed += 1;
+	}
+	if (is_code && has_data) {
+		send_code(cli, 1);
+		return 1;
+	}
+	if (sent >= requests)
+		return 0;
+	send_code(cli, 0);
+	return 1;
+}
+
+
+/** Read from client, handle replies. Return 0 when client is done. */
+static int handle_input(struct client* cli)
+{
+	char* end;
+	int n;
+	int r = 1;
+
+	n = read(cli->fd, cli->buf + cli->len, BUF_SIZE - 1 - cli->len);
+	if (n <= 0) {
+		fputs("lircrcd closed connection\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+	cli->len += n;
+	cli->buf[cli->len] = '\0';
+	while (r && (end = strstr(cli->buf, "\nEND\n")) != NULL) {
+		end += 5;
+		n = end - cli->buf;
+		r = handle_reply(cli, end - 1);
+		memmove(cli->buf, end, cli->len - n + 1);
+		cli->len -= n;
+	}
+	return r;
+}
+
+
+int main(int argc, char** argv)
+{
+	static struct client clients[MAX_CLIENTS];
+	struct pollfd pfds[MAX_CLIENTS];
+	struct timespec start;
+	struct timespec end;
+	int count = 10;
+	int active;
+	double us;
+	int i;
+
+	if (argc < 2) {
+		fputs("Usage: lircrcd-bench socket"
+		      " [clients [requests [remote button...]]]\n", stderr);
+		return EXIT_FAILURE;
+	}
+	if (argc > 2)
+		count = atoi(argv[2]);
+	if (count < 1 || count > MAX_CLIENTS) {
+		fprintf(stderr, "clients must be 1..%d\n", MAX_CLIENTS);
+		return EXIT_FAILURE;
+	}
+	requests = argc > 3 ? atol(argv[3]) : 10000;
+	if (argc > 5) {
+		remote = argv[4];
+		buttons = (const char* const*)argv + 5;
+	}
+	for (button_count = 0; buttons[button_count] != NULL; button_count++)
+		;
+
+	for (i = 0; i < count; i++) {
+		if (!connect_client(argv[1], &clients[i]))
+			return EXIT_FAILURE;
+		pfds[i].fd = clients[i].fd;
+		pfds[i].events = POLLIN;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	active = count;
+	while (active > 0) {
+		if (poll(pfds, count, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			return EXIT_FAILURE;
+		}
+		for (i = 0; i < count; i++) {
+			if (pfds[i].fd == -1 || !(pfds[i].revents & POLLIN))
+				continue;
+			if (!handle_input(&clients[i])) {
+				pfds[i].fd = -1;
+				active -= 1;
+			}
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	us = elapsed_us(&start, &end);
+	printf("%3d clients: %ld codes, %ld requests in %.3f s, %.0f requests/s,"
+	       " latency avg %.1f us, max %.1f us\n",
+	       count, sent, completed, us / 1000000, completed / us * 1000000,
+	       total_us / completed, max_us);
+	for (i = 0; i < count; i++)
+		close(clients[i].fd);
+	return 0;
+}
@@ -0,0 +1,118 @@
+/****************************************************************************
+** pacing-bench.c **********************************************************
+****************************************************************************
+*
+* pacing-bench - measure the gap errors of send_ir_ncode().
+*
+* Sends a short raw frame repeatedly through a driver which just checks
+* when send_func() is called. Each frame must start after the previous
+* frame's signal and the remote's gap, send_ir_ncode() waits for this
+* deadline on CLOCK_MONOTONIC. Reports how late the frames start: when
+* sleeping only, and when spinning the last microseconds with and without
+* SCHED_FIFO (see send_pacing_set()).
+*
+* Usage: pacing-bench [frames]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lirc_private.h"
+
+static const char* const CONFIG =
+	"begin remote\n  name pacing\n  flags RAW_CODES\n"
+	"  eps 30\n  aeps 100\n  gap 2000\n"
+	"  begin raw_codes\n    name FRAME\n"
+	"      500 500 500 1000 500\n"
+	"  end raw_codes\nend remote\n";
+
+static int early_count;
+
+
+static int bench_send(struct ir_remote* remote, struct ir_ncode* code)
+{
+	struct timespec now;
+
+	/* remote->next_send is still the deadline for this frame. */
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (remote->last_code != NULL
+	    && (now.tv_sec < remote->next_send.tv_sec
+		|| (now.tv_sec == remote->next_send.tv_sec
+		    && now.tv_nsec < remote->next_send.tv_nsec)))
+		early_count += 1;
+	return send_buffer_put(remote, code);
+}
+
+
+static const struct driver bench_driver = {
+	.name		= "pacing-bench",
+	.device		= "/dev/null",
+	.features	= LIRC_CAN_SEND_PULSE,
+	.send_mode	= LIRC_MODE_PULSE,
+	.rec_mode	= 0,
+	.code_length	= 0,
+	.send_func	= bench_send,
+	.api_version	= 3,
+	.driver_version = "0.10.0"
+};
+
+
+/** Send frames, check the gaps, report errors. Returns 0 if OK. */
+static int bench(struct ir_remote* remote, int frames,
+		 unsigned int busy_wait, int realtime)
+{
+	struct send_pacing_stats stats;
+	int i;
+
+	send_pacing_set(busy_wait, realtime);
+	send_pacing_clear_stats();
+	remote->last_code = NULL;
+	early_count = 0;
+	for (i = 0; i < frames; i++) {
+		if (!send_ir_ncode(remote, remote->codes, 1)) {
+			fputs("Cannot send\n", stderr);
+			return 1;
+		}
+	}
+	if (early_count > 0) {
+		fprintf(stderr, "%d frames sent too early\n", early_count);
+		return 1;
+	}
+	send_pacing_get_stats(&stats);
+	printf("busy wait %4u us %-10s %6lu waits, %7.1f us mean error,"
+	       " %7.1f us max\n", busy_wait, realtime ? "SCHED_FIFO" : "",
+	       stats.waits,
+	       stats.waits > 0 ? stats.error_sum / 1e3 / stats.waits : 0.0,
+	       stats.error_max / 1e3);
+	return 0;
+}
+
+
+int main(int argc, char** argv)
+{
+	struct ir_remote* remote;
+	int frames = 200;
+	int errors = 0;
+	FILE* f;
+
+	lirc_log_open("pacing-bench", 0, LIRC_ERROR);
+	memcpy((void*)curr_driver, &bench_driver, sizeof(struct driver));
+	send_buffer_init();
+	if (argc > 1)
+		frames = atoi(argv[1]);
+	f = fmemopen((void*)CONFIG, strlen(CONFIG), "r");
+	remote = read_config(f, "pacing");
+	fclose(f);
+	if (remote == NULL || remote == (void*)-1) {
+		fputs("Cannot parse pacing config\n", stderr);
+		return EXIT_FAILURE;
+	}
+	errors += bench(remote, frames, 0, 0);
+	errors += bench(remote, frames, 50, 0);
+	errors += bench(remote, frames, 200, 0);
+	errors += bench(remote, frames, 200, 1);
+	free_config(remote);
+	return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,207 @@
+/****************************************************************************
+** reader-thread-bench.c ***************************************************
+****************************************************************************
+*
+* reader-thread-bench - stress the reader thread using the file driver.
+*
+* The codes of a NEC remote are written as mode2 data to a file which is
+* read by the file plugin through the reader thread, see
+* rec_reader_start(). The decoder stalls now and then, like lircd
+* serving a slow client, while the reader thread reads the whole file
+* as fast as it can.
+*
+* With a queue holding the complete file, each decoded code must be the
+* one sent and nothing may be dropped. With a small queue, items must
+* be dropped, and the queued and dropped items must add up to the items
+* in the file. Reports the queue statistics for both.
+*
+* Usage: reader-thread-bench [frames [file.so]]
+*/
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lirc_driver.h"
+#include "lirc_private.h"
+
+/* Decoded frames between stalls, and the stall (us). */
+#define STALL_FRAMES    16
+#define STALL           20000
+
+#define SMALL_QUEUE     256
+
+static const char* const CONFIG =
+	"begin remote\n  name nec\n  bits 16\n"
+	"  flags SPACE_ENC|CONST_LENGTH\n  eps 30\n  aeps 100\n"
+	"  header 9000 4500\n  one 560 1690\n  zero 560 560\n"
+	"  ptrail 560\n  repeat 9000 2250\n"
+	"  pre_data_bits 16\n  pre_data 0x20DF\n  gap 108000\n"
+	"  begin codes\n"
+	"    KEY_0 0x08F7\n    KEY_1 0x8877\n    KEY_2 0x48B7\n"
+	"    KEY_3 0xC837\n    KEY_4 0x28D7\n    KEY_5 0xA857\n"
+	"    KEY_6 0x6897\n    KEY_7 0xE817\n    KEY_8 0x18E7\n"
+	"    KEY_9 0x9867\n    KEY_UP 0x02FD\n    KEY_DOWN 0x827D\n"
+	"  end codes\nend remote\n";
+
+
+/** Write the codes as mode2 lines, a gap before each. Returns items. */
+static int write_input(FILE* f, struct ir_remote* remote, int frames)
+{
+	struct ir_ncode* code = remote->codes;
+	const lirc_t* signal;
+	int items = 0;
+	int length;
+	int i;
+	int j;
+
+	for (i = 0; i < frames; i++, code++) {
+		if (code->name == NULL)
+			code = remote->codes;
+		if (!send_buffer_put(remote, code))
+			return 0;
+		signal = send_buffer_data();
+		length = send_buffer_length();
+		fprintf(f, "space %u\n", remote->max_gap_length);
+		for (j = 0; j < length; j++)
+			fprintf(f, "%s %u\n", j % 2 == 0 ? "pulse" : "space",
+				signal[j]);
+		items += length + 1;
+	}
+	fprintf(f, "space %u\n", remote->max_gap_length);
+	return items + 1;
+}
+
+
+/**
+ * Decode until EOF, stalling each STALL_FRAMES frames. Returns number
+ * of codes decoded, of those the number not as sent in *errors.
+ */
+static int receive_codes(struct ir_remote* remote, int* errors)
+{
+	struct ir_ncode* code = remote->codes;
+	char expected[128];
+	char* message;
+	int decoded = 0;
+
+	*errors = 0;
+	while (1) {
+		message = drv.rec_func(remote);
+		if (message == NULL)
+			continue;
+		if (strstr(message, " __EOF ") != NULL)
+			break;
+		snprintf(expected, sizeof(expected), " %s %s\n",
+			 code->name, remote->name);
+		if (strstr(message, expected) == NULL)
+			*errors += 1;
+		decoded += 1;
+		code++;
+		if (code->name == NULL)
+			code = remote->codes;
+		if (decoded % STALL_FRAMES == 0)
+			usleep(STALL);
+	}
+	return decoded;
+}
+
+
+/** Run frames through a queue of size items, return number of errors. */
+static int bench(struct ir_remote* remote, const char* path, int frames,
+		 int items, unsigned int size)
+{
+	struct option_t option;
+	struct rec_reader_stats stats;
+	int decoded;
+	int errors;
+
+	strncpy(option.key, "set-infile", sizeof(option.key));
+	strncpy(option.value, path, sizeof(option.value) - 1);
+	option.value[sizeof(option.value) - 1] = '\0';
+	if (drv.drvctl_func(DRVCTL_SET_OPTION, &option) != 0) {
+		fprintf(stderr, "Cannot read %s\n", path);
+		return 1;
+	}
+	rec_buffer_init();
+	if (!rec_reader_start(size)) {
+		fputs("Cannot start reader thread\n", stderr);
+		return 1;
+	}
+	decoded = receive_codes(remote, &errors);
+	rec_reader_get_stats(&stats);
+	rec_reader_stop();
+	printf("queue %6u: %6lu items, %5lu overflows, %6lu max queued,"
+	       " %4.1f ms max delay, %d/%d frames decoded\n",
+	       size, stats.items, stats.overflows, stats.max_fill,
+	       stats.max_delay / 1e3, decoded, frames);
+	/* The driver returns EOF after the items in the file. */
+	if (stats.items + stats.overflows != (unsigned long)items + 1) {
+		fprintf(stderr, "%d items in file, queued and dropped differ\n",
+			items);
+		return 1;
+	}
+	if (size > (unsigned int)items)
+		return stats.overflows + errors + (decoded != frames);
+	return stats.overflows == 0;
+}
+
+
+int main(int argc, char** argv)
+{
+	const char* plugin = "../plugins/.libs/file.so";
+	const struct driver* const* hardwares;
+	char path[] = "/tmp/reader-thread-bench.XXXXXX";
+	struct ir_remote* remote;
+	void* handle;
+	int frames = 200;
+	int errors = 0;
+	int items;
+	int fd;
+	FILE* f;
+
+	if (argc > 1)
+		frames = atoi(argv[1]);
+	if (argc > 2)
+		plugin = argv[2];
+	lirc_log_open("reader-thread-bench", 0, LIRC_ERROR);
+	f = fmemopen((void*)CONFIG, strlen(CONFIG), "r");
+	remote = read_config(f, "nec");
+	fclose(f);
+	if (remote == NULL || remote == (void*)-1) {
+		fputs("Cannot parse nec config\n", stderr);
+		return EXIT_FAILURE;
+	}
+	handle = dlopen(plugin, RTLD_NOW);
+	if (handle == NULL) {
+		fprintf(stderr, "%s\n", dlerror());
+		return EXIT_FAILURE;
+	}
+	hardwares = (const struct driver* const*)dlsym(handle, "hardwares");
+	if (hardwares == NULL || hardwares[0] == NULL) {
+		fprintf(stderr, "No driver in %s\n", plugin);
+		return EXIT_FAILURE;
+	}
+	memcpy(&drv, hardwares[0], sizeof(struct driver));
+	drv.fd = -1;
+	if (!drv.open_func("/dev/null") || !drv.init_func()) {
+		fputs("Cannot init file driver\n", stderr);
+		return EXIT_FAILURE;
+	}
+	fd = mkstemp(path);
+	f = fd == -1 ? NULL : fdopen(fd, "w");
+	if (f == NULL) {
+		perror(path);
+		return EXIT_FAILURE;
+	}
+	items = write_input(f, remote, frames);
+	fclose(f);
+
+	errors += bench(remote, path, frames, items, items + 1);
+	errors += bench(remote, path, frames, items, SMALL_QUEUE);
+	drv.deinit_func();
+	unlink(path);
+	free_config(remote);
+	return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,551 @@
+/****************************************************************************
+** roundtrip-bench.c *******************************************************
+****************************************************************************
+*
+* roundtrip-bench - time transmit encoding and check that it decodes back.
+*
+* Reads all lircd.conf files given, or found in the given directories.
+* All buttons of all remotes are encoded using init_sim(), as a first
+* frame and as a repeat, for both toggle states of remotes using a
+* toggle bit or toggle mask. Reports the average time per encoding.
+*
+* Then each button is decoded in-process by decode_all() using an
+* in-memory driver: a first frame after a long space, followed by the
+* remote's min_repeat repeats like SEND_ONCE sends, at least one, each
+* after the remote's gap. The frames should decode as the button with
+* repeat counts 0, 1, ... Buttons decoded as a button with the same
+* name and code of an earlier remote in the same file are duplicates,
+* other mismatches are listed, as are buttons which cannot be encoded.
+* The average decoding time per frame is reported as well.
+*
+* Exits with failure status if there are mismatches.
+*
+* Usage: roundtrip-bench [rounds [lircd.conf or dir...]]
+*/
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "lirc_private.h"
+
+static const char* const DEFAULT_PATHS[] = {
+	"etc/lircd.conf.Aspire_6530G", "etc/lircd.conf.d", "tests", NULL
+};
+
+/** Space before a first frame, longer than any gap. */
+static const lirc_t LONG_SPACE = 1000000;
+
+/** Max number of decoded strings for a button. */
+#define MAX_DECODED 8
+
+/** Size of a decoded string buffer. */
+#define DECODED_SIZE 256
+
+static lirc_t bench_readdata(lirc_t timeout);
+
+static const struct driver bench_driver = {
+	.name		= "roundtrip-bench",
+	.device		= "/dev/null",
+	.features	= LIRC_CAN_SEND_PULSE | LIRC_CAN_REC_MODE2,
+	.send_mode	= LIRC_MODE_PULSE,
+	.rec_mode	= LIRC_MODE_MODE2,
+	.code_length	= 0,
+	.decode_func	= receive_decode,
+	.readdata	= bench_readdata,
+	.api_version	= 3,
+	.driver_version = "0.10.0"
+};
+
+/** A parsed config file. */
+struct config {
+	const char*		path;
+	struct ir_remote*	remotes;
+	int			first;  /**< First of its buttons. */
+	int			end;    /**< Index after its last button. */
+};
+
+/** A button in a toggle state. */
+struct button {
+	struct ir_remote*	remote;
+	struct ir_ncode*	code;
+	int			toggle;
+};
+
+static struct config* configs;
+static int config_count;
+static int skipped;
+
+static struct button* buttons;
+static int button_count;
+
+static lirc_t* signal_data;
+static int signal_size;
+static int signal_pos;
+static int signal_alloc;
+
+
+static lirc_t bench_readdata(lirc_t timeout)
+{
+	if (signal_pos >= signal_size)
+		return 0;
+	return signal_data[signal_pos++];
+}
+
+
+static double elapsed_ns(const struct timespec* start,
+			 const struct timespec* end)
+{
+	return (end->tv_sec - start->tv_sec) * 1e9
+	       + (end->tv_nsec - start->tv_nsec);
+}
+
+
+static int is_config_name(const char* name)
+{
+	size_t len = strlen(name);
+
+	if (strcmp(name, "lirc_options.conf") == 0)
+		return 0;
+	return strstr(name, "lircd.conf") != NULL
+	       || (len > 5 && strcmp(name + len - 5, ".conf") == 0);
+}
+
+
+static void add_config(const char* path)
+{
+	struct ir_remote* remotes;
+	FILE* f;
+
+	f = fopen(path, "r");
+	if (f == NULL) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	remotes = read_config(f, path);
+	fclose(f);
+	if (remotes == NULL || remotes == (void*)-1) {
+		fprintf(stderr, "Skipping %s: no remotes\n", path);
+		skipped += 1;
+		return;
+	}
+	configs = realloc(configs, (config_count + 1) * sizeof(*configs));
+	configs[config_count].path = strdup(path);
+	configs[config_count].remotes = remotes;
+	config_count += 1;
+}
+
+
+/** Add config file path, or all config files below directory path. */
+static void add_path(const char* path)
+{
+	struct dirent** entries;
+	struct stat st;
+	const char* name;
+	char* child;
+	int n;
+	int i;
+
+	if (stat(path, &st) != 0) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	if (!S_ISDIR(st.st_mode)) {
+		add_config(path);
+		return;
+	}
+	n = scandir(path, &entries, NULL, alphasort);
+	for (i = 0; i < n; i++) {
+		name = entries[i]->d_name;
+		if (name[0] != '.') {
+			child = malloc(strlen(path) + strlen(name) + 2);
+			sprintf(child, "%s/%s", path, name);
+			if (stat(child, &st) == 0
+			    && (S_ISDIR(st.st_mode) || is_config_name(name)))
+				add_path(child);
+			free(child);
+		}
+		free(entries[i]);
+	}
+	free(entries);
+}
+
+
+static int toggle_count(const struct ir_remote* remote)
+{
+	return has_toggle_bit_mask(remote) || has_toggle_mask(remote) ? 2 : 1;
+}
+
+
+static void set_toggle(struct ir_remote* remote, int toggle)
+{
+	if (has_toggle_bit_mask(remote))
+		remote->toggle_bit_mask_state =
+			toggle ? remote->toggle_bit_mask : 0;
+	if (has_toggle_mask(remote))
+		remote->toggle_mask_state = toggle;
+}
+
+
+static void add_buttons(struct config* config)
+{
+	struct ir_remote* remote;
+	struct ir_ncode* code;
+	int t;
+
+	config->first = button_count;
+	for (remote = config->remotes;
+	     remote != NULL;
+	     remote = remote->next) {
+		for (code = remote->codes; code->name != NULL; code++) {
+			for (t = 0; t < toggle_count(remote); t++) {
+				buttons = realloc(buttons, (button_count + 1)
+						  * sizeof(*buttons));
+				buttons[button_count].remote = remote;
+				buttons[button_count].code = code;
+				buttons[button_count].toggle = t;
+				button_count += 1;
+			}
+		}
+	}
+	config->end = button_count;
+}
+
+
+/** Gap after a frame, as computed by init_send() for a real send. */
+static lirc_t frame_gap(const struct ir_remote* remote, lirc_t sum, int repeat)
+{
+	if (has_repeat_gap(remote) && repeat && has_repeat(remote))
+		return remote->repeat_gap;
+	if (is_const(remote) && min_gap(remote) > sum)
+		return min_gap(remote) - sum;
+	return min_gap(remote);
+}
+
+
+static void add_signal(lirc_t data)
+{
+	if (signal_size == signal_alloc) {
+		signal_alloc = signal_alloc > 0 ? 2 * signal_alloc : 1024;
+		signal_data = realloc(signal_data,
+				      signal_alloc * sizeof(lirc_t));
+	}
+	signal_data[signal_size++] = data;
+}
+
+
+/** Append the encoded frame to signal_data, return its gap or 0. */
+static lirc_t add_frame(struct button* b, int repeat)
+{
+	const lirc_t* data;
+	int len;
+	int i;
+
+	set_toggle(b->remote, b->toggle);
+	if (!init_sim(b->remote, b->code, repeat))
+		return 0;
+	data = send_buffer_data();
+	len = send_buffer_length();
+	for (i = 0; i < len; i++)
+		add_signal(i % 2 == 0 ? data[i] | PULSE_BIT : data[i]);
+	return frame_gap(b->remote, send_buffer_sum(), repeat);
+}
+
+
+/** Encode all buttons rounds times, return ns per encoding. */
+static double bench_encode(int rounds)
+{
+	struct timespec start;
+	struct timespec end;
+	int r;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < button_count; i++) {
+			set_toggle(buttons[i].remote, buttons[i].toggle);
+			init_sim(buttons[i].remote, buttons[i].code, 0);
+			init_sim(buttons[i].remote, buttons[i].code, 1);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return elapsed_ns(&start, &end) / (2.0 * rounds * button_count);
+}
+
+
+/** Decode signal_data using remotes, return number of strings. */
+static int decode(struct ir_remote* remotes, char decoded[][DECODED_SIZE])
+{
+	int n = 0;
+	char* s;
+
+	signal_pos = 0;
+	rec_buffer_init();
+	last_remote = NULL;
+	while (signal_pos < signal_size) {
+		if (!rec_buffer_clear())
+			continue;
+		s = decode_all(remotes);
+		if (s == NULL)
+			continue;
+		if (n < MAX_DECODED)
+			snprintf(decoded[n], DECODED_SIZE, "%s", s);
+		n += 1;
+	}
+	return n;
+}
+
+
+/** Round trip results for a button, mismatches from RT_ENCODE. */
+enum result {
+	RT_OK,
+	RT_DUPLICATE,   /**< Decoded as same button of an earlier remote. */
+	RT_ENCODE,      /**< init_sim() failed. */
+	RT_FIRST,       /**< First frame decoded wrong or not at all. */
+	RT_REPEAT,      /**< Repeat decoded wrong or not at all. */
+	RT_SHADOWED,    /**< Decoded as another remote earlier in config. */
+	RT_RESULTS
+};
+
+static const char* const RESULT_TEXT[] = {
+	"ok", "duplicate of an earlier remote", "cannot be encoded",
+	"first frame not decoded", "repeat not decoded",
+	"decoded as another remote"
+};
+
+
+/**
+ * Return 1 if s decodes as button b with reps repeats. If remote is
+ * not NULL, the decoded remote name is stored there.
+ */
+static int is_decoded(const char* s, const struct button* b, int reps,
+		      char* remote)
+{
+	char buf[DECODED_SIZE];
+	char name[DECODED_SIZE];
+	struct ir_ncode* code;
+	unsigned long long value;
+	int r;
+
+	if (remote == NULL)
+		remote = buf;
+	remote[0] = '\0';
+	if (sscanf(s, "%llx %x %255s %255s", &value, &r, name, remote) != 4)
+		return 0;
+	if (r != reps || strcmp(remote, b->remote->name) != 0)
+		return 0;
+	if (strcmp(name, b->code->name) == 0)
+		return 1;
+	/* Buttons with the same code decode as the first of them. */
+	code = get_code_by_name(b->remote, name);
+	return code != NULL && !is_raw(b->remote) && code->code == b->code->code
+	       && code->next == NULL && b->code->next == NULL;
+}
+
+
+/**
+ * Return 1 if s decodes as a button of a remote before b's remote in
+ * config with the same name and code as b, i. e., decode_all() finds
+ * it first.
+ */
+static int is_duplicate(const struct config* config, const char* s,
+			const struct button* b)
+{
+	char name[DECODED_SIZE];
+	char remote_name[DECODED_SIZE];
+	struct ir_remote* remote;
+	struct ir_ncode* code;
+	unsigned long long value;
+	int r;
+
+	if (sscanf(s, "%llx %x %255s %255s",
+		   &value, &r, name, remote_name) != 4
+	    || strcmp(name, b->code->name) != 0)
+		return 0;
+	for (remote = config->remotes;
+	     remote != NULL && remote != b->remote;
+	     remote = remote->next) {
+		if (strcmp(remote->name, remote_name) != 0)
+			continue;
+		for (code = remote->codes; code->name != NULL; code++)
+			if (strcmp(code->name, name) == 0
+			    && code->code == b->code->code)
+				return 1;
+		return 0;
+	}
+	return 0;
+}
+
+
+/**
+ * Encode button b as a first frame and its repeats and decode it using
+ * the remotes in config. Updates frames and ns with decoding time.
+ */
+static enum result check_button(const struct config*	config,
+				struct button*		b,
+				char			decoded[][DECODED_SIZE],
+				int*			n,
+				long*			frames,
+				double*			ns)
+{
+	char remote[DECODED_SIZE];
+	struct timespec start;
+	struct timespec end;
+	int repeats = b->remote->min_repeat > 0 ? b->remote->min_repeat : 1;
+	lirc_t gap;
+	int i;
+
+	*n = 0;
+	signal_size = 0;
+	add_signal(LONG_SPACE);
+	gap = add_frame(b, 0);
+	if (gap == 0)
+		return RT_ENCODE;
+	for (i = 0; i < repeats; i++) {
+		add_signal(gap);
+		gap = add_frame(b, 1);
+		if (gap == 0)
+			return RT_ENCODE;
+	}
+	add_signal(LONG_SPACE);
+	set_toggle(b->remote, 0);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	*n = decode(config->remotes, decoded);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	*ns += elapsed_ns(&start, &end);
+	*frames += 1 + repeats;
+	if (*n == 0)
+		return RT_FIRST;
+	if (!is_decoded(decoded[0], b, 0, remote)) {
+		if (is_duplicate(config, decoded[0], b))
+			return RT_DUPLICATE;
+		if (remote[0] != '\0' && strcmp(remote, b->remote->name) != 0)
+			return RT_SHADOWED;
+		return RT_FIRST;
+	}
+	if (*n != 1 + repeats)
+		return RT_REPEAT;
+	for (i = 1; i < *n && i < MAX_DECODED; i++)
+		if (!is_decoded(decoded[i], b, i, NULL))
+			return RT_REPEAT;
+	return RT_OK;
+}
+
+
+static void print_example(const struct button*	b,
+			  char			decoded[][DECODED_SIZE],
+			  int			n)
+{
+	int i;
+
+	fprintf(stderr, ", e.g. %s", b->code->name);
+	if (toggle_count(b->remote) > 1)
+		fprintf(stderr, " (toggle %d)", b->toggle);
+	if (n == 0)
+		fputs(": nothing decoded", stderr);
+	for (i = 0; i < n && i < MAX_DECODED; i++)
+		fprintf(stderr, "%s \"%.*s\"", i > 0 ? "," : ":",
+			(int)strcspn(decoded[i], "\n"), decoded[i]);
+	fputs("\n", stderr);
+}
+
+
+/**
+ * Round trip all buttons in config. Print a line for each remote and
+ * kind of mismatch or duplicate, add the number of buttons for each
+ * result to totals. Return the number of buttons with mismatches.
+ */
+static int check_config(const struct config*	config,
+			int			totals[RT_RESULTS],
+			long*			frames,
+			double*			ns)
+{
+	char decoded[MAX_DECODED][DECODED_SIZE];
+	char example[RT_RESULTS][MAX_DECODED][DECODED_SIZE];
+	int example_n[RT_RESULTS];
+	struct button* example_b[RT_RESULTS];
+	int counts[RT_RESULTS];
+	struct ir_remote* remote;
+	enum result r;
+	int mismatches = 0;
+	int first;
+	int n;
+	int i;
+
+	for (first = config->first; first < config->end; first = i) {
+		remote = buttons[first].remote;
+		memset(counts, 0, sizeof(counts));
+		for (i = first;
+		     i < config->end && buttons[i].remote == remote;
+		     i++) {
+			r = check_button(config, &buttons[i], decoded, &n,
+					 frames, ns);
+			if (counts[r]++ == 0) {
+				memcpy(example[r], decoded, sizeof(decoded));
+				example_n[r] = n;
+				example_b[r] = &buttons[i];
+			}
+			totals[r] += 1;
+		}
+		for (r = RT_DUPLICATE; r < RT_RESULTS;
+		     r = (enum result)(r + 1)) {
+			if (counts[r] == 0)
+				continue;
+			if (r >= RT_ENCODE)
+				mismatches += counts[r];
+			fprintf(stderr, "%s: %s: %d of %d buttons %s",
+				config->path, remote->name,
+				counts[r], i - first, RESULT_TEXT[r]);
+			print_example(example_b[r], example[r], example_n[r]);
+		}
+	}
+	return mismatches;
+}
+
+
+int main(int argc, char** argv)
+{
+	const char* const* paths = DEFAULT_PATHS;
+	int totals[RT_RESULTS] = { 0 };
+	double decode_ns = 0;
+	long frames = 0;
+	int rounds = 100;
+	int remote_count = 0;
+	int mismatches = 0;
+	struct ir_remote* remote;
+	int i;
+
+	lirc_log_open("roundtrip-bench", 0, LIRC_ERROR);
+	memcpy((void*)curr_driver, &bench_driver, sizeof(struct driver));
+	send_buffer_init();
+	if (argc > 1)
+		rounds = atoi(argv[1]);
+	if (argc > 2)
+		paths = (const char* const*)argv + 2;
+	for (i = 0; paths[i] != NULL; i++)
+		add_path(paths[i]);
+	for (i = 0; i < config_count; i++) {
+		add_buttons(&configs[i]);
+		for (remote = configs[i].remotes; remote; remote = remote->next)
+			remote_count += 1;
+	}
+	if (button_count == 0) {
+		fputs("No buttons found\n", stderr);
+		return EXIT_FAILURE;
+	}
+	printf("%d files, %d skipped, %d remotes, %d buttons incl. toggles\n",
+	       config_count, skipped, remote_count, button_count);
+	printf("encode: %8.1f ns/frame\n", bench_encode(rounds));
+	for (i = 0; i < config_count; i++)
+		mismatches += check_config(&configs[i], totals, &frames,
+					   &decode_ns);
+	printf("decode: %8.1f ns/frame\n", decode_ns / frames);
+	printf("%d ok", totals[RT_OK]);
+	for (i = RT_DUPLICATE; i < RT_RESULTS; i++)
+		printf(", %d %s", totals[i], RESULT_TEXT[i]);
+	printf("\n");
+	return mismatches == 0 ? 0 : 1;
+}
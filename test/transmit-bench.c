@@ -0,0 +1,240 @@
+/****************************************************************************
+** transmit-bench.c ********************************************************
+****************************************************************************
+*
+* transmit-bench - check and time the send_buffer_put() encoding.
+*
+* Encodes all codes of all remotes in the given lircd.conf files. Each
+* code is first sent with an empty encoded signals cache, and then again
+* in the same state from the cache; the two results must be equal.
+* Reports the average time per send_buffer_put() when encoding every
+* time (the cache is cleared before each send, the clearing itself is
+* not included) and when the signals come from the cache.
+*
+* Then a long raw frame, sent with low gap repeats, is streamed using
+* send_buffer_stream(). The chunks must match the complete signal;
+* the time until the first chunk and the complete signal is reported.
+*
+* Usage: transmit-bench [rounds [lircd.conf...]]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lirc_private.h"
+
+static const struct driver bench_driver = {
+	.name		= "transmit-bench",
+	.device		= "/dev/null",
+	.features	= LIRC_CAN_SEND_PULSE,
+	.send_mode	= LIRC_MODE_PULSE,
+	.rec_mode	= 0,
+	.code_length	= 0,
+	.api_version	= 3,
+	.driver_version = "0.10.0"
+};
+
+struct send {
+	struct ir_remote*	remote;
+	struct ir_ncode*	code;
+};
+
+static struct send* sends;
+static int send_count;
+
+static const int LONG_FRAME = 701;
+
+static struct timespec first_chunk;
+static int chunk_count;
+static int chunk_items;
+static lirc_t* chunk_data;
+
+
+static double elapsed_ns(const struct timespec* start,
+			 const struct timespec* end)
+{
+	return (end->tv_sec - start->tv_sec) * 1e9
+	       + (end->tv_nsec - start->tv_nsec);
+}
+
+
+static void add_sends(struct ir_remote* remotes)
+{
+	struct ir_remote* remote;
+	struct ir_ncode* code;
+
+	for (remote = remotes; remote != NULL; remote = remote->next) {
+		for (code = remote->codes; code->name != NULL; code++) {
+			sends = realloc(sends, (send_count + 1) * sizeof(*sends));
+			sends[send_count].remote = remote;
+			sends[send_count].code = code;
+			send_count += 1;
+		}
+	}
+}
+
+
+/** Send code uncached and cached in the same state, compare. */
+static int check(struct ir_remote* remote, struct ir_ncode* code)
+{
+	struct ir_remote saved_remote = *remote;
+	struct ir_ncode saved_code = *code;
+	lirc_t* data;
+	lirc_t sum;
+	int length;
+	int r1;
+	int r2;
+	int ok;
+
+	send_cache_clear();
+	r1 = send_buffer_put(remote, code);
+	length = send_buffer_length();
+	sum = send_buffer_sum();
+	data = malloc((length + 1) * sizeof(lirc_t));
+	memcpy(data, send_buffer_data(), length * sizeof(lirc_t));
+	*remote = saved_remote;
+	*code = saved_code;
+	r2 = send_buffer_put(remote, code);
+	ok = r1 == r2
+	     && length == send_buffer_length()
+	     && sum == send_buffer_sum()
+	     && memcmp(data, send_buffer_data(), length * sizeof(lirc_t)) == 0;
+	if (!ok)
+		fprintf(stderr, "Mismatch for %s %s\n", remote->name, code->name);
+	free(data);
+	return ok;
+}
+
+
+static double bench(int rounds, int cached, int clear_only)
+{
+	struct timespec start;
+	struct timespec end;
+	int r;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < send_count; i++) {
+			if (!cached)
+				send_cache_clear();
+			if (!clear_only)
+				send_buffer_put(sends[i].remote, sends[i].code);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return elapsed_ns(&start, &end) / ((double)rounds * send_count);
+}
+
+
+static int on_chunk(const lirc_t* data, int n, void* arg)
+{
+	if (chunk_count++ == 0)
+		clock_gettime(CLOCK_MONOTONIC, &first_chunk);
+	chunk_data = realloc(chunk_data, (chunk_items + n) * sizeof(lirc_t));
+	memcpy(chunk_data + chunk_items, data, n * sizeof(lirc_t));
+	chunk_items += n;
+	return 1;
+}
+
+
+/** Stream a long, repeated raw frame, return number of errors. */
+static int bench_stream(int rounds)
+{
+	struct ir_remote* remote;
+	struct timespec start;
+	struct timespec end;
+	double first_ns = 0;
+	double total_ns = 0;
+	char* buf = NULL;
+	size_t size = 0;
+	FILE* f;
+	int r;
+	int i;
+
+	f = open_memstream(&buf, &size);
+	fprintf(f, "begin remote\n  name long_raw\n  flags RAW_CODES\n");
+	fprintf(f, "  eps 30\n  aeps 100\n  gap 8000\n  min_repeat 3\n");
+	fprintf(f, "  begin raw_codes\n    name FRAME\n");
+	for (i = 0; i < LONG_FRAME; i++)
+		fprintf(f, " %d%s", 400 + 400 * (i % 3), i % 8 == 7 ? "\n" : "");
+	fprintf(f, "\n  end raw_codes\nend remote\n");
+	fclose(f);
+	f = fmemopen(buf, size, "r");
+	remote = read_config(f, "long_raw");
+	fclose(f);
+	free(buf);
+	if (remote == NULL || remote == (void*)-1) {
+		fputs("Cannot parse long_raw config\n", stderr);
+		return 1;
+	}
+	for (r = 0; r < rounds; r++) {
+		chunk_count = 0;
+		chunk_items = 0;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (!send_buffer_stream(remote, remote->codes, on_chunk, NULL)) {
+			fputs("Cannot stream long_raw\n", stderr);
+			return 1;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		first_ns += elapsed_ns(&start, &first_chunk);
+		total_ns += elapsed_ns(&start, &end);
+	}
+	if (chunk_items != send_buffer_length()
+	    || memcmp(chunk_data, send_buffer_data(),
+		      chunk_items * sizeof(lirc_t)) != 0) {
+		fputs("Streamed chunks differ from signal\n", stderr);
+		return 1;
+	}
+	printf("stream:  %d items in %d chunks, first after %.1f ns,"
+	       " complete after %.1f ns\n", chunk_items, chunk_count,
+	       first_ns / rounds, total_ns / rounds);
+	free_config(remote);
+	return 0;
+}
+
+
+int main(int argc, char** argv)
+{
+	static const char* const DEFAULT_FILES[] = {
+		"etc/lircd.conf.Aspire_6530G", NULL
+	};
+	const char* const* files = DEFAULT_FILES;
+	struct ir_remote* remotes;
+	int rounds = 100;
+	int errors = 0;
+	FILE* f;
+	int i;
+
+	lirc_log_open("transmit-bench", 0, LIRC_ERROR);
+	memcpy((void*)curr_driver, &bench_driver, sizeof(struct driver));
+	send_buffer_init();
+	if (argc > 1)
+		rounds = atoi(argv[1]);
+	if (argc > 2)
+		files = (const char* const*)argv + 2;
+	for (i = 0; files[i] != NULL; i++) {
+		f = fopen(files[i], "r");
+		if (f == NULL) {
+			perror(files[i]);
+			return EXIT_FAILURE;
+		}
+		remotes = read_config(f, files[i]);
+		fclose(f);
+		if (remotes == NULL || remotes == (void*)-1) {
+			fprintf(stderr, "Cannot parse %s\n", files[i]);
+			return EXIT_FAILURE;
+		}
+		add_sends(remotes);
+	}
+	for (i = 0; i < send_count; i++)
+		errors += !check(sends[i].remote, sends[i].code);
+	printf("%d codes checked, %d errors\n", send_count, errors);
+	printf("encoded: %8.1f ns/send\n",
+	       bench(rounds, 0, 0) - bench(rounds, 0, 1));
+	printf("cached:  %8.1f ns/send\n", bench(rounds, 1, 0));
+	errors += bench_stream(rounds);
+	return errors == 0 ? 0 : 1;
+}
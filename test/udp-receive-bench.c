@@ -0,0 +1,252 @@
+/****************************************************************************
+** udp-receive-bench.c *****************************************************
+****************************************************************************
+*
+* udp-receive-bench - stress the udp plugin with bursts of packets.
+*
+* Loads the udp plugin listening on a free port with 1 us clocktick.
+* Bursts of packets, each holding a long gap as an extended time value
+* and NEC frames, are sent to it on the loopback interface and read
+* using readdata_batch() until no more data arrives. The samples must
+* be the ones sent, and the packets received and dropped, as reported
+* by DRVCTL_GET_REC_STATS, must add up to the packets sent.
+*
+* Runs with a receive buffer holding a burst, and with a small one where
+* packets are dropped. Reports packets per receive call, reading time
+* and losses for both.
+*
+* Usage: udp-receive-bench [bursts [udp.so]]
+*/
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "lirc_driver.h"
+#include "lirc_private.h"
+
+#define BURST           64
+#define FRAMES          4
+#define GAP             100000
+#define MAX_ITEMS       (FRAMES * 68 + 1)
+
+#define LARGE_RCVBUF    "1048576"
+#define SMALL_RCVBUF    "4096"
+
+static const uint32_t CODE = 0x20DF08F7;
+
+struct packet {
+	uint8_t data[MAX_ITEMS * 6];
+	int	length;
+	lirc_t	samples[MAX_ITEMS];
+	int	count;
+};
+
+
+static void add_item(struct packet* p, int pulse, uint32_t usec)
+{
+	uint8_t* d = p->data + p->length;
+
+	if (usec > 0x7FFF) {
+		/* Extended: a zero time, then 4 bytes. */
+		d[0] = 0;
+		d[1] = pulse ? 0 : 0x80;
+		d[2] = usec & 0xFF;
+		d[3] = (usec >> 8) & 0xFF;
+		d[4] = (usec >> 16) & 0xFF;
+		d[5] = (usec >> 24) & 0xFF;
+		p->length += 6;
+	} else {
+		/* The high bit is clear for pulses. */
+		d[0] = usec & 0xFF;
+		d[1] = ((usec >> 8) & 0x7F) | (pulse ? 0 : 0x80);
+		p->length += 2;
+	}
+	p->samples[p->count++] = pulse ? usec | PULSE_BIT : usec;
+}
+
+
+/** Make the packet: a gap, then FRAMES NEC frames with gaps. */
+static void make_packet(struct packet* p)
+{
+	int i;
+	int bit;
+
+	memset(p, 0, sizeof(*p));
+	for (i = 0; i < FRAMES; i++) {
+		add_item(p, 0, i == 0 ? GAP : 40000);
+		add_item(p, 1, 9000);
+		add_item(p, 0, 4500);
+		for (bit = 31; bit >= 0; bit--) {
+			add_item(p, 1, 560);
+			add_item(p, 0, (CODE >> bit) & 1 ? 1690 : 560);
+		}
+		add_item(p, 1, 560);
+	}
+}
+
+
+static int get_stats(struct drv_rec_stats* stats)
+{
+	return drv.drvctl_func(DRVCTL_GET_REC_STATS, stats) == 0;
+}
+
+
+static int set_option(const char* key, const char* value)
+{
+	struct option_t option;
+
+	snprintf(option.key, sizeof(option.key), "%s", key);
+	snprintf(option.value, sizeof(option.value), "%s", value);
+	return drv.drvctl_func(DRVCTL_SET_OPTION, &option) == 0;
+}
+
+
+/**
+ * Send bursts of packets to port and read them, using the receive buffer
+ * rcvbuf. Returns number of errors.
+ */
+static int bench(const char* rcvbuf, int port, int bursts, int must_drop)
+{
+	static lirc_t buf[512];
+	struct drv_rec_stats stats;
+	struct sockaddr_in addr;
+	struct packet packet;
+	struct timespec start;
+	struct timespec end;
+	double reading = 0;
+	int mismatches = 0;
+	int pos = 0;
+	int sent = 0;
+	int count;
+	int fd;
+	int b;
+	int i;
+
+	make_packet(&packet);
+	if (!set_option("rcvbuf", rcvbuf) || !drv.init_func()) {
+		fputs("Cannot init udp driver\n", stderr);
+		return 1;
+	}
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	for (b = 0; b < bursts; b++) {
+		for (i = 0; i < BURST; i++) {
+			if (sendto(fd, packet.data, packet.length, 0,
+				   (struct sockaddr*)&addr,
+				   sizeof(addr)) == packet.length)
+				sent += 1;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		/* Read until nothing more arrives within 20 ms. */
+		while ((count = drv.readdata_batch(buf, 512, 20000)) > 0) {
+			for (i = 0; i < count; i++, pos++) {
+				if (pos == packet.count)
+					pos = 0;
+				if (buf[i] != packet.samples[pos])
+					mismatches += 1;
+			}
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		/* Less the final timeout. */
+		reading += (end.tv_sec - start.tv_sec) * 1e3
+			   + (end.tv_nsec - start.tv_nsec) / 1e6 - 20;
+	}
+	close(fd);
+	if (!get_stats(&stats)) {
+		fputs("DRVCTL_GET_REC_STATS failed\n", stderr);
+		drv.deinit_func();
+		return 1;
+	}
+	drv.deinit_func();
+	printf("rcvbuf %8s: %6d sent, %6llu received, %6llu dropped,"
+	       " %5.2f packets per read, %6.2f us per packet\n",
+	       rcvbuf, sent, (unsigned long long)stats.packets,
+	       (unsigned long long)stats.dropped,
+	       stats.batches > 0 ? (double)stats.packets / stats.batches : 0.0,
+	       stats.packets > 0 ? reading * 1e3 / stats.packets : 0.0);
+	if (mismatches > 0 || stats.errors > 0) {
+		fprintf(stderr, "%d samples differ, %llu bad packets\n",
+			mismatches, (unsigned long long)stats.errors);
+		return 1;
+	}
+	if (stats.samples != stats.packets * packet.count) {
+		fputs("Samples and packets differ\n", stderr);
+		return 1;
+	}
+	if (stats.packets + stats.dropped != (unsigned long long)sent) {
+		fputs("Received and dropped packets differ from sent\n",
+		      stderr);
+		return 1;
+	}
+	return must_drop ? stats.dropped == 0 : stats.dropped > 0;
+}
+
+
+/** Return a free udp port. */
+static int free_port(void)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	int fd;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0
+	    || getsockname(fd, (struct sockaddr*)&addr, &len) != 0) {
+		close(fd);
+		return -1;
+	}
+	close(fd);
+	return ntohs(addr.sin_port);
+}
+
+
+int main(int argc, char** argv)
+{
+	const char* plugin = "../plugins/.libs/udp.so";
+	const struct driver* const* hardwares;
+	char device[16];
+	void* handle;
+	int bursts = 50;
+	int errors = 0;
+	int port;
+
+	if (argc > 1)
+		bursts = atoi(argv[1]);
+	if (argc > 2)
+		plugin = argv[2];
+	lirc_log_open("udp-receive-bench", 0, LIRC_ERROR);
+	handle = dlopen(plugin, RTLD_NOW);
+	if (handle == NULL) {
+		fprintf(stderr, "%s\n", dlerror());
+		return EXIT_FAILURE;
+	}
+	hardwares = (const struct driver* const*)dlsym(handle, "hardwares");
+	if (hardwares == NULL || hardwares[0] == NULL) {
+		fprintf(stderr, "No driver in %s\n", plugin);
+		return EXIT_FAILURE;
+	}
+	memcpy(&drv, hardwares[0], sizeof(struct driver));
+	port = free_port();
+	snprintf(device, sizeof(device), "%d", port);
+	drv.device = device;
+	drv.fd = -1;
+	if (port == -1 || !set_option("clocktick", "1")) {
+		fputs("Cannot setup udp driver\n", stderr);
+		return EXIT_FAILURE;
+	}
+	errors += bench(LARGE_RCVBUF, port, bursts, 0);
+	errors += bench(SMALL_RCVBUF, port, bursts, 1);
+	return errors == 0 ? 0 : 1;
+}
@@ -97,22 +97,27 @@ int main(int argc, char* argv[])
 
 	r = lirc_readconfig(config_file, &config, NULL);
 	if (r == 0) {
-		char* code;
+		char* codes[16];
 		char* c;
-		int r;
+		int count;
+		int i;
 
-		while (lirc_nextcode(&code) == 0) {
-			if (code == NULL || !*code)
-				continue;
-			while ((r = lirc_code2char(config, code, &c)) == 0) {
-				if (c == NULL || !*c)
-					break;
-				printf("%s\n", c);
-				fflush(stdout);
-			}
-			free(code);
-			if (r == -1)
+		r = 0;
+		while (r != -1) {
+			count = lirc_nextcodes(codes, 16);
+			if (count == -1)
 				break;
+			for (i = 0; i < count && r != -1; i++) {
+				if (!*codes[i])
+					continue;
+				while ((r = lirc_code2char(config, codes[i],
+							   &c)) == 0) {
+					if (c == NULL || !*c)
+						break;
+					printf("%s\n", c);
+				}
+			}
+			fflush(stdout);
 		}
 		lirc_freeconfig(config);
 	}
@@ -18,12 +18,18 @@
 #endif
 
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
 #include <unistd.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <getopt.h>
+#include <time.h>
+#include <sys/resource.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
@@ -37,6 +43,10 @@ static const char* const USAGE =
 	"\t-d --daemon\t\tRun in background\n"
 	"\t-D --loglevel=level\t'error', 'info', 'notice',... or 0..10\n"
 	"\t-n --name=progname\tUse this program name for lircrc matching\n"
+	"\t-j --jobs=n\t\tRun at most n instances of each command\n"
+	"\t-c --coalesce\t\tQueue at most one request per command\n"
+	"\t-w --workers=n\t\tRun shell commands in n persistent shells\n"
+	"\t-s --stats\t\tReport latency and cpu usage at exit/SIGUSR1\n"
 	"\t-h --help\t\tDisplay usage summary\n"
 	"\t-v --version\t\tDisplay version\n";
 
@@ -46,81 +56,670 @@ static const struct option options[] = {
 	{ "daemon",   no_argument,	 NULL, 'd' },
 	{ "name",     required_argument, NULL, 'n' },
 	{ "loglevel", required_argument, NULL, 'D' },
+	{ "jobs",     required_argument, NULL, 'j' },
+	{ "coalesce", no_argument,	 NULL, 'c' },
+	{ "workers",  required_argument, NULL, 'w' },
+	{ "stats",    no_argument,	 NULL, 's' },
 	{ 0,          0,		 0,    0   }
 };
 
 static int opt_daemonize	= 0;
 static loglevel_t opt_loglevel	= LIRC_NOLOG;
 static const char* opt_progname	= "irexec";
+static int opt_jobs		= 0;
+static int opt_coalesce		= 0;
+static int opt_workers		= 0;
+static int opt_stats		= 0;
 
 static char path[256] = {0};
 
+/** Max number of requests waiting for a free job slot or worker. */
+#define MAX_PENDING 256
 
-/** Run shell command line in isolated process using double fork(). */
-static void run_command(const char* cmd)
+#define MAX_WORKERS 32
+
+#define MAX_ARGS 64
+
+/** Characters which require a shell to run a command. */
+static const char* const SHELL_CHARS = "|&;<>()$`\\\"'*?[]#~{}!\n";
+
+/** Shell builtins which have no executable counterpart. */
+static const char* const SHELL_BUILTINS[] = {
+	".", ":", "alias", "cd", "command", "eval", "exec", "exit", "export",
+	"getopts", "hash", "local", "read", "readonly", "return", "set",
+	"shift", "source", "trap", "type", "ulimit", "umask", "unset",
+	"wait", NULL
+};
+
+extern char** environ;
+
+/** A distinct command string from lircrc, created when first seen. */
+struct action {
+	char*		cmd;
+	char**		argv;           /**< Direct argv, or NULL for shell. */
+	int		running;
+	int		pending;        /**< Requests in pending queue. */
+	struct action*	next;
+};
+
+/** A running child process started by posix_spawn(). */
+struct job {
+	pid_t		pid;
+	struct action*	action;
+	struct timespec	start;
+	struct job*	next;
+};
+
+/** A persistent shell running commands read from cmd_fd. */
+struct worker {
+	pid_t		pid;            /**< 0 if not running. */
+	int		cmd_fd;
+	int		done_fd;        /**< Exit status for each command. */
+	struct action*	action;         /**< Running command, or NULL. */
+	struct timespec	start;
+};
+
+struct request {
+	struct action*	action;
+	struct timespec	received;
+};
+
+static struct action* actions = NULL;
+static struct job* jobs = NULL;
+static struct job* free_jobs = NULL;
+static struct worker workers[MAX_WORKERS];
+
+/** FIFO of requests which could not be started right away. */
+static struct {
+	struct request	requests[MAX_PENDING];
+	int		head;
+	int		count;
+} pending;
+
+static struct {
+	unsigned long	events;
+	unsigned long	direct;
+	unsigned long	shell;
+	unsigned long	pool;
+	unsigned long	coalesced;
+	unsigned long	dropped;
+	unsigned long	finished;
+	double		latency_us;     /**< Event to launch, total. */
+	double		max_latency_us;
+	double		run_us;         /**< Launch to exit, total. */
+} stats;
+
+static int signal_pipe[2] = { -1, -1 };
+static volatile sig_atomic_t got_sigchld = 0;
+static volatile sig_atomic_t got_sigusr1 = 0;
+static volatile sig_atomic_t got_term = 0;
+
+
+static double elapsed_us(const struct timespec* start,
+			 const struct timespec* end)
 {
-	pid_t pid1;
-	pid_t pid2;
+	return (end->tv_sec - start->tv_sec) * 1000000.0
+	       + (end->tv_nsec - start->tv_nsec) / 1000.0;
+}
 
-	pid1 = fork();
-	if (pid1 < 0) {
-		log_perror_err("Cannot fork");
-		perror("Cannot fork()");
-		exit(EXIT_FAILURE);
+
+static double rusage_us(int who)
+{
+	struct rusage usage;
+
+	getrusage(who, &usage);
+	return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000.0
+	       + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+
+static void print_stats(void)
+{
+	unsigned long launched = stats.direct + stats.shell + stats.pool;
+	double self_us = rusage_us(RUSAGE_SELF);
+	double children_us = rusage_us(RUSAGE_CHILDREN);
+	unsigned long n = launched > 0 ? launched : 1;
+
+	fprintf(stderr,
+		"irexec: %lu events, %lu commands (%lu direct, %lu shell,"
+		" %lu pool), %lu coalesced, %lu dropped\n",
+		stats.events, launched, stats.direct, stats.shell,
+		stats.pool, stats.coalesced, stats.dropped);
+	fprintf(stderr,
+		"irexec: launch latency avg %.1f us, max %.1f us;"
+		" run time avg %.1f us\n",
+		stats.latency_us / n, stats.max_latency_us,
+		stats.finished > 0 ? stats.run_us / stats.finished : 0.0);
+	fprintf(stderr,
+		"irexec: cpu per command %.1f us, children %.1f us\n",
+		self_us / n, children_us / n);
+	log_notice("%lu events, %lu commands, latency avg %.1f us,"
+		   " cpu %.1f us/command",
+		   stats.events, launched, stats.latency_us / n, self_us / n);
+}
+
+
+static void on_signal(int sig)
+{
+	int saved_errno = errno;
+
+	switch (sig) {
+	case SIGCHLD:
+		got_sigchld = 1;
+		break;
+	case SIGUSR1:
+		got_sigusr1 = 1;
+		break;
+	default:
+		got_term = 1;
 	}
-	if (pid1 == 0) {
-		pid2 = fork();
-		if (pid2 < 0) {
-			log_perror_err("Cannot do secondary fork()");
-			exit(EXIT_FAILURE);
-		}
-		if (pid2 == 0) {
-			log_debug("Execing command \"%s\"", cmd);
-			char* const vp[] = {strdup(SH_PATH),
-			      strdup("-c"),
-			      strdup(cmd),
-			      NULL
-			};
-			execvp(SH_PATH, vp);
-			/* not reached, unless there was an error */
-			log_perror_err("execvp failed");
-			fputs("execvp failed\n", stderr);
-			exit(EXIT_FAILURE);
-		} else {
-			waitpid(pid2, NULL, WNOHANG);
-			exit(0);
+	if (write(signal_pipe[1], "", 1) == -1)
+		; /* pipe full, a wakeup is pending anyway. */
+	errno = saved_errno;
+}
+
+
+/**
+ * Split cmd into argv if it can run without a shell, else return NULL.
+ * The returned vector and its strings are allocated as one block.
+ */
+static char** parse_argv(const char* cmd)
+{
+	char** argv;
+	char* buf;
+	char* arg;
+	size_t len = strlen(cmd);
+	int argc = 0;
+	int i;
+
+	if (strpbrk(cmd, SHELL_CHARS) != NULL)
+		return NULL;
+	argv = (char**)malloc((MAX_ARGS + 1) * sizeof(char*) + len + 1);
+	if (argv == NULL)
+		return NULL;
+	buf = (char*)(argv + MAX_ARGS + 1);
+	memcpy(buf, cmd, len + 1);
+	for (arg = strtok(buf, " \t"); arg != NULL; arg = strtok(NULL, " \t")) {
+		if (argc == MAX_ARGS)
+			goto shell;
+		argv[argc++] = arg;
+	}
+	argv[argc] = NULL;
+	/* Assignments and builtins need a shell. */
+	if (argc == 0 || strchr(argv[0], '=') != NULL)
+		goto shell;
+	for (i = 0; SHELL_BUILTINS[i] != NULL; i++)
+		if (strcmp(argv[0], SHELL_BUILTINS[i]) == 0)
+			goto shell;
+	return argv;
+
+shell:
+	free(argv);
+	return NULL;
+}
+
+
+static struct action* get_action(const char* cmd)
+{
+	struct action* action;
+
+	for (action = actions; action != NULL; action = action->next)
+		if (strcmp(action->cmd, cmd) == 0)
+			return action;
+	action = (struct action*)calloc(1, sizeof(struct action));
+	if (action == NULL)
+		return NULL;
+	action->cmd = strdup(cmd);
+	if (action->cmd == NULL) {
+		free(action);
+		return NULL;
+	}
+	action->argv = parse_argv(cmd);
+	action->next = actions;
+	actions = action;
+	return action;
+}
+
+
+static void free_actions(void)
+{
+	struct action* next;
+	struct job* job;
+
+	for (; actions != NULL; actions = next) {
+		next = actions->next;
+		free(actions->cmd);
+		free(actions->argv);
+		free(actions);
+	}
+	while (jobs != NULL || free_jobs != NULL) {
+		job = jobs != NULL ? jobs : free_jobs;
+		if (job == jobs)
+			jobs = job->next;
+		else
+			free_jobs = job->next;
+		free(job);
+	}
+}
+
+
+static void init_spawnattr(posix_spawnattr_t* attr)
+{
+	sigset_t sigs;
+
+	posix_spawnattr_init(attr);
+	sigemptyset(&sigs);
+	sigaddset(&sigs, SIGPIPE);
+	posix_spawnattr_setsigdefault(attr, &sigs);
+	sigemptyset(&sigs);
+	posix_spawnattr_setsigmask(attr, &sigs);
+	posix_spawnattr_setflags(attr,
+				 POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+}
+
+
+/** Start a persistent shell reading commands from a pipe. */
+static int start_worker(struct worker* w)
+{
+	static const char* const argv[] = { SH_PATH, NULL };
+	posix_spawn_file_actions_t file_actions;
+	posix_spawnattr_t attr;
+	int cmd_pipe[2];
+	int done_pipe[2];
+	int r;
+
+	if (pipe2(cmd_pipe, O_CLOEXEC) == -1)
+		return 0;
+	if (pipe2(done_pipe, O_CLOEXEC) == -1) {
+		close(cmd_pipe[0]);
+		close(cmd_pipe[1]);
+		return 0;
+	}
+	posix_spawn_file_actions_init(&file_actions);
+	posix_spawn_file_actions_adddup2(&file_actions, cmd_pipe[0], 0);
+	posix_spawn_file_actions_adddup2(&file_actions, done_pipe[1], 3);
+	init_spawnattr(&attr);
+	r = posix_spawn(&w->pid, SH_PATH, &file_actions, &attr,
+			(char* const*)argv, environ);
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&file_actions);
+	close(cmd_pipe[0]);
+	close(done_pipe[1]);
+	if (r != 0) {
+		errno = r;
+		log_perror_err("Cannot start worker shell");
+		close(cmd_pipe[1]);
+		close(done_pipe[0]);
+		w->pid = 0;
+		return 0;
+	}
+	w->cmd_fd = cmd_pipe[1];
+	w->done_fd = done_pipe[0];
+	w->action = NULL;
+	log_debug("Started worker shell %d", w->pid);
+	return 1;
+}
+
+
+static void stop_worker(struct worker* w)
+{
+	close(w->cmd_fd);
+	close(w->done_fd);
+	w->pid = 0;
+}
+
+
+static struct worker* get_worker(void)
+{
+	int i;
+
+	for (i = 0; i < opt_workers; i++)
+		if (workers[i].pid != 0 && workers[i].action == NULL)
+			return &workers[i];
+	for (i = 0; i < opt_workers; i++)
+		if (workers[i].pid == 0 && start_worker(&workers[i]))
+			return &workers[i];
+	return NULL;
+}
+
+
+/**
+ * Run cmd in a subshell of worker w, so it cannot change the worker's
+ * state; the worker reports the exit status on fd 3.
+ */
+static int run_in_worker(struct worker* w, const char* cmd)
+{
+	char* buf;
+	char* p;
+	size_t len;
+	ssize_t r;
+
+	buf = (char*)malloc(strlen(cmd) * 4 + 64);
+	if (buf == NULL) {
+		log_error("Out of memory");
+		return 0;
+	}
+	p = stpcpy(buf, "( eval '");
+	for (; *cmd != '\0'; cmd++) {
+		if (*cmd == '\'')
+			p = stpcpy(p, "'\\''");
+		else
+			*p++ = *cmd;
+	}
+	p = stpcpy(p, "' ) </dev/null 3>&-; echo $? >&3\n");
+	len = p - buf;
+	for (p = buf; len > 0; p += r, len -= r) {
+		r = write(w->cmd_fd, p, len);
+		if (r == -1 && errno == EINTR) {
+			r = 0;
+		} else if (r <= 0) {
+			log_perror_err("Cannot write to worker shell");
+			free(buf);
+			return 0;
 		}
+	}
+	free(buf);
+	return 1;
+}
+
+
+/** Start command using posix_spawn(), directly or using /bin/sh -c. */
+static int spawn_command(struct action* action)
+{
+	const char* sh_argv[] = { SH_PATH, "-c", action->cmd, NULL };
+	posix_spawnattr_t attr;
+	struct job* job;
+	pid_t pid;
+	int r;
+
+	init_spawnattr(&attr);
+	if (action->argv != NULL) {
+		log_debug("Spawning command \"%s\"", action->cmd);
+		r = posix_spawnp(&pid, action->argv[0], NULL, &attr,
+				 action->argv, environ);
 	} else {
-		waitpid(pid1, NULL, 0);
+		log_debug("Execing command \"%s\"", action->cmd);
+		r = posix_spawn(&pid, SH_PATH, NULL, &attr,
+				(char* const*)sh_argv, environ);
 	}
+	posix_spawnattr_destroy(&attr);
+	if (r != 0) {
+		errno = r;
+		log_perror_err("Cannot run \"%s\"", action->cmd);
+		return 0;
+	}
+	job = free_jobs;
+	if (job != NULL)
+		free_jobs = job->next;
+	else
+		job = (struct job*)malloc(sizeof(struct job));
+	if (job == NULL) {
+		/* Cannot track it, just let it run. */
+		log_error("Out of memory");
+		return 1;
+	}
+	job->pid = pid;
+	job->action = action;
+	clock_gettime(CLOCK_MONOTONIC, &job->start);
+	job->next = jobs;
+	jobs = job;
+	if (action->argv != NULL)
+		stats.direct += 1;
+	else
+		stats.shell += 1;
+	return 1;
 }
 
 
-/** Get buttonclick messages from lircd socket and process them. */
-static void process_input(struct lirc_config* config)
+/**
+ * Launch request if the concurrency limit and the worker pool allows.
+ * @return 1 if started or failed, 0 if it has to wait.
+ */
+static int start_request(const struct request* request)
+{
+	struct action* action = request->action;
+	struct worker* w = NULL;
+	struct timespec now;
+	double us;
+
+	if (opt_jobs > 0 && action->running >= opt_jobs)
+		return 0;
+	if (action->argv == NULL && opt_workers > 0) {
+		w = get_worker();
+		if (w == NULL)
+			return 0;
+		if (!run_in_worker(w, action->cmd))
+			return 1;
+		w->action = action;
+		clock_gettime(CLOCK_MONOTONIC, &w->start);
+		stats.pool += 1;
+	} else if (!spawn_command(action)) {
+		return 1;
+	}
+	action->running += 1;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	us = elapsed_us(&request->received, &now);
+	stats.latency_us += us;
+	if (us > stats.max_latency_us)
+		stats.max_latency_us = us;
+	return 1;
+}
+
+
+/** Start queued requests which are no longer blocked, in order. */
+static void run_pending(void)
+{
+	struct request* request;
+	int i;
+	int j;
+	int n = pending.count;
+
+	for (i = 0, j = 0; i < n; i++) {
+		request = &pending.requests[(pending.head + i) % MAX_PENDING];
+		if (start_request(request)) {
+			request->action->pending -= 1;
+			continue;
+		}
+		pending.requests[(pending.head + j) % MAX_PENDING] = *request;
+		j += 1;
+	}
+	pending.count = j;
+}
+
+
+/** Handle a command string from lircrc for an event received at time. */
+static void submit(const char* cmd, const struct timespec* received)
+{
+	struct request request;
+
+	request.action = get_action(cmd);
+	if (request.action == NULL) {
+		log_error("Out of memory");
+		return;
+	}
+	request.received = *received;
+	if (request.action->pending == 0 && start_request(&request))
+		return;
+	if (opt_coalesce && request.action->pending > 0) {
+		log_trace("Coalescing \"%s\"", cmd);
+		stats.coalesced += 1;
+		return;
+	}
+	if (pending.count == MAX_PENDING) {
+		log_warn("Too many pending commands, dropping \"%s\"", cmd);
+		stats.dropped += 1;
+		return;
+	}
+	pending.requests[(pending.head + pending.count) % MAX_PENDING] =
+		request;
+	pending.count += 1;
+	request.action->pending += 1;
+}
+
+
+static void command_done(struct action* action, const struct timespec* start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	action->running -= 1;
+	stats.finished += 1;
+	stats.run_us += elapsed_us(start, &now);
+}
+
+
+/** Reap exited children, worker shells included. */
+static void reap_children(void)
 {
-	char* code;
+	struct job** prev;
+	struct job* job;
+	pid_t pid;
+	int i;
+
+	while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+		for (prev = &jobs; *prev != NULL; prev = &(*prev)->next) {
+			job = *prev;
+			if (job->pid != pid)
+				continue;
+			command_done(job->action, &job->start);
+			*prev = job->next;
+			job->next = free_jobs;
+			free_jobs = job;
+			break;
+		}
+		for (i = 0; i < opt_workers; i++) {
+			if (workers[i].pid != pid)
+				continue;
+			log_notice("Worker shell %d exited", pid);
+			if (workers[i].action != NULL)
+				command_done(workers[i].action,
+					     &workers[i].start);
+			stop_worker(&workers[i]);
+		}
+	}
+}
+
+
+static void worker_done(struct worker* w)
+{
+	char buf[64];
+
+	if (read(w->done_fd, buf, sizeof(buf)) <= 0)
+		return;         /* Worker died, handled in reap_children(). */
+	if (w->action != NULL)
+		command_done(w->action, &w->start);
+	w->action = NULL;
+}
+
+
+/** Translate codes from lircd and submit the resulting commands. */
+static int process_codes(struct lirc_config* config)
+{
+	struct timespec received;
+	char* codes[16];
 	char* c;
+	int count;
 	int r;
+	int i;
 
-	while (lirc_nextcode(&code) == 0) {
-		if (code == NULL)
-			continue;
-		r = lirc_code2char(config, code, &c);
-		while (r == 0 && c != NULL) {
-			run_command(c);
-			r = lirc_code2char(config, code, &c);
+	while ((count = lirc_nextcodes(codes, 16)) > 0) {
+		clock_gettime(CLOCK_MONOTONIC, &received);
+		for (i = 0; i < count; i++) {
+			stats.events += 1;
+			r = lirc_code2char(config, codes[i], &c);
+			while (r == 0 && c != NULL) {
+				submit(c, &received);
+				r = lirc_code2char(config, codes[i], &c);
+			}
+			if (r == -1)
+				return 0;
+		}
+	}
+	return count == 0;
+}
+
+
+/** Get buttonclick messages from lircd socket and process them. */
+static void process_input(struct lirc_config* config, int fd)
+{
+	struct pollfd pfds[2 + MAX_WORKERS];
+	struct worker* pfd_workers[2 + MAX_WORKERS];
+	char buf[64];
+	int n;
+	int i;
+
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	while (!got_term) {
+		pfds[0].fd = fd;
+		pfds[0].events = POLLIN;
+		pfds[1].fd = signal_pipe[0];
+		pfds[1].events = POLLIN;
+		n = 2;
+		for (i = 0; i < opt_workers; i++) {
+			if (workers[i].pid == 0)
+				continue;
+			pfd_workers[n] = &workers[i];
+			pfds[n].fd = workers[i].done_fd;
+			pfds[n].events = POLLIN;
+			n += 1;
+		}
+		if (poll(pfds, n, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			log_perror_err("poll() failed");
+			break;
 		}
-		free(code);
-		if (r == -1)
+		if (pfds[1].revents & POLLIN) {
+			while (read(signal_pipe[0], buf, sizeof(buf)) > 0)
+				;
+		}
+		if (got_sigchld) {
+			got_sigchld = 0;
+			reap_children();
+		}
+		for (i = 2; i < n; i++)
+			if (pfds[i].revents != 0 && pfd_workers[i]->pid != 0)
+				worker_done(pfd_workers[i]);
+		if (pfds[0].revents != 0 && !process_codes(config))
 			break;
+		if (pending.count > 0)
+			run_pending();
+		if (got_sigusr1) {
+			got_sigusr1 = 0;
+			print_stats();
+		}
+	}
+}
+
+
+static void init_signals(void)
+{
+	struct sigaction act;
+
+	if (pipe2(signal_pipe, O_CLOEXEC | O_NONBLOCK) == -1) {
+		perror("Cannot create pipe");
+		exit(EXIT_FAILURE);
 	}
+	memset(&act, 0, sizeof(act));
+	act.sa_handler = on_signal;
+	sigemptyset(&act.sa_mask);
+	act.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+	sigaction(SIGCHLD, &act, NULL);
+	if (opt_stats) {
+		sigaction(SIGUSR1, &act, NULL);
+		sigaction(SIGTERM, &act, NULL);
+		sigaction(SIGINT, &act, NULL);
+	}
+	/* Broken worker pipes are handled when writing. */
+	signal(SIGPIPE, SIG_IGN);
 }
 
 
 int irexec(const char* configfile)
 {
 	struct lirc_config* config;
+	int fd;
 
 	if (opt_daemonize) {
 		if (daemon(0, 0) == -1) {
@@ -128,7 +727,8 @@ int irexec(const char* configfile)
 			return EXIT_FAILURE;
 		}
 	}
-	if (lirc_init(opt_progname, opt_daemonize ? 0 : 1) == -1)
+	fd = lirc_init(opt_progname, opt_daemonize ? 0 : 1);
+	if (fd == -1)
 		return EXIT_FAILURE;
 
 	if (lirc_readconfig(configfile, &config, NULL) != 0) {
@@ -140,10 +740,14 @@ int irexec(const char* configfile)
 	lirc_log_set_file(path);
 	lirc_log_open("irexec", 1, opt_loglevel);
 
-	process_input(config);
+	init_signals();
+	process_input(config, fd);
+	if (opt_stats)
+		print_stats();
 	lirc_deinit();
 
 	lirc_freeconfig(config);
+	free_actions();
 	return EXIT_SUCCESS;
 }
 
@@ -152,7 +756,7 @@ int main(int argc, char* argv[])
 {
 	int c;
 
-	while ((c = getopt_long(argc, argv, "D:hvdn:", options, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "D:hvdn:j:cw:s", options, NULL)) != -1) {
 		switch (c) {
 		case 'h':
 			puts(USAGE);
@@ -169,6 +773,27 @@ int main(int argc, char* argv[])
 		case 'D':
 			opt_loglevel = string2loglevel(optarg);
 			break;
+		case 'j':
+			opt_jobs = atoi(optarg);
+			if (opt_jobs < 0) {
+				fputs("Bad jobs count\n", stderr);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'c':
+			opt_coalesce = 1;
+			break;
+		case 'w':
+			opt_workers = atoi(optarg);
+			if (opt_workers < 0 || opt_workers > MAX_WORKERS) {
+				fprintf(stderr, "Workers must be 0..%d\n",
+					MAX_WORKERS);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 's':
+			opt_stats = 1;
+			break;
 		default:
 			fputs(USAGE, stderr);
 			return EXIT_FAILURE;
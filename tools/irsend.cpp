@@ -26,7 +26,11 @@
 
 #include <getopt.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/stat.h>
 
 #include "lirc_log.h"
 #include "lirc_client.h"
@@ -36,17 +40,21 @@ static const logchannel_t logchannel = LOG_APP;
 static const char* const help =
 	"\nSynopsis:\n"
 	"    irsend [options] SEND_ONCE remote code [code...]\n"
+	"    irsend [options] SEND_SEQUENCE remote code [code...]\n"
 	"    irsend [options] SEND_START remote code\n"
 	"    irsend [options] SEND_STOP remote code\n"
 	"    irsend [options] LIST remote\n"
 	"    irsend [options] SET_TRANSMITTERS remote num [num...]\n"
 	"    irsend [options] SIMULATE \"scancode repeat keysym remote\"\n"
+	"    irsend [options] --batch[=path]\n"
 	"Options:\n"
 	"    -h --help\t\t\tdisplay usage summary\n"
 	"    -v --version\t\tdisplay version\n"
 	"    -d --device=device\t\tuse given lircd socket [" LIRCD "]\n"
 	"    -a --address=host[:port]\tconnect to lircd at this address\n"
-	"    -# --count=n\t\tsend command n times\n";
+	"    -# --count=n\t\tsend command n times\n"
+	"    -b --batch[=path]\t\trun lircd commands read from path [stdin]\n"
+	"    -D --delay=usecs\t\textra pause between SEND_SEQUENCE codes\n";
 
 const char* prog;
 
@@ -63,6 +71,199 @@ int send_packet(lirc_cmd_ctx* ctx, int fd)
 	return r == 0 ? 0 : -1;
 }
 
+/** Max number of batch commands sent but not yet replied to. */
+static const int BATCH_MAX_PENDING = 64;
+
+/** A batch command waiting for reply. */
+struct batch_cmd {
+	unsigned long	lineno;
+	struct timespec	start;
+};
+
+static int batch_errors = 0;
+
+
+static double elapsed_ms(const struct timespec* start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000.0
+	       + (now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+
+/** Report status and latency, then reply data lines indented by a tab. */
+static void batch_report(unsigned long		lineno,
+			 int			status,
+			 const struct timespec*	start,
+			 const char*		reply)
+{
+	const char* s;
+
+	printf("%lu %s %.3f ms", lineno, status == 0 ? "OK" : "ERROR",
+	       elapsed_ms(start));
+	/* lircd error messages come as reply data. */
+	if (status != 0 && status != EIO)
+		printf(" %s", strerror(status));
+	printf("\n");
+	while (reply != NULL && *reply) {
+		s = strchr(reply, '\n');
+		if (s == NULL)
+			s = reply + strlen(reply);
+		printf("\t%.*s\n", (int)(s - reply), reply);
+		reply = *s ? s + 1 : s;
+	}
+	fflush(stdout);
+	if (status != 0)
+		batch_errors += 1;
+}
+
+
+static void on_batch_reply(void*	data,
+			   int		status,
+			   const char*	command,
+			   const char*	reply)
+{
+	struct batch_cmd* cmd = (struct batch_cmd*)data;
+
+	batch_report(cmd->lineno, status, &cmd->start, reply);
+	free(cmd);
+}
+
+
+/** Queue a batch command line, ignoring blank and comment lines. */
+static void batch_queue(lirc_async* ctx, char* line, unsigned long lineno)
+{
+	struct batch_cmd* cmd;
+	int r;
+
+	line += strspn(line, " \t\r");
+	if (*line == '\0' || *line == '#')
+		return;
+	cmd = (struct batch_cmd*)malloc(sizeof(struct batch_cmd));
+	if (cmd == NULL) {
+		fprintf(stderr, "%s: out of memory\n", prog);
+		exit(EXIT_FAILURE);
+	}
+	cmd->lineno = lineno;
+	clock_gettime(CLOCK_MONOTONIC, &cmd->start);
+	r = lirc_async_command(ctx, on_batch_reply, cmd, "%s\n", line);
+	if (r == EMSGSIZE || r == ENOMEM) {
+		batch_report(lineno, r, &cmd->start, NULL);
+		free(cmd);
+	} else if (r != 0) {
+		perrorf("Cannot write to lircd");
+		exit(EXIT_FAILURE);
+	}
+}
+
+
+/**
+ * Run lircd commands read from path, one per line, on a single
+ * connection. Commands are pipelined; for each a line "<line number>
+ * OK|ERROR <latency>" is printed when the reply arrives, followed by
+ * reply data if any. A FIFO is opened read-write so it stays open when
+ * writers come and go. Returns when input ends and all replies are in.
+ */
+static int run_batch(int fd, const char* path)
+{
+	struct pollfd pfds[2];
+	struct stat st;
+	lirc_async* ctx;
+	char buff[PACKET_SIZE * 4];
+	size_t len = 0;
+	unsigned long lineno = 0;
+	char* line;
+	char* end;
+	int input;
+	ssize_t n;
+	int r;
+
+	if (path == NULL || strcmp(path, "-") == 0) {
+		input = STDIN_FILENO;
+	} else {
+		if (stat(path, &st) == 0 && S_ISFIFO(st.st_mode))
+			input = open(path, O_RDWR);
+		else
+			input = open(path, O_RDONLY);
+		if (input == -1) {
+			perrorf("Cannot open %s", path);
+			return EXIT_FAILURE;
+		}
+	}
+	ctx = lirc_async_new(fd, NULL, NULL);
+	if (ctx == NULL) {
+		fprintf(stderr, "%s: out of memory\n", prog);
+		return EXIT_FAILURE;
+	}
+	while (input != -1 || lirc_async_pending(ctx) > 0) {
+		pfds[0].fd = lirc_async_fd(ctx);
+		pfds[0].events = POLLIN;
+		if (lirc_async_want_write(ctx))
+			pfds[0].events |= POLLOUT;
+		pfds[1].fd = lirc_async_pending(ctx) < BATCH_MAX_PENDING ?
+			     input : -1;
+		pfds[1].events = POLLIN;
+		if (poll(pfds, 2, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			perrorf("poll()");
+			break;
+		}
+		if (pfds[0].revents & POLLOUT) {
+			r = lirc_async_on_writable(ctx);
+			if (r != 0) {
+				fprintf(stderr, "%s: %s\n", prog, strerror(r));
+				break;
+			}
+		}
+		if (pfds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+			r = lirc_async_on_readable(ctx);
+			if (r != 0) {
+				fprintf(stderr, "%s: %s\n", prog, strerror(r));
+				break;
+			}
+		}
+		if (!(pfds[1].revents & (POLLIN | POLLHUP | POLLERR)))
+			continue;
+		n = read(input, buff + len, sizeof(buff) - len - 1);
+		if (n <= 0) {
+			if (n == -1 && errno == EINTR)
+				continue;
+			if (len > 0) {
+				buff[len] = '\0';
+				batch_queue(ctx, buff, ++lineno);
+			}
+			close(input);
+			input = -1;
+			continue;
+		}
+		len += n;
+		buff[len] = '\0';
+		line = buff;
+		while ((end = strchr(line, '\n')) != NULL) {
+			*end = '\0';
+			batch_queue(ctx, line, ++lineno);
+			line = end + 1;
+		}
+		len -= line - buff;
+		if (len == sizeof(buff) - 1) {
+			struct timespec now;
+
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			batch_report(++lineno, EMSGSIZE, &now, NULL);
+			len = 0;
+		}
+		memmove(buff, line, len);
+	}
+	if (input != -1)
+		close(input);
+	lirc_async_free(ctx);
+	return batch_errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
 void reformat_simarg(char* code, char buffer[])
 {
 	unsigned int scancode;
@@ -95,6 +296,9 @@ int main(int argc, char** argv)
 	char* address = NULL;
 	unsigned short port = LIRC_INET_PORT;
 	unsigned long count = 1;
+	unsigned long delay = 0;
+	int batch = 0;
+	const char* batch_path = NULL;
 	int fd;
 	char buffer[PACKET_SIZE + 1];
 	int r;
@@ -110,9 +314,11 @@ int main(int argc, char** argv)
 			{ "device",  required_argument, NULL, 'd' },
 			{ "address", required_argument, NULL, 'a' },
 			{ "count",   required_argument, NULL, '#' },
+			{ "delay",   required_argument, NULL, 'D' },
+			{ "batch",   optional_argument, NULL, 'b' },
 			{ 0,	     0,			0,    0	  }
 		};
-		c = getopt_long(argc, argv, "hvd:a:#:", long_options, NULL);
+		c = getopt_long(argc, argv, "hvd:a:#:D:b::", long_options, NULL);
 		if (c == -1)
 			break;
 		switch (c) {
@@ -159,11 +365,26 @@ int main(int argc, char** argv)
 			}
 			break;
 		}
+		case 'b':
+			batch = 1;
+			batch_path = optarg;
+			break;
+		case 'D':
+		{
+			char* end;
+
+			delay = strtoul(optarg, &end, 10);
+			if (!*optarg || *end) {
+				fprintf(stderr, "%s: invalid delay value: %s\n", prog, optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		}
 		default:
 			return EXIT_FAILURE;
 		}
 	}
-	if (optind + 2 > argc) {
+	if (!batch && optind + 2 > argc) {
 		fprintf(stderr, "%s: not enough arguments\n", prog);
 		return EXIT_FAILURE;
 	}
@@ -183,6 +404,8 @@ int main(int argc, char** argv)
 		free(address);
 	address = NULL;
 
+	if (batch)
+		return run_batch(fd, batch_path);
 	directive = argv[optind++];
 
 	if (strcasecmp(directive, "set_transmitters") == 0) {
@@ -207,7 +430,33 @@ int main(int argc, char** argv)
 		if (send_packet(&ctx, fd) == -1)
 			exit(EXIT_FAILURE);
 	}
-	if (strcasecmp(directive, "simulate") == 0) {
+	if (strcasecmp(directive, "send_sequence") == 0) {
+		remote = argv[optind++];
+		if (optind == argc) {
+			fprintf(stderr, "%s: not enough arguments\n", prog);
+			exit(EXIT_FAILURE);
+		}
+		snprintf(buffer, sizeof(buffer), "%s", directive);
+		for (; optind < argc; optind++) {
+			char step[PACKET_SIZE + 1];
+
+			snprintf(step, sizeof(step), "%s %s %s %lu %lu",
+				 strlen(buffer) > strlen(directive) ? "," : "",
+				 remote, argv[optind],
+				 count > 1 ? count : 0,
+				 optind + 1 < argc ? delay : 0);
+			if (strlen(buffer) + strlen(step) + 2 >= PACKET_SIZE) {
+				fprintf(stderr, "%s: input too long\n", prog);
+				exit(EXIT_FAILURE);
+			}
+			strcat(buffer, step);
+		}
+		strcat(buffer, "\n");
+		lirc_command_init(&ctx, "%s", buffer);
+		lirc_command_reply_to_stdout(&ctx);
+		if (send_packet(&ctx, fd) == -1)
+			exit(EXIT_FAILURE);
+	} else if (strcasecmp(directive, "simulate") == 0) {
 		code = argv[optind++];
 		if (optind != argc) {
 			fprintf(stderr, "%s: invalid argument count\n", prog);
@@ -26,6 +26,7 @@
 	"\nSynopsis:\n" \
 	"    lirc-lsplugins [-l] [-q] [-U plugindir] [drivers]\n" \
 	"    lirc-lsplugins -e [-q] [-U plugindir]\n" \
+	"    lirc-lsplugins -i [-U plugindir]\n" \
 	"    lirc-lsplugins [-s|-p|-h|-v]\n\n" \
 	"If [drivers] is given list matching plugins, else list all.\n\n" \
 	"Options:\n" \
@@ -35,6 +36,7 @@
 	"    -y, --yaml\t\tGenerate a YAML plugins config file.\n" \
 	"    -e, --errors\tList plugins which can't load driver(s).\n" \
 	"    -s, --summary\tPrint summary on plugins status.\n" \
+	"    -i, --index\t\tRebuild the plugin index cache and exit.\n" \
 	"    -q, --quiet\t\tBe less verbose.\n" \
 	"    -p, --default-path\tPrint default search path and exit.\n" \
 	"    -h, --help\t\tDisplay this message and exit.\n" \
@@ -58,7 +60,8 @@
 	"#    d: LIRC_CAN_SET_SEND_DUTY_CYCLE\n" \
 	"#    t: LIRC_CAN_SET_TRANSMITTER_MASK\n" \
 	"#    C: LIRC_CAN_MEASURE_CARRIER\n" \
-	"#    D: LIRC_CAN_NOTIFY_DECODE\n"
+	"#    D: LIRC_CAN_NOTIFY_DECODE\n" \
+	"#    Q: LIRC_CAN_USE_READER_THREAD\n"
 
 const struct option options[] = {
 	{ "plugindir",	  required_argument, NULL, 'U' },
@@ -66,6 +69,7 @@ const struct option options[] = {
 	{ "long",	  no_argument,	     NULL, 'l' },
 	{ "errors",	  no_argument,	     NULL, 'e' },
 	{ "summary",	  no_argument,	     NULL, 's' },
+	{ "index",	  no_argument,	     NULL, 'i' },
 	{ "yaml",	  no_argument,	     NULL, 'y' },
 	{ "default-path", no_argument,	     NULL, 'p' },
 	{ "version",	  no_argument,	     NULL, 'v' },
@@ -101,6 +105,7 @@ static int opt_long = 0;                /**< --long option */
 static int opt_summary = 0;             /**< --summary option */
 static int opt_listerrors = 0;          /**< --errors option */
 static int opt_yaml = 0;                /**< --yaml option */
+static int opt_index = 0;               /**< --index option */
 
 static int sum_drivers = 0;
 static int sum_plugins = 0;
@@ -135,7 +140,7 @@ static line_t* line_new(const char* path)
 	line->info = NULL;
 	line->version = NULL;
 	line->device = NULL;
-	line->features = opt_long ? "              " : "";
+	line->features = opt_long ? "               " : "";
 	line->device_hint = NULL;
 	return line;
 }
@@ -291,7 +296,7 @@ static void format_features(struct driver* hw, line_t* line)
 	char buff[256];
 
 	snprintf(buff, sizeof(buff),
-		 "%c%c%c%c%c%c%c%c%c%c%c%c%c ",
+		 "%c%c%c%c%c%c%c%c%c%c%c%c%c%c ",
 		 get(LIRC_CAN_SEND_RAW, 'R', hw),
 		 get(LIRC_CAN_SEND_PULSE, 'P', hw),
 		 get(LIRC_CAN_SEND_MODE2, 'M', hw),
@@ -304,7 +309,8 @@ static void format_features(struct driver* hw, line_t* line)
 		 get(LIRC_CAN_SET_SEND_DUTY_CYCLE, 'd', hw),
 		 get(LIRC_CAN_SET_TRANSMITTER_MASK, 't', hw),
 		 get(LIRC_CAN_MEASURE_CARRIER, 'C', hw),
-		 get(LIRC_CAN_NOTIFY_DECODE, 'D', hw)
+		 get(LIRC_CAN_NOTIFY_DECODE, 'D', hw),
+		 get(LIRC_CAN_USE_READER_THREAD, 'Q', hw)
 		 );
 	line->features = strdup(buff);
 }
@@ -407,7 +413,7 @@ static void print_header(void)
 {
 	line_t line = { "Plugin", "# Driver ", "Flags" };
 
-	line.features = opt_long ?  "Features      " : "";
+	line.features = opt_long ?  "Features       " : "";
 	line_print(&line);
 }
 
@@ -425,7 +431,14 @@ static void print_yaml_header(void)
 
 void lsplugins(const char* pluginpath, const char* which)
 {
-	for_each_plugin(format_plugin, (void*)which, pluginpath);
+	const char* path = NULL;
+
+	if (!opt_summary && !opt_listerrors && strpbrk(which, "*?[") == NULL)
+		path = plugin_index_lookup(which, pluginpath);
+	if (path != NULL)
+		format_plugin(path, NULL, (void*)which);
+	else
+		for_each_plugin(format_plugin, (void*)which, pluginpath);
 	qsort(lines, line_ix, sizeof(line_t*), line_cmp);
 	if (opt_summary) {
 		printf("Plugins: %d\n", sum_plugins);
@@ -470,7 +483,7 @@ int main(int argc, char** argv)
 	if (getenv(PLUGINDIR_VAR) != NULL)
 		pluginpath = getenv(PLUGINDIR_VAR);
 	while ((c = getopt_long(argc, argv,
-				"selpqvhU:y", options, NULL)) != -1) {
+				"seilpqvhU:y", options, NULL)) != -1) {
 		switch (c) {
 		case 'U':
 			pluginpath = optarg;
@@ -490,6 +503,9 @@ int main(int argc, char** argv)
 		case 's':
 			opt_summary = 1;
 			break;
+		case 'i':
+			opt_index = 1;
+			break;
 		case 'q':
 			opt_quiet = 1;
 			break;
@@ -517,6 +533,10 @@ int main(int argc, char** argv)
 	lirc_log_set_file(path);
 	lirc_log_open("lirc-lsplugins", 1, level);
 
+	if (opt_index) {
+		plugin_index_refresh(pluginpath, 1);
+		return 0;
+	}
 	lsplugins(pluginpath, which);
 	return sum_errors == 0 ? 0 : 1;
 }